@@ -0,0 +1,26 @@
+
+
+
+__entry:
+mov 0 r8
+loop:
+
+push r8
+print
+drop
+
+inc r8
+push r8
+push LOOPS
+lt
+jmpif loop
+
+
+
+
+
+
+
+
+
+
@@ -0,0 +1,11 @@
+__entry:
+    push 0
+    push 1
+    push 2
+    push "a"
+    push "b"
+    ; two rotations bring 1 and 2 on top, the compare prints 0
+    rotl 4
+    rotl 4
+    eq
+    print
@@ -0,0 +1,564 @@
+#ifndef AOT_H
+#define AOT_H
+#include <stdarg.h>
+#include <ctype.h>
+#include <limits.h>
+#include "xpu.h"
+
+// ----------------- AOT runtime -------------------------
+// The runtime the C that xtoa --aot generates links against. It only needs xpu.h:
+// there is no loader, no decoder and no interpreter behind it. Every instruction
+// of the program is its own block of C, labels are C labels, jumps are gotos and
+// operands are literals, so the C compiler optimizes across instructions. Int
+// fast paths are inlined, the helpers below carry the interpreter's semantics for
+// every other type, down to its error messages.
+//
+// The generated file holds the string pool as C literals and calls aot_init before
+// the first instruction, which only copies those literals into XStrings.
+
+#ifdef _WIN32
+#define AOT_PLATFORM "windows"
+#else
+#define AOT_PLATFORM "unix"
+#endif
+
+typedef enum {
+    AOT_ADD, AOT_SUB, AOT_MUL, AOT_DIV, AOT_MOD,
+    AOT_EQ, AOT_NE, AOT_LT, AOT_GT, AOT_LE, AOT_GE,
+} AotOp;
+
+static XPU aot_xpu;
+static const char *aot_filename = "";
+static char **aot_pool;
+static size_t aot_pool_count;
+static Variable *aot_globals; // indexed by variable slot, like Program.variables
+static size_t aot_globals_count;
+static int aot_exit_code;
+
+void aot_init(const char *filename, const char *const *strings, size_t strings_count, size_t variables) {
+    aot_filename = filename;
+    aot_xpu = xpu_init();
+    aot_pool_count = strings_count;
+    aot_pool = malloc(sizeof(char *) * (strings_count ? strings_count : 1));
+    for (size_t i = 0; i < strings_count; i++) aot_pool[i] = xstring_from(strings[i]);
+    aot_globals_count = variables;
+    aot_globals = malloc(sizeof(Variable) * (variables ? variables : 1));
+    for (size_t i = 0; i < variables; i++) {
+        aot_globals[i].slot = SYMBOL_NONE;
+        WORD_STORE(aot_globals[i].value, ((Word){.type = WPOINTER, .as_pointer = NULL}));
+    }
+}
+
+void aot_free() {
+    for (size_t i = 0; i < aot_globals_count; i++) {
+        word_release(WORD_LOAD(aot_globals[i].value));
+    }
+    free(aot_globals);
+    for (size_t i = 0; i < aot_pool_count; i++) xstring_release(aot_pool[i]);
+    free(aot_pool);
+    xpu_free(&aot_xpu);
+}
+
+// EERROR for the instruction on line
+static inline void aot_error(size_t line, const char *msg, ...) {
+    va_list vl;
+    va_start(vl, msg);
+    fprintf(stderr, "%s%s:%zu ERROR: ", OLOG_PREFIX, aot_filename, line);
+    vfprintf(stderr, msg, vl);
+    fprintf(stderr, "\n");
+    va_end(vl);
+    aot_free();
+    exit(1);
+}
+
+static inline Word aot_string(size_t index) {
+    return (Word){.type = WCHARP, .as_string = xstring_retain(aot_pool[index])};
+}
+
+static inline Word aot_float(uint32_t bits) {
+    Word w = {.type = WFLOAT};
+    memcpy(&w.as_float, &bits, sizeof(bits));
+    return w;
+}
+
+// operand_to_word of an operand that has no word
+static inline Word aot_invalid_operand(size_t line, const char *text) {
+    aot_error(line, "Invalid operand: %s\n", text);
+    return (Word){.type = WPOINTER, .as_pointer = NULL};
+}
+
+static inline void aot_set_register(XRegister *reg, Word w) {
+    Word old_value = reg->reg_value;
+    reg->reg_value = w;
+    word_release(old_value);
+}
+
+// ----------------- AOT arithmetic -------------------------
+
+#define AOT_COMPARE(a, b) do { \
+        switch (op) { \
+            case AOT_EQ: result->as_int = (a) == (b); break; \
+            case AOT_NE: result->as_int = (a) != (b); break; \
+            case AOT_LT: result->as_int = (a) < (b); break; \
+            case AOT_GT: result->as_int = (a) > (b); break; \
+            case AOT_LE: result->as_int = (a) <= (b); break; \
+            case AOT_GE: result->as_int = (a) >= (b); break; \
+            default: break; \
+        } \
+    } while (0)
+
+// binary_words: w2 was pushed first and w1 last, false when nothing is left on the stack
+static inline bool aot_binary_words(size_t line, AotOp op, Word w2, Word w1, Word *result) {
+    switch (op) {
+        case AOT_ADD:
+        case AOT_SUB:
+            if (w1.type != w2.type) {
+                aot_error(line, "Invalid types on stack expected two values of same type got %s and %s\n",
+                          word_type_to_string(w1.type), word_type_to_string(w2.type));
+            }
+            if (w1.type == WINT) {
+                result->type = WINT;
+                result->as_int = op == AOT_ADD ? w1.as_int + w2.as_int : w1.as_int - w2.as_int;
+            } else if (w1.type == WFLOAT) {
+                result->type = WFLOAT;
+                result->as_float = op == AOT_ADD ? w1.as_float + w2.as_float : w1.as_float - w2.as_float;
+            } else {
+                aot_error(line, "type '%s' is not supported \n", word_type_to_string(w1.type));
+            }
+            return true;
+
+        case AOT_MUL:
+        case AOT_DIV:
+            if (op == AOT_DIV && (w1.as_int == 0 || w1.as_float == 0.0f)) return false;
+            if (w1.type == WINT && w2.type == WINT) {
+                result->type = WINT;
+                result->as_int = op == AOT_MUL ? w2.as_int * w1.as_int : w2.as_int / w1.as_int;
+            } else if (w1.type == WFLOAT && w2.type == WFLOAT) {
+                result->type = WFLOAT;
+                result->as_float = op == AOT_MUL ? w2.as_float * w1.as_float : w2.as_float / w1.as_float;
+            } else {
+                aot_error(line, "type '%s' is not supported \n", word_type_to_string(w1.type));
+            }
+            return true;
+
+        case AOT_MOD:
+            if (w1.type == WINT && w2.type == WINT && w1.as_int != 0) {
+                result->type = WINT;
+                result->as_int = w2.as_int % w1.as_int;
+            } else {
+                aot_error(line, "type '%s' is not supported \n", word_type_to_string(w1.type));
+            }
+            return true;
+
+        default:
+            // comparisons, values of different types are never equal
+            result->type = WINT;
+            result->as_int = op == AOT_NE;
+            if (w1.type != w2.type) return true;
+            switch (w1.type) {
+                case WINT: AOT_COMPARE(w2.as_int, w1.as_int);
+                    break;
+                case WFLOAT: AOT_COMPARE(w2.as_float, w1.as_float);
+                    break;
+                case WCHARP:
+                    if (op == AOT_EQ || op == AOT_NE) {
+                        AOT_COMPARE(strcmp(w2.as_string, w1.as_string), 0);
+                        break;
+                    }
+                // fallthrough
+                default:
+                    aot_error(line, "type '%s' is not supported \n", word_type_to_string(w1.type));
+            }
+            return true;
+    }
+}
+
+// stack form of a binary opcode
+static inline void aot_binary(size_t line, AotOp op) {
+    Word w1 = xstack_pop(&aot_xpu.stack);
+    Word w2 = xstack_pop(&aot_xpu.stack);
+    Word result;
+    if (aot_binary_words(line, op, w2, w1, &result)) xstack_push(&aot_xpu.stack, result);
+    word_release(w1);
+    word_release(w2);
+}
+
+// pushop, w2 and w1 are its operands
+static inline void aot_pushop(size_t line, AotOp op, Word w2, Word w1) {
+    Word result;
+    if (aot_binary_words(line, op, w2, w1, &result)) xstack_push(&aot_xpu.stack, result);
+    word_release(w1);
+    word_release(w2);
+}
+
+// the taken branch of cmpjmpif
+static inline bool aot_compare(size_t line, AotOp op, Word w2, Word w1) {
+    Word result;
+    aot_binary_words(line, op, w2, w1, &result);
+    word_release(w1);
+    word_release(w2);
+    return result.as_int == 1;
+}
+
+// Stack form of a binary opcode on two ints: a is the deeper and b the topmost word,
+// the result replaces a. Other types, or a failed guard, take aot_binary.
+#define AOT_BINARY_INT(line, op, expr, guard) do { \
+        WordCell *top = stack->stack + stack->count; \
+        if (stack->count < 2 || WORD_TYPE(top[-2]) != WINT || WORD_TYPE(top[-1]) != WINT) aot_binary(line, op); \
+        else { \
+            int a = WORD_LOAD(top[-2]).as_int, b = WORD_LOAD(top[-1]).as_int; \
+            if (!(guard)) aot_binary(line, op); \
+            else { \
+                WORD_STORE(top[-2], ((Word){.type = WINT, .as_int = (expr)})); \
+                stack->count--; \
+            } \
+        } \
+    } while (0)
+
+// add/sub <register> <value>
+static inline void aot_register_add(size_t line, XRegister *dest, Word src_val, bool sub) {
+    int sign = sub ? -1 : 1;
+    if (dest->reg_value.type == src_val.type) {
+        switch (dest->reg_value.type) {
+            case WINT: dest->reg_value.as_int += sign * src_val.as_int;
+                break;
+            case WFLOAT: dest->reg_value.as_float += sign * src_val.as_float;
+                break;
+            case W_CHAR: dest->reg_value.as_char += sign * src_val.as_char;
+                break;
+            default: break;
+        }
+    } else if (dest->reg_value.type == WPOINTER && src_val.type == WINT) {
+        dest->reg_value.as_pointer = (char *) dest->reg_value.as_pointer + sign * src_val.as_int;
+    } else if (dest->reg_value.type == WINT && src_val.type == WFLOAT) {
+        dest->reg_value.type = WFLOAT;
+        dest->reg_value.as_float = (float) dest->reg_value.as_int + sign * src_val.as_float;
+    } else if (!sub) {
+        aot_error(line, "Invalid data types expected values of same type but got %s and %s\n",
+                  word_type_to_string(src_val.type), word_type_to_string(dest->reg_value.type));
+    }
+}
+
+// add/sub <n>: pushes the top word moved by n
+static inline void aot_offset_top(int imm, bool sub) {
+    Word w = xstack_peek(&aot_xpu.stack, 0);
+    if (w.type == WINT) w.as_int = sub ? w.as_int - imm : w.as_int + imm;
+    else if (w.type == WFLOAT) w.as_float = sub ? w.as_float - (float) imm : w.as_float + (float) imm;
+    else if (w.type == WPOINTER || w.type == WCHARP) w.as_pointer = (char *) w.as_pointer + (sub ? -imm : imm);
+    xstack_push(&aot_xpu.stack, w);
+}
+
+// and/or on two ints, and leaves nothing on the stack like the interpreter
+static inline void aot_bitwise(size_t line, bool or) {
+    Word w1 = xstack_pop(&aot_xpu.stack);
+    Word w2 = xstack_pop(&aot_xpu.stack);
+    if (w1.type != WINT || w2.type != WINT) {
+        aot_error(line, "type '%s' is not supported \n", word_type_to_string(w1.type));
+    }
+    if (or) xstack_push(&aot_xpu.stack, (Word){.type = WINT, .as_int = w2.as_int | w1.as_int});
+}
+
+static inline void aot_not(size_t line) {
+    Word w1 = xstack_pop(&aot_xpu.stack);
+    if (w1.type == WINT) {
+        xstack_push(&aot_xpu.stack, (Word){.type = WINT, .as_int = !w1.as_int});
+    } else if (w1.type == WFLOAT) {
+        xstack_push(&aot_xpu.stack, (Word){.type = WFLOAT, .as_float = !w1.as_float});
+    } else {
+        aot_error(line, "type '%s' is not supported \n", word_type_to_string(w1.type));
+    }
+}
+
+// cmp <a> <b>, the result goes to rdx
+static inline void aot_cmp(Word w1, Word w2) {
+    int cmp = 0;
+    if (w1.type == w2.type) {
+        switch (w1.type) {
+            case WINT: cmp = w1.as_int - w2.as_int;
+                break;
+            case WFLOAT: cmp = (w1.as_float > w2.as_float) ? 1 : -1;
+                break;
+            case WCHARP: cmp = strcmp(w1.as_string, w2.as_string);
+                break;
+            default: break;
+        }
+    }
+    aot_set_register(&aot_xpu.registers[REG_RDX], (Word){.type = WINT, .as_int = cmp});
+}
+
+// ----------------- AOT stack -------------------------
+
+static inline void aot_print() {
+    Word w1 = xstack_pop(&aot_xpu.stack);
+    switch (w1.type) {
+        case WINT: printf("%d\n", w1.as_int);
+            break;
+        case WFLOAT: printf("%f\n", w1.as_float);
+            break;
+        case WCHARP: printf("%s\n", w1.as_string);
+            break;
+        case W_CHAR: printf("%c\n", w1.as_char);
+            break;
+        case WPOINTER: printf("%p\n", w1.as_pointer);
+            break;
+        default: break;
+    }
+    word_release(w1);
+}
+
+static inline void aot_dup() {
+    Word w1 = xstack_peek(&aot_xpu.stack, 0);
+    // chars and bools are not copied
+    if (w1.type == W_CHAR || w1.type == WBOOL) return;
+    xstack_push(&aot_xpu.stack, word_retain(w1));
+}
+
+static inline void aot_merge() {
+    Word w1 = xstack_pop(&aot_xpu.stack);
+    Word w2 = xstack_pop(&aot_xpu.stack);
+    if (w1.type == WCHARP && w2.type == WCHARP) {
+        size_t len1 = strlen(w1.as_string), len2 = strlen(w2.as_string);
+        char *merged = xstring_alloc(len2 + 1 + len1);
+        memcpy(merged, w2.as_string, len2);
+        merged[len2] = ' ';
+        memcpy(merged + len2 + 1, w1.as_string, len1);
+        xstack_push(&aot_xpu.stack, (Word){.type = WCHARP, .as_string = merged});
+    }
+    word_release(w1);
+    word_release(w2);
+}
+
+// sprintf: the format on top and its arguments below, the first one deepest
+static inline void aot_sprintf(size_t line) {
+    Word format_word = xstack_pop(&aot_xpu.stack);
+    if (format_word.type != WCHARP || format_word.as_string == NULL) {
+        aot_error(line, "Expected format string for sprintf, got %s\n", word_type_to_string(format_word.type));
+    }
+
+    int arg_count = 0;
+    char *fmt = format_word.as_string;
+    for (char *p = fmt; *p; p++) {
+        if (*p == '%' && *(p + 1) != '%') {
+            arg_count++;
+            p++;
+            while (*p && !isalpha(*p) && *p != '%') p++;
+        }
+    }
+    if (!xstack_check(&aot_xpu.stack, arg_count)) {
+        aot_error(line, "Stack underflow: sprintf requires %d arguments\n", arg_count);
+    }
+
+    Word *fmt_args = malloc(arg_count * sizeof(Word));
+    if (!fmt_args) aot_error(line, "Failed to allocate memory for sprintf arguments\n");
+    for (int i = arg_count - 1; i >= 0; i--) {
+        fmt_args[i] = xstack_pop(&aot_xpu.stack);
+    }
+
+    int size = 0;
+    for (int i = 0; i < arg_count; i++) {
+        Word arg = fmt_args[i];
+        switch (arg.type) {
+            case WINT: size += snprintf(NULL, 0, "%d", arg.as_int);
+                break;
+            case WFLOAT: size += snprintf(NULL, 0, "%f", arg.as_float);
+                break;
+            case WCHARP: size += arg.as_string ? strlen(arg.as_string) : 4;
+                break;
+            case W_CHAR: size += 1;
+                break;
+            case WPOINTER: size += snprintf(NULL, 0, "%p", arg.as_pointer);
+                break;
+            case WBOOL: size += arg.as_bool ? 4 : 5;
+                break;
+            default:
+                aot_error(line, "Unsupported argument type %s for sprintf\n", word_type_to_string(arg.type));
+        }
+    }
+    size += strlen(fmt) + 1;
+
+    char *result = xstring_alloc(size);
+    if (!result) aot_error(line, "Failed to allocate memory for sprintf result\n");
+
+    int offset = 0;
+    int arg_index = 0;
+    for (char *p = fmt; *p; p++) {
+        if (*p == '%' && *(p + 1) != '%') {
+            p++;
+            char specifier[32];
+            int spec_len = 0;
+            specifier[spec_len++] = '%';
+            while (*p && !isalpha(*p) && *p != '%') {
+                specifier[spec_len++] = *p++;
+            }
+            specifier[spec_len++] = *p;
+            specifier[spec_len] = '\0';
+
+            Word arg = fmt_args[arg_index++];
+            switch (arg.type) {
+                case WINT: offset += snprintf(result + offset, size - offset, specifier, arg.as_int);
+                    break;
+                case WFLOAT: offset += snprintf(result + offset, size - offset, specifier, arg.as_float);
+                    break;
+                case WCHARP:
+                    offset += snprintf(result + offset, size - offset, specifier, arg.as_string ? arg.as_string : "(null)");
+                    break;
+                case W_CHAR: offset += snprintf(result + offset, size - offset, specifier, arg.as_char);
+                    break;
+                case WPOINTER: offset += snprintf(result + offset, size - offset, specifier, arg.as_pointer);
+                    break;
+                case WBOOL:
+                    offset += snprintf(result + offset, size - offset, specifier, arg.as_bool ? "true" : "false");
+                    break;
+                default:
+                    break;
+            }
+        } else {
+            result[offset++] = *p;
+            if (*p == '%' && *(p + 1) == '%') p++;
+        }
+    }
+    result[offset] = '\0';
+    xstack_push(&aot_xpu.stack, (Word){.type = WCHARP, .as_string = result});
+
+    for (int i = 0; i < arg_count; i++) word_release(fmt_args[i]);
+    free(fmt_args);
+    xstring_release(format_word.as_string);
+}
+
+// rotl/rotr <n> on the topmost n words
+static inline void aot_rotate(int n, bool left) {
+    XStack *stack = &aot_xpu.stack;
+    if (n <= 0 || (size_t) n >= stack->count) return;
+    WordCell *cells = stack->stack + stack->count - n;
+    WordCell moved;
+    if (left) {
+        moved = cells[n - 1];
+        memmove(cells + 1, cells, sizeof(WordCell) * (n - 1));
+        cells[0] = moved;
+    } else {
+        moved = cells[0];
+        memmove(cells, cells + 1, sizeof(WordCell) * (n - 1));
+        cells[n - 1] = moved;
+    }
+}
+
+static inline void aot_alloc(size_t size, XRegister *reg) {
+    if (size == 0) return;
+    void *mem = calloc(1, size);
+    if (reg) {
+        word_release(reg->reg_value);
+        reg->reg_value = (Word){.type = WPOINTER, .as_pointer = mem};
+    } else {
+        xstack_push(&aot_xpu.stack, (Word){.type = WPOINTER, .as_pointer = mem});
+    }
+}
+
+static inline void aot_free_register(XRegister *reg) {
+    if (reg->reg_value.type != WPOINTER) return;
+    free(reg->reg_value.as_pointer);
+    reg->reg_value.as_pointer = NULL;
+}
+
+static inline void aot_free_top() {
+    Word w = xstack_pop(&aot_xpu.stack);
+    if (w.type == WPOINTER) free(w.as_pointer);
+}
+
+// ----------------- AOT variables -------------------------
+// Inside a function the innermost frame holds the variables, outside of one the
+// globals do, so a lookup never crosses from one to the other.
+
+static inline Variable *aot_global(size_t slot) {
+    return slot < aot_globals_count && aot_globals[slot].slot == slot ? &aot_globals[slot] : NULL;
+}
+
+static inline Variable *aot_declare_global(size_t slot) {
+    aot_globals[slot].slot = slot;
+    return &aot_globals[slot];
+}
+
+static inline Variable *aot_resolve(size_t slot, size_t local) {
+    if (aot_xpu.frames_count > 0) return frame_lookup(&aot_xpu, slot, local);
+    return aot_global(slot);
+}
+
+static inline Variable *aot_bind(size_t slot, size_t local) {
+    if (aot_xpu.frames_count > 0) return frame_bind(&aot_xpu, slot, local);
+    Variable *var = aot_global(slot);
+    return var ? var : aot_declare_global(slot);
+}
+
+// assign_variable
+static inline void aot_assign(Variable *target_var, Word new_value) {
+    Word old_value = WORD_LOAD(target_var->value);
+    new_value = word_retain(new_value);
+    if (old_value.type == WCHARP) {
+        xstring_release(old_value.as_string);
+    } else if (old_value.type == WPOINTER && old_value.as_pointer != NULL) {
+        free(old_value.as_pointer);
+    }
+    WORD_STORE(target_var->value, new_value);
+}
+
+static inline bool aot_unset(Word w) {
+    return w.type == WPOINTER && w.as_pointer == NULL;
+}
+
+// a variable operand, the value of an unset variable is an error
+static inline Word aot_variable(size_t line, size_t slot, size_t local, const char *name) {
+    Variable *var = aot_resolve(slot, local);
+    Word w = var ? word_retain(WORD_LOAD(var->value)) : (Word){.type = WPOINTER, .as_pointer = NULL};
+    if (aot_unset(w)) aot_error(line, "Variable not found: %s\n", name);
+    return w;
+}
+
+static inline void aot_getvar(Variable *var, const char *message, const char *name) {
+    Word w = var ? word_retain(WORD_LOAD(var->value)) : (Word){.type = WPOINTER, .as_pointer = NULL};
+    if (aot_unset(w)) OERROR(stderr, "ERROR: %s: variable '%s' not found\n", message, name);
+    else xstack_push(&aot_xpu.stack, w);
+}
+
+static inline void aot_setvar(bool global, size_t slot, size_t local, const char *message) {
+    if (aot_xpu.stack.count == 0) {
+        OERROR(stderr, "ERROR: %s: Stack underflow\n", message);
+        return;
+    }
+    Word new_value = xstack_pop(&aot_xpu.stack);
+    Variable *var = global ? aot_global(slot) : aot_bind(slot, local);
+    aot_assign(var ? var : aot_declare_global(slot), new_value);
+    word_release(new_value);
+}
+
+// inc/dec <variable>
+static inline void aot_step_variable(size_t slot, size_t local, int step, const char *name) {
+    Variable *var = aot_resolve(slot, local);
+    if (var == NULL) return;
+    Word value = WORD_LOAD(var->value);
+    if (aot_unset(value)) {
+        OERROR(stderr, "ERROR: could not found variable '%s'\n", name);
+    } else if (value.type == WINT) {
+        value.as_int += step;
+        WORD_STORE(var->value, value);
+    }
+}
+
+// addvar <variable> <n>
+static inline void aot_addvar(size_t line, size_t slot, size_t local, int n, const char *name) {
+    Variable *var = aot_resolve(slot, local);
+    if (var == NULL) aot_error(line, "Variable not found: %s\n", name);
+    Word value = WORD_LOAD(var->value);
+    if (value.type != WINT) {
+        aot_error(line, "Invalid types on stack expected two values of same type got %s and %s\n",
+                  word_type_to_string(WINT), word_type_to_string(value.type));
+    }
+    value.as_int += n;
+    WORD_STORE(var->value, value);
+}
+
+// the count of alloc <type> <variable>
+static inline size_t aot_variable_count(size_t slot, size_t local) {
+    Variable *var = aot_resolve(slot, local);
+    return var ? (size_t) WORD_LOAD(var->value).as_int : 1;
+}
+
+#endif // AOT_H
@@ -182,6 +182,7 @@ static Token* lexer_read_number(Lexer *lexer) {
             buffer[i++] = lexer_advance(lexer);
         }
     } else {
+        if (lexer_peek(lexer) == '-') buffer[i++] = lexer_advance(lexer);
         while (is_digit(lexer_peek(lexer)) && i < sizeof(buffer) - 1) {
             buffer[i++] = lexer_advance(lexer);
         }
@@ -290,7 +291,7 @@ static Token* lexer_next_token(Lexer *lexer) {
         return token_create(TOKEN_RPAREN, ")", line, column);
     }
 
-    if (is_digit(c)) {
+    if (is_digit(c) || (c == '-' && lexer->pos + 1 < lexer->length && is_digit(lexer->input[lexer->pos + 1]))) {
         return lexer_read_number(lexer);
     }
 
@@ -644,6 +645,42 @@ static char* preprocess_file(Preprocessor *pp, const char *filename) {
     return result;
 }
 
+static uint64_t preprocess_hash_bytes(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < size; i++) hash = (hash ^ bytes[i]) * 1099511628211u;
+    return hash;
+}
+
+// FNV-1a over filename and every file it includes, in the order and up to the
+// depth preprocess_file reads them. An include that is missing hashes as missing,
+// so creating it changes the hash. False when filename itself can not be read.
+static bool preprocess_hash(const char *filename, uint64_t *hash, int depth) {
+    if (depth > 5) return true;
+    *hash = preprocess_hash_bytes(*hash, filename, strlen(filename) + 1);
+    char *content = read_file(filename);
+    if (!content) {
+        *hash = preprocess_hash_bytes(*hash, "", 1);
+        return false;
+    }
+    size_t length = strlen(content);
+    *hash = preprocess_hash_bytes(*hash, &length, sizeof(length));
+    *hash = preprocess_hash_bytes(*hash, content, length);
+
+    TokenStream *stream = tokenize(content);
+    free(content);
+    for (size_t i = 0; i < stream->count; i++) {
+        Token *token = &stream->tokens[i];
+        if (token->type != TOKEN_DIRECTIVE || strncmp(token->value, "#include", 8) != 0) continue;
+        char include_file[256];
+        if (sscanf(token->value + 8, " \"%255[^\"]\"", include_file) == 1 ||
+            sscanf(token->value + 8, " <%255[^>]>", include_file) == 1) {
+            preprocess_hash(include_file, hash, depth + 1);
+        }
+    }
+    token_stream_free(stream);
+    return true;
+}
+
 Instruction parse_instruction(const char *instruction) {
     for (size_t i = 0; i < INSTRUCTION_COUNT; i++) {
         if (strcmp(instructions[i].name, instruction) == 0) {
@@ -742,7 +779,7 @@ int parse_program(OrtaVM *vm, const char *filename) {
                 return 0;
             }
 
-            InstructionData instr;
+            InstructionData instr = {0};
             instr.opcode = parsed_instruction;
             instr.operands = operands;
             instr.line = current_line;
@@ -754,7 +791,11 @@ int parse_program(OrtaVM *vm, const char *filename) {
     }
 
     token_stream_free(stream);
-    return 1;
+    decode_program(&vm->program);
+    if (!link_calls(&vm->program)) return 0;
+    link_program(&vm->program);
+    fuse_program(&vm->program);
+    return verify_program(&vm->program);
 }
 
 int orta_preprocess(char *filename, char *output_file) {
@@ -0,0 +1,693 @@
+#ifndef JIT_H
+#define JIT_H
+#include "orta.h"
+
+// ----------------- JIT -------------------------
+// Baseline template JIT for Linux x86-64 (orta --jit). The driver single steps
+// the program and counts how often every jump, call, return or side exit lands
+// on an instruction. Once a landing point is hot, the straight run of
+// instructions after it becomes a region: every opcode copies a pre-assembled
+// machine code template into a buffer, immediates, register offsets and jump
+// targets are patched in, and the buffer is mapped executable.
+//
+// Compiled code works on the interpreter's own data stack and registers. It
+// handles ints, leaves through a side exit as soon as a guard (stack depth, room,
+// operand types, a zero divisor) fails, and the interpreter then reruns that
+// instruction. Opcodes without a template call execute_instruction in place.
+//
+// Other platforms, and builds with ORTA_COMPACT_WORD whose cells the templates
+// do not know, run the interpreter.
+
+#if defined(__x86_64__) && defined(__linux__) && !defined(ORTA_COMPACT_WORD)
+#define ORTA_JIT
+#include <sys/mman.h>
+#endif
+
+#define JIT_HOT_THRESHOLD 50
+#define JIT_MAX_REGION 512
+#define JIT_EXIT_VM UINT32_MAX // the step helper left ip in the vm
+
+#ifdef ORTA_JIT
+
+// what compiled code sees, rbx points here while it runs
+typedef struct {
+    WordCell *sp; // one past the top of the data stack
+    WordCell *base;
+    WordCell *limit;
+    XRegister *registers;
+    OrtaVM *vm;
+} JitFrame;
+
+// returns the instruction the interpreter continues at
+typedef uint32_t (*JitCode)(JitFrame *frame);
+
+_Static_assert(sizeof(WordCell) == 16 && offsetof(Word, type) == 0 && offsetof(Word, as_int) == 8,
+               "the templates address stack cells as {type, pad, value}");
+_Static_assert(offsetof(JitFrame, sp) == 0 && offsetof(JitFrame, base) == 8 &&
+               offsetof(JitFrame, limit) == 16 && offsetof(JitFrame, registers) == 24,
+               "the prologue loads JitFrame by offset");
+_Static_assert(WINT == 0 && WFLOAT == 1 && WCHARP == 2, "the type guards compare raw tags");
+
+// ----------------- Templates -------------------------
+// Register use: rbx frame, r12 stack pointer, r13 registers, r14 stack base,
+// r15 stack limit, rax/rcx/rdx scratch. Guards end in a jcc rel32 to a side exit.
+
+// push rbx/r12/r13/r14/r15; mov rbx, rdi; load r12, r14, r15, r13 from the frame
+static const unsigned char jit_t_prologue[] = {
+    0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57, 0x48, 0x89, 0xfb,
+    0x4c, 0x8b, 0x23, 0x4c, 0x8b, 0x73, 0x08, 0x4c, 0x8b, 0x7b, 0x10, 0x4c, 0x8b, 0x6b, 0x18,
+};
+// mov [rbx], r12; mov eax, ip(1); pop r15/r14/r13/r12/rbx; ret
+static const unsigned char jit_t_exit[] = {
+    0x4c, 0x89, 0x23, 0xb8, 0, 0, 0, 0, 0x41, 0x5f, 0x41, 0x5e, 0x41, 0x5d, 0x41, 0x5c, 0x5b, 0xc3,
+};
+// cmp r12, r15; jae exit
+static const unsigned char jit_t_room[] = {0x4d, 0x39, 0xfc, 0x0f, 0x83, 0, 0, 0, 0};
+// lea rax, [r12-16]; cmp rax, r14; jb exit
+static const unsigned char jit_t_depth1[] = {0x49, 0x8d, 0x44, 0x24, 0xf0, 0x4c, 0x39, 0xf0, 0x0f, 0x82, 0, 0, 0, 0};
+// lea rax, [r12-32]; cmp rax, r14; jb exit
+static const unsigned char jit_t_depth2[] = {0x49, 0x8d, 0x44, 0x24, 0xe0, 0x4c, 0x39, 0xf0, 0x0f, 0x82, 0, 0, 0, 0};
+// cmp dword [r12-16], WINT; jne exit
+static const unsigned char jit_t_top_int[] = {0x41, 0x83, 0x7c, 0x24, 0xf0, 0x00, 0x0f, 0x85, 0, 0, 0, 0};
+// cmp dword [r12-32], WINT; jne exit
+static const unsigned char jit_t_second_int[] = {0x41, 0x83, 0x7c, 0x24, 0xe0, 0x00, 0x0f, 0x85, 0, 0, 0, 0};
+// cmp dword [r12-16], WFLOAT; ja exit
+static const unsigned char jit_t_top_number[] = {0x41, 0x83, 0x7c, 0x24, 0xf0, 0x01, 0x0f, 0x87, 0, 0, 0, 0};
+// cmp dword [r12-16], WCHARP; je exit
+static const unsigned char jit_t_top_not_string[] = {0x41, 0x83, 0x7c, 0x24, 0xf0, 0x02, 0x0f, 0x84, 0, 0, 0, 0};
+// cmp dword [r13+type(3)], WINT; jne exit
+static const unsigned char jit_t_reg_int[] = {0x41, 0x83, 0xbd, 0, 0, 0, 0, 0x00, 0x0f, 0x85, 0, 0, 0, 0};
+// cmp dword [r13+type(3)], WFLOAT; ja exit
+static const unsigned char jit_t_reg_number[] = {0x41, 0x83, 0xbd, 0, 0, 0, 0, 0x01, 0x0f, 0x87, 0, 0, 0, 0};
+// cmp dword [r13+type(3)], WCHARP; je exit
+static const unsigned char jit_t_reg_not_string[] = {0x41, 0x83, 0xbd, 0, 0, 0, 0, 0x02, 0x0f, 0x84, 0, 0, 0, 0};
+
+// mov qword [r12], type(4); mov qword [r12+8], value(13); add r12, 16
+static const unsigned char jit_t_push_imm[] = {
+    0x49, 0xc7, 0x04, 0x24, 0, 0, 0, 0, 0x49, 0xc7, 0x44, 0x24, 0x08, 0, 0, 0, 0, 0x49, 0x83, 0xc4, 0x10,
+};
+// mov rax, [r13+type(3)]; mov [r12], rax; mov rax, [r13+value(14)]; mov [r12+8], rax; add r12, 16
+static const unsigned char jit_t_push_reg[] = {
+    0x49, 0x8b, 0x85, 0, 0, 0, 0, 0x49, 0x89, 0x04, 0x24, 0x49, 0x8b, 0x85, 0, 0, 0, 0,
+    0x49, 0x89, 0x44, 0x24, 0x08, 0x49, 0x83, 0xc4, 0x10,
+};
+// sub r12, 16
+static const unsigned char jit_t_drop[] = {0x49, 0x83, 0xec, 0x10};
+// movdqu xmm0, [r12-16]; movdqu [r12], xmm0; add r12, 16
+static const unsigned char jit_t_dup[] = {
+    0xf3, 0x41, 0x0f, 0x6f, 0x44, 0x24, 0xf0, 0xf3, 0x41, 0x0f, 0x7f, 0x04, 0x24, 0x49, 0x83, 0xc4, 0x10,
+};
+// movdqu xmm0, [r12-16]; movdqu xmm1, [r12-32]; movdqu [r12-32], xmm0; movdqu [r12-16], xmm1
+static const unsigned char jit_t_swap[] = {
+    0xf3, 0x41, 0x0f, 0x6f, 0x44, 0x24, 0xf0, 0xf3, 0x41, 0x0f, 0x6f, 0x4c, 0x24, 0xe0,
+    0xf3, 0x41, 0x0f, 0x7f, 0x44, 0x24, 0xe0, 0xf3, 0x41, 0x0f, 0x7f, 0x4c, 0x24, 0xf0,
+};
+
+// Binary ops leave the result in the deeper cell, whose int tag is already set.
+// mov eax, [r12-24]; add eax, [r12-8]; mov [r12-24], eax; sub r12, 16
+static const unsigned char jit_t_add[] = {
+    0x41, 0x8b, 0x44, 0x24, 0xe8, 0x41, 0x03, 0x44, 0x24, 0xf8, 0x41, 0x89, 0x44, 0x24, 0xe8, 0x49, 0x83, 0xec, 0x10,
+};
+// sub subtracts the deeper from the topmost value, like binary_words
+// mov eax, [r12-8]; sub eax, [r12-24]; mov [r12-24], eax; sub r12, 16
+static const unsigned char jit_t_sub[] = {
+    0x41, 0x8b, 0x44, 0x24, 0xf8, 0x41, 0x2b, 0x44, 0x24, 0xe8, 0x41, 0x89, 0x44, 0x24, 0xe8, 0x49, 0x83, 0xec, 0x10,
+};
+// mov eax, [r12-24]; imul eax, [r12-8]; mov [r12-24], eax; sub r12, 16
+static const unsigned char jit_t_mul[] = {
+    0x41, 0x8b, 0x44, 0x24, 0xe8, 0x41, 0x0f, 0xaf, 0x44, 0x24, 0xf8, 0x41, 0x89, 0x44, 0x24, 0xe8,
+    0x49, 0x83, 0xec, 0x10,
+};
+// mov ecx, [r12-8]; lea edx, [rcx+1]; cmp edx, 1; jbe exit(13) (divisor 0 or -1);
+// cmp ecx, INT_MIN; je exit(25) (the interpreter's float zero test); mov eax, [r12-24];
+// cdq; idiv ecx; mov [r12-24], eax; sub r12, 16
+static const unsigned char jit_t_div[] = {
+    0x41, 0x8b, 0x4c, 0x24, 0xf8, 0x8d, 0x51, 0x01, 0x83, 0xfa, 0x01, 0x0f, 0x86, 0, 0, 0, 0,
+    0x81, 0xf9, 0x00, 0x00, 0x00, 0x80, 0x0f, 0x84, 0, 0, 0, 0, 0x41, 0x8b, 0x44, 0x24, 0xe8,
+    0x99, 0xf7, 0xf9, 0x41, 0x89, 0x44, 0x24, 0xe8, 0x49, 0x83, 0xec, 0x10,
+};
+// mov ecx, [r12-8]; lea edx, [rcx+1]; cmp edx, 1; jbe exit(13); mov eax, [r12-24];
+// cdq; idiv ecx; mov [r12-24], edx; sub r12, 16
+static const unsigned char jit_t_mod[] = {
+    0x41, 0x8b, 0x4c, 0x24, 0xf8, 0x8d, 0x51, 0x01, 0x83, 0xfa, 0x01, 0x0f, 0x86, 0, 0, 0, 0,
+    0x41, 0x8b, 0x44, 0x24, 0xe8, 0x99, 0xf7, 0xf9, 0x41, 0x89, 0x54, 0x24, 0xe8, 0x49, 0x83, 0xec, 0x10,
+};
+// mov eax, [r12-24]; cmp eax, [r12-8]; setcc(11) al; movzx eax, al; mov [r12-24], eax; sub r12, 16
+static const unsigned char jit_t_compare[] = {
+    0x41, 0x8b, 0x44, 0x24, 0xe8, 0x41, 0x3b, 0x44, 0x24, 0xf8, 0x0f, 0x94, 0xc0, 0x0f, 0xb6, 0xc0,
+    0x41, 0x89, 0x44, 0x24, 0xe8, 0x49, 0x83, 0xec, 0x10,
+};
+
+// cmp dword [r12-8], 1; lea r12, [r12-16]; je target
+static const unsigned char jit_t_jmpif[] = {
+    0x41, 0x83, 0x7c, 0x24, 0xf8, 0x01, 0x4d, 0x8d, 0x64, 0x24, 0xf0, 0x0f, 0x84, 0, 0, 0, 0,
+};
+// jmp target
+static const unsigned char jit_t_jmp[] = {0xe9, 0, 0, 0, 0};
+// mov eax, [r12-24]; cmp eax, [r12-8]; lea r12, [r12-32]; jcc(16) target
+static const unsigned char jit_t_cmpjmp_stack[] = {
+    0x41, 0x8b, 0x44, 0x24, 0xe8, 0x41, 0x3b, 0x44, 0x24, 0xf8, 0x4d, 0x8d, 0x64, 0x24, 0xe0, 0x0f, 0x84, 0, 0, 0, 0,
+};
+// cmp eax, ecx; jcc(3) target
+static const unsigned char jit_t_cmpjmp[] = {0x39, 0xc8, 0x0f, 0x84, 0, 0, 0, 0};
+// cmp eax, imm(1); je target(7), one per jmptable entry
+static const unsigned char jit_t_case[] = {0x3d, 0, 0, 0, 0, 0x0f, 0x84, 0, 0, 0, 0};
+
+// operand loads for cmpjmpif and pushop, a goes to eax and b to ecx
+// mov eax, [r12-8]; lea r12, [r12-16]
+static const unsigned char jit_t_a_pop[] = {0x41, 0x8b, 0x44, 0x24, 0xf8, 0x4d, 0x8d, 0x64, 0x24, 0xf0};
+// mov eax, imm(1)
+static const unsigned char jit_t_a_imm[] = {0xb8, 0, 0, 0, 0};
+// mov eax, [r13+value(3)]
+static const unsigned char jit_t_a_reg[] = {0x41, 0x8b, 0x85, 0, 0, 0, 0};
+// mov ecx, imm(1)
+static const unsigned char jit_t_b_imm[] = {0xb9, 0, 0, 0, 0};
+// mov ecx, [r13+value(3)]
+static const unsigned char jit_t_b_reg[] = {0x41, 0x8b, 0x8d, 0, 0, 0, 0};
+// add eax, ecx
+static const unsigned char jit_t_op_add[] = {0x01, 0xc8};
+// sub ecx, eax; mov eax, ecx
+static const unsigned char jit_t_op_sub[] = {0x29, 0xc1, 0x89, 0xc8};
+// imul eax, ecx
+static const unsigned char jit_t_op_mul[] = {0x0f, 0xaf, 0xc1};
+// cmp eax, ecx; setcc(3) al; movzx eax, al
+static const unsigned char jit_t_op_compare[] = {0x39, 0xc8, 0x0f, 0x94, 0xc0, 0x0f, 0xb6, 0xc0};
+// mov qword [r12], WINT; mov [r12+8], eax; add r12, 16
+static const unsigned char jit_t_push_eax[] = {
+    0x49, 0xc7, 0x04, 0x24, 0x00, 0x00, 0x00, 0x00, 0x41, 0x89, 0x44, 0x24, 0x08, 0x49, 0x83, 0xc4, 0x10,
+};
+
+// cmp dword [r13+type(3)], WINT; jne +8; add dword [r13+value(13)], 1
+static const unsigned char jit_t_inc_reg[] = {
+    0x41, 0x83, 0xbd, 0, 0, 0, 0, 0x00, 0x75, 0x08, 0x41, 0x83, 0x85, 0, 0, 0, 0, 0x01,
+};
+// cmp dword [r13+type(3)], WINT; jne +8; sub dword [r13+value(13)], 1
+static const unsigned char jit_t_dec_reg[] = {
+    0x41, 0x83, 0xbd, 0, 0, 0, 0, 0x00, 0x75, 0x08, 0x41, 0x83, 0xad, 0, 0, 0, 0, 0x01,
+};
+// mov qword [r13+type(3)], tag(7); mov dword [r13+value(14)], imm(18)
+static const unsigned char jit_t_mov_reg_imm[] = {
+    0x49, 0xc7, 0x85, 0, 0, 0, 0, 0, 0, 0, 0, 0x41, 0xc7, 0x85, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+// mov rax, [r13+src type(3)]; mov [r13+dst type(10)], rax;
+// mov rax, [r13+src value(17)]; mov [r13+dst value(24)], rax
+static const unsigned char jit_t_mov_reg_reg[] = {
+    0x49, 0x8b, 0x85, 0, 0, 0, 0, 0x49, 0x89, 0x85, 0, 0, 0, 0,
+    0x49, 0x8b, 0x85, 0, 0, 0, 0, 0x49, 0x89, 0x85, 0, 0, 0, 0,
+};
+
+// mov [rbx], r12; mov rdi, rbx; mov esi, ip(7); mov rax, jit_step(13); call rax;
+// mov r12, [rbx]; test eax, eax; je exit
+static const unsigned char jit_t_step[] = {
+    0x4c, 0x89, 0x23, 0x48, 0x89, 0xdf, 0xbe, 0, 0, 0, 0, 0x48, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0,
+    0xff, 0xd0, 0x4c, 0x8b, 0x23, 0x85, 0xc0, 0x0f, 0x84, 0, 0, 0, 0,
+};
+
+#define JIT_REG_TYPE(reg) ((uint32_t) ((reg) * sizeof(XRegister) + offsetof(XRegister, reg_value)))
+#define JIT_REG_VALUE(reg) (JIT_REG_TYPE(reg) + (uint32_t) offsetof(Word, as_int))
+
+// ----------------- Region compiler -------------------------
+
+typedef struct {
+    size_t at;     // rel32 field in the buffer
+    size_t target; // instruction the jump goes to
+    bool exit;     // always leave through a side exit, even for a target inside the region
+} JitFixup;
+
+typedef struct {
+    unsigned char *data;
+    size_t count;
+    size_t capacity;
+
+    size_t first; // the region is instructions [first, end)
+    size_t end;
+    size_t *offsets; // code offset of every instruction in the region
+
+    JitFixup *fixups;
+    size_t fixups_count;
+    size_t fixups_capacity;
+} JitCompiler;
+
+typedef struct {
+    OrtaVM *vm;
+    JitCode *code;  // per instruction, the region compiled for that entry
+    uint32_t *hits; // per instruction, how often control landed there
+    void **regions;
+    size_t *region_sizes;
+    size_t regions_count;
+    size_t regions_capacity;
+} Jit;
+
+static size_t jit_emit(JitCompiler *c, const unsigned char *code, size_t size) {
+    if (c->count + size > c->capacity) {
+        while (c->count + size > c->capacity) c->capacity = c->capacity ? c->capacity * 2 : 4096;
+        c->data = realloc(c->data, c->capacity);
+    }
+    memcpy(c->data + c->count, code, size);
+    c->count += size;
+    return c->count - size;
+}
+
+static void jit_patch32(JitCompiler *c, size_t at, uint32_t value) {
+    memcpy(c->data + at, &value, sizeof(value));
+}
+
+static void jit_patch64(JitCompiler *c, size_t at, uint64_t value) {
+    memcpy(c->data + at, &value, sizeof(value));
+}
+
+static void jit_fixup(JitCompiler *c, size_t at, size_t target, bool exit) {
+    if (c->fixups_count >= c->fixups_capacity) {
+        c->fixups_capacity = c->fixups_capacity ? c->fixups_capacity * 2 : 64;
+        c->fixups = realloc(c->fixups, sizeof(JitFixup) * c->fixups_capacity);
+    }
+    c->fixups[c->fixups_count++] = (JitFixup){.at = at, .target = target, .exit = exit};
+}
+
+// emits a guard template, its trailing rel32 leaves at ip
+static size_t jit_guard(JitCompiler *c, const unsigned char *code, size_t size, size_t ip) {
+    size_t at = jit_emit(c, code, size);
+    jit_fixup(c, at + size - 4, ip, true);
+    return at;
+}
+
+static void jit_guard_reg(JitCompiler *c, const unsigned char *code, size_t size, XRegisters reg, size_t ip) {
+    size_t at = jit_guard(c, code, size, ip);
+    jit_patch32(c, at + 3, JIT_REG_TYPE(reg));
+}
+
+// condition code of a compare, shared by setcc (0x90 | cc) and jcc (0x80 | cc)
+static int jit_condition(Instruction op) {
+    switch (generic_opcode(op)) {
+        case IEQ: return 0x4;
+        case INE: return 0x5;
+        case ILT: return 0xc;
+        case IGT: return 0xf;
+        case ILE: return 0xe;
+        case IGE: return 0xd;
+        default: return -1;
+    }
+}
+
+static bool jit_int_operand(const Operand *op) {
+    return op->kind == OPERAND_INT || op->kind == OPERAND_REGISTER;
+}
+
+static void jit_guard_operand(JitCompiler *c, const Operand *op, size_t ip) {
+    if (op->kind == OPERAND_REGISTER) jit_guard_reg(c, jit_t_reg_int, sizeof(jit_t_reg_int), op->as_register, ip);
+}
+
+static void jit_load_operand(JitCompiler *c, const Operand *op, bool into_b) {
+    size_t at;
+    if (op->kind == OPERAND_INT) {
+        at = into_b ? jit_emit(c, jit_t_b_imm, sizeof(jit_t_b_imm)) : jit_emit(c, jit_t_a_imm, sizeof(jit_t_a_imm));
+        jit_patch32(c, at + 1, (uint32_t) op->as_int);
+    } else {
+        at = into_b ? jit_emit(c, jit_t_b_reg, sizeof(jit_t_b_reg)) : jit_emit(c, jit_t_a_reg, sizeof(jit_t_a_reg));
+        jit_patch32(c, at + 3, JIT_REG_VALUE(op->as_register));
+    }
+}
+
+static int jit_step(JitFrame *frame, uint32_t ip);
+
+static void jit_compile_step(JitCompiler *c, size_t ip) {
+    size_t at = jit_emit(c, jit_t_step, sizeof(jit_t_step));
+    jit_patch32(c, at + 7, (uint32_t) ip);
+    jit_patch64(c, at + 13, (uint64_t) (uintptr_t) jit_step);
+    jit_fixup(c, at + sizeof(jit_t_step) - 4, JIT_EXIT_VM, true);
+}
+
+// false when the instruction has no template and needs the step helper
+static bool jit_compile_instruction(JitCompiler *c, Program *program, size_t ip) {
+    InstructionData *instr = &program->instructions[ip];
+    Operand *args = instr->args;
+    size_t at;
+
+    switch (instr->opcode) {
+        case INOP:
+            return true;
+
+        case IPUSH:
+            if (args[0].kind == OPERAND_STRING) return false;
+            jit_guard(c, jit_t_room, sizeof(jit_t_room), ip);
+            if (args[0].kind == OPERAND_REGISTER) {
+                jit_guard_reg(c, jit_t_reg_number, sizeof(jit_t_reg_number), args[0].as_register, ip);
+                at = jit_emit(c, jit_t_push_reg, sizeof(jit_t_push_reg));
+                jit_patch32(c, at + 3, JIT_REG_TYPE(args[0].as_register));
+                jit_patch32(c, at + 14, JIT_REG_VALUE(args[0].as_register));
+                return true;
+            }
+            at = jit_emit(c, jit_t_push_imm, sizeof(jit_t_push_imm));
+            if (args[0].kind == OPERAND_FLOAT) {
+                uint32_t bits;
+                memcpy(&bits, &args[0].as_float, sizeof(bits));
+                jit_patch32(c, at + 4, WFLOAT);
+                jit_patch32(c, at + 13, bits);
+            } else {
+                jit_patch32(c, at + 4, WINT);
+                jit_patch32(c, at + 13, (uint32_t) args[0].as_int);
+            }
+            return true;
+
+        case IEVAL: // folded to an int at load time
+            jit_guard(c, jit_t_room, sizeof(jit_t_room), ip);
+            at = jit_emit(c, jit_t_push_imm, sizeof(jit_t_push_imm));
+            jit_patch32(c, at + 4, WINT);
+            jit_patch32(c, at + 13, (uint32_t) (instr->argc ? args[0].as_int : 0));
+            return true;
+
+        case IDROP:
+            jit_guard(c, jit_t_depth1, sizeof(jit_t_depth1), ip);
+            jit_guard(c, jit_t_top_not_string, sizeof(jit_t_top_not_string), ip);
+            jit_emit(c, jit_t_drop, sizeof(jit_t_drop));
+            return true;
+
+        case IDUP:
+            jit_guard(c, jit_t_depth1, sizeof(jit_t_depth1), ip);
+            jit_guard(c, jit_t_room, sizeof(jit_t_room), ip);
+            jit_guard(c, jit_t_top_number, sizeof(jit_t_top_number), ip);
+            jit_emit(c, jit_t_dup, sizeof(jit_t_dup));
+            return true;
+
+        case ISWAP:
+            jit_guard(c, jit_t_depth2, sizeof(jit_t_depth2), ip);
+            jit_emit(c, jit_t_swap, sizeof(jit_t_swap));
+            return true;
+
+        case IADD:
+        case ISUB:
+        case IMUL:
+        case IDIV:
+        case IMOD:
+        case IEQ:
+        case INE:
+        case ILT:
+        case IGT:
+        case ILE:
+        case IGE:
+            // add and sub with operands work on registers and the top word
+            if (instr->argc != 0) return false;
+            // fallthrough
+        case IADD_INT:
+        case ISUB_INT:
+        case IMUL_INT:
+        case IEQ_INT:
+        case INE_INT:
+        case ILT_INT:
+        case IGT_INT:
+        case ILE_INT:
+        case IGE_INT: {
+            Instruction op = generic_opcode(instr->opcode);
+            jit_guard(c, jit_t_depth2, sizeof(jit_t_depth2), ip);
+            jit_guard(c, jit_t_top_int, sizeof(jit_t_top_int), ip);
+            jit_guard(c, jit_t_second_int, sizeof(jit_t_second_int), ip);
+            switch (op) {
+                case IADD: jit_emit(c, jit_t_add, sizeof(jit_t_add));
+                    break;
+                case ISUB: jit_emit(c, jit_t_sub, sizeof(jit_t_sub));
+                    break;
+                case IMUL: jit_emit(c, jit_t_mul, sizeof(jit_t_mul));
+                    break;
+                case IDIV:
+                    at = jit_emit(c, jit_t_div, sizeof(jit_t_div));
+                    jit_fixup(c, at + 13, ip, true);
+                    jit_fixup(c, at + 25, ip, true);
+                    break;
+                case IMOD:
+                    at = jit_emit(c, jit_t_mod, sizeof(jit_t_mod));
+                    jit_fixup(c, at + 13, ip, true);
+                    break;
+                default:
+                    at = jit_emit(c, jit_t_compare, sizeof(jit_t_compare));
+                    c->data[at + 11] = (unsigned char) (0x90 | jit_condition(op));
+                    break;
+            }
+            return true;
+        }
+
+        case IJMP:
+            if (args[0].kind != OPERAND_LABEL || args[0].as_index >= program->instructions_count) return false;
+            at = jit_emit(c, jit_t_jmp, sizeof(jit_t_jmp));
+            jit_fixup(c, at + 1, args[0].as_index, false);
+            return true;
+
+        case IJMPIF:
+            if (args[0].kind != OPERAND_LABEL || args[0].as_index >= program->instructions_count) return false;
+            jit_guard(c, jit_t_depth1, sizeof(jit_t_depth1), ip);
+            jit_guard(c, jit_t_top_int, sizeof(jit_t_top_int), ip);
+            at = jit_emit(c, jit_t_jmpif, sizeof(jit_t_jmpif));
+            jit_fixup(c, at + sizeof(jit_t_jmpif) - 4, args[0].as_index, false);
+            return true;
+
+        case IJMPTABLE:
+            for (size_t i = 0; i < instr->argc; i++) {
+                if (args[i].kind != OPERAND_LABEL || args[i].as_index >= program->instructions_count) return false;
+            }
+            // anything but an int index goes back to the interpreter, which takes the default
+            jit_guard(c, jit_t_depth1, sizeof(jit_t_depth1), ip);
+            jit_guard(c, jit_t_top_int, sizeof(jit_t_top_int), ip);
+            jit_emit(c, jit_t_a_pop, sizeof(jit_t_a_pop));
+            for (size_t i = 1; i < instr->argc; i++) {
+                at = jit_emit(c, jit_t_case, sizeof(jit_t_case));
+                jit_patch32(c, at + 1, (uint32_t) (i - 1));
+                jit_fixup(c, at + 7, args[i].as_index, false);
+            }
+            at = jit_emit(c, jit_t_jmp, sizeof(jit_t_jmp));
+            jit_fixup(c, at + 1, args[0].as_index, false);
+            return true;
+
+        case ICMPJMPIF:
+        case ICMPJMPIF_INT: {
+            // cmpjmpif <cmp> <label> [a] [b], a missing operand comes from the stack
+            int cc = jit_condition((Instruction) args[0].as_int);
+            size_t pushed = instr->argc - 2;
+            if (cc < 0 || args[1].kind != OPERAND_LABEL || args[1].as_index >= program->instructions_count) return false;
+            for (size_t i = 2; i < instr->argc; i++) {
+                if (!jit_int_operand(&args[i])) return false;
+            }
+            if (pushed == 0) {
+                jit_guard(c, jit_t_depth2, sizeof(jit_t_depth2), ip);
+                jit_guard(c, jit_t_top_int, sizeof(jit_t_top_int), ip);
+                jit_guard(c, jit_t_second_int, sizeof(jit_t_second_int), ip);
+                at = jit_emit(c, jit_t_cmpjmp_stack, sizeof(jit_t_cmpjmp_stack));
+                c->data[at + 16] = (unsigned char) (0x80 | cc);
+                jit_fixup(c, at + sizeof(jit_t_cmpjmp_stack) - 4, args[1].as_index, false);
+                return true;
+            }
+            if (pushed == 1) {
+                jit_guard(c, jit_t_depth1, sizeof(jit_t_depth1), ip);
+                jit_guard(c, jit_t_top_int, sizeof(jit_t_top_int), ip);
+                jit_guard_operand(c, &args[2], ip);
+                jit_emit(c, jit_t_a_pop, sizeof(jit_t_a_pop));
+                jit_load_operand(c, &args[2], true);
+            } else {
+                jit_guard_operand(c, &args[2], ip);
+                jit_guard_operand(c, &args[3], ip);
+                jit_load_operand(c, &args[2], false);
+                jit_load_operand(c, &args[3], true);
+            }
+            at = jit_emit(c, jit_t_cmpjmp, sizeof(jit_t_cmpjmp));
+            c->data[at + 3] = (unsigned char) (0x80 | cc);
+            jit_fixup(c, at + sizeof(jit_t_cmpjmp) - 4, args[1].as_index, false);
+            return true;
+        }
+
+        case IPUSHOP: {
+            // pushop <op> <a> <b>, div and mod keep their zero checks in the interpreter
+            Instruction op = (Instruction) args[0].as_int;
+            if (op != IADD && op != ISUB && op != IMUL && jit_condition(op) < 0) return false;
+            if (!jit_int_operand(&args[1]) || !jit_int_operand(&args[2])) return false;
+            jit_guard(c, jit_t_room, sizeof(jit_t_room), ip);
+            jit_guard_operand(c, &args[1], ip);
+            jit_guard_operand(c, &args[2], ip);
+            jit_load_operand(c, &args[1], false);
+            jit_load_operand(c, &args[2], true);
+            switch (op) {
+                case IADD: jit_emit(c, jit_t_op_add, sizeof(jit_t_op_add));
+                    break;
+                case ISUB: jit_emit(c, jit_t_op_sub, sizeof(jit_t_op_sub));
+                    break;
+                case IMUL: jit_emit(c, jit_t_op_mul, sizeof(jit_t_op_mul));
+                    break;
+                default:
+                    at = jit_emit(c, jit_t_op_compare, sizeof(jit_t_op_compare));
+                    c->data[at + 3] = (unsigned char) (0x90 | jit_condition(op));
+                    break;
+            }
+            jit_emit(c, jit_t_push_eax, sizeof(jit_t_push_eax));
+            return true;
+        }
+
+        case IINC:
+        case IDEC:
+            if (args[0].kind != OPERAND_REGISTER) return false;
+            at = instr->opcode == IINC
+                     ? jit_emit(c, jit_t_inc_reg, sizeof(jit_t_inc_reg))
+                     : jit_emit(c, jit_t_dec_reg, sizeof(jit_t_dec_reg));
+            jit_patch32(c, at + 3, JIT_REG_TYPE(args[0].as_register));
+            jit_patch32(c, at + 13, JIT_REG_VALUE(args[0].as_register));
+            return true;
+
+        case IMOV: {
+            // the old value is released by the interpreter, so strings stay there
+            if (args[1].kind != OPERAND_REGISTER) return false;
+            XRegisters dst = args[1].as_register;
+            if (args[0].kind == OPERAND_INT || args[0].kind == OPERAND_FLOAT) {
+                uint32_t bits = (uint32_t) args[0].as_int;
+                if (args[0].kind == OPERAND_FLOAT) memcpy(&bits, &args[0].as_float, sizeof(bits));
+                jit_guard_reg(c, jit_t_reg_not_string, sizeof(jit_t_reg_not_string), dst, ip);
+                at = jit_emit(c, jit_t_mov_reg_imm, sizeof(jit_t_mov_reg_imm));
+                jit_patch32(c, at + 3, JIT_REG_TYPE(dst));
+                jit_patch32(c, at + 7, args[0].kind == OPERAND_FLOAT ? WFLOAT : WINT);
+                jit_patch32(c, at + 14, JIT_REG_VALUE(dst));
+                jit_patch32(c, at + 18, bits);
+                return true;
+            }
+            if (args[0].kind != OPERAND_REGISTER) return false;
+            XRegisters src = args[0].as_register;
+            jit_guard_reg(c, jit_t_reg_number, sizeof(jit_t_reg_number), src, ip);
+            jit_guard_reg(c, jit_t_reg_not_string, sizeof(jit_t_reg_not_string), dst, ip);
+            at = jit_emit(c, jit_t_mov_reg_reg, sizeof(jit_t_mov_reg_reg));
+            jit_patch32(c, at + 3, JIT_REG_TYPE(src));
+            jit_patch32(c, at + 10, JIT_REG_TYPE(dst));
+            jit_patch32(c, at + 17, JIT_REG_VALUE(src));
+            jit_patch32(c, at + 24, JIT_REG_VALUE(dst));
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
+
+// Compiles the region entered at first and maps it executable, false if the
+// mapping failed. The region runs up to a ret or halt or JIT_MAX_REGION instructions.
+static bool jit_compile(Jit *jit, size_t first) {
+    Program *program = &jit->vm->program;
+    JitCompiler c = {0};
+    c.first = first;
+    c.end = first;
+    while (c.end < program->instructions_count && c.end - first < JIT_MAX_REGION) {
+        Instruction op = program->instructions[c.end++].opcode;
+        if (op == IRET || op == IHALT) break;
+    }
+    c.offsets = malloc(sizeof(size_t) * (c.end - first));
+
+    jit_emit(&c, jit_t_prologue, sizeof(jit_t_prologue));
+    for (size_t ip = first; ip < c.end; ip++) {
+        c.offsets[ip - first] = c.count;
+        if (!jit_compile_instruction(&c, program, ip)) jit_compile_step(&c, ip);
+    }
+    // falling off the region continues in the interpreter
+    size_t at = jit_emit(&c, jit_t_jmp, sizeof(jit_t_jmp));
+    jit_fixup(&c, at + 1, c.end, true);
+
+    // one side exit per target, jumps inside the region go straight to the code
+    size_t *exits = malloc(sizeof(size_t) * 2 * c.fixups_count);
+    size_t exits_count = 0;
+    for (size_t i = 0; i < c.fixups_count; i++) {
+        JitFixup *fixup = &c.fixups[i];
+        size_t target;
+        if (!fixup->exit && fixup->target >= first && fixup->target < c.end) {
+            target = c.offsets[fixup->target - first];
+        } else {
+            size_t e = 0;
+            while (e < exits_count && exits[e * 2] != fixup->target) e++;
+            if (e == exits_count) {
+                exits[e * 2] = fixup->target;
+                exits[e * 2 + 1] = jit_emit(&c, jit_t_exit, sizeof(jit_t_exit));
+                jit_patch32(&c, exits[e * 2 + 1] + 4, (uint32_t) fixup->target);
+                exits_count++;
+            }
+            target = exits[e * 2 + 1];
+        }
+        jit_patch32(&c, fixup->at, (uint32_t) (int32_t) (target - (fixup->at + 4)));
+    }
+    free(exits);
+
+    void *memory = mmap(NULL, c.count, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    bool mapped = memory != MAP_FAILED;
+    if (mapped) {
+        memcpy(memory, c.data, c.count);
+        if (mprotect(memory, c.count, PROT_READ | PROT_EXEC) != 0) {
+            munmap(memory, c.count);
+            mapped = false;
+        }
+    }
+    if (mapped) {
+        if (jit->regions_count >= jit->regions_capacity) {
+            jit->regions_capacity = jit->regions_capacity ? jit->regions_capacity * 2 : 16;
+            jit->regions = realloc(jit->regions, sizeof(void *) * jit->regions_capacity);
+            jit->region_sizes = realloc(jit->region_sizes, sizeof(size_t) * jit->regions_capacity);
+        }
+        jit->regions[jit->regions_count] = memory;
+        jit->region_sizes[jit->regions_count++] = c.count;
+        jit->code[first] = (JitCode) memory;
+    }
+    free(c.data);
+    free(c.offsets);
+    free(c.fixups);
+    return mapped;
+}
+
+// ----------------- Driver -------------------------
+
+// Called by compiled code for an opcode without a template. Keeps running
+// native code only if the instruction fell through to the next one.
+static int jit_step(JitFrame *frame, uint32_t ip) {
+    OrtaVM *vm = frame->vm;
+    XPU *xpu = &vm->xpu;
+    xpu->stack.count = (size_t) (frame->sp - frame->base);
+    xpu->ip = ip;
+    execute_instruction(vm, &vm->program.instructions[ip]);
+    frame->sp = frame->base + xpu->stack.count;
+    return !vm->program.halted && xpu->ip == (size_t) ip + 1;
+}
+
+#endif // ORTA_JIT
+
+void jit_execute_program(OrtaVM *vm) {
+#ifndef ORTA_JIT
+    execute_program(vm);
+#else
+    if (!enter_program(vm)) return;
+    XPU *xpu = &vm->xpu;
+    Program *program = &vm->program;
+    Jit jit = {0};
+    jit.vm = vm;
+    jit.code = calloc(program->instructions_count, sizeof(JitCode));
+    jit.hits = calloc(program->instructions_count, sizeof(uint32_t));
+    JitFrame frame = {
+        .base = xpu->stack.stack,
+        .limit = xpu->stack.stack + xpu->stack.capacity,
+        .registers = xpu->registers,
+        .vm = vm,
+    };
+
+    // landed: control got here by a jump, call, return or side exit
+    bool landed = true;
+    while (!program->halted && xpu->ip < program->instructions_count) {
+        size_t ip = xpu->ip;
+        if (jit.code[ip] != NULL) {
+            frame.sp = frame.base + xpu->stack.count;
+            uint32_t next = jit.code[ip](&frame);
+            xpu->stack.count = (size_t) (frame.sp - frame.base);
+            landed = true;
+            if (next == JIT_EXIT_VM) continue;
+            xpu->ip = next;
+            if (next != ip) continue;
+            // a guard of the entry instruction failed, the interpreter runs it once
+        } else if (landed && ++jit.hits[ip] == JIT_HOT_THRESHOLD && jit_compile(&jit, ip)) continue;
+        execute_instruction(vm, &program->instructions[ip]);
+        landed = xpu->ip != ip + 1;
+    }
+
+    for (size_t i = 0; i < jit.regions_count; i++) munmap(jit.regions[i], jit.region_sizes[i]);
+    free(jit.regions);
+    free(jit.region_sizes);
+    free(jit.code);
+    free(jit.hits);
+#endif
+}
+
+#endif // JIT_H
@@ -0,0 +1,103 @@
+#ifndef XLZ_H
+#define XLZ_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// A small LZ77 codec. The stream is a list of sequences:
+//
+//   <literal count> <literals> <match length - XLZ_MIN_MATCH> <match distance>
+//
+// with the counts as LEB128 varints. The last sequence stops after its literals,
+// the decoder knows the decoded size up front.
+
+#define XLZ_MIN_MATCH 4
+#define XLZ_HASH_BITS 14
+#define XLZ_WINDOW (1u << 16)
+
+// worst case size of xlz_compress output for size input bytes
+static inline size_t xlz_bound(size_t size) {
+    return size + size / 2 + 16; // a 4 byte match costs up to 6
+}
+
+static inline size_t xlz_put_varint(unsigned char *out, uint64_t value) {
+    size_t n = 0;
+    do {
+        unsigned char byte = value & 0x7f;
+        value >>= 7;
+        out[n++] = byte | (value ? 0x80 : 0);
+    } while (value);
+    return n;
+}
+
+static inline bool xlz_get_varint(const unsigned char *in, size_t size, size_t *at, uint64_t *value) {
+    *value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (*at >= size) return false;
+        unsigned char byte = in[(*at)++];
+        *value |= (uint64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+static inline uint32_t xlz_hash(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return (v * 2654435761u) >> (32 - XLZ_HASH_BITS);
+}
+
+// compresses size bytes of in into out, which holds xlz_bound(size) bytes, and returns the compressed size
+static size_t xlz_compress(const unsigned char *in, size_t size, unsigned char *out) {
+    size_t *table = calloc((size_t) 1 << XLZ_HASH_BITS, sizeof(size_t)); // position + 1, 0 for none
+    size_t n = 0, anchor = 0, at = 0;
+    while (at + XLZ_MIN_MATCH <= size) {
+        uint32_t h = xlz_hash(in + at);
+        size_t candidate = table[h];
+        table[h] = at + 1;
+        if (!candidate || at - (candidate - 1) > XLZ_WINDOW ||
+            memcmp(in + candidate - 1, in + at, XLZ_MIN_MATCH) != 0) {
+            at++;
+            continue;
+        }
+        size_t from = candidate - 1, length = XLZ_MIN_MATCH;
+        while (at + length < size && in[from + length] == in[at + length]) length++;
+
+        n += xlz_put_varint(out + n, at - anchor);
+        memcpy(out + n, in + anchor, at - anchor);
+        n += at - anchor;
+        n += xlz_put_varint(out + n, length - XLZ_MIN_MATCH);
+        n += xlz_put_varint(out + n, at - from);
+        at += length;
+        anchor = at;
+    }
+    n += xlz_put_varint(out + n, size - anchor);
+    memcpy(out + n, in + anchor, size - anchor);
+    n += size - anchor;
+    free(table);
+    return n;
+}
+
+// decodes exactly out_size bytes, false when in is malformed or does not fill out
+static bool xlz_decompress(const unsigned char *in, size_t size, unsigned char *out, size_t out_size) {
+    size_t at = 0, n = 0;
+    for (;;) {
+        uint64_t literals, length, distance;
+        if (!xlz_get_varint(in, size, &at, &literals) || literals > size - at || literals > out_size - n) return false;
+        memcpy(out + n, in + at, literals);
+        at += literals;
+        n += literals;
+        if (n == out_size) return at == size;
+
+        if (!xlz_get_varint(in, size, &at, &length) || !xlz_get_varint(in, size, &at, &distance)) return false;
+        if (distance == 0 || distance > n || out_size - n < XLZ_MIN_MATCH || length > out_size - n - XLZ_MIN_MATCH)
+            return false;
+        length += XLZ_MIN_MATCH;
+        // byte by byte, a match may overlap the bytes it produces
+        for (size_t i = 0; i < length; i++, n++) out[n] = out[n - distance];
+    }
+}
+
+#endif // XLZ_H
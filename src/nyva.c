@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <ctype.h>
 #include <assert.h>
@@ -40,6 +41,7 @@ typedef enum {
     TOKEN_IMPORT,
     TOKEN_BREAK,
     TOKEN_MODULUS,
+    TOKEN_MATCH,
 } TokenType;
 
 typedef struct {
@@ -82,8 +84,18 @@ typedef enum {
     NODE_IMPORT,
     NODE_BREAK_STATEMENT,
     NODE_WHILE_STATEMENT,
+    NODE_MATCH_STATEMENT,
 } NodeType;
 
+struct ASTNode;
+
+typedef struct {
+    int *values;
+    int value_count;
+    struct ASTNode **body;
+    int body_count;
+} MatchCase;
+
 typedef struct ASTNode {
     NodeType type;
     union {
@@ -156,6 +168,13 @@ typedef struct ASTNode {
             struct ASTNode **body;
             int body_count;
         } while_statement;
+        struct {
+            struct ASTNode *value;
+            MatchCase *cases;
+            int case_count;
+            struct ASTNode **else_body;
+            int else_body_count;
+        } match_statement;
     } data;
 } ASTNode;
 
@@ -181,6 +200,8 @@ Keyword keywords[] = {
     {"import", TOKEN_IMPORT},
     {"break", TOKEN_BREAK},
     {"while", TOKEN_WHILE},
+    {"match", TOKEN_MATCH},
+    {"switch", TOKEN_MATCH},
     {NULL, 0}
 };
 
@@ -514,11 +535,16 @@ Token *tokenize(const char *input) {
         .column = 0
     };
     lexer_advance(&lexer);
-    Token *tokens = malloc(sizeof(Token) * 1024);
+    int capacity = 1024;
+    Token *tokens = malloc(sizeof(Token) * capacity);
     int count = 0;
     Token token;
     do {
         token = lexer_get_next_token(&lexer);
+        if (count == capacity) {
+            capacity *= 2;
+            tokens = realloc(tokens, sizeof(Token) * capacity);
+        }
         tokens[count++] = token;
     } while (token.type != TOKEN_EOF);
     free(lexer.input);
@@ -858,6 +884,77 @@ ASTNode *parser_parse_while_statement(Parser *parser) {
     return node;
 }
 
+#define MATCH_MAX_CASES 256
+#define MATCH_MAX_VALUES 64
+#define BLOCK_MAX_STATEMENTS 64
+
+// the fixed size node arrays stop the parse instead of overflowing
+void parser_check_limit(Parser *parser, int count, int max, const char *what) {
+    if (count < max) return;
+    Token token = parser_current_token(parser);
+    fprintf(stderr, "More than %d %s at line %d, column %d\n", max, what, token.line, token.column);
+    exit(1);
+}
+
+ASTNode **parser_parse_block(Parser *parser, int *count) {
+    parser_expect(parser, TOKEN_LBRACE);
+    ASTNode **body = malloc(sizeof(ASTNode*) * BLOCK_MAX_STATEMENTS);
+    *count = 0;
+    while (parser_current_token(parser).type != TOKEN_RBRACE &&
+           parser_current_token(parser).type != TOKEN_EOF) {
+        parser_check_limit(parser, *count, BLOCK_MAX_STATEMENTS, "statements in a block");
+        body[(*count)++] = parser_parse_statement(parser);
+    }
+    parser_expect(parser, TOKEN_RBRACE);
+    return body;
+}
+
+// match (value) { 1 { ... } 2, -3 { ... } else { ... } }, cases are int literals
+ASTNode *parser_parse_match_statement(Parser *parser) {
+    parser_expect(parser, TOKEN_MATCH);
+    parser_expect(parser, TOKEN_LPAREN);
+    ASTNode *value = parser_parse_expression(parser);
+    parser_expect(parser, TOKEN_RPAREN);
+    parser_expect(parser, TOKEN_LBRACE);
+    ASTNode *node = malloc(sizeof(ASTNode));
+    node->type = NODE_MATCH_STATEMENT;
+    node->data.match_statement.value = value;
+    node->data.match_statement.cases = malloc(sizeof(MatchCase) * MATCH_MAX_CASES);
+    node->data.match_statement.case_count = 0;
+    node->data.match_statement.else_body = NULL;
+    node->data.match_statement.else_body_count = 0;
+    while (parser_current_token(parser).type != TOKEN_RBRACE &&
+           parser_current_token(parser).type != TOKEN_EOF) {
+        if (parser_current_token(parser).type == TOKEN_ELSE) {
+            if (node->data.match_statement.else_body != NULL) {
+                Token token = parser_current_token(parser);
+                fprintf(stderr, "Second else in a match at line %d, column %d\n", token.line, token.column);
+                exit(1);
+            }
+            parser_advance(parser);
+            node->data.match_statement.else_body = parser_parse_block(parser, &node->data.match_statement.else_body_count);
+            continue;
+        }
+        parser_check_limit(parser, node->data.match_statement.case_count, MATCH_MAX_CASES, "match cases");
+        MatchCase *match_case = &node->data.match_statement.cases[node->data.match_statement.case_count++];
+        match_case->values = malloc(sizeof(int) * MATCH_MAX_VALUES);
+        match_case->value_count = 0;
+        do {
+            if (match_case->value_count > 0) parser_advance(parser);
+            parser_check_limit(parser, match_case->value_count, MATCH_MAX_VALUES, "values in a match case");
+            bool negative = parser_current_token(parser).type == TOKEN_MINUS;
+            if (negative) parser_advance(parser);
+            Token token = parser_current_token(parser);
+            parser_expect(parser, TOKEN_NUMBER);
+            long long value = strtoll(token.value, NULL, 10);
+            match_case->values[match_case->value_count++] = (int) (negative ? -value : value);
+        } while (parser_current_token(parser).type == TOKEN_COMMA);
+        match_case->body = parser_parse_block(parser, &match_case->body_count);
+    }
+    parser_expect(parser, TOKEN_RBRACE);
+    return node;
+}
+
 ASTNode *parser_parse_import_statement(Parser *parser) {
     parser_expect(parser, TOKEN_IMPORT);
     parser_expect(parser, TOKEN_LPAREN);
@@ -894,6 +991,8 @@ ASTNode *parser_parse_statement(Parser *parser) {
         node = parser_parse_for_statement(parser);
     } else if (token.type == TOKEN_WHILE) {
         node = parser_parse_while_statement(parser);
+    } else if (token.type == TOKEN_MATCH) {
+        node = parser_parse_match_statement(parser);
     } else if (token.type == TOKEN_IMPORT) {
         node = parser_parse_import_statement(parser);
     } else if (token.type == TOKEN_BREAK) {
@@ -1075,8 +1174,7 @@ void codegen_generate_expression(CodeGenerator *gen, ASTNode *node) {
             for (int i = 0; i < node->data.function_call.args->data.argument_list.count; i++) {
                 codegen_generate_expression(gen, node->data.function_call.args->data.argument_list.args[i]);
             }
-            codegen_emit(gen, "push %d", node->data.function_call.args->data.argument_list.count);
-            codegen_emit(gen, "call %s", func_name);
+            codegen_emit(gen, "invoke %s %d", func_name, node->data.function_call.args->data.argument_list.count);
         }
         if (strncmp(func_name, "@", 1) == 0) {
             codegen_emit(gen, "; END BUILTIN CALL %s", node->data.function_call.name);
@@ -1132,19 +1230,12 @@ void codegen_generate_if_statement(CodeGenerator *gen, ASTNode *node) {
 
 void codegen_generate_parameter_list(CodeGenerator *gen, ASTNode *node) {}
 
-char *error_not_enough_args = NULL;
-
 void codegen_generate_function_definition(CodeGenerator *gen, ASTNode *node) {
     codegen_emit(gen, "; %s(%d)", node->data.function_definition.name, node->data.function_definition.params->data.parameter_list.count);
     codegen_emit(gen, "%s:", node->data.function_definition.name);
     gen->indent_level = 1;
     if (!(strcmp(node->data.function_definition.name, "__entry") == 0)) {
-        codegen_emit(gen, "push %d", node->data.function_definition.params->data.parameter_list.count);
-        codegen_emit(gen, "eq");
-        codegen_emit(gen, "not");
-        codegen_emit(gen, "here");
-        codegen_emit(gen, "swap");
-        codegen_emit(gen, "jmpif %s", error_not_enough_args);
+        codegen_emit(gen, "arity %d", node->data.function_definition.params->data.parameter_list.count);
     }
     codegen_emit(gen, "togglelocalscope");
     ASTNode *params = node->data.function_definition.params;
@@ -1220,6 +1311,119 @@ void codegen_generate_while_statement(CodeGenerator *gen, ASTNode *node) {
     free(end_label);
 }
 
+typedef struct {
+    int value;
+    char *label;
+} MatchEntry;
+
+int match_entry_compare(const void *a, const void *b) {
+    int x = ((const MatchEntry *) a)->value, y = ((const MatchEntry *) b)->value;
+    return x < y ? -1 : x > y;
+}
+
+// binary search for the value in temp over entries[lo, hi), a miss goes to default_label
+void codegen_generate_match_search(CodeGenerator *gen, MatchEntry *entries, int lo, int hi, const char *temp,
+                                   const char *default_label) {
+    if (hi - lo <= 2) {
+        for (int i = lo; i < hi; i++) {
+            codegen_emit(gen, "getvar %s", temp);
+            codegen_emit(gen, "push %d", entries[i].value);
+            codegen_emit(gen, "eq");
+            codegen_emit(gen, "jmpif %s", entries[i].label);
+        }
+        codegen_emit(gen, "jmp %s", default_label);
+        return;
+    }
+    int mid = lo + (hi - lo) / 2;
+    char *lower = codegen_create_label(gen, "match_lower");
+    codegen_emit(gen, "getvar %s", temp);
+    codegen_emit(gen, "push %d", entries[mid].value);
+    codegen_emit(gen, "lt");
+    codegen_emit(gen, "jmpif %s", lower);
+    codegen_generate_match_search(gen, entries, mid, hi, temp, default_label);
+    codegen_emit(gen, "%s:", lower);
+    codegen_generate_match_search(gen, entries, lo, mid, temp, default_label);
+    free(lower);
+}
+
+// Dense cases index a jmptable, values at most twice as spread as there are cases.
+// Sparse ones, and tables from INT_MIN whose -low is no int, binary search on the
+// value kept in a hidden variable.
+void codegen_generate_match_statement(CodeGenerator *gen, ASTNode *node) {
+    char *end_label = codegen_create_label(gen, "match_end");
+    char *default_label = node->data.match_statement.else_body != NULL ? codegen_create_label(gen, "match_else") : end_label;
+    int case_count = node->data.match_statement.case_count;
+    char **case_labels = malloc(sizeof(char*) * (case_count + 1));
+    int count = 0;
+    for (int i = 0; i < case_count; i++) count += node->data.match_statement.cases[i].value_count;
+    MatchEntry *entries = malloc(sizeof(MatchEntry) * (count + 1));
+    count = 0;
+    for (int i = 0; i < case_count; i++) {
+        MatchCase *match_case = &node->data.match_statement.cases[i];
+        case_labels[i] = codegen_create_label(gen, "match_case");
+        for (int j = 0; j < match_case->value_count; j++) {
+            entries[count++] = (MatchEntry){match_case->values[j], case_labels[i]};
+        }
+    }
+    qsort(entries, count, sizeof(MatchEntry), match_entry_compare);
+    for (int i = 1; i < count; i++) {
+        if (entries[i].value == entries[i - 1].value) {
+            fprintf(stderr, "Error: duplicate match case %d\n", entries[i].value);
+            exit(1);
+        }
+    }
+
+    codegen_generate_expression(gen, node->data.match_statement.value);
+    long long span = count > 0 ? (long long) entries[count - 1].value - entries[0].value + 1 : 0;
+    if (count == 0) {
+        codegen_emit(gen, "drop");
+        codegen_emit(gen, "jmp %s", default_label);
+    } else if (span <= 2LL * count && entries[0].value != INT_MIN) {
+        int low = entries[0].value;
+        if (low != 0) {
+            codegen_emit(gen, "push %d", -low);
+            codegen_emit(gen, "add");
+        }
+        size_t size = 64 + (size_t) span * 72;
+        char *table = malloc(size);
+        int written = snprintf(table, size, "jmptable %s", default_label);
+        int i = 0;
+        for (long long value = low; value <= entries[count - 1].value; value++) {
+            const char *label = default_label;
+            if (entries[i].value == value) label = entries[i++].label;
+            written += snprintf(table + written, size - written, " %s", label);
+        }
+        codegen_emit(gen, "%s", table);
+        free(table);
+    } else {
+        char *temp = codegen_create_label(gen, "match");
+        codegen_emit(gen, "setvar %s", temp);
+        codegen_generate_match_search(gen, entries, 0, count, temp, default_label);
+        free(temp);
+    }
+
+    for (int i = 0; i < case_count; i++) {
+        MatchCase *match_case = &node->data.match_statement.cases[i];
+        codegen_emit(gen, "%s:", case_labels[i]);
+        for (int j = 0; j < match_case->body_count; j++) {
+            codegen_generate_statement_with_break(gen, match_case->body[j], current_break_label);
+        }
+        codegen_emit(gen, "jmp %s", end_label);
+        free(case_labels[i]);
+    }
+    if (node->data.match_statement.else_body != NULL) {
+        codegen_emit(gen, "%s:", default_label);
+        for (int j = 0; j < node->data.match_statement.else_body_count; j++) {
+            codegen_generate_statement_with_break(gen, node->data.match_statement.else_body[j], current_break_label);
+        }
+        free(default_label);
+    }
+    codegen_emit(gen, "%s:", end_label);
+    free(end_label);
+    free(case_labels);
+    free(entries);
+}
+
 void codegen_generate_import_statement(CodeGenerator *gen, ASTNode *node);
 
 void codegen_generate_statement(CodeGenerator *gen, ASTNode *node) {
@@ -1248,6 +1452,9 @@ void codegen_generate_statement(CodeGenerator *gen, ASTNode *node) {
         case NODE_WHILE_STATEMENT:
             codegen_generate_while_statement(gen, node);
             break;
+        case NODE_MATCH_STATEMENT:
+            codegen_generate_match_statement(gen, node);
+            break;
         case NODE_IMPORT:
             codegen_emit(gen, "; START IMPORTED FILE %s", node->data.import_statement.file);
             codegen_generate_import_statement(gen, node);
@@ -1274,19 +1481,12 @@ void codegen_generate_statement_with_break(CodeGenerator *gen, ASTNode *node, ch
 }
 
 void codegen_generate_program(CodeGenerator *gen, ASTNode *program) {
-    error_not_enough_args = codegen_create_label(gen, "error_not_enough_args");
     for (int i = 0; i < program->data.program.count; i++) {
         codegen_generate_statement(gen, program->data.program.statements[i]);
         if (program->data.program.statements[i]->type == NODE_FUNCTION_DEFINITION) {
             codegen_emit(gen, "");
         }
     }
-    codegen_emit(gen, "%s:", error_not_enough_args);
-    codegen_emit(gen, "    push \"[%%s ERROR] invalid amount of arguments\"");
-    codegen_emit(gen, "    sprintf");
-    codegen_emit(gen, "    print");
-    codegen_emit(gen, "    halt 1");
-    free(error_not_enough_args);
 }
 
 void free_ast(ASTNode *node) {
@@ -1374,6 +1574,24 @@ void free_ast(ASTNode *node) {
             }
             free(node->data.while_statement.body);
             break;
+        case NODE_MATCH_STATEMENT:
+            free_ast(node->data.match_statement.value);
+            for (int i = 0; i < node->data.match_statement.case_count; i++) {
+                MatchCase *match_case = &node->data.match_statement.cases[i];
+                for (int j = 0; j < match_case->body_count; j++) {
+                    free_ast(match_case->body[j]);
+                }
+                free(match_case->body);
+                free(match_case->values);
+            }
+            free(node->data.match_statement.cases);
+            if (node->data.match_statement.else_body != NULL) {
+                for (int i = 0; i < node->data.match_statement.else_body_count; i++) {
+                    free_ast(node->data.match_statement.else_body[i]);
+                }
+                free(node->data.match_statement.else_body);
+            }
+            break;
         case NODE_IMPORT:
             free(node->data.import_statement.file);
             break;
@@ -0,0 +1,1364 @@
+#ifndef OPT_H
+#define OPT_H
+#include "orta.h"
+#include "profile.h"
+
+// ----------------- Optimizer -------------------------
+// Offline passes over a loaded program, run by xopt before it writes a new xbin.
+// The program is linked and fused already. A pass rewrites instructions in place
+// and turns the ones it removes into INOPs; link_program then drops them and
+// renumbers jump targets and labels. Facts a pass learns never cross a basic
+// block boundary, so every jump target starts from nothing.
+
+#define OPT_MAX_ROUNDS 8
+#define OPT_INLINE_BUDGET 16 // instructions in the body of a routine that gets inlined
+#define OPT_INLINE_HOT_BUDGET 48 // the same for a call site a profile shows hot
+#define OPT_INLINE_GROWTH 2  // inlining stops before the program grows past this factor
+#define OPT_UNROLL_BUDGET 32 // instructions an unrolled loop may take
+#define OPT_UNROLL_FACTOR 4  // copies of the body per test of a counter that keeps looping
+#define OPT_TRIP_SCAN (1 << 24) // trips counted before a loop is taken as unbounded
+
+typedef struct {
+    size_t folded;      // operations on constants computed at build time
+    size_t propagated;  // reads replaced by the constant, register or value they copy
+    size_t dead_stores; // register writes and stack values nothing reads
+    size_t dead_code;   // unreachable instructions
+    size_t threaded;    // jumps retargeted past a jmp, or dropped before their own target
+    size_t labels;      // labels of unreachable code
+    size_t inlined;     // calls replaced by the body of the routine
+    size_t laid_out;    // segments moved and jmps dropped by the profile
+    size_t hoisted;     // loop invariant register loads moved in front of the loop
+    size_t reduced;     // products of a loop counter kept up to date by an add
+    size_t unrolled;    // counted loops unrolled
+    size_t rounds;
+} OptStats;
+
+typedef struct {
+    size_t start;
+    size_t end; // one past the last instruction
+    size_t succ[2];
+    size_t succ_count;
+    bool reachable;
+} OptBlock;
+
+typedef struct {
+    OptBlock *blocks;
+    size_t count;
+    size_t *block_of; // instruction -> block
+    bool *leader;     // instruction starts a block
+} OptCfg;
+
+static inline Instruction opt_opcode(InstructionData *instr) {
+    return generic_opcode(instr->opcode);
+}
+
+// the operand holding the destination of a jump or call
+static inline size_t opt_target_operand(InstructionData *instr) {
+    return opt_opcode(instr) == ICMPJMPIF ? 1 : 0;
+}
+
+// the jump or call destination of instr
+static bool opt_target(Program *program, InstructionData *instr, size_t *target) {
+    size_t index = opt_target_operand(instr);
+    switch (opt_opcode(instr)) {
+        case IJMP:
+        case IJMPIF:
+        case ICALL:
+        case ICMPJMPIF: break;
+        default: return false;
+    }
+    if (instr->argc <= index || instr->args[index].kind != OPERAND_LABEL) return false;
+    if (instr->args[index].as_index >= program->instructions_count) return false;
+    *target = instr->args[index].as_index;
+    return true;
+}
+
+static bool opt_ends_block(Instruction op) {
+    switch (op) {
+        case IJMP:
+        case IJMPIF:
+        case IJMPTABLE:
+        case ICMPJMPIF:
+        case ICALL:
+        case IRET:
+        case IHALT: return true;
+        default: return false;
+    }
+}
+
+static void opt_cfg_free(OptCfg *cfg) {
+    free(cfg->blocks);
+    free(cfg->block_of);
+    free(cfg->leader);
+}
+
+static void opt_reach(OptCfg *cfg, size_t *worklist, size_t *pending, size_t block) {
+    if (cfg->blocks[block].reachable) return;
+    cfg->blocks[block].reachable = true;
+    worklist[(*pending)++] = block;
+}
+
+// marks the blocks reachable from the roots, exports are labels callers outside the program may enter
+static void opt_mark_reachable(Program *program, OptCfg *cfg, const char *const *exports, size_t exports_count) {
+    if (cfg->count == 0) return;
+    // roots: the entry point, the exported labels and every label used as a value, which code may jump to later
+    size_t count = program->instructions_count;
+    for (size_t b = 0; b < cfg->count; b++) cfg->blocks[b].reachable = false;
+    size_t *worklist = malloc(sizeof(size_t) * cfg->count);
+    size_t pending = 0, entry;
+    if (find_label(program, OENTRY, &entry) && entry < count) {
+        opt_reach(cfg, worklist, &pending, cfg->block_of[entry]);
+    } else {
+        opt_reach(cfg, worklist, &pending, 0);
+        for (size_t i = 0; i < program->labels_count; i++) {
+            if (program->labels[i].address < count)
+                opt_reach(cfg, worklist, &pending, cfg->block_of[program->labels[i].address]);
+        }
+    }
+    for (size_t i = 0; i < exports_count; i++) {
+        if (find_label(program, exports[i], &entry) && entry < count)
+            opt_reach(cfg, worklist, &pending, cfg->block_of[entry]);
+    }
+    for (size_t i = 0; i < count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        for (size_t j = 0; j < instr->argc; j++) {
+            if (instr->args[j].kind == OPERAND_LABEL && operand_role(instr->opcode, j) != ROLE_TARGET &&
+                instr->args[j].as_index < count) {
+                opt_reach(cfg, worklist, &pending, cfg->block_of[instr->args[j].as_index]);
+            }
+        }
+    }
+    while (pending > 0) {
+        OptBlock *blk = &cfg->blocks[worklist[--pending]];
+        InstructionData *last = &program->instructions[blk->end - 1];
+        for (size_t s = 0; s < blk->succ_count; s++) opt_reach(cfg, worklist, &pending, blk->succ[s]);
+        // more targets than succ holds
+        if (opt_opcode(last) != IJMPTABLE) continue;
+        for (size_t j = 0; j < last->argc; j++) {
+            if (last->args[j].kind == OPERAND_LABEL && last->args[j].as_index < count)
+                opt_reach(cfg, worklist, &pending, cfg->block_of[last->args[j].as_index]);
+        }
+    }
+    free(worklist);
+}
+
+OptCfg opt_build_cfg(Program *program) {
+    size_t count = program->instructions_count;
+    OptCfg cfg = {0};
+    cfg.leader = jump_targets(program);
+    cfg.block_of = malloc(sizeof(size_t) * (count + 1));
+    if (count == 0) return cfg;
+
+    cfg.leader[0] = true;
+    for (size_t i = 0; i + 1 < count; i++) {
+        if (opt_ends_block(opt_opcode(&program->instructions[i]))) cfg.leader[i + 1] = true;
+    }
+    for (size_t i = 0; i < count; i++) cfg.count += cfg.leader[i];
+    cfg.blocks = calloc(cfg.count, sizeof(OptBlock));
+
+    size_t block = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (cfg.leader[i] && i > 0) block++;
+        if (cfg.leader[i]) cfg.blocks[block].start = i;
+        cfg.blocks[block].end = i + 1;
+        cfg.block_of[i] = block;
+    }
+
+    for (size_t b = 0; b < cfg.count; b++) {
+        OptBlock *blk = &cfg.blocks[b];
+        InstructionData *last = &program->instructions[blk->end - 1];
+        Instruction op = opt_opcode(last);
+        size_t target;
+        if (opt_target(program, last, &target)) blk->succ[blk->succ_count++] = cfg.block_of[target];
+        // a call comes back to the instruction after it
+        if (op != IJMP && op != IJMPTABLE && op != IRET && op != IHALT && blk->end < count) {
+            blk->succ[blk->succ_count++] = cfg.block_of[blk->end];
+        }
+    }
+
+    opt_mark_reachable(program, &cfg, NULL, 0);
+    return cfg;
+}
+
+// ----------------- Rewriting -------------------------
+
+// turns instr into opcode with the given operand texts, decoded like load_xbin would
+static void opt_rewrite(Program *program, InstructionData *instr, Instruction opcode, size_t argc, const char **texts) {
+    VECTOR_FOR_EACH(char *, elem, &instr->operands) {
+        free(*elem);
+    }
+    vector_free(&instr->operands);
+    vector_init(&instr->operands, argc ? argc : 1, sizeof(char *));
+    for (size_t i = 0; i < argc; i++) {
+        char *copy = strdup(texts[i]);
+        vector_push(&instr->operands, &copy);
+    }
+    instr->opcode = opcode;
+    instr->deopt = false;
+    instr->proven = false;
+    decode_instruction(program, instr);
+}
+
+static void opt_set_operand(Program *program, InstructionData *instr, size_t index, const char *text) {
+    char **slot = (char **) vector_get(&instr->operands, index);
+    free(*slot);
+    *slot = strdup(text);
+    instr->args[index] = decode_operand(program, instr->opcode, index, text);
+}
+
+static void opt_push_int(Program *program, InstructionData *instr, int value) {
+    char *text = format("%d", value);
+    opt_rewrite(program, instr, IPUSH, 1, (const char **) &text);
+    free(text);
+}
+
+static void opt_jump(Program *program, InstructionData *instr, size_t target) {
+    char *text = format("%zu", target);
+    opt_rewrite(program, instr, IJMP, 1, (const char **) &text);
+    free(text);
+}
+
+static inline void opt_remove(InstructionData *instr) {
+    instr->opcode = INOP;
+}
+
+// a new instruction with no operands, filled by opt_add_text and decoded by opt_reload
+static InstructionData opt_instruction(Instruction opcode, size_t line) {
+    InstructionData instr = {0};
+    instr.opcode = opcode;
+    instr.line = line;
+    vector_init(&instr.operands, 2, sizeof(char *));
+    return instr;
+}
+
+static void opt_add_text(InstructionData *instr, const char *text) {
+    char *copy = strdup(text);
+    vector_push(&instr->operands, &copy);
+}
+
+// an undecoded copy of instr
+static InstructionData opt_copy(InstructionData *instr) {
+    InstructionData copy = opt_instruction(opt_opcode(instr), instr->line);
+    for (size_t j = 0; j < instr->operands.size; j++) opt_add_text(&copy, operand_text(instr, j));
+    return copy;
+}
+
+// sets a target operand text only, for code that opt_reload decodes afterwards
+static void opt_set_text(InstructionData *instr, size_t index, size_t target) {
+    char **slot = (char **) vector_get(&instr->operands, index);
+    free(*slot);
+    *slot = format("%zu", target);
+}
+
+// points every jump or call destination of copy at new_index of the one in instr,
+// all entries of a jmptable included
+static void opt_relink(InstructionData *copy, InstructionData *instr, const size_t *new_index, size_t count) {
+    for (size_t j = 0; j < instr->argc; j++) {
+        if (operand_role(opt_opcode(instr), j) != ROLE_TARGET || instr->args[j].kind != OPERAND_LABEL ||
+            instr->args[j].as_index >= count) continue;
+        opt_set_text(copy, j, new_index[instr->args[j].as_index]);
+    }
+}
+
+static void opt_free_instruction(InstructionData *instr) {
+    VECTOR_FOR_EACH(char *, elem, &instr->operands) {
+        free(*elem);
+    }
+    vector_free(&instr->operands);
+    free(instr->args);
+}
+
+// decodes a rebuilt instruction array again, like load_xbin does after reading one, false
+// when the result does not verify. verify_program quickened some opcodes, decoding needs
+// the generic ones for the operand roles
+static bool opt_reload(Program *program) {
+    for (size_t i = 0; i < program->instructions_count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        instr->opcode = generic_opcode(instr->opcode);
+    }
+    decode_program(program);
+    fuse_program(program);
+    return verify_program(program);
+}
+
+// ----------------- Constant folding -------------------------
+
+// the int stack form of op, a is the deeper and b the topmost operand like binary_words.
+// False when the interpreter would not push an int (division by zero) or the result overflows.
+static bool opt_eval(Instruction op, int a, int b, int *out) {
+    int64_t r;
+    switch (op) {
+        case IADD: r = (int64_t) a + b; break;
+        case ISUB: r = (int64_t) b - a; break;
+        case IMUL: r = (int64_t) a * b; break;
+        case IDIV:
+            // binary_words also takes INT_MIN for a float zero
+            if (b == 0 || b == INT_MIN) return false;
+            r = (int64_t) a / b;
+            break;
+        case IMOD:
+            if (b == 0) return false;
+            r = (int64_t) a % b;
+            break;
+        case IEQ: r = a == b; break;
+        case INE: r = a != b; break;
+        case ILT: r = a < b; break;
+        case IGT: r = a > b; break;
+        case ILE: r = a <= b; break;
+        case IGE: r = a >= b; break;
+        default: return false;
+    }
+    if (r < INT_MIN || r > INT_MAX) return false;
+    *out = (int) r;
+    return true;
+}
+
+static bool opt_is_int_push(InstructionData *instr) {
+    return opt_opcode(instr) == IPUSH && instr->argc == 1 && instr->args[0].kind == OPERAND_INT;
+}
+
+static bool opt_is_int(Operand *op) {
+    return op->kind == OPERAND_INT;
+}
+
+static size_t opt_fold(Program *program, OptCfg *cfg) {
+    size_t folded = 0;
+    for (size_t i = 0; i < program->instructions_count; i++) {
+        InstructionData *code = &program->instructions[i];
+        Instruction op = opt_opcode(code);
+        bool next = i + 1 < program->instructions_count && !cfg->leader[i + 1];
+        bool next2 = next && i + 2 < program->instructions_count && !cfg->leader[i + 2];
+        int r;
+
+        // pushop <op> a b
+        if (op == IPUSHOP && opt_is_int(&code->args[1]) && opt_is_int(&code->args[2]) &&
+            opt_eval((Instruction) code->args[0].as_int, code->args[1].as_int, code->args[2].as_int, &r)) {
+            opt_push_int(program, code, r);
+            folded++;
+        }
+        // cmpjmpif <cmp> L a b
+        else if (op == ICMPJMPIF && code->argc == 4 && opt_is_int(&code->args[2]) && opt_is_int(&code->args[3]) &&
+                 code->args[1].kind == OPERAND_LABEL &&
+                 opt_eval((Instruction) code->args[0].as_int, code->args[2].as_int, code->args[3].as_int, &r)) {
+            if (r == 1) opt_jump(program, code, code->args[1].as_index);
+            else opt_remove(code);
+            folded++;
+        }
+        // push n, jmpif L
+        else if (next && opt_is_int_push(code) && opt_opcode(&code[1]) == IJMPIF && code[1].argc == 1 &&
+                 code[1].args[0].kind == OPERAND_LABEL) {
+            if (code->args[0].as_int == 1) opt_jump(program, code, code[1].args[0].as_index);
+            else opt_remove(code);
+            opt_remove(&code[1]);
+            folded++;
+        }
+        // push a, push b, <op>
+        else if (next2 && opt_is_int_push(code) && opt_is_int_push(&code[1]) && code[2].argc == 0 &&
+                 opt_eval(opt_opcode(&code[2]), code[0].args[0].as_int, code[1].args[0].as_int, &r)) {
+            opt_push_int(program, code, r);
+            opt_remove(&code[1]);
+            opt_remove(&code[2]);
+            folded++;
+        }
+    }
+    return folded;
+}
+
+// ----------------- Copy propagation -------------------------
+// What every register is known to hold since the start of the block: nothing, a
+// constant operand, or a copy of another register.
+
+typedef enum { OPT_UNKNOWN, OPT_CONSTANT, OPT_COPY } OptFactKind;
+
+typedef struct {
+    OptFactKind kind;
+    size_t from; // instruction whose first operand is the constant, or the copied register
+} OptFact;
+
+// true when instr reads or writes registers only through its own register operands
+static bool opt_register_operands_only(InstructionData *instr) {
+    switch (opt_opcode(instr)) {
+        case INOP:
+        case IPUSH:
+        case IPOP:
+        case IMOV:
+        case IDROP:
+        case IDUP:
+        case ISWAP:
+        case IJMP:
+        case IJMPIF:
+        case ICMPJMPIF:
+        case IPUSHOP:
+        case IGETVAR:
+        case ISETVAR:
+        case IVAR:
+        case IADDVAR:
+        case IPRINT:
+        case IINC:
+        case IDEC: return true;
+        case IADD:
+        case ISUB:
+        case IMUL:
+        case IDIV:
+        case IMOD:
+        case IEQ:
+        case INE:
+        case ILT:
+        case IGT:
+        case ILE:
+        case IGE: return instr->argc == 0;
+        default: return false;
+    }
+}
+
+// the register instr overwrites, REG_COUNT for none
+static size_t opt_written_register(InstructionData *instr) {
+    switch (opt_opcode(instr)) {
+        case IMOV:
+            return instr->argc == 2 && instr->args[1].kind == OPERAND_REGISTER ? (size_t) instr->args[1].as_register : REG_COUNT;
+        case IPOP:
+        case IINC:
+        case IDEC:
+            return instr->argc == 1 && instr->args[0].kind == OPERAND_REGISTER ? (size_t) instr->args[0].as_register : REG_COUNT;
+        default:
+            return REG_COUNT;
+    }
+}
+
+// operands that only read a value and may take a constant instead of a register
+static bool opt_value_operand(InstructionData *instr, size_t index) {
+    switch (opt_opcode(instr)) {
+        case IPUSH:
+        case IMOV: return index == 0;
+        case IPUSHOP: return index >= 1;
+        case ICMPJMPIF: return index >= 2;
+        default: return false;
+    }
+}
+
+static bool opt_constant_operand(Operand *op) {
+    return op->kind == OPERAND_INT || op->kind == OPERAND_FLOAT || op->kind == OPERAND_STRING;
+}
+
+static void opt_forget(OptFact *facts, size_t reg) {
+    facts[reg].kind = OPT_UNKNOWN;
+    for (size_t r = 0; r < REG_COUNT; r++) {
+        if (facts[r].kind == OPT_COPY && facts[r].from == reg) facts[r].kind = OPT_UNKNOWN;
+    }
+}
+
+static size_t opt_propagate(Program *program, OptCfg *cfg) {
+    size_t propagated = 0;
+    OptFact facts[REG_COUNT];
+
+    for (size_t i = 0; i < program->instructions_count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        if (cfg->leader[i]) memset(facts, 0, sizeof(facts));
+
+        if (!opt_register_operands_only(instr)) {
+            memset(facts, 0, sizeof(facts));
+            continue;
+        }
+        for (size_t j = 0; j < instr->argc; j++) {
+            Operand *op = &instr->args[j];
+            if (op->kind != OPERAND_REGISTER || !opt_value_operand(instr, j)) continue;
+            OptFact fact = facts[op->as_register];
+            if (fact.kind == OPT_CONSTANT) {
+                InstructionData *from = &program->instructions[fact.from];
+                char *text = strdup(operand_text(from, 0));
+                opt_set_operand(program, instr, j, text);
+                free(text);
+                propagated++;
+            } else if (fact.kind == OPT_COPY) {
+                opt_set_operand(program, instr, j, register_table[fact.from].name);
+                propagated++;
+            }
+        }
+
+        size_t written = opt_written_register(instr);
+        if (written == REG_COUNT) continue;
+        opt_forget(facts, written);
+        if (opt_opcode(instr) != IMOV) continue;
+        Operand *src = &instr->args[0];
+        if (opt_constant_operand(src)) {
+            facts[written] = (OptFact){.kind = OPT_CONSTANT, .from = i};
+        } else if (src->kind == OPERAND_REGISTER && (size_t) src->as_register != written) {
+            facts[written] = (OptFact){.kind = OPT_COPY, .from = src->as_register};
+        }
+    }
+
+    // setvar x, getvar x -> dup, setvar x: the stored value is still around.
+    // Only for verified programs, dup and setvar act differently on an empty stack.
+    for (size_t i = 0; program->verified && i + 1 < program->instructions_count; i++) {
+        InstructionData *code = &program->instructions[i];
+        if (cfg->leader[i + 1] || opt_opcode(&code[0]) != ISETVAR || opt_opcode(&code[1]) != IGETVAR ||
+            code[0].argc != 1 || code[1].argc != 1 || code[0].args[0].kind != OPERAND_VARIABLE ||
+            code[1].args[0].kind != OPERAND_VARIABLE || code[0].args[0].as_index != code[1].args[0].as_index) {
+            continue;
+        }
+        char *name = strdup(operand_text(&code[0], 0));
+        opt_rewrite(program, &code[0], IDUP, 0, NULL);
+        opt_rewrite(program, &code[1], ISETVAR, 1, (const char **) &name);
+        free(name);
+        propagated++;
+    }
+    return propagated;
+}
+
+// ----------------- Dead stores -------------------------
+
+static bool opt_pure_push(InstructionData *instr) {
+    if (opt_opcode(instr) != IPUSH || instr->argc != 1) return false;
+    switch (instr->args[0].kind) {
+        case OPERAND_INT:
+        case OPERAND_FLOAT:
+        case OPERAND_STRING:
+        case OPERAND_REGISTER:
+        case OPERAND_LABEL: return true;
+        default: return false;
+    }
+}
+
+static size_t opt_dead_stores(Program *program, OptCfg *cfg) {
+    size_t removed = 0;
+
+    // stack values nothing reads: push x, drop / dup, drop / swap, swap
+    for (size_t i = 0; i + 1 < program->instructions_count; i++) {
+        InstructionData *code = &program->instructions[i];
+        if (cfg->leader[i + 1]) continue;
+        Instruction first = opt_opcode(&code[0]), second = opt_opcode(&code[1]);
+        bool dropped = second == IDROP && code[1].argc == 0 &&
+                       (opt_pure_push(&code[0]) || (first == IDUP && code[0].argc == 0));
+        // two swaps on a short stack leave two empty words behind
+        bool swapped = program->verified && first == ISWAP && second == ISWAP;
+        if (!dropped && !swapped) continue;
+        opt_remove(&code[0]);
+        opt_remove(&code[1]);
+        removed++;
+        i++;
+    }
+
+    // register writes overwritten before any read, every register is live at the end of a block
+    for (size_t b = 0; b < cfg->count; b++) {
+        OptBlock *blk = &cfg->blocks[b];
+        bool live[REG_COUNT];
+        for (size_t r = 0; r < REG_COUNT; r++) live[r] = true;
+
+        for (size_t i = blk->end; i-- > blk->start;) {
+            InstructionData *instr = &program->instructions[i];
+            if (instr->opcode == INOP) continue;
+            if (!opt_register_operands_only(instr)) {
+                for (size_t r = 0; r < REG_COUNT; r++) live[r] = true;
+                continue;
+            }
+            Instruction op = opt_opcode(instr);
+            size_t written = opt_written_register(instr);
+            if (op == IMOV && written != REG_COUNT && !live[written] &&
+                (opt_constant_operand(&instr->args[0]) || instr->args[0].kind == OPERAND_REGISTER)) {
+                opt_remove(instr);
+                removed++;
+                continue;
+            }
+            // inc and dec read the register they write
+            if (written != REG_COUNT && (op == IMOV || op == IPOP)) live[written] = false;
+            for (size_t j = 0; j < instr->argc; j++) {
+                if (op == IPOP || (op == IMOV && j == 1)) continue;
+                if (instr->args[j].kind == OPERAND_REGISTER) live[instr->args[j].as_register] = true;
+            }
+        }
+    }
+    return removed;
+}
+
+// ----------------- Jump threading -------------------------
+
+// where a jump to target ends up after following jmps
+static size_t opt_final_target(Program *program, size_t target) {
+    for (size_t hops = 0; hops < program->instructions_count; hops++) {
+        InstructionData *at = &program->instructions[target];
+        size_t next;
+        if (opt_opcode(at) != IJMP || !opt_target(program, at, &next) || next == target) break;
+        target = next;
+    }
+    return target;
+}
+
+static size_t opt_thread(Program *program) {
+    size_t threaded = 0;
+    for (size_t i = 0; i < program->instructions_count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        size_t target;
+        if (!opt_target(program, instr, &target)) continue;
+
+        size_t final = opt_final_target(program, target);
+        if (final != target) {
+            char *text = format("%zu", final);
+            opt_set_operand(program, instr, opt_target_operand(instr), text);
+            free(text);
+            threaded++;
+        }
+        if (opt_opcode(instr) == IJMP && final == i + 1) {
+            opt_remove(instr);
+            threaded++;
+        }
+    }
+    return threaded;
+}
+
+// ----------------- Unreachable code -------------------------
+
+static void opt_drop_labels(Program *program, const bool *dead) {
+    size_t kept = 0;
+    for (size_t i = 0; i < program->labels_count; i++) {
+        if (dead[i]) free(program->labels[i].name);
+        else program->labels[kept++] = program->labels[i];
+    }
+    program->labels_count = kept;
+    for (size_t i = 0; i < program->symbols.capacity; i++) program->symbols.entries[i].label = SYMBOL_NONE;
+    for (size_t i = 0; i < program->labels_count; i++) register_label(program, i);
+}
+
+static size_t opt_unreachable(Program *program, OptCfg *cfg, size_t *labels) {
+    size_t removed = 0;
+    for (size_t b = 0; b < cfg->count; b++) {
+        OptBlock *blk = &cfg->blocks[b];
+        if (blk->reachable) continue;
+        for (size_t i = blk->start; i < blk->end; i++) {
+            if (program->instructions[i].opcode != INOP) removed++;
+            opt_remove(&program->instructions[i]);
+        }
+    }
+
+    bool *dead = calloc(program->labels_count + 1, sizeof(bool));
+    for (size_t i = 0; i < program->labels_count; i++) {
+        size_t address = program->labels[i].address;
+        if (address < program->instructions_count && !cfg->blocks[cfg->block_of[address]].reachable &&
+            strcmp(program->labels[i].name, OENTRY) != 0) {
+            dead[i] = true;
+            (*labels)++;
+        }
+    }
+    opt_drop_labels(program, dead);
+    free(dead);
+    return removed;
+}
+
+// ----------------- Inlining -------------------------
+// Copies the bodies of small leaf routines into their callers. A routine qualifies
+// when it reaches its first ret within the budget of the call site, calls nothing,
+// jumps only inside itself and touches no variables or local scopes, whose frames
+// follow the call stack. Jump targets in a copy are renamed to the copy, and a jump
+// to the ret continues after the call site.
+
+// length of the routine at start without its ret, false when it can not be inlined
+static bool opt_inline_body(Program *program, size_t start, size_t budget, size_t *length) {
+    size_t count = program->instructions_count, ret = count;
+    for (size_t i = start; i < count && i - start <= budget; i++) {
+        if (opt_opcode(&program->instructions[i]) == IRET) {
+            ret = i;
+            break;
+        }
+    }
+    if (ret == count) return false;
+
+    for (size_t i = start; i < ret; i++) {
+        InstructionData *instr = &program->instructions[i];
+        Instruction op = opt_opcode(instr);
+        size_t target;
+        if (op == ICALL || op == ITOGGLELOCALSCOPE) return false;
+        for (size_t j = 0; j < instr->argc; j++) {
+            if (instr->args[j].kind == OPERAND_VARIABLE) return false;
+        }
+        if (opt_target(program, instr, &target)) {
+            if (target < start || target > ret) return false;
+        } else if (op == IJMP || op == IJMPIF || op == ICMPJMPIF || op == IJMPTABLE) {
+            return false;
+        }
+    }
+    *length = ret - start;
+    return true;
+}
+
+// false for call arguments a push can not reproduce
+static bool opt_inline_arguments(InstructionData *call) {
+    for (size_t j = 1; j < call->argc; j++) {
+        switch (call->args[j].kind) {
+            case OPERAND_INT:
+            case OPERAND_FLOAT:
+            case OPERAND_STRING:
+            case OPERAND_REGISTER: break;
+            default: return false;
+        }
+    }
+    return true;
+}
+
+// Inlines every call to a qualifying routine. With a profile, calls that never ran
+// stay calls and hot ones get OPT_INLINE_HOT_BUDGET. The program is decoded, fused
+// and verified again afterwards, so it is ready to run or to be written.
+size_t inline_program(Program *program, const Profile *profile) {
+    program_detach(program);
+    size_t count = program->instructions_count;
+    if (count == 0) return 0;
+    for (size_t i = 0; i < count; i++) {
+        program->instructions[i].opcode = generic_opcode(program->instructions[i].opcode);
+    }
+
+    size_t *new_index = malloc(sizeof(size_t) * (count + 1));
+    size_t *body = malloc(sizeof(size_t) * count);
+    bool *inlined = calloc(count, sizeof(bool));
+    size_t kept = 0, sites = 0;
+    for (size_t i = 0; i < count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        size_t target, grown = 1, budget = OPT_INLINE_BUDGET;
+        new_index[i] = kept;
+        if (profile && profile->count == count) {
+            if (profile->counts[i] == 0) budget = 0;
+            else if (profile_hot(profile, i)) budget = OPT_INLINE_HOT_BUDGET;
+        }
+        if (opt_opcode(instr) == ICALL && budget > 0 && opt_target(program, instr, &target) &&
+            opt_inline_arguments(instr) && opt_inline_body(program, target, budget, &body[i])) {
+            grown = instr->argc - 1 + body[i];
+            if (kept + grown + (count - i - 1) <= count * OPT_INLINE_GROWTH) {
+                inlined[i] = true;
+                sites++;
+            } else {
+                grown = 1;
+            }
+        }
+        kept += grown;
+    }
+    new_index[count] = kept;
+
+    if (sites == 0) {
+        free(inlined);
+        free(body);
+        free(new_index);
+        return 0;
+    }
+
+    InstructionData *code = malloc(sizeof(InstructionData) * (kept ? kept : 1));
+    for (size_t i = 0; i < count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        size_t at = new_index[i];
+        if (!inlined[i]) {
+            code[at] = *instr;
+            opt_relink(&code[at], instr, new_index, count);
+            continue;
+        }
+
+        // call f a b pushes b, then a, like ICALL
+        for (size_t j = instr->argc; j > 1; j--) {
+            code[at] = opt_instruction(IPUSH, instr->line);
+            opt_add_text(&code[at++], operand_text(instr, j - 1));
+        }
+        size_t start = instr->args[0].as_index, base = at;
+        for (size_t k = 0; k < body[i]; k++) {
+            InstructionData *from = &program->instructions[start + k];
+            code[at] = opt_copy(from);
+            // the copy has no args yet, rename through the original
+            size_t target;
+            if (opt_target(program, from, &target)) {
+                size_t renamed = target == start + body[i] ? new_index[i + 1] : base + target - start;
+                opt_set_text(&code[at], opt_target_operand(from), renamed);
+            }
+            at++;
+        }
+
+        opt_free_instruction(instr);
+    }
+
+    for (size_t i = 0; i < program->labels_count; i++) {
+        size_t address = program->labels[i].address;
+        program->labels[i].address = address < count ? new_index[address] : address - count + kept;
+    }
+
+    free(program->instructions);
+    program->instructions = code;
+    program->instructions_count = kept;
+    program->instructions_capacity = kept ? kept : 1;
+    opt_reload(program);
+
+    free(inlined);
+    free(body);
+    free(new_index);
+    return sites;
+}
+
+// ----------------- Loops -------------------------
+// A loop is the code from a backward jump's target (the header) to the jump (the
+// latch), entered only at the header. Invariant register loads in the header move
+// in front of it. Counted loops, a single block ending in cmpjmpif back to the
+// header on a register stepped once per trip, also get their products of the counter
+// strength-reduced, and are unrolled when the trip count is known.
+
+// the register instr writes inside a loop body, REG_COUNT for none
+static size_t opt_loop_written(InstructionData *instr) {
+    Instruction op = opt_opcode(instr);
+    if ((op == IADD || op == ISUB) && instr->argc == 2 && instr->args[0].kind == OPERAND_REGISTER) {
+        return instr->args[0].as_register;
+    }
+    return opt_written_register(instr);
+}
+
+// true when every register instr touches is one of its operands
+static bool opt_loop_safe(InstructionData *instr) {
+    return opt_register_operands_only(instr) || opt_loop_written(instr) != REG_COUNT;
+}
+
+// the constant instr adds to reg, for inc, dec and add/sub reg <int>
+static bool opt_loop_step(InstructionData *instr, size_t reg, int *step) {
+    Instruction op = opt_opcode(instr);
+    if (instr->argc == 0 || instr->args[0].kind != OPERAND_REGISTER || (size_t) instr->args[0].as_register != reg) {
+        return false;
+    }
+    if (op == IINC || op == IDEC) {
+        *step = op == IINC ? 1 : -1;
+        return instr->argc == 1;
+    }
+    if ((op == IADD || op == ISUB) && instr->argc == 2 && instr->args[1].kind == OPERAND_INT &&
+        instr->args[1].as_int != INT_MIN) {
+        *step = op == IADD ? instr->args[1].as_int : -instr->args[1].as_int;
+        return true;
+    }
+    return false;
+}
+
+static bool opt_reads_register(InstructionData *instr, size_t reg) {
+    for (size_t j = 0; j < instr->argc; j++) {
+        if (instr->args[j].kind == OPERAND_REGISTER && (size_t) instr->args[j].as_register == reg) return true;
+    }
+    return false;
+}
+
+// true when code outside [header, end) enters it at the header only, or only by
+// falling through into it when fallthrough is set
+static bool opt_single_entry(Program *program, size_t header, size_t end, bool fallthrough) {
+    size_t entry;
+    if (find_label(program, OENTRY, &entry) && entry >= header + !fallthrough && entry < end) return false;
+    for (size_t i = 0; i < program->instructions_count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        bool inside = i >= header && i < end;
+        for (size_t j = 0; j < instr->argc; j++) {
+            if (instr->args[j].kind != OPERAND_LABEL) continue;
+            size_t at = instr->args[j].as_index;
+            if (at < header || at >= end) continue;
+            // a label used as a value can be jumped to from anywhere
+            if (operand_role(opt_opcode(instr), j) != ROLE_TARGET) return false;
+            if (!inside && (at > header || fallthrough)) return false;
+        }
+    }
+    return true;
+}
+
+// the mov in the header block of loop [header, end) that can run once before the loop,
+// end for none: its register is written nowhere else in the loop and not read before
+// it in the header, its source is a constant or a register the loop leaves alone
+static size_t opt_invariant_mov(Program *program, OptCfg *cfg, size_t header, size_t end) {
+    size_t writes[REG_COUNT] = {0};
+    for (size_t i = header; i < end; i++) {
+        InstructionData *instr = &program->instructions[i];
+        if (!opt_loop_safe(instr)) return end;
+        size_t written = opt_loop_written(instr);
+        if (written != REG_COUNT) writes[written]++;
+    }
+
+    OptBlock *blk = &cfg->blocks[cfg->block_of[header]];
+    for (size_t m = header; m < blk->end; m++) {
+        InstructionData *instr = &program->instructions[m];
+        if (opt_opcode(instr) != IMOV || instr->argc != 2 || instr->args[1].kind != OPERAND_REGISTER) continue;
+        size_t reg = instr->args[1].as_register;
+        Operand *src = &instr->args[0];
+        bool invariant = opt_constant_operand(src) ||
+                         (src->kind == OPERAND_REGISTER && (size_t) src->as_register != reg && writes[src->as_register] == 0);
+        if (!invariant || writes[reg] != 1) continue;
+        bool read = false;
+        for (size_t i = header; i < m && !read; i++) read = opt_reads_register(&program->instructions[i], reg);
+        if (!read) return m;
+    }
+    return end;
+}
+
+static size_t opt_hoist(Program *program, OptCfg *cfg) {
+    size_t count = program->instructions_count, hoisted = 0;
+    // the last backward jump to a header closes its loop
+    size_t *latch = malloc(sizeof(size_t) * (count + 1));
+    for (size_t i = 0; i < count; i++) latch[i] = count;
+    for (size_t i = 0; i < count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        size_t target;
+        if (opt_opcode(instr) != ICALL && opt_target(program, instr, &target) && target <= i) latch[target] = i;
+    }
+
+    for (size_t header = 0; header < count; header++) {
+        size_t end = latch[header] + 1;
+        if (latch[header] == count || !opt_single_entry(program, header, end, false)) continue;
+        size_t m = opt_invariant_mov(program, cfg, header, end);
+        if (m == end) continue;
+
+        // the mov becomes the first instruction, jumps from inside the loop go past it
+        InstructionData mov = program->instructions[m];
+        memmove(&program->instructions[header + 1], &program->instructions[header], sizeof(InstructionData) * (m - header));
+        program->instructions[header] = mov;
+        for (size_t i = header + 1; i < end; i++) {
+            InstructionData *instr = &program->instructions[i];
+            size_t target;
+            if (opt_target(program, instr, &target) && target == header) {
+                char *text = format("%zu", header + 1);
+                opt_set_operand(program, instr, opt_target_operand(instr), text);
+                free(text);
+            }
+        }
+        hoisted++;
+        header++;
+        opt_cfg_free(cfg);
+        *cfg = opt_build_cfg(program);
+    }
+    free(latch);
+    return hoisted;
+}
+
+typedef struct {
+    size_t header;
+    size_t latch;   // cmpjmpif <cmp> header a b
+    size_t counter; // the induction register, one of a and b
+    size_t update;  // the instruction stepping it
+    int init;
+    int step;
+    size_t trips;   // times the body runs
+} OptCountedLoop;
+
+// the int the counter holds when falling into header, from a mov on the straight
+// line of code before it that nothing jumps into
+static bool opt_entry_value(Program *program, size_t header, size_t reg, int *value) {
+    size_t entry = SIZE_MAX;
+    find_label(program, OENTRY, &entry);
+    bool *jumped = calloc(program->instructions_count + 1, sizeof(bool));
+    for (size_t i = 0; i < program->instructions_count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        for (size_t j = 0; j < instr->argc; j++) {
+            if (instr->args[j].kind == OPERAND_LABEL && instr->args[j].as_index < program->instructions_count) {
+                jumped[instr->args[j].as_index] = true;
+            }
+        }
+    }
+
+    bool found = false;
+    for (size_t i = header; i-- > 0;) {
+        InstructionData *instr = &program->instructions[i];
+        Instruction op = opt_opcode(instr);
+        if (op == IJMP || op == IJMPTABLE || op == IRET || op == IHALT || !opt_loop_safe(instr)) break;
+        if (opt_loop_written(instr) == reg) {
+            found = op == IMOV && instr->args[0].kind == OPERAND_INT;
+            if (found) *value = instr->args[0].as_int;
+            break;
+        }
+        if (jumped[i] || i == entry) break;
+    }
+    free(jumped);
+    return found;
+}
+
+// runs the counter like the loop would, false when it takes too long or overflows
+static bool opt_trip_count(OptCountedLoop *loop, InstructionData *latch, size_t side) {
+    Instruction cmp = (Instruction) latch->args[0].as_int;
+    int bound = latch->args[side == 2 ? 3 : 2].as_int;
+    int64_t value = loop->init;
+    for (size_t trip = 1; trip <= OPT_TRIP_SCAN; trip++) {
+        value += loop->step;
+        if (value < INT_MIN || value > INT_MAX) return false;
+        int taken;
+        if (!opt_eval(cmp, side == 2 ? (int) value : bound, side == 2 ? bound : (int) value, &taken)) return false;
+        if (taken != 1) {
+            loop->trips = trip;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool opt_counted_loop(Program *program, OptBlock *blk, OptCountedLoop *loop) {
+    size_t latch = blk->end - 1, target;
+    InstructionData *cond = &program->instructions[latch];
+    if (opt_opcode(cond) != ICMPJMPIF || cond->argc != 4 || !opt_target(program, cond, &target) || target != blk->start) {
+        return false;
+    }
+    Instruction cmp = (Instruction) cond->args[0].as_int;
+    if (cmp < IEQ || cmp > IGE) return false;
+
+    size_t side;
+    if (cond->args[2].kind == OPERAND_REGISTER && cond->args[3].kind == OPERAND_INT) side = 2;
+    else if (cond->args[3].kind == OPERAND_REGISTER && cond->args[2].kind == OPERAND_INT) side = 3;
+    else return false;
+
+    *loop = (OptCountedLoop){.header = blk->start, .latch = latch, .counter = cond->args[side].as_register, .update = latch};
+    for (size_t i = blk->start; i < latch; i++) {
+        InstructionData *instr = &program->instructions[i];
+        if (!opt_loop_safe(instr) || opt_loop_written(instr) != loop->counter) continue;
+        if (loop->update != latch || !opt_loop_step(instr, loop->counter, &loop->step)) return false;
+        loop->update = i;
+    }
+    for (size_t i = blk->start; i < latch; i++) {
+        if (!opt_loop_safe(&program->instructions[i])) return false;
+    }
+    return loop->update != latch && opt_single_entry(program, blk->start, blk->end, true) &&
+           opt_entry_value(program, blk->start, loop->counter, &loop->init) &&
+           opt_trip_count(loop, cond, side);
+}
+
+// pushop mul <counter> <k>, pop <t> after the update: t stays counter * k when
+// add t <step * k> follows the update, set up by a mov before the loop. Returns
+// the pushop, the latch for none.
+static size_t opt_reduced_product(Program *program, OptCountedLoop *loop, int *factor) {
+    for (size_t p = loop->update + 1; p + 1 < loop->latch; p++) {
+        InstructionData *mul = &program->instructions[p], *pop = &program->instructions[p + 1];
+        if (opt_opcode(mul) != IPUSHOP || (Instruction) mul->args[0].as_int != IMUL ||
+            opt_opcode(pop) != IPOP || pop->args[0].kind != OPERAND_REGISTER) {
+            continue;
+        }
+        size_t side;
+        if (mul->args[1].kind == OPERAND_REGISTER && mul->args[2].kind == OPERAND_INT) side = 1;
+        else if (mul->args[2].kind == OPERAND_REGISTER && mul->args[1].kind == OPERAND_INT) side = 2;
+        else continue;
+        size_t product = pop->args[0].as_register;
+        if ((size_t) mul->args[side].as_register != loop->counter || product == loop->counter) continue;
+
+        int k = mul->args[side == 1 ? 2 : 1].as_int, first, step;
+        if (!opt_eval(IMUL, loop->init, k, &first) || !opt_eval(IMUL, loop->step, k, &step)) continue;
+        // reads before the product was taken would see the new value early
+        bool used = false;
+        for (size_t i = loop->header; i < loop->latch && !used; i++) {
+            InstructionData *instr = &program->instructions[i];
+            if (i < p) used = opt_reads_register(instr, product);
+            else if (i > p + 1) used = opt_loop_written(instr) == product;
+        }
+        if (used) continue;
+        *factor = k;
+        return p;
+    }
+    return loop->latch;
+}
+
+// replaces instructions[at, at + removed) by inserted ones. Jumps and labels into the
+// replaced range move to its start, the ones behind it move along.
+static bool opt_splice(Program *program, size_t at, size_t removed, InstructionData *insert, size_t inserted) {
+    size_t count = program->instructions_count, total = count - removed + inserted;
+    for (size_t i = 0; i < count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        size_t target;
+        if (i >= at && i < at + removed) {
+            opt_free_instruction(instr);
+        } else if (opt_target(program, instr, &target) && target > at) {
+            opt_set_text(instr, opt_target_operand(instr), target >= at + removed ? target - removed + inserted : at);
+        }
+    }
+    for (size_t i = 0; i < program->labels_count; i++) {
+        size_t address = program->labels[i].address;
+        if (address >= at + removed) program->labels[i].address = address - removed + inserted;
+        else if (address > at) program->labels[i].address = at;
+    }
+
+    InstructionData *code = malloc(sizeof(InstructionData) * (total ? total : 1));
+    memcpy(code, program->instructions, sizeof(InstructionData) * at);
+    memcpy(code + at, insert, sizeof(InstructionData) * inserted);
+    memcpy(code + at + inserted, program->instructions + at + removed, sizeof(InstructionData) * (count - at - removed));
+    free(program->instructions);
+    program->instructions = code;
+    program->instructions_count = total;
+    program->instructions_capacity = total ? total : 1;
+    return opt_reload(program);
+}
+
+// rewrites one counted loop and sets *next to where the code behind it starts now,
+// false when the rewritten program does not verify
+static bool opt_rewrite_loop(Program *program, OptCountedLoop *loop, OptStats *stats, size_t *next) {
+    int factor = 0;
+    size_t product = opt_reduced_product(program, loop, &factor);
+    bool reduced = product != loop->latch;
+    size_t length = loop->latch - loop->header - (reduced ? 1 : 0);
+
+    // full unrolling drops the latch, partial unrolling tests the counter once per copies
+    size_t copies = 1;
+    bool keep_latch = true;
+    if (loop->trips * length <= OPT_UNROLL_BUDGET) {
+        copies = loop->trips;
+        keep_latch = false;
+    } else {
+        for (size_t k = OPT_UNROLL_FACTOR; k > 1; k /= 2) {
+            if (loop->trips % k == 0 && k * length + 1 <= OPT_UNROLL_BUDGET) {
+                copies = k;
+                break;
+            }
+        }
+    }
+    if (!reduced && copies == 1 && keep_latch) {
+        *next = loop->latch + 1;
+        return true;
+    }
+
+    InstructionData *code = malloc(sizeof(InstructionData) * (copies * length + 2));
+    size_t at = 0;
+    const char *reg = NULL;
+    char *step = NULL;
+    if (reduced) {
+        reg = operand_text(&program->instructions[product + 1], 0);
+        step = format("%d", loop->step * factor);
+        char *first = format("%d", loop->init * factor);
+        code[at] = opt_instruction(IMOV, program->instructions[loop->header].line);
+        opt_add_text(&code[at], first);
+        opt_add_text(&code[at++], reg);
+        free(first);
+    }
+
+    size_t body = at;
+    for (size_t c = 0; c < copies; c++) {
+        for (size_t i = loop->header; i < loop->latch; i++) {
+            if (reduced && (i == product || i == product + 1)) continue;
+            code[at++] = opt_copy(&program->instructions[i]);
+            if (reduced && i == loop->update) {
+                code[at] = opt_instruction(IADD, program->instructions[i].line);
+                opt_add_text(&code[at], reg);
+                opt_add_text(&code[at++], step);
+            }
+        }
+    }
+    if (keep_latch) {
+        code[at] = opt_copy(&program->instructions[loop->latch]);
+        opt_set_text(&code[at++], 1, loop->header + body);
+    }
+    free(step);
+
+    if (reduced) stats->reduced++;
+    if (copies > 1 || !keep_latch) stats->unrolled++;
+    bool ok = opt_splice(program, loop->header, loop->latch + 1 - loop->header, code, at);
+    free(code);
+    *next = loop->header + at;
+    return ok;
+}
+
+// every counted loop once, in program order, false when a rewrite broke the program
+static bool opt_loops(Program *program, OptStats *stats) {
+    for (size_t next = 0;;) {
+        OptCfg cfg = opt_build_cfg(program);
+        OptCountedLoop loop;
+        bool found = false;
+        for (size_t b = 0; b < cfg.count && !found; b++) {
+            found = cfg.blocks[b].start >= next && cfg.blocks[b].reachable &&
+                    opt_counted_loop(program, &cfg.blocks[b], &loop);
+        }
+        opt_cfg_free(&cfg);
+        if (!found) return true;
+        if (!opt_rewrite_loop(program, &loop, stats, &next)) return false;
+    }
+}
+
+// ----------------- Layout -------------------------
+// Reorders code by a profile. Segments are runs of code that end in jmp, ret or
+// halt, so nothing falls from one into the next and they can go anywhere. The
+// first segment stays first, a segment a hot jmp leads to follows the jmp, which
+// is dropped, and segments that never ran go behind all the others. A last segment
+// that falls off the end of the program stays last.
+
+static bool opt_ends_segment(Instruction op) {
+    return op == IJMP || op == IJMPTABLE || op == IRET || op == IHALT;
+}
+
+// moves segments so hot code is contiguous, returns how many moved. Profile counts
+// move along with their instructions.
+size_t layout_program(Program *program, Profile *profile) {
+    program_detach(program);
+    size_t count = program->instructions_count;
+    if (count == 0 || profile->count != count) return 0;
+    for (size_t i = 0; i < count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        Instruction op = opt_opcode(instr);
+        size_t target;
+        instr->opcode = op;
+        // a jump the program computes may go anywhere
+        if ((op == IJMP || op == IJMPIF || op == ICMPJMPIF || op == ICALL) && !opt_target(program, instr, &target)) return 0;
+    }
+
+    size_t *start = malloc(sizeof(size_t) * (count + 1)), segments = 0;
+    size_t *segment_of = malloc(sizeof(size_t) * count);
+    for (size_t i = 0; i < count; i++) {
+        if (i == 0 || opt_ends_segment(opt_opcode(&program->instructions[i - 1]))) start[segments++] = i;
+        segment_of[i] = segments - 1;
+    }
+    start[segments] = count;
+    bool pinned = !opt_ends_segment(opt_opcode(&program->instructions[count - 1]));
+
+    bool *ran = calloc(segments, sizeof(bool));
+    for (size_t i = 0; i < count; i++) {
+        if (profile->counts[i] > 0) ran[segment_of[i]] = true;
+    }
+
+    size_t *order = malloc(sizeof(size_t) * segments), placed = 0, moved = 0;
+    bool *done = calloc(segments, sizeof(bool));
+    bool *dropped = calloc(count, sizeof(bool));
+    for (size_t s = 0;;) {
+        order[placed++] = s;
+        done[s] = true;
+        if (s != placed - 1) moved++;
+        if (placed == segments) break;
+
+        // follow a hot jmp to the start of a segment still to place
+        InstructionData *last = &program->instructions[start[s + 1] - 1];
+        size_t target, next = segments;
+        if (opt_opcode(last) == IJMP && profile_hot(profile, start[s + 1] - 1) && opt_target(program, last, &target) &&
+            start[segment_of[target]] == target && !done[segment_of[target]] &&
+            !(pinned && segment_of[target] == segments - 1)) {
+            next = segment_of[target];
+            dropped[start[s + 1] - 1] = true;
+        }
+        // otherwise the first segment left that ran, then the first that did not
+        for (size_t pass = 0; pass < 2 && next == segments; pass++) {
+            for (size_t t = 0; t < segments && next == segments; t++) {
+                if (!done[t] && ran[t] == (pass == 0) && !(pinned && t == segments - 1)) next = t;
+            }
+        }
+        s = next == segments ? segments - 1 : next;
+    }
+
+    size_t kept = 0, removed = 0;
+    for (size_t i = 0; i < count; i++) removed += dropped[i];
+    if (moved == 0 && removed == 0) {
+        free(dropped);
+        free(done);
+        free(order);
+        free(ran);
+        free(segment_of);
+        free(start);
+        return 0;
+    }
+
+    // a dropped jmp was the last of its segment, whatever jumped to it goes to the next one
+    size_t *new_index = malloc(sizeof(size_t) * (count + 1));
+    for (size_t o = 0; o < segments; o++) {
+        size_t s = order[o];
+        for (size_t i = start[s]; i < start[s + 1]; i++) {
+            new_index[i] = kept;
+            if (!dropped[i]) kept++;
+        }
+    }
+    new_index[count] = kept;
+
+    InstructionData *code = malloc(sizeof(InstructionData) * kept);
+    uint64_t *counts = calloc(kept + 1, sizeof(uint64_t));
+    uint64_t *taken = calloc(kept + 1, sizeof(uint64_t));
+    for (size_t i = 0; i < count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        if (dropped[i]) {
+            opt_free_instruction(instr);
+            continue;
+        }
+        opt_relink(instr, instr, new_index, count);
+        code[new_index[i]] = *instr;
+        counts[new_index[i]] = profile->counts[i];
+        taken[new_index[i]] = profile->taken[i];
+    }
+    for (size_t i = 0; i < program->labels_count; i++) {
+        size_t address = program->labels[i].address;
+        program->labels[i].address = address < count ? new_index[address] : address - count + kept;
+    }
+
+    free(program->instructions);
+    program->instructions = code;
+    program->instructions_count = kept;
+    program->instructions_capacity = kept;
+    opt_reload(program);
+
+    free(profile->counts);
+    free(profile->taken);
+    profile->counts = counts;
+    profile->taken = taken;
+    profile->count = kept;
+    profile->hash = profile_hash(program);
+
+    free(new_index);
+    free(dropped);
+    free(done);
+    free(order);
+    free(ran);
+    free(segment_of);
+    free(start);
+    return moved + removed;
+}
+
+// ----------------- Pipeline -------------------------
+
+static size_t opt_pass(Program *program, size_t (*pass)(Program *, OptCfg *)) {
+    OptCfg cfg = opt_build_cfg(program);
+    size_t changes = pass(program, &cfg);
+    opt_cfg_free(&cfg);
+    if (changes) link_program(program);
+    return changes;
+}
+
+static size_t opt_thread_pass(Program *program, OptCfg *cfg) {
+    (void) cfg;
+    return opt_thread(program);
+}
+
+// runs every pass until none changes anything
+static void opt_rounds(Program *program, OptStats *stats) {
+    for (size_t i = 0; i < program->instructions_count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        instr->opcode = generic_opcode(instr->opcode);
+    }
+
+    for (size_t round = 0; round < OPT_MAX_ROUNDS; round++) {
+        stats->rounds++;
+        size_t changes = 0, n;
+
+        changes += n = opt_pass(program, opt_fold);
+        stats->folded += n;
+        changes += n = opt_pass(program, opt_propagate);
+        stats->propagated += n;
+        changes += n = opt_pass(program, opt_dead_stores);
+        stats->dead_stores += n;
+        changes += n = opt_pass(program, opt_thread_pass);
+        stats->threaded += n;
+        changes += n = opt_pass(program, opt_hoist);
+        stats->hoisted += n;
+
+        OptCfg cfg = opt_build_cfg(program);
+        n = opt_unreachable(program, &cfg, &stats->labels);
+        opt_cfg_free(&cfg);
+        if (n) link_program(program);
+        changes += n;
+        stats->dead_code += n;
+
+        if (changes == 0) break;
+    }
+}
+
+// lays out and inlines by the profile if there is one, cleans up, then rewrites
+// counted loops and cleans up after them. False when the result does not verify,
+// the program must not be written then
+bool optimize_program(Program *program, Profile *profile, OptStats *stats) {
+    // the passes rewrite instructions, a mapped xbin gets its own copy first
+    program_detach(program);
+    if (profile) stats->laid_out = layout_program(program, profile);
+    stats->inlined = inline_program(program, profile);
+    opt_rounds(program, stats);
+    if (!opt_loops(program, stats)) return false;
+    if (stats->reduced || stats->unrolled) opt_rounds(program, stats);
+    return verify_program(program);
+}
+
+// ----------------- Stripping -------------------------
+
+// drops the code nothing reaches from OENTRY or an exported label and remaps the labels left,
+// returns the instructions removed
+size_t strip_program(Program *program, const char *const *exports, size_t exports_count, size_t *labels) {
+    program_detach(program);
+    OptCfg cfg = opt_build_cfg(program);
+    if (exports_count > 0) opt_mark_reachable(program, &cfg, exports, exports_count);
+    size_t dropped = *labels;
+    size_t removed = opt_unreachable(program, &cfg, labels);
+    opt_cfg_free(&cfg);
+    if (removed || *labels != dropped) link_program(program);
+    return removed;
+}
+
+#endif // OPT_H
@@ -7,6 +7,10 @@
 #include "std.h"
 #include "config.h"
 #include "asm.h"
+#include "jit.h"
+#include "opt.h"
+#include "profile.h"
+#include "rir.h"
 
 #ifdef WIN32 
 #include <windows.h>
@@ -22,6 +26,17 @@ typedef struct {
     bool debug;
     bool notdeletepreprocessed;
     bool only_compile;
+    bool jit;
+    bool regvm;
+    bool inline_calls;
+    bool no_cache;
+    bool lazy;
+    bool strip;
+    const char **exports;
+    size_t exports_count;
+    XbinEncoding encoding;
+    const char *profile_out;
+    const char *profile_in;
     const char* input_file;
 } ProgramOptions;
 
@@ -38,6 +53,17 @@ void print_usage(const char *program_name) {
     printf("  %s--only-compile%s       Only compiles no run\n", COLOR_BLUE, COLOR_RESET);
     printf("  %s--version%s            Display version information\n", COLOR_BLUE, COLOR_RESET);
     printf("  %s--debug%s              Show detailed execution information\n", COLOR_BLUE, COLOR_RESET);
+    printf("  %s--jit%s                Compile hot code to native code (Linux x86-64)\n", COLOR_BLUE, COLOR_RESET);
+    printf("  %s--regvm%s              Run through the register form of the bytecode\n", COLOR_BLUE, COLOR_RESET);
+    printf("  %s--inline%s             Inline small routines at their call sites\n", COLOR_BLUE, COLOR_RESET);
+    printf("  %s--no-cache%s           Always parse the source instead of using ~/.orta/cache\n", COLOR_BLUE, COLOR_RESET);
+    printf("  %s--lazy%s               Decode routines of the bytecode on first use, for short runs\n", COLOR_BLUE, COLOR_RESET);
+    printf("  %s--compact%s            Write the bytecode file with varints instead of fixed records\n", COLOR_BLUE, COLOR_RESET);
+    printf("  %s--compress%s           Compress the sections of the bytecode file\n", COLOR_BLUE, COLOR_RESET);
+    printf("  %s--strip%s              Leave code unreachable from the entry point out of the bytecode file\n", COLOR_BLUE, COLOR_RESET);
+    printf("  %s--export <label>%s     Keep the label and what it reaches when stripping, repeatable\n", COLOR_BLUE, COLOR_RESET);
+    printf("  %s--profile-out <file>%s Record instruction and branch counts while running\n", COLOR_BLUE, COLOR_RESET);
+    printf("  %s--profile-in <file>%s  Lay out and inline the program by a recorded profile\n", COLOR_BLUE, COLOR_RESET);
     
     printf("\n%s%sEXAMPLES:%s\n", COLOR_BOLD, COLOR_MAGENTA, COLOR_RESET);
     printf("  %s example.x           %s# Run source with preprocessing\n", program_name, COLOR_GREEN);
@@ -109,6 +135,45 @@ int install_std() {
     return 0;
 }
 
+// The bytecode of a parsed source is kept in ~/.orta/cache under a hash of the
+// source, everything it includes and the build of the VM, so running the same
+// unchanged script again skips the front end.
+char *cache_path(const char *filename, bool no_preproc) {
+    char version[128];
+    snprintf(version, sizeof(version), "%.1f %s %d %d", _VERSION, GITHASH, XBIN_VERSION, no_preproc);
+    uint64_t hash = preprocess_hash_bytes(14695981039346656037u, version, strlen(version) + 1);
+    if (!preprocess_hash(filename, &hash, 0)) return NULL;
+
+    char path[64];
+    snprintf(path, sizeof(path), "~/.orta/cache/%016llx.xbin", (unsigned long long) hash);
+    return expand_path(path);
+}
+
+// Loads a cache entry, false on a miss with vm left as ortavm_create made it
+bool cache_load(OrtaVM *vm, const char *path, const char *filename, bool lazy) {
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+    if (lazy ? load_xbin_lazy(vm, path) : load_xbin(vm, path)) return true;
+    ortavm_free(vm);
+    *vm = ortavm_create(filename);
+    return false;
+}
+
+// Writes next to the entry and renames it over, so a run that maps the entry
+// meanwhile keeps the file it mapped
+bool cache_store(OrtaVM *vm, const char *path) {
+    ensure_directory("~/.orta/cache/");
+    char temporary[PATH_MAX];
+#ifdef WIN32
+    snprintf(temporary, sizeof(temporary), "%s.%d.tmp", path, _getpid());
+#else
+    snprintf(temporary, sizeof(temporary), "%s.%d.tmp", path, (int) getpid());
+#endif
+    if (create_xbin(vm, temporary) && rename(temporary, path) == 0) return true;
+    remove(temporary);
+    return false;
+}
+
 ProgramOptions parse_arguments(int argc, char **argv) {
     ProgramOptions options = {
         .help = false,
@@ -118,6 +183,17 @@ ProgramOptions parse_arguments(int argc, char **argv) {
         .debug = false,
         .notdeletepreprocessed = false,
         .only_compile = false,
+        .jit = false,
+        .regvm = false,
+        .inline_calls = false,
+        .no_cache = false,
+        .lazy = false,
+        .strip = false,
+        .exports = NULL,
+        .exports_count = 0,
+        .encoding = XBIN_FIXED,
+        .profile_out = NULL,
+        .profile_in = NULL,
         .input_file = NULL
     };
     
@@ -148,6 +224,29 @@ ProgramOptions parse_arguments(int argc, char **argv) {
             options.show_version = true;
         } else if (strcmp(argv[i], "--debug") == 0) {
             options.debug = true;
+        } else if (strcmp(argv[i], "--jit") == 0) {
+            options.jit = true;
+        } else if (strcmp(argv[i], "--regvm") == 0) {
+            options.regvm = true;
+        } else if (strcmp(argv[i], "--inline") == 0) {
+            options.inline_calls = true;
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            options.no_cache = true;
+        } else if (strcmp(argv[i], "--lazy") == 0) {
+            options.lazy = true;
+        } else if (strcmp(argv[i], "--strip") == 0) {
+            options.strip = true;
+        } else if (strcmp(argv[i], "--export") == 0 && i + 1 < argc) {
+            if (!options.exports) options.exports = malloc(sizeof(char *) * argc);
+            options.exports[options.exports_count++] = argv[++i];
+        } else if (strcmp(argv[i], "--compact") == 0) {
+            options.encoding |= XBIN_COMPACT;
+        } else if (strcmp(argv[i], "--compress") == 0) {
+            options.encoding |= XBIN_COMPRESSED;
+        } else if (strcmp(argv[i], "--profile-out") == 0 && i + 1 < argc) {
+            options.profile_out = argv[++i];
+        } else if (strcmp(argv[i], "--profile-in") == 0 && i + 1 < argc) {
+            options.profile_in = argv[++i];
         } else if (argv[i][0] != '-' && options.input_file == NULL) {
             options.input_file = argv[i];
         }
@@ -189,6 +288,11 @@ int main(int argc, char **argv) {
     const char *filename = options.input_file;
     size_t len = strlen(filename);
     bool is_bytecode = false;
+    // everything but the plain interpreter walks the whole program anyway
+    bool lazy = options.lazy && !options.jit && !options.regvm && !options.inline_calls &&
+                !options.profile_in && !options.profile_out;
+    char *cache = NULL;
+    bool cached = false;
     
     if (len > 5 && strcmp(filename + len - 5, ".xbin") == 0) {
         is_bytecode = true;
@@ -196,13 +300,20 @@ int main(int argc, char **argv) {
             print_progress("LOAD", "Loading compiled bytecode");
         }
         
-        if (!load_xbin(&vm, filename)) {
+        if (!(lazy ? load_xbin_lazy(&vm, filename) : load_xbin(&vm, filename))) {
             print_error("Failed to load bytecode file");
             ortavm_free(&vm);
             return EXIT_FAILURE;
         }
     } else if (len > 2 && strcmp(filename + len - 2, ".x") == 0) {
-        if (!options.no_preproc) {
+        cache = options.no_cache ? NULL : cache_path(filename, options.no_preproc);
+        if (cache && cache_load(&vm, cache, filename, lazy)) {
+            cached = true;
+            if (options.debug) {
+                print_progress("CACHE", "Loaded cached bytecode");
+                print_info(cache);
+            }
+        } else if (!options.no_preproc) {
             if (options.debug) {
                 print_progress("PREPROC", "Preprocessing source file");
             }
@@ -248,18 +359,38 @@ int main(int argc, char **argv) {
                 return EXIT_FAILURE;
             }
         }
+        if (cache && !cached && !cache_store(&vm, cache) && options.debug) {
+            print_info("Could not write the bytecode cache");
+        }
     } else {
         print_error("Unsupported file format. Please use .x or .xbin files");
         ortavm_free(&vm);
         return EXIT_FAILURE;
     }
     
+    Profile profile = {0};
+    if (options.profile_in && profile_read(&profile, &vm.program, options.profile_in)) {
+        size_t moved = layout_program(&vm.program, &profile);
+        size_t inlined = inline_program(&vm.program, &profile);
+        if (options.debug) printf("Profile moved %zu segments, inlined %zu calls\n", moved, inlined);
+        profile_free(&profile);
+    } else if (options.inline_calls) {
+        size_t inlined = inline_program(&vm.program, NULL);
+        if (options.debug) printf("Inlined %zu calls\n", inlined);
+    }
+
     if (options.debug) {
         print_progress("EXEC", "Executing program instructions");
     }
     if (!options.only_compile) {
         time_t start = time(NULL);
-        execute_program(&vm);
+        if (options.profile_out) {
+            profile = profile_create(&vm.program);
+            profile_program(&vm, &profile, options.profile_out);
+            profile_free(&profile);
+        } else if (options.jit) jit_execute_program(&vm);
+        else if (options.regvm) rir_execute_program(&vm);
+        else execute_program(&vm);
         time_t end = time(NULL);
     
         printf("EXECUTION COMPLETED IN %ds\n", (int)(end - start));
@@ -276,21 +407,40 @@ int main(int argc, char **argv) {
         char bytecode_filename[256];
         snprintf(bytecode_filename, sizeof(bytecode_filename), "%.*s.xbin", (int)(len - 2), filename);
         
-        if (options.debug) {
-            print_progress("COMPILE", "Creating bytecode file");
-            printf(" %s%s%s\n", COLOR_BLUE, bytecode_filename, COLOR_RESET);
-        }
-        
-        if (create_xbin(&vm, bytecode_filename)) {
+        // on a cache hit only a bytecode file older than the source or in another encoding is written again
+        struct stat source, bytecode;
+        if (cached && !options.strip && stat(filename, &source) == 0 && stat(bytecode_filename, &bytecode) == 0 &&
+            bytecode.st_mtime >= source.st_mtime && xbin_file_encoding(bytecode_filename) == (int) options.encoding) {
+            if (options.debug) print_info("Bytecode file is up to date");
+        } else {
             if (options.debug) {
-                print_success("Bytecode created successfully");
+                print_progress("COMPILE", "Creating bytecode file");
+                printf(" %s%s%s\n", COLOR_BLUE, bytecode_filename, COLOR_RESET);
+            }
+        
+            if (options.strip) {
+                size_t labels = 0, address;
+                for (size_t i = 0; i < options.exports_count; i++) {
+                    if (!find_label(&vm.program, options.exports[i], &address))
+                        fprintf(stderr, "Exported label '%s' not found\n", options.exports[i]);
+                }
+                size_t removed = strip_program(&vm.program, options.exports, options.exports_count, &labels);
+                if (options.debug) printf("Stripped %zu instructions and %zu labels\n", removed, labels);
+            }
+
+            if (create_xbin_encoded(&vm, bytecode_filename, options.encoding)) {
+                if (options.debug) {
+                    print_success("Bytecode created successfully");
+                }
+            } else {
+                print_error("Failed to create bytecode file");
             }
-        } else {
-            print_error("Failed to create bytecode file");
         }
     }
     int exit_code = vm.program.exit_code;
     ortavm_free(&vm);
+    free(options.exports);
+    free(cache);
 
     return exit_code;
 }
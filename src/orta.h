@@ -12,6 +12,7 @@
 #include <limits.h>
 #include <inttypes.h>
 #include <stdarg.h>
+#include <stddef.h>
 
 #ifdef _WIN32
     #include <windows.h>
@@ -39,6 +40,7 @@
     #include <sys/stat.h>
     #include <sys/types.h>
     #include <sys/wait.h>
+    #include <sys/mman.h>
     #define PLATFORM "unix"
 #endif
 
@@ -46,14 +48,12 @@
 #include "libs/str.h"
 #include "libs/loadfn.h"
 #include "libs/xthread.h"
+#include "libs/xlz.h"
+#include "xpu.h"
 
-#define ODEFAULT_STACK_SIZE 16384
 #define ODEFAULT_ENTRY "__entry"
 #define MEMORY_CAPACITY 8192
 #define MAX_LINE_LENGTH 1024
-#define OLOG_PREFIX "[OVM] "
-
-#define OERROR(stream, fmt, ...) fprintf(stream, OLOG_PREFIX fmt, ##__VA_ARGS__)
 
 // ----------------- Preproc Config -------------------------
 #define MAX_INCLUDE_DEPTH 16
@@ -64,179 +64,8 @@
 #define MAX_ARG_LEN 256
 #define MAX_INCLUDE_PATHS 16
 
-static size_t OSTACK_SIZE = ODEFAULT_STACK_SIZE;
 static char *OENTRY = ODEFAULT_ENTRY;
 
-typedef enum {
-    WINT,
-    WFLOAT,
-    WCHARP,
-    W_CHAR,
-    WPOINTER,
-    WBOOL,
-} WordType;
-
-typedef struct {
-    WordType type;
-    union {
-        int as_int;
-        float as_float;
-        char as_char;
-        char *as_string;
-        void *as_pointer;
-        int as_bool;
-    };
-} Word;
-
-typedef struct {
-    Word reg_value;
-    size_t reg_size;
-} XRegister;
-
-typedef enum {
-    REG_RAX,
-    REG_RBX,
-    REG_RCX,
-    REG_RDX,
-    REG_RSI,
-    REG_RDI,
-    REG_R8,
-    REG_R9,
-    REG_R10,
-    REG_R11,
-    REG_R12,
-    REG_R13,
-    REG_R14,
-    REG_R15,
-    REG_FR,
-    REG_COUNT,
-} XRegisters;
-
-typedef enum {
-    REGSIZE_8BIT = 1,
-    REGSIZE_16BIT,
-    REGSIZE_32BIT = 4,
-    REGSIZE_64BIT = 8,
-} XRegisterSize;
-
-typedef struct {
-    char *name;
-    XRegisters id;
-    XRegisterSize size;
-} XRegisterInfo;
-
-XRegisterInfo register_table[REG_COUNT] = {
-    {"RAX", REG_RAX, REGSIZE_64BIT}, {"RBX", REG_RBX, REGSIZE_64BIT},
-    {"RCX", REG_RCX, REGSIZE_64BIT}, {"RDX", REG_RDX, REGSIZE_64BIT},
-    {"RSI", REG_RSI, REGSIZE_64BIT}, {"RDI", REG_RDI, REGSIZE_64BIT},
-    {"R8", REG_R8, REGSIZE_64BIT}, {"R9", REG_R9, REGSIZE_64BIT},
-    {"R10", REG_R10, REGSIZE_64BIT}, {"R11", REG_R11, REGSIZE_64BIT},
-    {"R12", REG_R12, REGSIZE_64BIT}, {"R13", REG_R13, REGSIZE_64BIT},
-    {"R14", REG_R14, REGSIZE_64BIT}, {"R15", REG_R15, REGSIZE_64BIT},
-    {"FR", REG_FR, REGSIZE_64BIT},
-};
-
-int is_register(const char *str) {
-    for (int i = 0; i < REG_COUNT; i++) {
-        if (strcasecmp(str, register_table[i].name) == 0) return 1;
-    }
-    return 0;
-}
-
-XRegisters register_name_to_enum(const char *reg_name) {
-    for (int i = 0; i < REG_COUNT; i++) {
-        if (strcasecmp(reg_name, register_table[i].name) == 0)
-            return register_table[i].id;
-    }
-    return (XRegisters) -1;
-}
-
-typedef struct {
-    Word *stack;
-    size_t count;
-    size_t capacity;
-} XStack;
-
-XStack xstack_create(size_t capacity) {
-    XStack x = {0};
-    x.stack = malloc(sizeof(Word) * capacity);
-    x.capacity = capacity;
-    x.count = 0;
-    return x;
-}
-
-int xstack_push(XStack *stack, Word w) {
-    if (stack->count >= stack->capacity) return 0;
-    stack->stack[stack->count++] = w;
-    return 1;
-}
-
-Word xstack_pop(XStack *stack) {
-    if (stack->count == 0) {
-        Word w = {.type = WPOINTER, .as_pointer = NULL};
-        return w;
-    }
-    return stack->stack[--stack->count];
-}
-
-Word xstack_peek(XStack *stack, size_t offset) {
-    if (offset >= stack->count) {
-        Word w = {.type = WPOINTER, .as_pointer = NULL};
-        return w;
-    }
-    return stack->stack[stack->count - 1 - offset];
-}
-
-int xstack_check(XStack *stack, size_t expected) {
-    if (stack->count >= expected) {
-        return 1;
-    } else {
-        return 0;
-    }
-}
-
-void xstack_free(XStack *stack) {
-    for (size_t i = 0; i < stack->count; i++) {
-        if (stack->stack[i].type == WCHARP) free(stack->stack[i].as_string);
-        else if (stack->stack[i].type == WPOINTER) free(stack->stack[i].as_pointer);
-    }
-    free(stack->stack);
-}
-
-typedef struct {
-    XRegister *registers;
-    XStack stack;
-    size_t ip;
-    XStack call_stack;
-} XPU;
-
-XPU xpu_init() {
-    XPU xpu = {0};
-    xpu.stack = xstack_create(OSTACK_SIZE);
-    xpu.call_stack = xstack_create(1024);
-    xpu.registers = malloc(sizeof(XRegister) * REG_COUNT);
-    xpu.ip = 0;
-
-    for (int i = 0; i < REG_COUNT; i++) {
-        xpu.registers[i].reg_size = register_table[i].size;
-        xpu.registers[i].reg_value.type = WPOINTER;
-        xpu.registers[i].reg_value.as_pointer = NULL;
-    }
-    return xpu;
-}
-
-void xpu_free(XPU *xpu) {
-    for (int i = 0; i < REG_COUNT; i++) {
-        if (xpu->registers[i].reg_value.type == WCHARP)
-            free(xpu->registers[i].reg_value.as_string);
-        else if (xpu->registers[i].reg_value.type == WPOINTER)
-            free(xpu->registers[i].reg_value.as_pointer);
-    }
-    xstack_free(&xpu->stack);
-    xstack_free(&xpu->call_stack);
-    free(xpu->registers);
-}
-
 typedef enum {
     INOP, IPUSH, IMOV, IPOP, IADD, ISUB, IMUL, IDIV, IMOD, IAND, IOR,
     IXOR, INOT, IEQ, INE, ILT, IGT, ILE, IGE, IJMP, IJMPIF, ICALL,
@@ -245,7 +74,22 @@ typedef enum {
     IDEC, IINC, IEVAL, ICMP, IREADMEM, ICPYMEM, IWRITEMEM,
     IVAR, ISETVAR, IGETVAR, IFREE, ITOGGLELOCALSCOPE,
     IGETGLOBALVAR, ISETGLOBALVAR, IOVM, ICAST, IHERE,
-    ISPRINTF
+    ISPRINTF,
+    // superinstructions, produced by fuse_program
+    ICMPJMPIF, IADDVAR, IPUSHOP,
+    // numbered after the superinstructions so older xbins keep their opcodes
+    IJMPTABLE,
+    // calling convention directives, checked and lowered by link_calls before linking
+    IARITY, IINVOKE,
+    INSTRUCTION_COUNT,
+    // quickened variants, only created at runtime and never written to an xbin
+    IADD_INT, IADD_FLOAT, ISUB_INT, ISUB_FLOAT, IMUL_INT, IMUL_FLOAT,
+    IEQ_INT, IEQ_FLOAT, IEQ_STRING, INE_INT, INE_FLOAT, INE_STRING,
+    ILT_INT, ILT_FLOAT, IGT_INT, IGT_FLOAT, ILE_INT, ILE_FLOAT, IGE_INT, IGE_FLOAT,
+    ICMPJMPIF_INT,
+    // the start of code load_xbin_lazy has not decoded yet
+    ILAZY,
+    OPCODE_COUNT
 } Instruction;
 
 typedef enum {
@@ -292,14 +136,81 @@ static const InstructionInfo instructions[] = {
     {"getglobalvar", IGETGLOBALVAR, {ARG_EXACT, 1, 0}}, {"setglobalvar", ISETGLOBALVAR, {ARG_EXACT, 1, 0}},
     {"nop", INOP, {ARG_EXACT, 0, 0}}, {"ovm", IOVM, {ARG_EXACT, 1, 1}}, {"cast", ICAST, {ARG_EXACT, 1, 1}},
     {"here", IHERE, {ARG_EXACT, 0, 0}}, {"sprintf", ISPRINTF, {ARG_MIN, 0, 0}},
+    {"cmpjmpif", ICMPJMPIF, {ARG_RANGE, 2, 4}}, {"addvar", IADDVAR, {ARG_EXACT, 2, 2}},
+    {"pushop", IPUSHOP, {ARG_EXACT, 3, 3}}, {"jmptable", IJMPTABLE, {ARG_MIN, 1, 1}},
+    {"arity", IARITY, {ARG_EXACT, 1, 1}}, {"invoke", IINVOKE, {ARG_EXACT, 2, 2}},
 };
 
 #define INSTRUCTION_COUNT (sizeof(instructions) / sizeof(instructions[0]))
 
+// ----------------- Quickening -------------------------
+// A generic binary handler rewrites its instruction to the variant for the operand
+// types it just saw. The variant checks the types again and falls back to the generic
+// opcode for good when they differ, so polymorphic sites stay generic.
+
+typedef struct {
+    Instruction generic;
+    WordType type;
+    Instruction quickened;
+} Quickening;
+
+static const Quickening quickenings[] = {
+    {IADD, WINT, IADD_INT}, {IADD, WFLOAT, IADD_FLOAT},
+    {ISUB, WINT, ISUB_INT}, {ISUB, WFLOAT, ISUB_FLOAT},
+    {IMUL, WINT, IMUL_INT}, {IMUL, WFLOAT, IMUL_FLOAT},
+    {IEQ, WINT, IEQ_INT}, {IEQ, WFLOAT, IEQ_FLOAT}, {IEQ, WCHARP, IEQ_STRING},
+    {INE, WINT, INE_INT}, {INE, WFLOAT, INE_FLOAT}, {INE, WCHARP, INE_STRING},
+    {ILT, WINT, ILT_INT}, {ILT, WFLOAT, ILT_FLOAT},
+    {IGT, WINT, IGT_INT}, {IGT, WFLOAT, IGT_FLOAT},
+    {ILE, WINT, ILE_INT}, {ILE, WFLOAT, ILE_FLOAT},
+    {IGE, WINT, IGE_INT}, {IGE, WFLOAT, IGE_FLOAT},
+    {ICMPJMPIF, WINT, ICMPJMPIF_INT},
+};
+
+Instruction generic_opcode(Instruction opcode) {
+    for (size_t i = 0; i < sizeof(quickenings) / sizeof(quickenings[0]); i++) {
+        if (quickenings[i].quickened == opcode) return quickenings[i].generic;
+    }
+    return opcode;
+}
+
+// Operands are decoded once after loading so the interpreter never re-parses operand strings
+typedef enum {
+    OPERAND_NONE,
+    OPERAND_INT,
+    OPERAND_FLOAT,
+    OPERAND_REGISTER,
+    OPERAND_STRING,   // index into Program.strings
+    OPERAND_LABEL,    // resolved instruction address
+    OPERAND_VARIABLE, // variable slot (index into Program.variable_names)
+    OPERAND_TYPE,
+    OPERAND_POINTER,
+    OPERAND_SYMBOL,   // bare word that could not be resolved at load time
+} OperandKind;
+
+typedef struct {
+    OperandKind kind;
+    uint32_t local; // frame cell of an OPERAND_VARIABLE inside its function
+    union {
+        int as_int;
+        float as_float;
+        XRegisters as_register;
+        size_t as_index;
+        WordType as_type;
+        void *as_pointer;
+    };
+} Operand;
+
 typedef struct {
     Instruction opcode;
     Vector operands;
     size_t line;
+    Operand *args;
+    size_t argc;
+    bool deopt;       // a quickened variant failed its type guard, stay generic
+    bool proven;      // verify_program proved the operand types of the quickened opcode
+    int stack_effect; // pushes minus pops, set by verify_program
+    size_t max_stack; // function entries only, deepest the function's own stack gets
 } InstructionData;
 
 typedef struct {
@@ -307,10 +218,105 @@ typedef struct {
     size_t address;
 } Label;
 
+// ----------------- Symbol table -------------------------
+// Interned names shared by labels, variables and string literals. Open addressing
+// with linear probing, the hash is computed once when a name is interned or looked up.
+
+#define SYMTAB_INITIAL_CAPACITY 64
+
 typedef struct {
     char *name;
-    Word value;
-} Variable;
+    uint32_t hash;
+    size_t label;    // index into Program.labels
+    size_t slot;     // variable slot
+    size_t constant; // index into Program.strings of the literal with this text
+} Symbol;
+
+typedef struct {
+    Symbol *entries;
+    size_t capacity; // always a power of two
+    size_t count;
+} SymbolTable;
+
+static uint32_t symbol_hash(const char *name) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *) name; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void symtab_init(SymbolTable *table) {
+    table->entries = NULL;
+    table->capacity = 0;
+    table->count = 0;
+}
+
+void symtab_free(SymbolTable *table) {
+    for (size_t i = 0; i < table->capacity; i++) {
+        free(table->entries[i].name);
+    }
+    free(table->entries);
+    symtab_init(table);
+}
+
+static Symbol *symtab_probe(SymbolTable *table, const char *name, uint32_t hash) {
+    size_t mask = table->capacity - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        Symbol *entry = &table->entries[i];
+        if (entry->name == NULL) return entry;
+        if (entry->hash == hash && strcmp(entry->name, name) == 0) return entry;
+    }
+}
+
+static void symtab_grow(SymbolTable *table) {
+    Symbol *old = table->entries;
+    size_t old_capacity = table->capacity;
+
+    table->capacity = old_capacity ? old_capacity * 2 : SYMTAB_INITIAL_CAPACITY;
+    table->entries = calloc(table->capacity, sizeof(Symbol));
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].name == NULL) continue;
+        *symtab_probe(table, old[i].name, old[i].hash) = old[i];
+    }
+    free(old);
+}
+
+Symbol *symtab_find(SymbolTable *table, const char *name) {
+    if (table->count == 0) return NULL;
+    Symbol *entry = symtab_probe(table, name, symbol_hash(name));
+    return entry->name ? entry : NULL;
+}
+
+Symbol *symtab_intern(SymbolTable *table, const char *name) {
+    // keep the load factor under 3/4 so probing always finds an empty entry
+    if ((table->count + 1) * 4 > table->capacity * 3) symtab_grow(table);
+    uint32_t hash = symbol_hash(name);
+    Symbol *entry = symtab_probe(table, name, hash);
+    if (entry->name == NULL) {
+        entry->name = strdup(name);
+        entry->hash = hash;
+        entry->label = SYMBOL_NONE;
+        entry->slot = SYMBOL_NONE;
+        entry->constant = SYMBOL_NONE;
+        table->count++;
+    }
+    return entry;
+}
+
+// An xbin v2 loaded in place (see Bytecode image). Until program_detach the args,
+// operand vectors and operand texts of every instruction point into it.
+typedef struct {
+    const unsigned char *data; // NULL when the instructions own their operands
+    size_t size;
+    bool mapped;               // munmap data when the program is freed
+    bool allocated;            // free data when the program is freed
+    Operand *args;             // the operands converted, when the file's could not be used in place
+    char **texts;              // operand texts, pointers into the pool of data
+    size_t *segments;          // load_xbin_lazy: sorted starts of the code between labels
+    size_t segments_count;     // 0 once every instruction is decoded
+} ProgramImage;
 
 typedef struct {
     char *filename;
@@ -323,7 +329,13 @@ typedef struct {
     size_t labels_count;
     size_t labels_capacity;
 
+    Vector strings;
+    Vector variable_names;
+    SymbolTable symbols;
+
     Vector variables;
+    ProgramImage image;
+    bool verified; // verify_program proved the stack depths, execute_program runs unchecked
     bool halted;
     int exit_code;
 } Program;
@@ -343,6 +355,9 @@ typedef struct {
     XPU xpu;
     Program program;
     OrtaMeta meta;
+    // EERROR calls it before it frees the vm and exits, for what a run has to save
+    void (*on_error)(void *data);
+    void *on_error_data;
 } OrtaVM;
 
 void program_init(Program *program, const char *filename) {
@@ -353,7 +368,13 @@ void program_init(Program *program, const char *filename) {
     program->labels_capacity = 32;
     program->labels_count = 0;
     program->labels = malloc(sizeof(Label) * program->labels_capacity);
+    vector_init(&program->strings, 8, sizeof(char *));
+    vector_init(&program->variable_names, 8, sizeof(char *));
     vector_init(&program->variables, 5, sizeof(Variable));
+    symtab_init(&program->symbols);
+    program->image = (ProgramImage){0};
+    program->verified = false;
+    program->halted = false;
     program->exit_code = 0;
 }
 
@@ -366,6 +387,12 @@ void add_instruction(Program *program, InstructionData instr) {
     program->instructions[program->instructions_count++] = instr;
 }
 
+// makes labels[index] visible to find_label, the first definition of a name wins
+void register_label(Program *program, size_t index) {
+    Symbol *symbol = symtab_intern(&program->symbols, program->labels[index].name);
+    if (symbol->label == SYMBOL_NONE) symbol->label = index;
+}
+
 void add_label(Program *program, const char *name, size_t address) {
     if (program->labels_count >= program->labels_capacity) {
         program->labels_capacity *= 2;
@@ -374,37 +401,44 @@ void add_label(Program *program, const char *name, size_t address) {
 
     program->labels[program->labels_count].name = strdup(name);
     program->labels[program->labels_count].address = address;
+    register_label(program, program->labels_count);
     program->labels_count++;
-    Vector *nop_operands = malloc(sizeof(Vector));
-    vector_init(nop_operands, 1, sizeof(char *));
-    add_instruction(program, (InstructionData){INOP, nop_operands});
+    // placeholder so the label has an address, link_program strips it again
+    InstructionData nop = {0};
+    nop.opcode = INOP;
+    vector_init(&nop.operands, 1, sizeof(char *));
+    add_instruction(program, nop);
 }
 
 int find_label(Program *program, const char *name, size_t *address) {
-    char *search_name = NULL;
-    search_name = strdup(name);
-
-
-    for (size_t i = 0; i < program->labels_count; i++) {
-        if (strcmp(program->labels[i].name, search_name) == 0) {
-            *address = program->labels[i].address;
-            free(search_name);
-            return 1;
-        }
-    }
+    Symbol *symbol = symtab_find(&program->symbols, name);
+    if (symbol == NULL || symbol->label == SYMBOL_NONE) return 0;
+    *address = program->labels[symbol->label].address;
+    return 1;
+}
 
-    free(search_name);
-    return 0;
+void image_release(ProgramImage *image) {
+#ifndef _WIN32
+    if (image->mapped) munmap((void *) image->data, image->size);
+#endif
+    if (image->allocated) free((void *) image->data);
+    free(image->args);
+    free(image->texts);
+    free(image->segments);
+    *image = (ProgramImage){0};
 }
 
 void program_free(Program *program) {
     free(program->filename);
-    for (size_t i = 0; i < program->instructions_count; i++) {
+    program->filename = NULL;
+    for (size_t i = 0; i < program->instructions_count && !program->image.data; i++) {
         VECTOR_FOR_EACH(char *, elem, &program->instructions[i].operands) {
             free(*elem);
         }
         vector_free(&program->instructions[i].operands);
+        free(program->instructions[i].args);
     }
+    image_release(&program->image);
     free(program->instructions);
     program->instructions = NULL;
     program->instructions_count = 0;
@@ -418,12 +452,22 @@ void program_free(Program *program) {
     program->labels_count = 0;
     program->labels_capacity = 0;
 
+    VECTOR_FOR_EACH(char *, str, &program->strings) {
+        xstring_release(*str);
+    }
+    vector_free(&program->strings);
+    VECTOR_FOR_EACH(char *, name, &program->variable_names) {
+        free(*name);
+    }
+    vector_free(&program->variable_names);
+    symtab_free(&program->symbols);
+
     VECTOR_FOR_EACH(Variable, var, &program->variables) {
-        free(var->name);
-        if (var->value.type == WCHARP) {
-            free(var->value.as_string);
-        } else if (var->value.type == WPOINTER) {
-            free(var->value.as_pointer);
+        Word w = WORD_LOAD(var->value);
+        if (w.type == WCHARP) {
+            xstring_release(w.as_string);
+        } else if (w.type == WPOINTER) {
+            free(w.as_pointer);
         }
     }
     vector_free(&program->variables);
@@ -434,6 +478,8 @@ OrtaVM ortavm_create(const char *filename) {
     vm.xpu = xpu_init();
     program_init(&vm.program, filename);
     vm.meta.flags_count = 0;
+    vm.on_error = NULL;
+    vm.on_error_data = NULL;
     strncpy(vm.meta.magic, "XBIN", 4);
     for (size_t i = 0; i < 4; i++) {
         vm.meta.flags[i] = FLAG_NOTHING;
@@ -490,6 +536,17 @@ ArgRequirement instruction_expected_args(Instruction instruction) {
     return (ArgRequirement){ARG_EXACT, -1, 0};
 }
 
+// instruction_expected_args of every opcode at once, for loaders that check many instructions
+static const ArgRequirement *arg_requirements(void) {
+    static ArgRequirement table[INSTRUCTION_COUNT];
+    static bool ready = false;
+    if (!ready) {
+        for (size_t i = 0; i < INSTRUCTION_COUNT; i++) table[instructions[i].instruction] = instructions[i].args;
+        ready = true;
+    }
+    return table;
+}
+
 int is_pointer(char *str) {
     return str && strlen(str) >= 2 && str[0] == '(' && str[strlen(str) - 1] == ')';
 }
@@ -528,6 +585,7 @@ int is_label_reference(const char *str) {
 }
 
 const char *instruction_to_string(Instruction instruction) {
+    instruction = generic_opcode(instruction);
     for (size_t i = 0; i < (sizeof(instructions) / sizeof(instructions[0])); i++) {
         if (instructions[i].instruction == instruction)
             return instructions[i].name;
@@ -535,6 +593,14 @@ const char *instruction_to_string(Instruction instruction) {
     return "unknown";
 }
 
+Instruction string_to_instruction(const char *name) {
+    for (size_t i = 0; i < (sizeof(instructions) / sizeof(instructions[0])); i++) {
+        if (strcmp(instructions[i].name, name) == 0)
+            return instructions[i].instruction;
+    }
+    return (Instruction) -1;
+}
+
 char *trim_left(const char *str) {
     while (isspace((unsigned char)*str)) str++;
     return strdup(str);
@@ -566,33 +632,32 @@ void microsleep(unsigned long usecs) {
 #endif
 }
 
+// Joins the operands of print, merge and eval with single spaces, string
+// literals without their quotes. Runs once per instruction at load time.
 char *hmerge(InstructionData *instr) {
-    char *string = calloc(1, 256);
+    size_t size = 1;
+    VECTOR_FOR_EACH(char *, elem, &instr->operands) {
+        size += strlen(*(char **) elem) + 1;
+    }
+    char *string = malloc(size);
+    size_t len = 0;
 
     VECTOR_FOR_EACH(char *, elem, &instr->operands) {
         char *rcharp = *(char **) elem;
+        size_t part = strlen(rcharp);
 
         if (is_string(rcharp)) {
-            size_t len = strlen(rcharp);
-            if (len >= 2) {
-                char *temp = malloc(len - 1);
-                strncpy(temp, rcharp + 1, len - 2);
-                temp[len - 2] = '\0';
-                strcat(string, temp);
-                free(temp);
-            }
+            part = part >= 2 ? part - 2 : 0;
+            memcpy(string + len, rcharp + 1, part);
         } else {
-            strcat(string, rcharp);
+            memcpy(string + len, rcharp, part);
         }
-
-        strcat(string, " ");
-    }
-
-    size_t len = strlen(string);
-    if (len > 0 && string[len - 1] == ' ') {
-        string[len - 1] = '\0';
+        len += part;
+        string[len++] = ' ';
     }
 
+    if (len > 0) len--;
+    string[len] = '\0';
     return string;
 }
 
@@ -611,11 +676,12 @@ int eval(char *s) {
     ops[o_idx++] = '+';
 
     while (*p) {
+        if (o_idx == sizeof(ops)) return 0;
         while (isspace(*p)) p++;
         if (isdigit(*p)) {
             int val = 0;
             while (isdigit(*p)) val = val * 10 + (*p++ - '0');
-            char op = ops[--o_idx];
+            char op = o_idx > 0 ? ops[--o_idx] : 0; // a number with no operator before it is dropped
             switch (op) {
                 case '+': values[v_idx - 1] += val;
                     break;
@@ -650,7 +716,7 @@ int eval(char *s) {
             } else if (isdigit(*p)) {
                 while (isdigit(*p)) val = val * 10 + (*p++ - '0');
             }
-            char op = ops[--o_idx];
+            char op = o_idx > 0 ? ops[--o_idx] : 0;
             switch (op) {
                 case '*': values[v_idx - 1] *= val;
                     break;
@@ -673,7 +739,7 @@ int eval(char *s) {
             *p = '\0';
             int val = eval(start);
             *p = temp;
-            char op = ops[--o_idx];
+            char op = o_idx > 0 ? ops[--o_idx] : 0;
             switch (op) {
                 case '+': values[v_idx - 1] += val;
                     break;
@@ -714,72 +780,94 @@ void unsetlocalscope(OrtaVM *vm, Vector *current) {
     *current = vm->program.variables;
 }
 
-Word getvar(OrtaVM *vm, char *var_name, Vector *scope) {
-    Variable *found_var = NULL;
-    Word empty_word = {.type = WPOINTER, .as_pointer = NULL};
+ssize_t find_variable_slot(Program *program, const char *name) {
+    Symbol *symbol = symtab_find(&program->symbols, name);
+    if (symbol == NULL || symbol->slot == SYMBOL_NONE) return -1;
+    return (ssize_t) symbol->slot;
+}
 
-    VECTOR_FOR_EACH(Variable, var, scope) {
-        if (strcmp(var->name, var_name) == 0) {
-            found_var = var;
-            break;
-        }
+size_t intern_variable(Program *program, const char *name) {
+    Symbol *symbol = symtab_intern(&program->symbols, name);
+    if (symbol->slot == SYMBOL_NONE) {
+        char *copy = strdup(name);
+        vector_push(&program->variable_names, &copy);
+        symbol->slot = program->variable_names.size - 1;
     }
+    return symbol->slot;
+}
 
-    if (found_var) {
-        Word value = found_var->value;
-        if (value.type == WCHARP) {
-            value.as_string = strdup(value.as_string);
-        }
-        return value;
-    }
+// scopes are indexed by slot, entries that were never declared hold SYMBOL_NONE
+Variable *find_variable(Vector *scope, size_t slot) {
+    if (slot >= scope->size) return NULL;
+    Variable *var = (Variable *) vector_get(scope, slot);
+    return var->slot == slot ? var : NULL;
+}
 
-    return empty_word;
+Variable *declare_variable(Vector *scope, size_t slot) {
+    Variable empty = {.slot = SYMBOL_NONE};
+    WORD_STORE(empty.value, ((Word){.type = WPOINTER, .as_pointer = NULL}));
+    while (scope->size <= slot) vector_push(scope, &empty);
+    Variable *var = (Variable *) vector_get(scope, slot);
+    var->slot = slot;
+    return var;
 }
 
-bool is_variable(char *var_name, Vector *scope) {
-    bool found_var = false;
+bool is_variable_slot(size_t slot, Vector *scope) {
+    return find_variable(scope, slot) != NULL;
+}
 
-    VECTOR_FOR_EACH(Variable, var, scope) {
-        if (strcmp(var->name, var_name) == 0) {
-            found_var = true;
-            break;
-        }
+Word variable_value(Variable *var) {
+    return word_retain(WORD_LOAD(var->value));
+}
+
+void assign_variable(Variable *target_var, Word new_value) {
+    Word old_value = WORD_LOAD(target_var->value);
+    new_value = word_retain(new_value);
+    if (old_value.type == WCHARP) {
+        xstring_release(old_value.as_string);
+    } else if (old_value.type == WPOINTER && old_value.as_pointer != NULL) {
+        free(old_value.as_pointer);
     }
+    WORD_STORE(target_var->value, new_value);
+}
 
-    return found_var;
+Word getvar_slot(OrtaVM *vm, size_t slot, Vector *scope) {
+    Word empty_word = {.type = WPOINTER, .as_pointer = NULL};
+    Variable *found_var = find_variable(scope, slot);
+    return found_var ? variable_value(found_var) : empty_word;
 }
 
-void setvar(OrtaVM *vm, char *var_name, Vector *scope, Word new_value) {
-    Variable *target_var = NULL;
+void setvar_slot(OrtaVM *vm, size_t slot, Vector *scope, Word new_value) {
+    Variable *target_var = find_variable(scope, slot);
+    if (!target_var) target_var = declare_variable(scope, slot);
+    assign_variable(target_var, new_value);
+}
 
-    VECTOR_FOR_EACH(Variable, var, scope) {
-        if (strcmp(var->name, var_name) == 0) {
-            target_var = var;
-            break;
-        }
-    }
+// variable of op in the current scope, the innermost frame or the globals
+Variable *resolve_variable(OrtaVM *vm, const Operand *op) {
+    if (vm->xpu.frames_count > 0) return frame_lookup(&vm->xpu, op->as_index, op->local);
+    return find_variable(&vm->program.variables, op->as_index);
+}
 
-    if (!target_var) {
-        Variable var;
-        var.name = strdup(var_name);
-        var.value.type = WPOINTER;
-        var.value.as_pointer = NULL;
-        vector_push(scope, &var);
-        target_var = (Variable *) vector_get(scope, scope->size - 1);
-    }
+Variable *bind_variable(OrtaVM *vm, const Operand *op) {
+    if (vm->xpu.frames_count > 0) return frame_bind(&vm->xpu, op->as_index, op->local);
+    Variable *var = find_variable(&vm->program.variables, op->as_index);
+    return var ? var : declare_variable(&vm->program.variables, op->as_index);
+}
 
-    if (target_var->value.type == WCHARP) {
-        free(target_var->value.as_string);
-    } else if (target_var->value.type == WPOINTER && target_var->value.as_pointer != NULL) {
-        free(target_var->value.as_pointer);
-    }
+Word getvar(OrtaVM *vm, char *var_name, Vector *scope) {
+    ssize_t slot = find_variable_slot(&vm->program, var_name);
+    if (slot < 0) return (Word){.type = WPOINTER, .as_pointer = NULL};
+    return getvar_slot(vm, (size_t) slot, scope);
+}
 
-    if (new_value.type == WCHARP) {
-        target_var->value.type = WCHARP;
-        target_var->value.as_string = strdup(new_value.as_string);
-    } else {
-        target_var->value = new_value;
-    }
+bool is_variable(Program *program, char *var_name, Vector *scope) {
+    ssize_t slot = find_variable_slot(program, var_name);
+    return slot >= 0 && is_variable_slot((size_t) slot, scope);
+}
+
+void setvar(OrtaVM *vm, char *var_name, Vector *scope, Word new_value) {
+    setvar_slot(vm, intern_variable(&vm->program, var_name), scope, new_value);
 }
 
 void EERROR(OrtaVM *vm, const char *msg, ...) {
@@ -792,6 +880,7 @@ void EERROR(OrtaVM *vm, const char *msg, ...) {
 
     va_end(vl);
 
+    if (vm->on_error) vm->on_error(vm->on_error_data);
     ortavm_free(vm);
     exit(1);
 }
@@ -810,11 +899,7 @@ Word parseOperand(OrtaVM *vm, const char *operand_c, Vector *scope) {
     if (is_register(operand)) {
         XRegisters reg = register_name_to_enum(operand);
         if (reg != (XRegisters) -1) {
-            w = vm->xpu.registers[reg].reg_value;
-            if (w.type == WCHARP && w.as_string != NULL) {
-                w.as_string = strdup(w.as_string);
-            }
-            return w;
+            return word_retain(vm->xpu.registers[reg].reg_value);
         }
         EERROR(vm, ERROR_BASE"Invalid register: %s\n",
                vm->program.filename, vm->program.instructions[vm->xpu.ip].line, operand);
@@ -835,15 +920,11 @@ Word parseOperand(OrtaVM *vm, const char *operand_c, Vector *scope) {
 
     if (is_string(operand)) {
         w.type = WCHARP;
-        size_t len = strlen(operand) - 2;
-        w.as_string = malloc(len + 1);
+        w.as_string = xstring_new(operand + 1, strlen(operand) - 2);
         if (!w.as_string) {
             EERROR(vm, ERROR_BASE"Failed to allocate memory for string\n",
                    vm->program.filename, vm->program.instructions[vm->xpu.ip].line);
-            return w;
         }
-        strncpy(w.as_string, operand + 1, len);
-        w.as_string[len] = '\0';
         return w;
     }
 
@@ -853,7 +934,7 @@ Word parseOperand(OrtaVM *vm, const char *operand_c, Vector *scope) {
         return w;
     }
 
-    if (is_variable((char *) operand, scope)) {
+    if (is_variable(&vm->program, (char *) operand, scope)) {
         w = getvar(vm, (char *) operand, scope);
         if (w.type == WPOINTER && w.as_pointer == NULL) {
             EERROR(vm, ERROR_BASE"Variable not found: %s\n",
@@ -880,166 +961,1476 @@ Word parseOperand(OrtaVM *vm, const char *operand_c, Vector *scope) {
     return w;
 }
 
+// ----------------- Operand decoding -------------------------
+
+typedef enum {
+    ROLE_VALUE,     // literal, register, variable or label address
+    ROLE_TARGET,    // jump/call destination
+    ROLE_VARIABLE,  // variable name
+    ROLE_COUNTER,   // register or variable name (inc/dec)
+    ROLE_SIZE,      // type name or value (alloc)
+    ROLE_TYPE,      // type name
+    ROLE_IMMEDIATE, // integer read with atoi
+    ROLE_TEXT,      // raw text consumed by hmerge or keyword lookups
+    ROLE_OPCODE,    // instruction name (superinstructions)
+} OperandRole;
+
+static OperandRole operand_role(Instruction opcode, size_t index) {
+    switch (opcode) {
+        case IJMP:
+        case IJMPIF:
+        case IJMPTABLE: return ROLE_TARGET;
+        case ICALL: return index == 0 ? ROLE_TARGET : ROLE_VALUE;
+        case IINVOKE: return index == 0 ? ROLE_TARGET : ROLE_IMMEDIATE;
+        case IARITY: return ROLE_IMMEDIATE;
+        case IVAR:
+        case ISETVAR:
+        case IGETVAR:
+        case ISETGLOBALVAR:
+        case IGETGLOBALVAR: return ROLE_VARIABLE;
+        case IINC:
+        case IDEC: return ROLE_COUNTER;
+        case IALLOC: return index == 0 ? ROLE_SIZE : ROLE_VALUE;
+        case ISIZEOF:
+        case ICAST: return ROLE_TYPE;
+        case IREADMEM:
+        case IWRITEMEM: return index == 2 ? ROLE_TYPE : ROLE_VALUE;
+        case IHALT:
+        case IROTL:
+        case IROTR: return ROLE_IMMEDIATE;
+        case IPRINT:
+        case IMERGE:
+        case IEVAL:
+        case IOVM: return ROLE_TEXT;
+        case ICMPJMPIF: return index == 0 ? ROLE_OPCODE : index == 1 ? ROLE_TARGET : ROLE_VALUE;
+        case IPUSHOP: return index == 0 ? ROLE_OPCODE : ROLE_VALUE;
+        case IADDVAR: return index == 0 ? ROLE_VARIABLE : ROLE_IMMEDIATE;
+        default: return ROLE_VALUE;
+    }
+}
 
-Vector *current_scope = NULL;
+char *program_string(Program *program, size_t index) {
+    return vector_get_str(&program->strings, index);
+}
 
-const char *word_type_to_string(WordType wt) {
-    switch (wt) {
-        case WINT: return "INT";
-        case W_CHAR: return "CHAR";
-        case WPOINTER: return "POINTER";
-        case WCHARP: return "CHARP";
-        case WFLOAT: return "FLOAT";
-        case WBOOL: return "BOOL";
+// interns a literal into the constant pool, equal literals share one entry
+size_t add_string_constant(Program *program, const char *str, size_t len) {
+    char *constant = xstring_new(str, len);
+    Symbol *symbol = symtab_intern(&program->symbols, constant);
+    if (symbol->constant != SYMBOL_NONE) {
+        xstring_release(constant);
+        return symbol->constant;
     }
-    return "ERROR";
+    vector_push(&program->strings, &constant);
+    symbol->constant = program->strings.size - 1;
+    return symbol->constant;
 }
 
-Word xstack_pop_and_expect(OrtaVM *vm, WordType expected) {
-    Word result = xstack_pop(&vm->xpu.stack);
-    if (result.type == expected) {
-        return result;
-    } else {
-        EERROR(vm, ERROR_BASE"expected '%s' got '%s'\n",
-               vm->program.filename, vm->program.instructions[vm->xpu.ip].line, word_type_to_string(expected),
-               word_type_to_string(result.type));
+const char *operand_text(InstructionData *instr, size_t index) {
+    if (index < instr->operands.size) return vector_get_str(&instr->operands, index);
+    return "?";
+}
+
+static Operand decode_literal(Program *program, const char *text) {
+    Operand op = {.kind = OPERAND_NONE};
+    if (is_register(text)) {
+        op.kind = OPERAND_REGISTER;
+        op.as_register = register_name_to_enum(text);
+    } else if (is_number(text)) {
+        op.kind = OPERAND_INT;
+        op.as_int = atoi(text);
+    } else if (is_float(text)) {
+        op.kind = OPERAND_FLOAT;
+        op.as_float = atof(text);
+    } else if (is_string(text)) {
+        op.kind = OPERAND_STRING;
+        op.as_index = add_string_constant(program, text + 1, strlen(text) - 2);
+    } else if (is_pointer((char *) text)) {
+        char *copy = strdup(text);
+        op.kind = OPERAND_POINTER;
+        op.as_pointer = get_pointer(copy);
+        free(copy);
     }
+    return op;
 }
 
+Operand decode_operand(Program *program, Instruction opcode, size_t index, const char *text) {
+    OperandRole role = operand_role(opcode, index);
+    Operand op = {.kind = OPERAND_NONE};
+    size_t address;
 
-void call_dynlib_function(const char *lib_path, const char *func_name, OrtaVM *vm) {
-    LibHandle handle = LOAD_LIBRARY(lib_path);
-    if (!handle) {
-#ifdef WIN32
-        fprintf(stderr, "Failed to load library %s: Error code %lu\n", lib_path, GetLastError());
-#else
-        fprintf(stderr, "Failed to load library %s: %s\n", lib_path, dlerror());
-#endif
-        return;
+    switch (role) {
+        case ROLE_VARIABLE:
+            op.kind = OPERAND_VARIABLE;
+            op.as_index = intern_variable(program, text);
+            return op;
+        case ROLE_TYPE:
+            op.kind = OPERAND_TYPE;
+            op.as_type = get_type(text);
+            return op;
+        case ROLE_IMMEDIATE:
+            op.kind = OPERAND_INT;
+            op.as_int = atoi(text);
+            return op;
+        case ROLE_TEXT:
+            op.kind = OPERAND_SYMBOL;
+            return op;
+        case ROLE_OPCODE:
+            op.kind = OPERAND_INT;
+            op.as_int = string_to_instruction(text);
+            return op;
+        case ROLE_COUNTER:
+            if (is_register(text)) return decode_literal(program, text);
+            op.kind = OPERAND_VARIABLE;
+            op.as_index = intern_variable(program, text);
+            return op;
+        case ROLE_TARGET:
+            if (is_number(text)) {
+                op.kind = OPERAND_LABEL;
+                op.as_index = (size_t) atoi(text);
+            } else if (is_label_reference(text) && find_label(program, text, &address)) {
+                op.kind = OPERAND_LABEL;
+                op.as_index = address;
+            } else {
+                op.kind = OPERAND_SYMBOL;
+            }
+            return op;
+        case ROLE_SIZE:
+            if (is_type_name(text)) {
+                op.kind = OPERAND_TYPE;
+                op.as_type = get_type(text);
+                return op;
+            }
+        // fallthrough
+        case ROLE_VALUE:
+            op = decode_literal(program, text);
+            if (op.kind != OPERAND_NONE) return op;
+            if (find_variable_slot(program, text) < 0 && find_label(program, text, &address)) {
+                op.kind = OPERAND_LABEL;
+                op.as_index = address;
+            } else {
+                op.kind = OPERAND_VARIABLE;
+                op.as_index = intern_variable(program, text);
+            }
+            return op;
     }
+    return op;
+}
 
-    typedef void (*func_t)(OrtaVM *);
-    func_t function = (func_t) GET_PROC_ADDRESS(handle, func_name);
-    if (!function) {
-#ifdef WIN32
-        fprintf(stderr, "Failed to load function %s: Error code %lu\n", func_name, GetLastError());
-#else
-        fprintf(stderr, "Failed to load function %s: %s\n", func_name, dlerror());
-#endif
-        CLOSE_LIBRARY(handle);
-        return;
+// The operand text of print, merge and eval never changes, so the line print
+// writes and merge pushes becomes a pooled constant and eval its int, both kept
+// in args[0]. The remaining args stay symbols.
+static void fold_text_operands(Program *program, InstructionData *instr) {
+    Instruction op = instr->opcode;
+    if (instr->argc == 0 || (op != IPRINT && op != IMERGE && op != IEVAL)) return;
+    char *text = hmerge(instr);
+    if (op == IEVAL) {
+        instr->args[0].kind = OPERAND_INT;
+        instr->args[0].as_int = eval(text);
+    } else {
+        instr->args[0].kind = OPERAND_STRING;
+        instr->args[0].as_index = add_string_constant(program, text, strlen(text));
     }
+    free(text);
+}
 
-    function(vm);
-    CLOSE_LIBRARY(handle);
+void decode_instruction(Program *program, InstructionData *instr) {
+    free(instr->args);
+    instr->argc = instr->operands.size;
+    instr->args = instr->argc ? malloc(sizeof(Operand) * instr->argc) : NULL;
+    for (size_t i = 0; i < instr->argc; i++) {
+        instr->args[i] = decode_operand(program, instr->opcode, i, vector_get_str(&instr->operands, i));
+    }
+    fold_text_operands(program, instr);
 }
-static void print_word(Word w);
 
-void execute_instruction(OrtaVM *vm, InstructionData *instr) {
-    XPU *xpu = &vm->xpu;
-    Word w1, w2, result;
-    if (current_scope == NULL) {
-        current_scope = &vm->program.variables;
+// Numbers the variables of every function (a call target or the entry point) so a
+// frame can index its cells directly, frame_lookup falls back to a scan otherwise.
+static void assign_frame_cells(Program *program) {
+    size_t count = program->instructions_count;
+    size_t vars = program->variable_names.size;
+    if (count == 0 || vars == 0) return;
+
+    bool *starts = calloc(count, sizeof(bool));
+    size_t entry;
+    if (find_label(program, OENTRY, &entry) && entry < count) starts[entry] = true;
+    for (size_t i = 0; i < count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        if ((instr->opcode == ICALL || instr->opcode == IINVOKE) && instr->argc > 0 &&
+            instr->args[0].kind == OPERAND_LABEL &&
+            instr->args[0].as_index < count) {
+            starts[instr->args[0].as_index] = true;
+        }
     }
-    XRegister *regs = xpu->registers;
-    XRegister *rax = &regs[REG_RAX];
-    XRegister *rbx = &regs[REG_RBX];
-    XRegister *rcx = &regs[REG_RCX];
-    XRegister *rsi = &regs[REG_RSI];
-    XRegister *rdx = &regs[REG_RDX];
-    XRegister *rdi = &regs[REG_RDI];
 
-    switch (instr->opcode) {
-        case IPUSH: {
-            char *operand = vector_get_str(&instr->operands, 0);
-            Word w;
-            if (is_number(operand)) {
-                w.type = WINT;
-                w.as_int = atoi(operand);
-            } else if (is_float(operand)) {
-                w.type = WFLOAT;
-                w.as_float = atof(operand);
-            } else if (is_string(operand)) {
-                w.type = WCHARP;
-                size_t len = strlen(operand) - 2;
-                w.as_string = malloc(len + 1);
-                strncpy(w.as_string, operand + 1, len);
-                w.as_string[len] = '\0';
-            } else if (is_register(operand)) {
-                XRegisters reg = register_name_to_enum(operand);
-                if (reg != -1) w = regs[reg].reg_value;
-            } else {
-                EERROR(vm, ERROR_BASE"Invalid operand type expected number, string, float or register\n",
-                       vm->program.filename, instr->line);
+    size_t *cell = malloc(sizeof(size_t) * vars);
+    size_t *owner = malloc(sizeof(size_t) * vars);
+    for (size_t i = 0; i < vars; i++) owner[i] = SYMBOL_NONE;
+
+    size_t function = 0, next = 0;
+    for (size_t i = 0; i < count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        if (starts[i]) {
+            function++;
+            next = 0;
+        }
+        for (size_t j = 0; j < instr->argc; j++) {
+            Operand *op = &instr->args[j];
+            if (op->kind != OPERAND_VARIABLE) continue;
+            if (owner[op->as_index] != function) {
+                owner[op->as_index] = function;
+                cell[op->as_index] = next++;
             }
-            xstack_push(&xpu->stack, w);
-            break;
+            op->local = (uint32_t) cell[op->as_index];
         }
+    }
 
-        case IMOV: {
-            char *src = vector_get_str(&instr->operands, 0);
-            char *dst = vector_get_str(&instr->operands, 1);
-            XRegisters dst_reg = register_name_to_enum(dst);
-            if (dst_reg == -1) break;
-
-            if (is_register(src)) {
-                XRegisters src_reg = register_name_to_enum(src);
-                if (src_reg != -1) {
-                    if (regs[dst_reg].reg_value.type == WCHARP)
-                        free(regs[dst_reg].reg_value.as_string);
-                    regs[dst_reg].reg_value = regs[src_reg].reg_value;
-                }
-            } else if (is_number(src)) {
-                regs[dst_reg].reg_value.type = WINT;
-                regs[dst_reg].reg_value.as_int = atoi(src);
-            } else if (is_float(src)) {
-                regs[dst_reg].reg_value.type = WFLOAT;
-                regs[dst_reg].reg_value.as_float = atof(src);
-            } else if (is_string(src)) {
-                size_t len = strlen(src) - 2;
-                regs[dst_reg].reg_value.type = WCHARP;
-                regs[dst_reg].reg_value.as_string = malloc(len + 1);
-                strncpy(regs[dst_reg].reg_value.as_string, src + 1, len);
-                regs[dst_reg].reg_value.as_string[len] = '\0';
-            } else {
-                EERROR(vm, ERROR_BASE"Invalid operand type expected number, string, float or register\n",
-                       vm->program.filename, instr->line);
+    free(owner);
+    free(cell);
+    free(starts);
+}
+
+void decode_program(Program *program) {
+    // intern declared variable names first so later bare words resolve to variables before labels
+    for (size_t i = 0; i < program->instructions_count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        for (size_t j = 0; j < instr->operands.size; j++) {
+            if (operand_role(instr->opcode, j) == ROLE_VARIABLE) {
+                intern_variable(program, vector_get_str(&instr->operands, j));
             }
-            break;
         }
-
-        case IPOP: {
-            char *operand = vector_get_str(&instr->operands, 0);
-            XRegisters reg = register_name_to_enum(operand);
-            if (reg != -1) {
-                if (regs[reg].reg_value.type == WCHARP) {
-                    free(regs[reg].reg_value.as_string);
-                    regs[reg].reg_value.as_string = NULL;
-                }
+    }
+    for (size_t i = 0; i < program->instructions_count; i++) {
+        decode_instruction(program, &program->instructions[i]);
+    }
+    assign_frame_cells(program);
+}
+
+// ----------------- Calling convention -------------------------
+// A function that starts with `arity n` takes n words, `invoke f n` calls f with the
+// n words on top of the stack. link_calls checks every invoke of a function against
+// its arity once, then lowers invoke to a plain call and arity to a nop, so no
+// instruction is left to count arguments at run time. A plain call of a function
+// with an arity is rejected, its argument count could not be checked.
+
+// the instruction a call to target runs first, skipping the nops of its labels
+static InstructionData *call_entry(Program *program, size_t target) {
+    while (target < program->instructions_count && program->instructions[target].opcode == INOP) target++;
+    return target < program->instructions_count ? &program->instructions[target] : NULL;
+}
+
+bool link_calls(Program *program) {
+    bool ok = true;
+    for (size_t i = 0; i < program->instructions_count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        if ((instr->opcode != IINVOKE && instr->opcode != ICALL) || instr->argc < 1 ||
+            instr->args[0].kind != OPERAND_LABEL) continue;
+        InstructionData *entry = call_entry(program, instr->args[0].as_index);
+        if (!entry || entry->opcode != IARITY) continue;
+        if (instr->opcode == ICALL) {
+            OERROR(stderr, ERROR_BASE"%s takes %d arguments, call it with invoke %s %d\n", program->filename,
+                   instr->line, operand_text(instr, 0), entry->args[0].as_int, operand_text(instr, 0),
+                   entry->args[0].as_int);
+            ok = false;
+            continue;
+        }
+        if (entry->args[0].as_int == instr->args[1].as_int) continue;
+        OERROR(stderr, ERROR_BASE"%s takes %d arguments, %d given\n", program->filename, instr->line,
+               operand_text(instr, 0), entry->args[0].as_int, instr->args[1].as_int);
+        ok = false;
+    }
+    if (!ok) return false;
+
+    for (size_t i = 0; i < program->instructions_count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        if (instr->opcode == IARITY) {
+            instr->opcode = INOP;
+        } else if (instr->opcode == IINVOKE) {
+            free(*(char **) vector_get(&instr->operands, 1));
+            vector_remove(&instr->operands, 1);
+            instr->opcode = ICALL;
+            instr->argc = 1;
+        }
+    }
+    return true;
+}
+
+// ----------------- Linking -------------------------
+// Resolves label references to absolute instruction indices and strips the INOPs
+// emitted by add_label. Jump operands are rewritten to their index so create_xbin
+// stores the linked program, linking an already linked program changes nothing.
+
+static size_t link_address(const size_t *new_index, size_t count, size_t kept, size_t address) {
+    // out of range targets stay out of range
+    return address < count ? new_index[address] : address - count + kept;
+}
+
+void link_program(Program *program) {
+    size_t count = program->instructions_count;
+    if (count == 0) return;
+
+    // a label at the very end needs something to point at, keep one trailing nop
+    size_t trailing = count;
+    while (trailing > 0 && program->instructions[trailing - 1].opcode == INOP) trailing--;
+
+    size_t *new_index = malloc(sizeof(size_t) * count);
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        new_index[i] = kept;
+        if (program->instructions[i].opcode != INOP || i == trailing) kept++;
+        else if (i > trailing) new_index[i] = kept - 1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        for (size_t j = 0; j < instr->argc; j++) {
+            if (instr->args[j].kind != OPERAND_LABEL) continue;
+            instr->args[j].as_index = link_address(new_index, count, kept, instr->args[j].as_index);
+            if (operand_role(instr->opcode, j) == ROLE_TARGET) {
+                char **text = (char **) vector_get(&instr->operands, j);
+                free(*text);
+                *text = format("%zu", instr->args[j].as_index);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < program->labels_count; i++) {
+        program->labels[i].address = link_address(new_index, count, kept, program->labels[i].address);
+    }
+
+    size_t out = 0;
+    for (size_t i = 0; i < count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        if (instr->opcode == INOP && i != trailing) {
+            VECTOR_FOR_EACH(char *, elem, &instr->operands) {
+                free(*elem);
+            }
+            vector_free(&instr->operands);
+            free(instr->args);
+            continue;
+        }
+        program->instructions[out++] = *instr;
+    }
+    program->instructions_count = out;
+    free(new_index);
+}
+
+// ----------------- Superinstructions -------------------------
+// Rewrites common sequences of a linked program into single instructions:
+//   push/getvar a, push/getvar b, <cmp>, jmpif L  ->  cmpjmpif <cmp> L a b
+//   getvar x, push n, add, setvar x               ->  addvar x n
+//   push/getvar a, push/getvar b, <op>            ->  pushop <op> a b
+// A sequence is never fused across a jump target. Fused instructions carry their
+// operand text, so create_xbin stores them and load_xbin decodes them like any other.
+
+static bool *jump_targets(Program *program) {
+    size_t count = program->instructions_count;
+    bool *targets = calloc(count + 1, sizeof(bool));
+    for (size_t i = 0; i < program->labels_count; i++) {
+        if (program->labels[i].address < count) targets[program->labels[i].address] = true;
+    }
+    for (size_t i = 0; i < count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        for (size_t j = 0; j < instr->argc; j++) {
+            if (instr->args[j].kind == OPERAND_LABEL && instr->args[j].as_index < count) {
+                targets[instr->args[j].as_index] = true;
+            }
+        }
+    }
+    return targets;
+}
+
+// nothing may jump into the middle of instructions[at, at + length)
+static bool fusible(Program *program, const bool *targets, size_t at, size_t length) {
+    if (at + length > program->instructions_count) return false;
+    for (size_t i = at + 1; i < at + length; i++) {
+        if (targets[i]) return false;
+    }
+    return true;
+}
+
+static bool is_value_instruction(InstructionData *instr) {
+    if (instr->argc != 1) return false;
+    if (instr->opcode == IGETVAR) return instr->args[0].kind == OPERAND_VARIABLE;
+    if (instr->opcode != IPUSH) return false;
+    switch (instr->args[0].kind) {
+        case OPERAND_INT:
+        case OPERAND_FLOAT:
+        case OPERAND_STRING:
+        case OPERAND_REGISTER: return true;
+        default: return false;
+    }
+}
+
+static bool is_compare_instruction(InstructionData *instr) {
+    switch (instr->opcode) {
+        case IEQ:
+        case INE:
+        case ILT:
+        case IGT:
+        case ILE:
+        case IGE: return instr->argc == 0;
+        default: return false;
+    }
+}
+
+static bool is_binary_instruction(InstructionData *instr) {
+    switch (instr->opcode) {
+        case IADD:
+        case ISUB:
+        case IMUL:
+        case IDIV:
+        case IMOD: return instr->argc == 0;
+        default: return is_compare_instruction(instr);
+    }
+}
+
+static void fused_operand(InstructionData *fused, const char *text, Operand op) {
+    char *copy = strdup(text);
+    vector_push(&fused->operands, &copy);
+    fused->args = realloc(fused->args, sizeof(Operand) * (fused->argc + 1));
+    fused->args[fused->argc++] = op;
+}
+
+static void fused_copy(InstructionData *fused, InstructionData *from, size_t index) {
+    fused_operand(fused, operand_text(from, index), from->args[index]);
+}
+
+static void fused_opcode(InstructionData *fused, Instruction opcode) {
+    fused_operand(fused, instruction_to_string(opcode), (Operand){.kind = OPERAND_INT, .as_int = opcode});
+}
+
+static InstructionData fused_begin(Instruction opcode) {
+    InstructionData fused = {0};
+    fused.opcode = opcode;
+    vector_init(&fused.operands, 4, sizeof(char *));
+    return fused;
+}
+
+// replaces instructions[at] by fused, the rest of the sequence becomes nops for link_program;
+// fused keeps the line of the component that can fail, so errors still point at it
+static void fuse_sequence(Program *program, size_t at, size_t length, InstructionData fused, size_t failing) {
+    InstructionData *head = &program->instructions[at];
+    fused.line = head[failing].line;
+    VECTOR_FOR_EACH(char *, elem, &head->operands) {
+        free(*elem);
+    }
+    vector_free(&head->operands);
+    free(head->args);
+    *head = fused;
+    for (size_t i = 1; i < length; i++) program->instructions[at + i].opcode = INOP;
+}
+
+static size_t fuse_at(Program *program, const bool *targets, size_t at) {
+    InstructionData *code = &program->instructions[at];
+
+    if (fusible(program, targets, at, 4) && code[0].opcode == IGETVAR && is_value_instruction(&code[0]) &&
+        code[1].opcode == IPUSH && code[1].argc == 1 && code[1].args[0].kind == OPERAND_INT &&
+        code[2].opcode == IADD && code[2].argc == 0 &&
+        code[3].opcode == ISETVAR && code[3].argc == 1 && code[3].args[0].kind == OPERAND_VARIABLE &&
+        code[3].args[0].as_index == code[0].args[0].as_index) {
+        InstructionData fused = fused_begin(IADDVAR);
+        fused_copy(&fused, &code[3], 0);
+        fused_copy(&fused, &code[1], 0);
+        fuse_sequence(program, at, 4, fused, 2);
+        return 4;
+    }
+
+    size_t values = 0;
+    while (values < 2 && at + values < program->instructions_count && is_value_instruction(&code[values])) values++;
+
+    for (size_t pushed = values + 1; pushed-- > 0;) {
+        if (!fusible(program, targets, at, pushed + 2)) continue;
+        InstructionData *cmp = &code[pushed];
+        InstructionData *jmp = &code[pushed + 1];
+        if (!is_compare_instruction(cmp) || jmp->opcode != IJMPIF || jmp->argc != 1 ||
+            jmp->args[0].kind != OPERAND_LABEL) continue;
+        InstructionData fused = fused_begin(ICMPJMPIF);
+        fused_opcode(&fused, cmp->opcode);
+        fused_copy(&fused, jmp, 0);
+        for (size_t i = 0; i < pushed; i++) fused_copy(&fused, &code[i], 0);
+        fuse_sequence(program, at, pushed + 2, fused, pushed);
+        return pushed + 2;
+    }
+
+    if (values == 2 && fusible(program, targets, at, 3) && is_binary_instruction(&code[2])) {
+        InstructionData fused = fused_begin(IPUSHOP);
+        fused_opcode(&fused, code[2].opcode);
+        fused_copy(&fused, &code[0], 0);
+        fused_copy(&fused, &code[1], 0);
+        fuse_sequence(program, at, 3, fused, 2);
+        return 3;
+    }
+    return 1;
+}
+
+void fuse_program(Program *program) {
+    // eq, not is ne, rewrite it first so the branch patterns see a single compare
+    bool *targets = jump_targets(program);
+    bool changed = false;
+    for (size_t i = 0; i + 1 < program->instructions_count; i++) {
+        InstructionData *code = &program->instructions[i];
+        if (code[0].opcode == IEQ && code[0].argc == 0 && code[1].opcode == INOT && code[1].argc == 0 &&
+            !targets[i + 1]) {
+            code[0].opcode = INE;
+            code[1].opcode = INOP;
+            changed = true;
+            i++;
+        }
+    }
+    free(targets);
+    if (changed) link_program(program);
+
+    targets = jump_targets(program);
+    changed = false;
+    for (size_t i = 0; i < program->instructions_count;) {
+        size_t length = fuse_at(program, targets, i);
+        changed |= length > 1;
+        i += length;
+    }
+    free(targets);
+    if (changed) link_program(program);
+}
+
+Word operand_to_word(OrtaVM *vm, InstructionData *instr, size_t index) {
+    Operand *op = &instr->args[index];
+    Word w = {.type = WPOINTER, .as_pointer = NULL};
+
+    switch (op->kind) {
+        case OPERAND_INT:
+            w.type = WINT;
+            w.as_int = op->as_int;
+            return w;
+        case OPERAND_FLOAT:
+            w.type = WFLOAT;
+            w.as_float = op->as_float;
+            return w;
+        case OPERAND_REGISTER:
+            return word_retain(vm->xpu.registers[op->as_register].reg_value);
+        case OPERAND_STRING:
+            w.type = WCHARP;
+            w.as_string = xstring_retain(program_string(&vm->program, op->as_index));
+            return w;
+        case OPERAND_POINTER:
+            w.as_pointer = op->as_pointer;
+            return w;
+        case OPERAND_LABEL:
+            w.type = WINT;
+            w.as_int = (int) op->as_index;
+            return w;
+        case OPERAND_VARIABLE: {
+            Variable *var = resolve_variable(vm, op);
+            if (var) w = variable_value(var);
+            if (w.type == WPOINTER && w.as_pointer == NULL) {
+                EERROR(vm, ERROR_BASE"Variable not found: %s\n",
+                       vm->program.filename, instr->line, operand_text(instr, index));
+            }
+            return w;
+        }
+        default:
+            EERROR(vm, ERROR_BASE"Invalid operand: %s\n",
+                   vm->program.filename, instr->line, operand_text(instr, index));
+            return w;
+    }
+}
+
+
+Word xstack_pop_and_expect(OrtaVM *vm, WordType expected) {
+    Word result = xstack_pop(&vm->xpu.stack);
+    if (result.type == expected) {
+        return result;
+    } else {
+        EERROR(vm, ERROR_BASE"expected '%s' got '%s'\n",
+               vm->program.filename, vm->program.instructions[vm->xpu.ip].line, word_type_to_string(expected),
+               word_type_to_string(result.type));
+    }
+}
+
+#define COMPARE_WORDS(a, b) do { \
+        switch (op) { \
+            case IEQ: result->as_int = (a) == (b); break; \
+            case INE: result->as_int = (a) != (b); break; \
+            case ILT: result->as_int = (a) < (b); break; \
+            case IGT: result->as_int = (a) > (b); break; \
+            case ILE: result->as_int = (a) <= (b); break; \
+            case IGE: result->as_int = (a) >= (b); break; \
+            default: break; \
+        } \
+    } while (0)
+
+// Applies the stack form of a binary opcode, w2 was pushed first and w1 last.
+// Returns false when the opcode leaves nothing on the stack (division by zero).
+static bool binary_words(OrtaVM *vm, InstructionData *instr, Instruction op, Word w2, Word w1, Word *result) {
+    switch (op) {
+        case IADD:
+        case ISUB:
+            if (w1.type != w2.type) {
+                EERROR(vm, ERROR_BASE"Invalid types on stack expected two values of same type got %s and %s\n",
+                       vm->program.filename, instr->line, word_type_to_string(w1.type),
+                       word_type_to_string(w2.type));
+            }
+            if (w1.type == WINT) {
+                result->type = WINT;
+                result->as_int = op == IADD ? w1.as_int + w2.as_int : w1.as_int - w2.as_int;
+            } else if (w1.type == WFLOAT) {
+                result->type = WFLOAT;
+                result->as_float = op == IADD ? w1.as_float + w2.as_float : w1.as_float - w2.as_float;
+            } else {
+                EERROR(vm, ERROR_BASE"type '%s' is not supported \n",
+                       vm->program.filename, instr->line, word_type_to_string(w1.type));
+            }
+            return true;
+
+        case IMUL:
+        case IDIV:
+            if (op == IDIV && (w1.as_int == 0 || w1.as_float == 0.0f)) return false;
+            if (w1.type == WINT && w2.type == WINT) {
+                result->type = WINT;
+                result->as_int = op == IMUL ? w2.as_int * w1.as_int : w2.as_int / w1.as_int;
+            } else if (w1.type == WFLOAT && w2.type == WFLOAT) {
+                result->type = WFLOAT;
+                result->as_float = op == IMUL ? w2.as_float * w1.as_float : w2.as_float / w1.as_float;
+            } else {
+                EERROR(vm, ERROR_BASE"type '%s' is not supported \n",
+                       vm->program.filename, instr->line, word_type_to_string(w1.type));
+            }
+            return true;
+
+        case IMOD:
+            if (w1.type == WINT && w2.type == WINT && w1.as_int != 0) {
+                result->type = WINT;
+                result->as_int = w2.as_int % w1.as_int;
+            } else {
+                EERROR(vm, ERROR_BASE"type '%s' is not supported \n",
+                       vm->program.filename, instr->line, word_type_to_string(w1.type));
+            }
+            return true;
+
+        default:
+            // comparisons, values of different types are never equal
+            result->type = WINT;
+            result->as_int = op == INE;
+            if (w1.type != w2.type) return true;
+            switch (w1.type) {
+                case WINT: COMPARE_WORDS(w2.as_int, w1.as_int);
+                    break;
+                case WFLOAT: COMPARE_WORDS(w2.as_float, w1.as_float);
+                    break;
+                case WCHARP:
+                    if (op == IEQ || op == INE) {
+                        COMPARE_WORDS(strcmp(w2.as_string, w1.as_string), 0);
+                        break;
+                    }
+                // fallthrough
+                default:
+                    EERROR(vm, ERROR_BASE"type '%s' is not supported \n",
+                           vm->program.filename, instr->line, word_type_to_string(w1.type));
+            }
+            return true;
+    }
+}
+
+
+void call_dynlib_function(const char *lib_path, const char *func_name, OrtaVM *vm) {
+    LibHandle handle = LOAD_LIBRARY(lib_path);
+    if (!handle) {
+#ifdef WIN32
+        fprintf(stderr, "Failed to load library %s: Error code %lu\n", lib_path, GetLastError());
+#else
+        fprintf(stderr, "Failed to load library %s: %s\n", lib_path, dlerror());
+#endif
+        return;
+    }
+
+    typedef void (*func_t)(OrtaVM *);
+    func_t function = (func_t) GET_PROC_ADDRESS(handle, func_name);
+    if (!function) {
+#ifdef WIN32
+        fprintf(stderr, "Failed to load function %s: Error code %lu\n", func_name, GetLastError());
+#else
+        fprintf(stderr, "Failed to load function %s: %s\n", func_name, dlerror());
+#endif
+        CLOSE_LIBRARY(handle);
+        return;
+    }
+
+    function(vm);
+    CLOSE_LIBRARY(handle);
+}
+static void print_word(Word w);
+
+void quicken(InstructionData *instr, Word w2, Word w1) {
+    if (instr->deopt || w1.type != w2.type) return;
+    for (size_t i = 0; i < sizeof(quickenings) / sizeof(quickenings[0]); i++) {
+        if (quickenings[i].generic == instr->opcode && quickenings[i].type == w1.type) {
+            instr->opcode = quickenings[i].quickened;
+            return;
+        }
+    }
+}
+
+void deoptimize(InstructionData *instr) {
+    instr->opcode = generic_opcode(instr->opcode);
+    instr->deopt = true;
+}
+
+// the int behind a pushed operand, false for any other type
+static bool operand_int(OrtaVM *vm, const Operand *op, int *out) {
+    Word w;
+    switch (op->kind) {
+        case OPERAND_INT:
+            *out = op->as_int;
+            return true;
+        case OPERAND_REGISTER:
+            w = vm->xpu.registers[op->as_register].reg_value;
+            break;
+        case OPERAND_VARIABLE: {
+            Variable *var = resolve_variable(vm, op);
+            if (var == NULL) return false;
+            w = WORD_LOAD(var->value);
+            break;
+        }
+        default:
+            return false;
+    }
+    if (w.type != WINT) return false;
+    *out = w.as_int;
+    return true;
+}
+
+// taken branch of a quickened cmpjmpif
+static inline bool compare_ints(Instruction op, int a, int b) {
+    switch (op) {
+        case IEQ: return a == b;
+        case INE: return a != b;
+        case ILT: return a < b;
+        case IGT: return a > b;
+        case ILE: return a <= b;
+        case IGE: return a >= b;
+        default: return false;
+    }
+}
+
+// ----------------- Verifier -------------------------
+// Abstract interpretation over the linked program. Each function (the entry label
+// and every call target) is walked with depths relative to its entry, calls use
+// the callee's summary, so recursion settles after a few rounds. A program is
+// verified when every reachable instruction has a fixed stack effect and one depth;
+// execute_program then runs it without bounds checks (execute_verified). Broken
+// jump targets and stack underflow in the entry function are rejected at load.
+
+#define VERIFY_UNREACHED INT_MIN
+#define VERIFY_TRACKED_SLOTS 4
+#define VERIFY_ANY ((WordType) -1)
+
+typedef struct {
+    int depth;                          // relative to the function entry
+    WordType top[VERIFY_TRACKED_SLOTS]; // inferred types of the topmost slots, top[0] is the top
+} VerifyState;
+
+typedef struct {
+    size_t entry;
+    bool returns;   // a ret was reached, net is known
+    int net;        // depth at ret
+    int need;       // slots below the entry the function consumes
+    int max;        // deepest relative depth
+} VerifyFunction;
+
+typedef enum {
+    VERIFY_OK,
+    VERIFY_DYNAMIC, // well formed, but only the checked loop can run it
+} VerifyResult;
+
+// pops and pushes of one instruction, false when they depend on runtime values
+static bool verify_effect(InstructionData *instr, int *pops, int *pushes) {
+    size_t argc = instr->argc;
+    *pops = 0;
+    *pushes = 0;
+    switch (generic_opcode(instr->opcode)) {
+        case INOP:
+        case IMOV:
+        case IXOR:
+        case IJMP:
+        case IRET:
+        case IHALT:
+        case IDEC:
+        case IINC:
+        case ICMP:
+        case IVAR:
+        case ITOGGLELOCALSCOPE:
+        case IADDVAR:
+        case IROTL:
+        case IROTR:
+            return true;
+        case IPUSH:
+        case ISIZEOF:
+        case IEVAL:
+        case IHERE:
+        case IGETVAR:
+        case IGETGLOBALVAR:
+        case IPUSHOP:
+            *pushes = 1;
+            return true;
+        case ILOAD:
+            *pushes = argc >= 1 && instr->args[0].kind == OPERAND_REGISTER;
+            return true;
+        case IPOP:
+        case IJMPIF:
+        case IJMPTABLE:
+        case ISTORE:
+        case IDROP:
+        case ISETVAR:
+        case ISETGLOBALVAR:
+            *pops = 1;
+            return true;
+        case IAND:
+            *pops = 2;
+            return true;
+        case IADD:
+        case ISUB:
+            if (argc >= 2) return true;
+            *pops = argc == 1 ? 1 : 2;
+            *pushes = 1;
+            return true;
+        case IMUL:
+        case IDIV:
+        case IMOD:
+        case IOR:
+        case IEQ:
+        case INE:
+        case ILT:
+        case IGT:
+        case ILE:
+        case IGE:
+            *pops = 2;
+            *pushes = 1;
+            return true;
+        case INOT:
+        case ICAST:
+            *pops = 1;
+            *pushes = 1;
+            return true;
+        case IDUP:
+            *pops = 1;
+            *pushes = 2;
+            return true;
+        case ISWAP:
+            *pops = 2;
+            *pushes = 2;
+            return true;
+        case IPRINT:
+            *pops = instr->operands.size == 0;
+            return true;
+        case IMERGE:
+            *pops = instr->operands.size == 0 ? 2 : 0;
+            *pushes = 1;
+            return true;
+        case IALLOC:
+            *pushes = argc < 3;
+            return argc >= 1;
+        case IWRITEMEM:
+            *pops = (argc == 0) + (argc <= 1) + (argc <= 2) + (argc < 4);
+            return true;
+        case IREADMEM:
+            *pops = (argc == 0) + (argc <= 1) + (argc <= 2);
+            *pushes = argc < 4;
+            return true;
+        case ICPYMEM:
+            *pops = 3;
+            return true;
+        case IMEMCMP:
+            *pushes = argc < 4;
+            return true;
+        case IFREE:
+            *pops = argc == 0;
+            return true;
+        case IOVM: {
+            const char *arg = operand_text(instr, 0);
+            if (strcmp(arg, "stack") == 0) return false;
+            *pushes = strcmp(arg, "stack_size") == 0 || strcmp(arg, "stack_ptr") == 0 ||
+                      strcmp(arg, "platform") == 0;
+            return true;
+        }
+        case ICMPJMPIF:
+            *pops = 4 - (int) argc;
+            return true;
+        case ICALL:
+            *pushes = (int) argc - 1;
+            return true;
+        default:
+            // xcall and sprintf move as many words as the runtime values say
+            return false;
+    }
+}
+
+static WordType operand_type(const Operand *op) {
+    switch (op->kind) {
+        case OPERAND_INT: return WINT;
+        case OPERAND_FLOAT: return WFLOAT;
+        case OPERAND_STRING: return WCHARP;
+        default: return VERIFY_ANY;
+    }
+}
+
+// result of a binary stack instruction, a is the deeper operand
+static WordType binary_type(Instruction op, WordType a, WordType b) {
+    switch (op) {
+        case IEQ:
+        case INE:
+        case ILT:
+        case IGT:
+        case ILE:
+        case IGE: return WINT;
+        default: break;
+    }
+    if (a != b || (a != WINT && a != WFLOAT)) return VERIFY_ANY;
+    return op == IMOD && a != WINT ? VERIFY_ANY : a;
+}
+
+// types of the words an instruction pushes, pushed[0] ends up on top
+static void verify_types(InstructionData *instr, const VerifyState *in, WordType pushed[2]) {
+    Instruction op = generic_opcode(instr->opcode);
+    pushed[0] = pushed[1] = VERIFY_ANY;
+    switch (op) {
+        case IPUSH: pushed[0] = operand_type(&instr->args[0]);
+            break;
+        case IDUP: pushed[0] = pushed[1] = in->top[0];
+            break;
+        case ISWAP: pushed[0] = in->top[1];
+            pushed[1] = in->top[0];
+            break;
+        case IADD:
+        case ISUB:
+            if (instr->argc == 1) {
+                pushed[0] = in->top[0];
+                break;
+            }
+        // fallthrough
+        case IMUL:
+        case IDIV:
+        case IMOD:
+        case IEQ:
+        case INE:
+        case ILT:
+        case IGT:
+        case ILE:
+        case IGE: pushed[0] = binary_type(op, in->top[1], in->top[0]);
+            break;
+        case IPUSHOP:
+            pushed[0] = binary_type((Instruction) instr->args[0].as_int, operand_type(&instr->args[1]),
+                                    operand_type(&instr->args[2]));
+            break;
+        case INOT: pushed[0] = in->top[0] == WINT || in->top[0] == WFLOAT ? in->top[0] : VERIFY_ANY;
+            break;
+        case ICAST: pushed[0] = instr->args[0].as_type;
+            break;
+        case IMERGE:
+        case IHERE: pushed[0] = WCHARP;
+            break;
+        case ISIZEOF:
+        case IEVAL:
+        case IMEMCMP: pushed[0] = WINT;
+            break;
+        case IALLOC: pushed[0] = WPOINTER;
+            break;
+        default: break;
+    }
+}
+
+// slot types after rotl/rotr n, which is a nop unless more than n words are on the stack;
+// a depth that does not prove the rotation leaves the top n slots unknown
+static void verify_rotate(InstructionData *instr, const VerifyState *in, VerifyState *out) {
+    Instruction op = generic_opcode(instr->opcode);
+    if (op != IROTL && op != IROTR) return;
+    int n = instr->args[0].kind == OPERAND_INT ? instr->args[0].as_int : VERIFY_TRACKED_SLOTS;
+    if (n <= 1) return;
+    for (int k = 0; k < VERIFY_TRACKED_SLOTS && k < n; k++) {
+        int from = op == IROTL ? (k + 1) % n : (k + n - 1) % n;
+        out->top[k] = in->depth > n && from < VERIFY_TRACKED_SLOTS ? in->top[from] : VERIFY_ANY;
+    }
+}
+
+static bool verify_target(Program *program, const Operand *op, size_t *target) {
+    if (op->kind != OPERAND_LABEL || op->as_index >= program->instructions_count) return false;
+    *target = op->as_index;
+    return true;
+}
+
+static bool verify_malformed(Program *program, InstructionData *instr, const char *reason) {
+    OERROR(stderr, ERROR_BASE"%s\n", program->filename, instr->line, reason);
+    return false;
+}
+
+// instructions whose jump or call target and operands have to be well formed wherever they are
+static bool verify_structure(Program *program, InstructionData *instr) {
+    size_t target;
+    switch (generic_opcode(instr->opcode)) {
+        case IJMP:
+        case IJMPIF:
+            if (!verify_target(program, &instr->args[0], &target))
+                return verify_malformed(program, instr, "invalid jump target");
+            return true;
+        case ICMPJMPIF:
+            if (!verify_target(program, &instr->args[1], &target))
+                return verify_malformed(program, instr, "invalid jump target");
+            return true;
+        case ICALL:
+            if (!verify_target(program, &instr->args[0], &target))
+                return verify_malformed(program, instr, "invalid call target");
+            return true;
+        case IJMPTABLE:
+            for (size_t i = 0; i < instr->argc; i++) {
+                if (!verify_target(program, &instr->args[i], &target))
+                    return verify_malformed(program, instr, "invalid jump target");
+            }
+            return true;
+        default:
+            return true;
+    }
+}
+
+typedef struct {
+    Program *program;
+    VerifyFunction *functions;
+    size_t *function_at; // instruction index to its entry in functions, SYMBOL_NONE if no function starts there
+    VerifyState *states;
+    size_t *owner;       // function that reached an instruction
+    size_t *worklist;
+    size_t pending;
+} Verifier;
+
+// false when at is reached with two depths or from two functions
+static bool verify_merge(Verifier *v, size_t self, size_t at, const VerifyState *in) {
+    VerifyState *state = &v->states[at];
+    if (v->owner[at] != SYMBOL_NONE && v->owner[at] != self) return false;
+    if (state->depth == VERIFY_UNREACHED) {
+        *state = *in;
+        v->owner[at] = self;
+        v->worklist[v->pending++] = at;
+        return true;
+    }
+    if (state->depth != in->depth) return false;
+    bool widened = false;
+    for (int k = 0; k < VERIFY_TRACKED_SLOTS; k++) {
+        if (state->top[k] != in->top[k] && state->top[k] != VERIFY_ANY) {
+            state->top[k] = VERIFY_ANY;
+            widened = true;
+        }
+    }
+    if (widened) v->worklist[v->pending++] = at;
+    return true;
+}
+
+// walks one function with the current callee summaries, sets *changed when its own summary moved
+static VerifyResult verify_function(Verifier *v, size_t self, bool *changed) {
+    Program *program = v->program;
+    VerifyFunction *function = &v->functions[self];
+    VerifyFunction summary = {.entry = function->entry};
+
+    for (size_t i = 0; i < program->instructions_count; i++) {
+        if (v->owner[i] != self) continue;
+        v->owner[i] = SYMBOL_NONE;
+        v->states[i].depth = VERIFY_UNREACHED;
+    }
+    VerifyState entry = {.depth = 0};
+    for (int k = 0; k < VERIFY_TRACKED_SLOTS; k++) entry.top[k] = VERIFY_ANY;
+    v->pending = 0;
+    if (!verify_merge(v, self, function->entry, &entry)) return VERIFY_DYNAMIC;
+
+    while (v->pending > 0) {
+        size_t at = v->worklist[--v->pending];
+        InstructionData *instr = &program->instructions[at];
+        VerifyState in = v->states[at];
+        int pops, pushes;
+        if (!verify_effect(instr, &pops, &pushes)) return VERIFY_DYNAMIC;
+        // a push of a symbol or variable is an error the checked loop reports when it runs
+        if (generic_opcode(instr->opcode) == IPUSH && operand_type(&instr->args[0]) == VERIFY_ANY &&
+            instr->args[0].kind != OPERAND_REGISTER) return VERIFY_DYNAMIC;
+        if (pops - in.depth > summary.need) summary.need = pops - in.depth;
+
+        WordType pushed[2];
+        verify_types(instr, &in, pushed);
+        VerifyState out = {.depth = in.depth - pops + pushes};
+        for (int k = 0; k < VERIFY_TRACKED_SLOTS; k++) {
+            int from = k - pushes + pops;
+            if (k < pushes) out.top[k] = k < 2 ? pushed[k] : VERIFY_ANY;
+            else out.top[k] = from < VERIFY_TRACKED_SLOTS ? in.top[from] : VERIFY_ANY;
+        }
+        verify_rotate(instr, &in, &out);
+        if (out.depth > summary.max) summary.max = out.depth;
+
+        size_t target;
+        switch (generic_opcode(instr->opcode)) {
+            case IHALT:
+                continue;
+            case IRET:
+                if (summary.returns && summary.net != out.depth) return VERIFY_DYNAMIC;
+                summary.returns = true;
+                summary.net = out.depth;
+                continue;
+            case IJMP:
+                verify_target(program, &instr->args[0], &target);
+                if (!verify_merge(v, self, target, &out)) return VERIFY_DYNAMIC;
+                continue;
+            case IJMPIF:
+                verify_target(program, &instr->args[0], &target);
+                if (!verify_merge(v, self, target, &out)) return VERIFY_DYNAMIC;
+                break;
+            case ICMPJMPIF:
+                verify_target(program, &instr->args[1], &target);
+                if (!verify_merge(v, self, target, &out)) return VERIFY_DYNAMIC;
+                break;
+            case IJMPTABLE:
+                for (size_t i = 0; i < instr->argc; i++) {
+                    verify_target(program, &instr->args[i], &target);
+                    if (!verify_merge(v, self, target, &out)) return VERIFY_DYNAMIC;
+                }
+                continue;
+            case ICALL: {
+                verify_target(program, &instr->args[0], &target);
+                VerifyFunction *callee = &v->functions[v->function_at[target]];
+                if (callee->need - out.depth > summary.need) summary.need = callee->need - out.depth;
+                // unknown until the callee reaches its ret, a later round picks the rest up
+                if (!callee->returns) continue;
+                out.depth += callee->net;
+                for (int k = 0; k < VERIFY_TRACKED_SLOTS; k++) out.top[k] = VERIFY_ANY;
+                if (out.depth > summary.max) summary.max = out.depth;
+                break;
+            }
+            default:
+                break;
+        }
+        if (at + 1 < program->instructions_count && !verify_merge(v, self, at + 1, &out)) return VERIFY_DYNAMIC;
+    }
+
+    *changed |= summary.returns != function->returns || summary.net != function->net ||
+            summary.need != function->need || summary.max != function->max;
+    *function = summary;
+    return VERIFY_OK;
+}
+
+// rewrites binary instructions and cmpjmpif whose operand types were proven to their quickened form
+static void verify_quicken(Program *program, const VerifyState *states) {
+    for (size_t i = 0; i < program->instructions_count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        const VerifyState *in = &states[i];
+        if (in->depth == VERIFY_UNREACHED) continue;
+
+        WordType a, b;
+        if (is_compare_instruction(instr) || ((instr->opcode == IADD || instr->opcode == ISUB ||
+                                               instr->opcode == IMUL) && instr->argc == 0)) {
+            a = in->top[1];
+            b = in->top[0];
+        } else if (instr->opcode == ICMPJMPIF) {
+            size_t pushed = instr->argc - 2;
+            a = pushed == 2 ? operand_type(&instr->args[2]) : pushed == 1 ? in->top[0] : in->top[1];
+            b = pushed >= 1 ? operand_type(&instr->args[instr->argc - 1]) : in->top[0];
+        } else continue;
+        if (a == VERIFY_ANY || a != b) continue;
+
+        Instruction generic = instr->opcode;
+        quicken(instr, (Word){.type = a}, (Word){.type = b});
+        instr->proven = instr->opcode != generic;
+    }
+}
+
+// false rejects the program, program->verified tells whether it may run unchecked
+bool verify_program(Program *program) {
+    size_t count = program->instructions_count;
+    program->verified = false;
+    for (size_t i = 0; i < count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        int pops, pushes;
+        if (!verify_structure(program, instr)) return false;
+        instr->stack_effect = verify_effect(instr, &pops, &pushes) ? pushes - pops : 0;
+        instr->max_stack = 0;
+        instr->proven = false;
+    }
+
+    size_t entry = 0;
+    if (!find_label(program, OENTRY, &entry)) entry = 0;
+    if (entry >= count) return true;
+
+    Verifier v = {.program = program};
+    v.functions = malloc(sizeof(VerifyFunction) * (count + 1));
+    v.function_at = malloc(sizeof(size_t) * count);
+    v.states = malloc(sizeof(VerifyState) * count);
+    v.owner = malloc(sizeof(size_t) * count);
+    // an instruction is queued once per visit and once more per slot type that widens to any
+    v.worklist = malloc(sizeof(size_t) * count * (VERIFY_TRACKED_SLOTS + 1));
+    for (size_t i = 0; i < count; i++) {
+        v.function_at[i] = SYMBOL_NONE;
+        v.owner[i] = SYMBOL_NONE;
+        v.states[i].depth = VERIFY_UNREACHED;
+    }
+
+    size_t functions_count = 0;
+    v.functions[functions_count++] = (VerifyFunction){.entry = entry};
+    v.function_at[entry] = 0;
+    for (size_t i = 0; i < count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        if (instr->opcode != ICALL) continue;
+        size_t target = instr->args[0].as_index;
+        if (v.function_at[target] != SYMBOL_NONE) continue;
+        v.function_at[target] = functions_count;
+        v.functions[functions_count++] = (VerifyFunction){.entry = target};
+    }
+
+    VerifyResult result = VERIFY_OK;
+    bool changed = true;
+    for (size_t round = 0; changed && result == VERIFY_OK; round++) {
+        // every round settles at least one more summary, more rounds means they never agree
+        if (round > functions_count + 1) {
+            result = VERIFY_DYNAMIC;
+            break;
+        }
+        changed = false;
+        for (size_t f = 0; f < functions_count && result == VERIFY_OK; f++) {
+            result = verify_function(&v, f, &changed);
+        }
+    }
+
+    // the entry pops more than it pushed, the checked loop reports that where it happens
+    if (result == VERIFY_OK && v.functions[0].need > 0) result = VERIFY_DYNAMIC;
+    if (result == VERIFY_OK) {
+        for (size_t f = 0; f < functions_count; f++) {
+            program->instructions[v.functions[f].entry].max_stack = (size_t) v.functions[f].max;
+        }
+        verify_quicken(program, v.states);
+        program->verified = true;
+    }
+
+    free(v.functions);
+    free(v.function_at);
+    free(v.states);
+    free(v.owner);
+    free(v.worklist);
+    return true;
+}
+
+// ----------------- Dispatch -------------------------
+// Handlers are shared by two run loops. With GCC/Clang every handler ends in its
+// own indirect jump through a label table (ORTA_COMPUTED_GOTO), otherwise
+// DISPATCH() breaks back to a plain switch. Build with -DORTA_NO_COMPUTED_GOTO
+// (make portable) to force the switch loop.
+
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(ORTA_NO_COMPUTED_GOTO)
+#define ORTA_COMPUTED_GOTO
+#endif
+
+#ifdef ORTA_COMPUTED_GOTO
+#define TARGET(op) case op: TARGET_##op:
+#define DISPATCH() do { \
+        if (++xpu->ip >= vm->program.instructions_count) return; \
+        instr = &vm->program.instructions[xpu->ip]; \
+        args = instr->args; \
+        goto *dispatch_table[instr->opcode]; \
+    } while (0)
+#else
+#define TARGET(op) case op:
+#define DISPATCH() break
+#endif
+
+// Quickened binary handler, a is the deeper and b the topmost of the two stack words.
+// The result replaces a in place. A failed type guard reruns the generic handler.
+#define QUICKENED(op, a_type, b_type, result_type, result_field, expr) \
+    TARGET(op) { \
+        WordCell *top = xpu->stack.stack + xpu->stack.count; \
+        if (xpu->stack.count < 2 || WORD_TYPE(top[-2]) != a_type || WORD_TYPE(top[-1]) != b_type) { \
+            deoptimize(instr); \
+            goto dispatch; \
+        } \
+        Word a = WORD_LOAD(top[-2]), b = WORD_LOAD(top[-1]); \
+        Word r = {.type = result_type, .result_field = (expr)}; \
+        word_release(a); \
+        word_release(b); \
+        WORD_STORE(top[-2], r); \
+        xpu->stack.count--; \
+        DISPATCH(); \
+    }
+
+// every quickened binary handler, a is the deeper and b the topmost operand
+#define QUICKENED_HANDLERS(X) \
+    X(IADD_INT, WINT, WINT, WINT, as_int, b.as_int + a.as_int) \
+    X(IADD_FLOAT, WFLOAT, WFLOAT, WFLOAT, as_float, b.as_float + a.as_float) \
+    X(ISUB_INT, WINT, WINT, WINT, as_int, b.as_int - a.as_int) \
+    X(ISUB_FLOAT, WFLOAT, WFLOAT, WFLOAT, as_float, b.as_float - a.as_float) \
+    X(IMUL_INT, WINT, WINT, WINT, as_int, a.as_int * b.as_int) \
+    X(IMUL_FLOAT, WFLOAT, WFLOAT, WFLOAT, as_float, a.as_float * b.as_float) \
+    X(IEQ_INT, WINT, WINT, WINT, as_int, a.as_int == b.as_int) \
+    X(IEQ_FLOAT, WFLOAT, WFLOAT, WINT, as_int, a.as_float == b.as_float) \
+    X(IEQ_STRING, WCHARP, WCHARP, WINT, as_int, strcmp(a.as_string, b.as_string) == 0) \
+    X(INE_INT, WINT, WINT, WINT, as_int, a.as_int != b.as_int) \
+    X(INE_FLOAT, WFLOAT, WFLOAT, WINT, as_int, a.as_float != b.as_float) \
+    X(INE_STRING, WCHARP, WCHARP, WINT, as_int, strcmp(a.as_string, b.as_string) != 0) \
+    X(ILT_INT, WINT, WINT, WINT, as_int, a.as_int < b.as_int) \
+    X(ILT_FLOAT, WFLOAT, WFLOAT, WINT, as_int, a.as_float < b.as_float) \
+    X(IGT_INT, WINT, WINT, WINT, as_int, a.as_int > b.as_int) \
+    X(IGT_FLOAT, WFLOAT, WFLOAT, WINT, as_int, a.as_float > b.as_float) \
+    X(ILE_INT, WINT, WINT, WINT, as_int, a.as_int <= b.as_int) \
+    X(ILE_FLOAT, WFLOAT, WFLOAT, WINT, as_int, a.as_float <= b.as_float) \
+    X(IGE_INT, WINT, WINT, WINT, as_int, a.as_int >= b.as_int) \
+    X(IGE_FLOAT, WFLOAT, WFLOAT, WINT, as_int, a.as_float >= b.as_float)
+
+// jmptable <default> <0> <1> ...: the entry an int index selects, the default for
+// an index out of range or a word that is no int
+static inline size_t jmptable_target(const InstructionData *instr, Word index) {
+    if (index.type == WINT && index.as_int >= 0 && (size_t) index.as_int + 1 < instr->argc) {
+        return instr->args[index.as_int + 1].as_index;
+    }
+    return instr->args[0].as_index;
+}
+
+bool program_decode_segment(Program *program, size_t at);
+bool program_decode_all(Program *program);
+
+// Runs from instr until the program halts or leaves the instruction range.
+// single_step stops after one instruction (execute_instruction).
+static void execute_from(OrtaVM *vm, InstructionData *instr, bool single_step) {
+    XPU *xpu = &vm->xpu;
+    Operand *args = instr->args;
+    Word w1, w2, result;
+    XRegister *regs = xpu->registers;
+    XRegister *rax = &regs[REG_RAX];
+    XRegister *rbx = &regs[REG_RBX];
+    XRegister *rcx = &regs[REG_RCX];
+    XRegister *rsi = &regs[REG_RSI];
+    XRegister *rdx = &regs[REG_RDX];
+    XRegister *rdi = &regs[REG_RDI];
+
+#ifdef ORTA_COMPUTED_GOTO
+    static const void *const run_table[OPCODE_COUNT] = {
+        [INOP] = &&TARGET_INOP, [IPUSH] = &&TARGET_IPUSH, [IMOV] = &&TARGET_IMOV, [IPOP] = &&TARGET_IPOP,
+        [IADD] = &&TARGET_IADD, [ISUB] = &&TARGET_ISUB, [IMUL] = &&TARGET_IMUL, [IDIV] = &&TARGET_IDIV,
+        [IMOD] = &&TARGET_IMOD, [IAND] = &&TARGET_IAND, [IOR] = &&TARGET_IOR, [IXOR] = &&TARGET_IXOR,
+        [INOT] = &&TARGET_INOT, [IEQ] = &&TARGET_IEQ, [INE] = &&TARGET_INE, [ILT] = &&TARGET_ILT,
+        [IGT] = &&TARGET_IGT, [ILE] = &&TARGET_ILE, [IGE] = &&TARGET_IGE, [IJMP] = &&TARGET_IJMP,
+        [IJMPIF] = &&TARGET_IJMPIF, [ICALL] = &&TARGET_ICALL, [IRET] = &&TARGET_IRET,
+        [ILOAD] = &&TARGET_ILOAD, [ISTORE] = &&TARGET_ISTORE, [IPRINT] = &&TARGET_IPRINT,
+        [IDUP] = &&TARGET_IDUP, [ISWAP] = &&TARGET_ISWAP, [IDROP] = &&TARGET_IDROP,
+        [IROTL] = &&TARGET_IROTL, [IROTR] = &&TARGET_IROTR, [IALLOC] = &&TARGET_IALLOC,
+        [IHALT] = &&TARGET_IHALT, [IMERGE] = &&TARGET_IMERGE, [IXCALL] = &&TARGET_IXCALL,
+        [ISIZEOF] = &&TARGET_ISIZEOF, [IMEMCMP] = &&TARGET_IMEMCMP, [IDEC] = &&TARGET_IDEC,
+        [IINC] = &&TARGET_IINC, [IEVAL] = &&TARGET_IEVAL, [ICMP] = &&TARGET_ICMP,
+        [IREADMEM] = &&TARGET_IREADMEM, [ICPYMEM] = &&TARGET_ICPYMEM, [IWRITEMEM] = &&TARGET_IWRITEMEM,
+        [IVAR] = &&TARGET_IVAR, [ISETVAR] = &&TARGET_ISETVAR, [IGETVAR] = &&TARGET_IGETVAR,
+        [IFREE] = &&TARGET_IFREE, [ITOGGLELOCALSCOPE] = &&TARGET_ITOGGLELOCALSCOPE,
+        [IGETGLOBALVAR] = &&TARGET_IGETGLOBALVAR, [ISETGLOBALVAR] = &&TARGET_ISETGLOBALVAR,
+        [IOVM] = &&TARGET_IOVM, [ICAST] = &&TARGET_ICAST, [IHERE] = &&TARGET_IHERE,
+        [ISPRINTF] = &&TARGET_ISPRINTF, [ICMPJMPIF] = &&TARGET_ICMPJMPIF, [IADDVAR] = &&TARGET_IADDVAR,
+        [IPUSHOP] = &&TARGET_IPUSHOP, [IJMPTABLE] = &&TARGET_IJMPTABLE,
+        [IADD_INT] = &&TARGET_IADD_INT, [IADD_FLOAT] = &&TARGET_IADD_FLOAT,
+        [ISUB_INT] = &&TARGET_ISUB_INT, [ISUB_FLOAT] = &&TARGET_ISUB_FLOAT,
+        [IMUL_INT] = &&TARGET_IMUL_INT, [IMUL_FLOAT] = &&TARGET_IMUL_FLOAT,
+        [IEQ_INT] = &&TARGET_IEQ_INT, [IEQ_FLOAT] = &&TARGET_IEQ_FLOAT, [IEQ_STRING] = &&TARGET_IEQ_STRING,
+        [INE_INT] = &&TARGET_INE_INT, [INE_FLOAT] = &&TARGET_INE_FLOAT, [INE_STRING] = &&TARGET_INE_STRING,
+        [ILT_INT] = &&TARGET_ILT_INT, [ILT_FLOAT] = &&TARGET_ILT_FLOAT,
+        [IGT_INT] = &&TARGET_IGT_INT, [IGT_FLOAT] = &&TARGET_IGT_FLOAT,
+        [ILE_INT] = &&TARGET_ILE_INT, [ILE_FLOAT] = &&TARGET_ILE_FLOAT,
+        [IGE_INT] = &&TARGET_IGE_INT, [IGE_FLOAT] = &&TARGET_IGE_FLOAT,
+        [ICMPJMPIF_INT] = &&TARGET_ICMPJMPIF_INT, [ILAZY] = &&TARGET_ILAZY,
+    };
+    // every entry leaves the loop, so single stepping costs nothing in the run loop
+    static const void *const step_table[OPCODE_COUNT] = {
+        [0 ... OPCODE_COUNT - 1] = &&step_done,
+    };
+    const void *const *dispatch_table = single_step ? step_table : run_table;
+#endif
+
+dispatch:
+    switch (instr->opcode) {
+        TARGET(INOP)
+            DISPATCH();
+
+        TARGET(ILAZY)
+            if (!program_decode_segment(&vm->program, xpu->ip)) {
+                EERROR(vm, "ERROR: malformed bytecode at instruction %zu", xpu->ip);
+            }
+            args = instr->args;
+            goto dispatch;
+
+        TARGET(IPUSH) {
+            Operand *op = &args[0];
+            Word w;
+            switch (op->kind) {
+                case OPERAND_INT:
+                    w.type = WINT;
+                    w.as_int = op->as_int;
+                    break;
+                case OPERAND_FLOAT:
+                    w.type = WFLOAT;
+                    w.as_float = op->as_float;
+                    break;
+                case OPERAND_STRING:
+                    w.type = WCHARP;
+                    w.as_string = xstring_retain(program_string(&vm->program, op->as_index));
+                    break;
+                case OPERAND_REGISTER:
+                    w = word_retain(regs[op->as_register].reg_value);
+                    break;
+                default:
+                    EERROR(vm, ERROR_BASE"Invalid operand type expected number, string, float or register\n",
+                           vm->program.filename, instr->line);
+            }
+            xstack_push(&xpu->stack, w);
+            DISPATCH();
+        }
+
+        TARGET(IMOV) {
+            Operand *src = &args[0];
+            if (args[1].kind != OPERAND_REGISTER) break;
+            XRegisters dst_reg = args[1].as_register;
+            Word old_value = regs[dst_reg].reg_value;
+
+            switch (src->kind) {
+                case OPERAND_REGISTER:
+                    regs[dst_reg].reg_value = word_retain(regs[src->as_register].reg_value);
+                    break;
+                case OPERAND_INT:
+                    regs[dst_reg].reg_value.type = WINT;
+                    regs[dst_reg].reg_value.as_int = src->as_int;
+                    break;
+                case OPERAND_FLOAT:
+                    regs[dst_reg].reg_value.type = WFLOAT;
+                    regs[dst_reg].reg_value.as_float = src->as_float;
+                    break;
+                case OPERAND_STRING:
+                    regs[dst_reg].reg_value.type = WCHARP;
+                    regs[dst_reg].reg_value.as_string = xstring_retain(program_string(&vm->program, src->as_index));
+                    break;
+                default:
+                    EERROR(vm, ERROR_BASE"Invalid operand type expected number, string, float or register\n",
+                           vm->program.filename, instr->line);
+            }
+            word_release(old_value);
+            DISPATCH();
+        }
+
+        TARGET(IPOP) {
+            if (args[0].kind == OPERAND_REGISTER) {
+                XRegisters reg = args[0].as_register;
+                word_release(regs[reg].reg_value);
                 regs[reg].reg_value = xstack_pop(&xpu->stack);
             } else {
                 EERROR(vm, ERROR_BASE"Invalid register: %s\n",
-                       vm->program.filename, instr->line, operand);
+                       vm->program.filename, instr->line, operand_text(instr, 0));
             }
-            break;
+            DISPATCH();
         }
 
-        case IADD: {
-            if (instr->operands.size >= 2) {
-                char *dest_str = vector_get_str(&instr->operands, 0);
-                char *src_str = vector_get_str(&instr->operands, 1);
-                XRegisters dest_reg = register_name_to_enum(dest_str);
+        TARGET(IADD) {
+            if (instr->argc >= 2) {
+                XRegisters dest_reg = args[0].kind == OPERAND_REGISTER ? args[0].as_register : (XRegisters) -1;
                 Word src_val;
 
-                if (is_register(src_str)) {
-                    XRegisters src_reg = register_name_to_enum(src_str);
-                    if (src_reg != -1) src_val = regs[src_reg].reg_value;
-                } else if (is_number(src_str)) {
+                if (args[1].kind == OPERAND_REGISTER) {
+                    src_val = regs[args[1].as_register].reg_value;
+                } else if (args[1].kind == OPERAND_INT) {
                     src_val.type = WINT;
-                    src_val.as_int = atoi(src_str);
-                } else if (is_float(src_str)) {
+                    src_val.as_int = args[1].as_int;
+                } else if (args[1].kind == OPERAND_FLOAT) {
                     src_val.type = WFLOAT;
-                    src_val.as_float = atof(src_str);
+                    src_val.as_float = args[1].as_float;
                 } else {
                     EERROR(vm, ERROR_BASE"Invalid operand type expected number, float or register\n",
                            vm->program.filename, instr->line);
@@ -1073,11 +2464,10 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                                word_type_to_string(dest->reg_value.type));
                     }
                 }
-            } else if (instr->operands.size == 1) {
-                char *src_str = vector_get_str(&instr->operands, 0);
+            } else if (instr->argc == 1) {
                 Word w = xstack_peek(&xpu->stack, 0);
-                if (is_number(src_str)) {
-                    int imm = atoi(src_str);
+                if (args[0].kind == OPERAND_INT) {
+                    int imm = args[0].as_int;
                     if (w.type == WINT) w.as_int += imm;
                     else if (w.type == WFLOAT) w.as_float += (float) imm;
                     else if (w.type == WPOINTER || w.type == WCHARP) w.as_pointer += imm;
@@ -1086,43 +2476,26 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
             } else {
                 w1 = xstack_pop(&xpu->stack);
                 w2 = xstack_pop(&xpu->stack);
-                if (w1.type == w2.type) {
-                    if (w1.type == WINT) {
-                        result.as_int = w1.as_int + w2.as_int;
-                        result.type = WINT;
-                    } else if (w1.type == WFLOAT) {
-                        result.as_float = w1.as_float + w2.as_float;
-                        result.type = WFLOAT;
-                    } else {
-                        EERROR(vm, ERROR_BASE"type '%s' is not supported \n",
-                               vm->program.filename, instr->line, word_type_to_string(w1.type));
-                    }
-                } else {
-                    EERROR(vm, ERROR_BASE"Invalid types on stack expected two values of same type got %s and %s\n",
-                           vm->program.filename, instr->line, word_type_to_string(w1.type),
-                           word_type_to_string(w2.type));
-                }
+                binary_words(vm, instr, IADD, w2, w1, &result);
+                quicken(instr, w2, w1);
                 xstack_push(&xpu->stack, result);
             }
-            break;
+            DISPATCH();
         }
 
-        case ISUB: {
-            if (instr->operands.size >= 2) {
-                char *dest_str = vector_get_str(&instr->operands, 0);
-                char *src_str = vector_get_str(&instr->operands, 1);
-                XRegisters dest_reg = register_name_to_enum(dest_str);
+        TARGET(ISUB) {
+            if (instr->argc >= 2) {
+                XRegisters dest_reg = args[0].kind == OPERAND_REGISTER ? args[0].as_register : (XRegisters) -1;
                 Word src_val;
 
-                if (is_register(src_str)) {
-                    XRegisters src_reg = register_name_to_enum(src_str);
-                    if (src_reg != -1) src_val = regs[src_reg].reg_value;
-                } else if (is_number(src_str)) {
+                if (args[1].kind == OPERAND_REGISTER) {
+                    src_val = regs[args[1].as_register].reg_value;
+                } else if (args[1].kind == OPERAND_INT) {
                     src_val.type = WINT;
-                    src_val.as_int = atoi(src_str);
-                } else if (is_float(src_str)) {
+                    src_val.as_int = args[1].as_int;
+                } else if (args[1].kind == OPERAND_FLOAT) {
                     src_val.type = WFLOAT;
-                    src_val.as_float = atof(src_str);
+                    src_val.as_float = args[1].as_float;
                 } else {
                     break;
                 }
@@ -1150,90 +2523,48 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                         dest->reg_value.as_float = (float) dest->reg_value.as_int - src_val.as_float;
                     }
                 }
-            } else if (instr->operands.size == 1) {
-                char *src_str = vector_get_str(&instr->operands, 0);
+            } else if (instr->argc == 1) {
                 Word w = xstack_peek(&xpu->stack, 0);
-                if (is_number(src_str)) {
-                    int imm = atoi(src_str);
+                if (args[0].kind == OPERAND_INT) {
+                    int imm = args[0].as_int;
                     if (w.type == WINT) w.as_int -= imm;
-                    else if (w.type == WFLOAT) w.as_float -= (float) imm;
-                    else if (w.type == WPOINTER || w.type == WCHARP) w.as_pointer -= imm;
-                }
-                xstack_push(&xpu->stack, w);
-            } else {
-                w1 = xstack_pop(&xpu->stack);
-                w2 = xstack_pop(&xpu->stack);
-                if (w1.type == w2.type) {
-                    if (w1.type == WINT) {
-                        result.as_int = w1.as_int - w2.as_int;
-                        result.type = WINT;
-                    } else if (w1.type == WFLOAT) {
-                        result.as_float = w1.as_float - w2.as_float;
-                        result.type = WFLOAT;
-                    } else {
-                        EERROR(vm, ERROR_BASE"type '%s' is not supported \n",
-                               vm->program.filename, instr->line, word_type_to_string(w1.type));
-                    }
-                } else {
-                    EERROR(vm, ERROR_BASE"Invalid types on stack expected two values of same type got %s and %s\n",
-                           vm->program.filename, instr->line, word_type_to_string(w1.type),
-                           word_type_to_string(w2.type));
+                    else if (w.type == WFLOAT) w.as_float -= (float) imm;
+                    else if (w.type == WPOINTER || w.type == WCHARP) w.as_pointer -= imm;
                 }
+                xstack_push(&xpu->stack, w);
+            } else {
+                w1 = xstack_pop(&xpu->stack);
+                w2 = xstack_pop(&xpu->stack);
+                binary_words(vm, instr, ISUB, w2, w1, &result);
+                quicken(instr, w2, w1);
                 xstack_push(&xpu->stack, result);
             }
-            break;
+            DISPATCH();
         }
 
-        case IMUL: {
+        TARGET(IMUL) {
             w1 = xstack_pop(&xpu->stack);
             w2 = xstack_pop(&xpu->stack);
-            if (w1.type == WINT && w2.type == WINT) {
-                result.type = WINT;
-                result.as_int = w2.as_int * w1.as_int;
-            } else if (w1.type == WFLOAT && w2.type == WFLOAT) {
-                result.type = WFLOAT;
-                result.as_float = w2.as_float * w1.as_float;
-            } else {
-                EERROR(vm, ERROR_BASE"type '%s' is not supported \n",
-                       vm->program.filename, instr->line, word_type_to_string(w1.type));
-            }
-            xstack_push(&xpu->stack, result);
-            break;
+            if (binary_words(vm, instr, IMUL, w2, w1, &result)) xstack_push(&xpu->stack, result);
+            quicken(instr, w2, w1);
+            DISPATCH();
         }
 
-        case IDIV: {
+        TARGET(IDIV) {
             w1 = xstack_pop(&xpu->stack);
             w2 = xstack_pop(&xpu->stack);
-            if (w1.as_int == 0 || w1.as_float == 0.0f) break;
-            if (w1.type == WINT && w2.type == WINT) {
-                result.type = WINT;
-                result.as_int = w2.as_int / w1.as_int;
-            } else if (w1.type == WFLOAT && w2.type == WFLOAT) {
-                result.type = WFLOAT;
-                result.as_float = w2.as_float / w1.as_float;
-            } else {
-                EERROR(vm, ERROR_BASE"type '%s' is not supported \n",
-                       vm->program.filename, instr->line, word_type_to_string(w1.type));
-            }
-            xstack_push(&xpu->stack, result);
-            break;
+            if (binary_words(vm, instr, IDIV, w2, w1, &result)) xstack_push(&xpu->stack, result);
+            DISPATCH();
         }
 
-        case IMOD: {
+        TARGET(IMOD) {
             w1 = xstack_pop(&xpu->stack);
             w2 = xstack_pop(&xpu->stack);
-            if (w1.type == WINT && w2.type == WINT && w1.as_int != 0) {
-                result.type = WINT;
-                result.as_int = w2.as_int % w1.as_int;
-            } else {
-                EERROR(vm, ERROR_BASE"type '%s' is not supported \n",
-                       vm->program.filename, instr->line, word_type_to_string(w1.type));
-            }
-            xstack_push(&xpu->stack, result);
-            break;
+            if (binary_words(vm, instr, IMOD, w2, w1, &result)) xstack_push(&xpu->stack, result);
+            DISPATCH();
         }
 
-        case IAND: {
+        TARGET(IAND) {
             w1 = xstack_pop(&xpu->stack);
             w2 = xstack_pop(&xpu->stack);
             if (w1.type == WINT && w2.type == WINT) {
@@ -1243,10 +2574,10 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                 EERROR(vm, ERROR_BASE"type '%s' is not supported \n",
                        vm->program.filename, instr->line, word_type_to_string(w1.type));
             }
-            break;
+            DISPATCH();
         }
 
-        case IOR: {
+        TARGET(IOR) {
             w1 = xstack_pop(&xpu->stack);
             w2 = xstack_pop(&xpu->stack);
             if (w1.type == WINT && w2.type == WINT) {
@@ -1257,27 +2588,24 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                        vm->program.filename, instr->line, word_type_to_string(w1.type));
             }
             xstack_push(&xpu->stack, result);
-            break;
+            DISPATCH();
         }
 
-        case IXOR: {
-            if (instr->operands.size >= 2) {
-                char *sreg1 = vector_get_str(&instr->operands, 0);
-                char *sreg2 = vector_get_str(&instr->operands, 1);
-                if (is_register(sreg1) && is_register(sreg2)) {
-                    XRegisters preg1 = register_name_to_enum(sreg1);
-                    XRegisters preg2 = register_name_to_enum(sreg2);
-                    if (preg1 != -1 && preg2 != -1 &&
-                        regs[preg1].reg_value.type == WINT &&
+        TARGET(IXOR) {
+            if (instr->argc >= 2) {
+                if (args[0].kind == OPERAND_REGISTER && args[1].kind == OPERAND_REGISTER) {
+                    XRegisters preg1 = args[0].as_register;
+                    XRegisters preg2 = args[1].as_register;
+                    if (regs[preg1].reg_value.type == WINT &&
                         regs[preg2].reg_value.type == WINT) {
                         regs[preg1].reg_value.as_int ^= regs[preg2].reg_value.as_int;
                     }
                 }
             }
-            break;
+            DISPATCH();
         }
 
-        case INOT: {
+        TARGET(INOT) {
             w1 = xstack_pop(&xpu->stack);
             if (w1.type == WINT) {
                 result.type = WINT;
@@ -1290,228 +2618,147 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                        vm->program.filename, instr->line, word_type_to_string(w1.type));
             }
             xstack_push(&xpu->stack, result);
-            break;
+            DISPATCH();
         }
 
-        case IEQ: {
+        TARGET(IEQ) {
             w1 = xstack_pop(&xpu->stack);
             w2 = xstack_pop(&xpu->stack);
-            result.type = WINT;
-            result.as_int = 0;
-            if (w1.type == w2.type) {
-                switch (w1.type) {
-                    case WINT: result.as_int = (w1.as_int == w2.as_int);
-                        break;
-                    case WFLOAT: result.as_int = (w1.as_float == w2.as_float);
-                        break;
-                    case WCHARP: result.as_int = (strcmp(w1.as_string, w2.as_string) == 0);
-                        break;
-                    default:
-                        EERROR(vm, ERROR_BASE"type '%s' is not supported \n",
-                               vm->program.filename, instr->line, word_type_to_string(w1.type));
-                }
-            }
-            xstack_push(&xpu->stack, result);
-            break;
+            if (binary_words(vm, instr, IEQ, w2, w1, &result)) xstack_push(&xpu->stack, result);
+            quicken(instr, w2, w1);
+            word_release(w1);
+            word_release(w2);
+            DISPATCH();
         }
 
-        case INE: {
+        TARGET(INE) {
             w1 = xstack_pop(&xpu->stack);
             w2 = xstack_pop(&xpu->stack);
-            result.type = WINT;
-            result.as_int = 1;
-            if (w1.type == w2.type) {
-                switch (w1.type) {
-                    case WINT: result.as_int = (w1.as_int != w2.as_int);
-                        break;
-                    case WFLOAT: result.as_int = (w1.as_float != w2.as_float);
-                        break;
-                    case WCHARP: result.as_int = (strcmp(w1.as_string, w2.as_string) != 0);
-                        break;
-                    default:
-                        EERROR(vm, ERROR_BASE"type '%s' is not supported \n",
-                               vm->program.filename, instr->line, word_type_to_string(w1.type));
-                }
-            }
-            xstack_push(&xpu->stack, result);
-            break;
+            if (binary_words(vm, instr, INE, w2, w1, &result)) xstack_push(&xpu->stack, result);
+            quicken(instr, w2, w1);
+            word_release(w1);
+            word_release(w2);
+            DISPATCH();
         }
 
-        case ILT: {
+        TARGET(ILT) {
             w1 = xstack_pop(&xpu->stack);
             w2 = xstack_pop(&xpu->stack);
-            result.type = WINT;
-            result.as_int = 0;
-            if (w1.type == w2.type) {
-                switch (w1.type) {
-                    case WINT: result.as_int = (w2.as_int < w1.as_int);
-                        break;
-                    case WFLOAT: result.as_int = (w2.as_float < w1.as_float);
-                        break;
-                    default:
-                        EERROR(vm, ERROR_BASE"type '%s' is not supported \n",
-                               vm->program.filename, instr->line, word_type_to_string(w1.type));
-                }
-            }
-            xstack_push(&xpu->stack, result);
-            break;
+            if (binary_words(vm, instr, ILT, w2, w1, &result)) xstack_push(&xpu->stack, result);
+            quicken(instr, w2, w1);
+            word_release(w1);
+            word_release(w2);
+            DISPATCH();
         }
 
-        case IGT: {
+        TARGET(IGT) {
             w1 = xstack_pop(&xpu->stack);
             w2 = xstack_pop(&xpu->stack);
-            result.type = WINT;
-            result.as_int = 0;
-            if (w1.type == w2.type) {
-                switch (w1.type) {
-                    case WINT: result.as_int = (w2.as_int > w1.as_int);
-                        break;
-                    case WFLOAT: result.as_int = (w2.as_float > w1.as_float);
-                        break;
-                    default:
-                        EERROR(vm, ERROR_BASE"type '%s' is not supported \n",
-                               vm->program.filename, instr->line, word_type_to_string(w1.type));
-                }
-            }
-            xstack_push(&xpu->stack, result);
-            break;
+            if (binary_words(vm, instr, IGT, w2, w1, &result)) xstack_push(&xpu->stack, result);
+            quicken(instr, w2, w1);
+            word_release(w1);
+            word_release(w2);
+            DISPATCH();
         }
 
-        case ILE: {
+        TARGET(ILE) {
             w1 = xstack_pop(&xpu->stack);
             w2 = xstack_pop(&xpu->stack);
-            result.type = WINT;
-            result.as_int = 0;
-            if (w1.type == w2.type) {
-                switch (w1.type) {
-                    case WINT: result.as_int = (w2.as_int <= w1.as_int);
-                        break;
-                    case WFLOAT: result.as_int = (w2.as_float <= w1.as_float);
-                        break;
-                    default:
-                        EERROR(vm, ERROR_BASE"type '%s' is not supported \n",
-                               vm->program.filename, instr->line, word_type_to_string(w1.type));
-                }
-            }
-            xstack_push(&xpu->stack, result);
-            break;
+            if (binary_words(vm, instr, ILE, w2, w1, &result)) xstack_push(&xpu->stack, result);
+            quicken(instr, w2, w1);
+            word_release(w1);
+            word_release(w2);
+            DISPATCH();
         }
 
-        case IGE: {
+        TARGET(IGE) {
             w1 = xstack_pop(&xpu->stack);
             w2 = xstack_pop(&xpu->stack);
-            result.type = WINT;
-            result.as_int = 0;
-            if (w1.type == w2.type) {
-                switch (w1.type) {
-                    case WINT: result.as_int = (w2.as_int >= w1.as_int);
-                        break;
-                    case WFLOAT: result.as_int = (w2.as_float >= w1.as_float);
-                        break;
-                    default:
-                        EERROR(vm, ERROR_BASE"type '%s' is not supported \n",
-                               vm->program.filename, instr->line, word_type_to_string(w1.type));
-                }
-            }
-            xstack_push(&xpu->stack, result);
-            break;
+            if (binary_words(vm, instr, IGE, w2, w1, &result)) xstack_push(&xpu->stack, result);
+            quicken(instr, w2, w1);
+            word_release(w1);
+            word_release(w2);
+            DISPATCH();
         }
 
-        case IJMP: {
-            char *operand = vector_get_str(&instr->operands, 0);
-            size_t target = 0;
-            if (is_number(operand)) target = atoi(operand);
-            else if (is_label_reference(operand)) find_label(&vm->program, operand, &target);
+        TARGET(IJMP) {
+            size_t target = args[0].kind == OPERAND_LABEL ? args[0].as_index : 0;
             if (target < vm->program.instructions_count) xpu->ip = target - 1;
             else {
                 EERROR(vm, ERROR_BASE"Invalid target: %s %d\n",
-                       vm->program.filename, instr->line, operand, target);
+                       vm->program.filename, instr->line, operand_text(instr, 0), target);
             }
-            break;
+            DISPATCH();
         }
 
-        case IJMPIF: {
+        TARGET(IJMPIF) {
             w1 = xstack_pop(&xpu->stack);
             if (w1.type == WINT && w1.as_int == 1) {
-                char *operand = vector_get_str(&instr->operands, 0);
-                size_t target = 0;
-                if (is_number(operand)) target = atoi(operand);
-                else if (is_label_reference(operand)) find_label(&vm->program, operand, &target);
+                size_t target = args[0].kind == OPERAND_LABEL ? args[0].as_index : 0;
                 if (target < vm->program.instructions_count) xpu->ip = target - 1;
                 else {
                     EERROR(vm, ERROR_BASE"Invalid target: %s %d\n",
-                           vm->program.filename, instr->line, operand, target);
+                           vm->program.filename, instr->line, operand_text(instr, 0), target);
                 }
             }
-            break;
+            DISPATCH();
         }
-        case ICALL: {
-            char *operand = vector_get_str(&instr->operands, 0);
-            size_t target = 0;
-            if (is_number(operand)) {
-                target = atoi(operand);
-            } else if (is_label_reference(operand)) {
-                if (!find_label(&vm->program, operand, &target)) {
-                    EERROR(vm, ERROR_BASE"Label not found: %s\n",
-                           vm->program.filename, instr->line, operand);
-                    return;
-                }
-            } else {
-                EERROR(vm, ERROR_BASE"Invalid call target: %s\n",
-                       vm->program.filename, instr->line, operand);
+        TARGET(IJMPTABLE) {
+            w1 = xstack_pop(&xpu->stack);
+            size_t target = jmptable_target(instr, w1);
+            word_release(w1);
+            if (target < vm->program.instructions_count) xpu->ip = target - 1;
+            else {
+                EERROR(vm, ERROR_BASE"Invalid target: %zu\n", vm->program.filename, instr->line, target);
+            }
+            DISPATCH();
+        }
+        TARGET(ICALL) {
+            if (args[0].kind != OPERAND_LABEL) {
+                EERROR(vm, ERROR_BASE"Label not found: %s\n",
+                       vm->program.filename, instr->line, operand_text(instr, 0));
                 return;
             }
+            size_t target = args[0].as_index;
             if (target >= vm->program.instructions_count) {
                 EERROR(vm, ERROR_BASE"Invalid jump target: %zu\n",
                        vm->program.filename, instr->line, target);
                 return;
             }
-            xstack_push(&vm->xpu.call_stack, (Word){.type = WINT, .as_int = xpu->ip});
+            if (!call_push(xpu, xpu->ip)) {
+                EERROR(vm, ERROR_BASE"Call stack overflow: more than %zu nested calls\n",
+                       vm->program.filename, instr->line, xpu->calls_count);
+                return;
+            }
             xpu->ip = target - 1;
-            //for (size_t i = 1; i < instr->operands.size; i++) {
-
-            for (size_t i = instr->operands.size; i > 0; i--) {
-                size_t operand_index = i - 1;
-                if (operand_index == 0) continue;
-                Word w = parseOperand(vm, vector_get_str(&instr->operands, operand_index), current_scope);
-                if (w.type == WPOINTER && w.as_pointer == NULL) {
-                    EERROR(vm, ERROR_BASE"Failed to parse operand: %s\n",
-                           vm->program.filename, instr->line, vector_get_str(&instr->operands, operand_index));
-                    return;
-                }
-                xstack_push(&xpu->stack, w);
+            for (size_t i = instr->argc; i > 1; i--) {
+                xstack_push(&xpu->stack, operand_to_word(vm, instr, i - 1));
             }
-            break;
+            DISPATCH();
         }
-        case IRET: {
-            Word ra = xstack_pop(&vm->xpu.call_stack);
-            xpu->ip = ra.as_int;
-            break;
+        TARGET(IRET) {
+            xpu->ip = call_pop(xpu);
+            DISPATCH();
         }
-        case ILOAD: {
-            char *operand = vector_get_str(&instr->operands, 0);
-            if (is_register(operand)) {
-                XRegisters reg = register_name_to_enum(operand);
-                if (reg != -1) xstack_push(&xpu->stack, regs[reg].reg_value);
+        TARGET(ILOAD) {
+            if (args[0].kind == OPERAND_REGISTER) {
+                xstack_push(&xpu->stack, word_retain(regs[args[0].as_register].reg_value));
             }
-            break;
+            DISPATCH();
         }
 
-        case ISTORE: {
+        TARGET(ISTORE) {
             w1 = xstack_pop(&xpu->stack);
-            char *operand = vector_get_str(&instr->operands, 0);
-            if (is_register(operand)) {
-                XRegisters reg = register_name_to_enum(operand);
-                if (reg != -1) {
-                    if (regs[reg].reg_value.type == WCHARP)
-                        free(regs[reg].reg_value.as_string);
-                    regs[reg].reg_value = w1;
-                }
+            if (args[0].kind == OPERAND_REGISTER) {
+                XRegisters reg = args[0].as_register;
+                if (regs[reg].reg_value.type == WCHARP)
+                    xstring_release(regs[reg].reg_value.as_string);
+                regs[reg].reg_value = w1;
             }
-            break;
+            DISPATCH();
         }
 
-        case IPRINT: {
+        TARGET(IPRINT) {
             if (instr->operands.size == 0) {
                 w1 = xstack_pop(&xpu->stack);
                 switch (w1.type) {
@@ -1526,45 +2773,43 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                     case WPOINTER: printf("%p\n", w1.as_pointer);
                         break;
                 }
+                word_release(w1);
             } else {
-                char *str = hmerge(instr);
-                printf("%s\n", str);
-                free(str);
+                puts(program_string(&vm->program, args[0].as_index));
             }
-            break;
+            DISPATCH();
         }
 
-        case IDUP: {
+        TARGET(IDUP) {
             w1 = xstack_peek(&xpu->stack, 0);
             switch (w1.type) {
                 case WINT: xstack_push(&xpu->stack, (Word){.type = WINT, .as_int = w1.as_int});
                     break;
                 case WFLOAT: xstack_push(&xpu->stack, (Word){.type = WFLOAT, .as_float = w1.as_float});
                     break;
-                case WCHARP: xstack_push(&xpu->stack, (Word){.type = WCHARP, .as_string = strdup(w1.as_string)});
+                case WCHARP: xstack_push(&xpu->stack, (Word){.type = WCHARP, .as_string = xstring_retain(w1.as_string)});
                     break;
                 case WPOINTER: xstack_push(&xpu->stack, (Word){.type = WPOINTER, .as_pointer = w1.as_pointer});
                     break;
             }
-            break;
+            DISPATCH();
         }
 
-        case ISWAP: {
+        TARGET(ISWAP) {
             w1 = xstack_pop(&xpu->stack);
             w2 = xstack_pop(&xpu->stack);
             xstack_push(&xpu->stack, w1);
             xstack_push(&xpu->stack, w2);
-            break;
+            DISPATCH();
         }
 
-        case IDROP: {
-            xstack_pop(&xpu->stack);
-            break;
+        TARGET(IDROP) {
+            word_release(xstack_pop(&xpu->stack));
+            DISPATCH();
         }
 
-        case IROTL: {
-            char *operand = vector_get_str(&instr->operands, 0);
-            int n = atoi(operand);
+        TARGET(IROTL) {
+            int n = args[0].as_int;
             if (n <= 0 || n >= xpu->stack.count) break;
             Word *temp = malloc(n * sizeof(Word));
             for (int i = 0; i < n; i++) temp[i] = xstack_pop(&xpu->stack);
@@ -1573,12 +2818,11 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
             temp[n - 1] = bottom;
             for (int i = n - 1; i >= 0; i--) xstack_push(&xpu->stack, temp[i]);
             free(temp);
-            break;
+            DISPATCH();
         }
 
-        case IROTR: {
-            char *operand = vector_get_str(&instr->operands, 0);
-            int n = atoi(operand);
+        TARGET(IROTR) {
+            int n = args[0].as_int;
             if (n <= 0 || n >= xpu->stack.count) break;
             Word *temp = malloc(n * sizeof(Word));
             for (int i = 0; i < n; i++) temp[i] = xstack_pop(&xpu->stack);
@@ -1587,16 +2831,14 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
             temp[0] = top;
             for (int i = n - 1; i >= 0; i--) xstack_push(&xpu->stack, temp[i]);
             free(temp);
-            break;
+            DISPATCH();
         }
 
-        case IALLOC: {
+        TARGET(IALLOC) {
             size_t size = 0;
-            if (instr->operands.size >= 1) {
-                char *size_str = vector_get_str(&instr->operands, 0);
-                if (is_type_name(size_str)) {
-                    WordType type = get_type(size_str);
-                    switch (type) {
+            if (instr->argc >= 1) {
+                if (args[0].kind == OPERAND_TYPE) {
+                    switch (args[0].as_type) {
                         case WINT: size = sizeof(int);
                             break;
                         case WFLOAT: size = sizeof(float);
@@ -1611,27 +2853,24 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                             break;
                     }
 
-                    if (instr->operands.size >= 2) {
-                        char *count_str = vector_get_str(&instr->operands, 1);
-                        if (is_number(count_str)) {
-                            size_t count = atoi(count_str);
-                            size *= count;
-                        } else if (is_register(count_str)) {
-                            XRegisters reg = register_name_to_enum(count_str);
-                            if (reg != -1 && regs[reg].reg_value.type == WINT) {
-                                size *= regs[reg].reg_value.as_int;
+                    if (instr->argc >= 2) {
+                        Operand *count = &args[1];
+                        if (count->kind == OPERAND_INT) {
+                            size *= count->as_int;
+                        } else if (count->kind == OPERAND_REGISTER) {
+                            if (regs[count->as_register].reg_value.type == WINT) {
+                                size *= regs[count->as_register].reg_value.as_int;
                             }
-                        } else if (is_variable(count_str, current_scope)) {
-                            Word variable = getvar(vm, count_str, current_scope);
-                            size *= variable.as_int;
+                        } else if (count->kind == OPERAND_VARIABLE) {
+                            Variable *variable = resolve_variable(vm, count);
+                            if (variable) size *= WORD_LOAD(variable->value).as_int;
                         }
                     }
-                } else if (is_number(size_str)) {
-                    size = atoi(size_str);
-                } else if (is_register(size_str)) {
-                    XRegisters reg = register_name_to_enum(size_str);
-                    if (reg != -1 && regs[reg].reg_value.type == WINT) {
-                        size = regs[reg].reg_value.as_int;
+                } else if (args[0].kind == OPERAND_INT) {
+                    size = args[0].as_int;
+                } else if (args[0].kind == OPERAND_REGISTER) {
+                    if (regs[args[0].as_register].reg_value.type == WINT) {
+                        size = regs[args[0].as_register].reg_value.as_int;
                     }
                 }
 
@@ -1640,16 +2879,13 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
 
                     memset(mem, 0, size);
 
-                    if (instr->operands.size >= 3) {
-                        char *dest_reg = vector_get_str(&instr->operands, 2);
-                        if (is_register(dest_reg)) {
-                            XRegisters reg = register_name_to_enum(dest_reg);
-                            if (reg != -1) {
-                                if (regs[reg].reg_value.type == WCHARP)
-                                    free(regs[reg].reg_value.as_string);
-                                regs[reg].reg_value.type = WPOINTER;
-                                regs[reg].reg_value.as_pointer = mem;
-                            }
+                    if (instr->argc >= 3) {
+                        if (args[2].kind == OPERAND_REGISTER) {
+                            XRegisters reg = args[2].as_register;
+                            if (regs[reg].reg_value.type == WCHARP)
+                                xstring_release(regs[reg].reg_value.as_string);
+                            regs[reg].reg_value.type = WPOINTER;
+                            regs[reg].reg_value.as_pointer = mem;
                         }
                     } else {
                         xstack_push(&xpu->stack, (Word){.type = WPOINTER, .as_pointer = mem});
@@ -1712,7 +2948,7 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                                     XRegisters reg = register_name_to_enum(dest_reg);
                                     if (reg != -1) {
                                         if (regs[reg].reg_value.type == WCHARP)
-                                            free(regs[reg].reg_value.as_string);
+                                            xstring_release(regs[reg].reg_value.as_string);
                                         regs[reg].reg_value.type = WPOINTER;
                                         regs[reg].reg_value.as_pointer = mem;
                                     }
@@ -1726,28 +2962,31 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                     EERROR(vm, ERROR_BASE"expected minimum one item on stack\n", vm->program.filename, instr->line);
                 }
             }
-            break;
+            DISPATCH();
         }
 
-        case IMERGE: {
+        TARGET(IMERGE) {
             if (instr->operands.size == 0) {
                 w1 = xstack_pop(&xpu->stack);
                 w2 = xstack_pop(&xpu->stack);
                 if (w1.type == WCHARP && w2.type == WCHARP) {
-                    char *merged = malloc(strlen(w1.as_string) + strlen(w2.as_string) + 2);
-                    strcpy(merged, w2.as_string);
-                    strcat(merged, " ");
-                    strcat(merged, w1.as_string);
+                    size_t len1 = strlen(w1.as_string), len2 = strlen(w2.as_string);
+                    char *merged = xstring_alloc(len2 + 1 + len1);
+                    memcpy(merged, w2.as_string, len2);
+                    merged[len2] = ' ';
+                    memcpy(merged + len2 + 1, w1.as_string, len1);
                     xstack_push(&xpu->stack, (Word){.type = WCHARP, .as_string = merged});
                 }
+                word_release(w1);
+                word_release(w2);
             } else {
-                char *merged = hmerge(instr);
+                char *merged = xstring_retain(program_string(&vm->program, args[0].as_index));
                 xstack_push(&xpu->stack, (Word){.type = WCHARP, .as_string = merged});
             }
-            break;
+            DISPATCH();
         }
 
-        case IXCALL: {
+        TARGET(IXCALL) {
             if (rax->reg_value.type == WINT) {
                 switch (rax->reg_value.as_int) {
                     case 1:
@@ -1772,16 +3011,16 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                         break;
                 }
             }
-            break;
+            DISPATCH();
         }
 
-        case IWRITEMEM: {
+        TARGET(IWRITEMEM) {
             void *dest_addr = NULL;
             size_t offset = 0;
             Word value;
             WordType write_type = WINT;
 
-            if (instr->operands.size == 0) {
+            if (instr->argc == 0) {
                 Word addr_word = xstack_pop(&xpu->stack);
                 if (addr_word.type == WPOINTER) {
                     dest_addr = addr_word.as_pointer;
@@ -1791,14 +3030,13 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                     vm->program.exit_code = 1;
                     return;
                 }
-            } else if (instr->operands.size >= 1) {
-                char *dest = vector_get_str(&instr->operands, 0);
-                if (is_register(dest)) {
-                    XRegisters reg = register_name_to_enum(dest);
-                    if (reg != -1 && regs[reg].reg_value.type == WPOINTER) {
+            } else if (instr->argc >= 1) {
+                if (args[0].kind == OPERAND_REGISTER) {
+                    XRegisters reg = args[0].as_register;
+                    if (regs[reg].reg_value.type == WPOINTER) {
                         dest_addr = regs[reg].reg_value.as_pointer;
                     } else {
-                        OERROR(stderr, "ERROR: Register %s must contain a pointer for WRITEMEM\n", dest);
+                        OERROR(stderr, "ERROR: Register %s must contain a pointer for WRITEMEM\n", operand_text(instr, 0));
                         vm->xpu.ip = vm->program.instructions_count;
                         vm->program.exit_code = 1;
                         return;
@@ -1806,7 +3044,7 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                 }
             }
 
-            if (instr->operands.size <= 1) {
+            if (instr->argc <= 1) {
                 Word off_word = xstack_pop(&xpu->stack);
                 if (off_word.type == WINT) {
                     offset = off_word.as_int;
@@ -1816,16 +3054,15 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                     vm->program.exit_code = 1;
                     return;
                 }
-            } else if (instr->operands.size >= 2) {
-                char *off = vector_get_str(&instr->operands, 1);
-                if (is_number(off)) {
-                    offset = atoi(off);
-                } else if (is_register(off)) {
-                    XRegisters reg = register_name_to_enum(off);
-                    if (reg != -1 && regs[reg].reg_value.type == WINT) {
+            } else if (instr->argc >= 2) {
+                if (args[1].kind == OPERAND_INT) {
+                    offset = args[1].as_int;
+                } else if (args[1].kind == OPERAND_REGISTER) {
+                    XRegisters reg = args[1].as_register;
+                    if (regs[reg].reg_value.type == WINT) {
                         offset = regs[reg].reg_value.as_int;
                     } else {
-                        OERROR(stderr, "ERROR: Register %s must contain an integer for offset\n", off);
+                        OERROR(stderr, "ERROR: Register %s must contain an integer for offset\n", operand_text(instr, 1));
                         vm->xpu.ip = vm->program.instructions_count;
                         vm->program.exit_code = 1;
                         return;
@@ -1833,7 +3070,7 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                 }
             }
 
-            if (instr->operands.size <= 2) {
+            if (instr->argc <= 2) {
                 Word type_word = xstack_pop(&xpu->stack);
                 if (type_word.type == WINT) {
                     write_type = (WordType) type_word.as_int;
@@ -1849,43 +3086,26 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                     vm->program.exit_code = 1;
                     return;
                 }
-            } else if (instr->operands.size >= 3) {
-                char *type_str = vector_get_str(&instr->operands, 2);
-                write_type = get_type(type_str);
+            } else if (instr->argc >= 3) {
+                write_type = args[2].as_type;
             }
 
-            if (instr->operands.size >= 4) {
-                char *val_str = vector_get_str(&instr->operands, 3);
-                if (is_register(val_str)) {
-                    XRegisters reg = register_name_to_enum(val_str);
-                    if (reg != -1) {
-                        value = regs[reg].reg_value;
-                    } else {
-                        OERROR(stderr, "ERROR: Invalid register %s\n", val_str);
-                        vm->xpu.ip = vm->program.instructions_count;
-                        vm->program.exit_code = 1;
-                        return;
-                    }
-                } else if (is_number(val_str)) {
+            if (instr->argc >= 4) {
+                Operand *val = &args[3];
+                if (val->kind == OPERAND_REGISTER) {
+                    value = regs[val->as_register].reg_value;
+                } else if (val->kind == OPERAND_INT) {
                     value.type = WINT;
-                    value.as_int = atoi(val_str);
-                } else if (is_float(val_str)) {
+                    value.as_int = val->as_int;
+                } else if (val->kind == OPERAND_FLOAT) {
                     value.type = WFLOAT;
-                    value.as_float = atof(val_str);
-                } else if (is_string(val_str)) {
+                    value.as_float = val->as_float;
+                } else if (val->kind == OPERAND_STRING) {
+                    // the pool keeps ownership, WCHARP writes duplicate it
                     value.type = WCHARP;
-                    size_t len = strlen(val_str) - 2;
-                    value.as_string = malloc(len + 1);
-                    if (!value.as_string) {
-                        OERROR(stderr, "ERROR: Failed to allocate memory for string\n");
-                        vm->xpu.ip = vm->program.instructions_count;
-                        vm->program.exit_code = 1;
-                        return;
-                    }
-                    strncpy(value.as_string, val_str + 1, len);
-                    value.as_string[len] = '\0';
+                    value.as_string = program_string(&vm->program, val->as_index);
                 } else {
-                    OERROR(stderr, "ERROR: Invalid value format %s\n", val_str);
+                    OERROR(stderr, "ERROR: Invalid value format %s\n", operand_text(instr, 3));
                     vm->xpu.ip = vm->program.instructions_count;
                     vm->program.exit_code = 1;
                     return;
@@ -1958,15 +3178,14 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                 return;
             }
 
-            if (instr->operands.size < 4 && value.type == WCHARP && value.as_string != NULL) {
-                free(value.as_string);
+            if (instr->argc < 4 && value.type == WCHARP && value.as_string != NULL) {
+                xstring_release(value.as_string);
             }
-            break;
+            DISPATCH();
         }
 
-        case ISIZEOF: {
-            char *operand = vector_get_str(&instr->operands, 0);
-            WordType type = get_type(operand);
+        TARGET(ISIZEOF) {
+            WordType type = args[0].as_type;
             int size = 0;
             switch (type) {
                 case WINT: size = sizeof(int);
@@ -1981,78 +3200,70 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                     break;
             }
             xstack_push(&xpu->stack, (Word){.type = WINT, .as_int = size});
-            break;
+            DISPATCH();
         }
 
-        case IDEC: {
-            char *operand = vector_get_str(&instr->operands, 0);
-            XRegisters reg = register_name_to_enum(operand);
-            if (reg != -1 && regs[reg].reg_value.type == WINT)
-                regs[reg].reg_value.as_int--;
-            else if (is_variable(operand, current_scope)) {
-                w1 = getvar(vm, operand, current_scope);
-
-                if (w1.type == WPOINTER && w1.as_pointer == NULL) {
-                    OERROR(stderr, "ERROR: could not found variable '%s'\n", operand);
-                } else {
-                    if (w1.type == WINT) {
-                        w1.as_int -= 1;
-                    }
-                    setvar(vm, operand, current_scope, w1);
+        TARGET(IDEC) {
+            if (args[0].kind == OPERAND_REGISTER) {
+                XRegisters reg = args[0].as_register;
+                if (regs[reg].reg_value.type == WINT) regs[reg].reg_value.as_int--;
+            } else if (args[0].kind == OPERAND_VARIABLE) {
+                Variable *var = resolve_variable(vm, &args[0]);
+                if (var == NULL) break;
+
+                Word value = WORD_LOAD(var->value);
+                if (value.type == WPOINTER && value.as_pointer == NULL) {
+                    OERROR(stderr, "ERROR: could not found variable '%s'\n", operand_text(instr, 0));
+                } else if (value.type == WINT) {
+                    value.as_int -= 1;
+                    WORD_STORE(var->value, value);
                 }
             }
 
-            break;
+            DISPATCH();
         }
 
-        case IINC: {
-            char *operand = vector_get_str(&instr->operands, 0);
-            XRegisters reg = register_name_to_enum(operand);
-            if (reg != -1 && regs[reg].reg_value.type == WINT)
-                regs[reg].reg_value.as_int++;
-            else if (is_variable(operand, current_scope)) {
-                w1 = getvar(vm, operand, current_scope);
-
-                if (w1.type == WPOINTER && w1.as_pointer == NULL) {
-                    OERROR(stderr, "ERROR: could not found variable '%s'\n", operand);
-                } else {
-                    if (w1.type == WINT) {
-                        w1.as_int += 1;
-                    }
-                    setvar(vm, operand, current_scope, w1);
+        TARGET(IINC) {
+            if (args[0].kind == OPERAND_REGISTER) {
+                XRegisters reg = args[0].as_register;
+                if (regs[reg].reg_value.type == WINT) regs[reg].reg_value.as_int++;
+            } else if (args[0].kind == OPERAND_VARIABLE) {
+                Variable *var = resolve_variable(vm, &args[0]);
+                if (var == NULL) break;
+
+                Word value = WORD_LOAD(var->value);
+                if (value.type == WPOINTER && value.as_pointer == NULL) {
+                    OERROR(stderr, "ERROR: could not found variable '%s'\n", operand_text(instr, 0));
+                } else if (value.type == WINT) {
+                    value.as_int += 1;
+                    WORD_STORE(var->value, value);
                 }
             }
-            break;
+            DISPATCH();
         }
 
-        case IEVAL: {
-            char *expr = hmerge(instr);
-            int val = eval(expr);
+        TARGET(IEVAL) {
+            int val = instr->argc ? args[0].as_int : 0;
             xstack_push(&xpu->stack, (Word){.type = WINT, .as_int = val});
-            free(expr);
         }
-        break;
+        DISPATCH();
 
-        case ICMP: {
-            if (instr->operands.size >= 2) {
-                char *op1 = vector_get_str(&instr->operands, 0);
-                char *op2 = vector_get_str(&instr->operands, 1);
-                Word w1, w2;
+        TARGET(ICMP) {
+            if (instr->argc >= 2) {
+                Word w1 = {0}, w2 = {0};
 
-                if (is_register(op1)) {
-                    XRegisters reg = register_name_to_enum(op1);
-                    w1 = regs[reg].reg_value;
-                } else if (is_number(op1)) {
+                if (args[0].kind == OPERAND_REGISTER) {
+                    w1 = regs[args[0].as_register].reg_value;
+                } else if (args[0].kind == OPERAND_INT) {
                     w1.type = WINT;
-                    w1.as_int = atoi(op1);
+                    w1.as_int = args[0].as_int;
                 }
 
-                if (is_register(op2)) {
-                    XRegisters reg = register_name_to_enum(op2);
-                    w2 = regs[reg].reg_value;
-                } else if (is_number(op2)) {
+                if (args[1].kind == OPERAND_REGISTER) {
+                    w2 = regs[args[1].as_register].reg_value;
+                } else if (args[1].kind == OPERAND_INT) {
                     w2.type = WINT;
-                    w2.as_int = atoi(op2);
+                    w2.as_int = args[1].as_int;
                 }
 
                 int cmp = 0;
@@ -2070,14 +3281,14 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                 rdx->reg_value.as_int = cmp;
             }
         }
-        break;
+        DISPATCH();
 
-        case IREADMEM: {
+        TARGET(IREADMEM) {
             void *src_addr = NULL;
             size_t offset = 0;
             WordType read_type = WINT;
 
-            if (instr->operands.size == 0) {
+            if (instr->argc == 0) {
                 Word addr_word = xstack_pop(&xpu->stack);
                 if (addr_word.type == WPOINTER) {
                     src_addr = addr_word.as_pointer;
@@ -2087,14 +3298,13 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                     vm->program.exit_code = 1;
                     return;
                 }
-            } else if (instr->operands.size >= 1) {
-                char *src = vector_get_str(&instr->operands, 0);
-                if (is_register(src)) {
-                    XRegisters reg = register_name_to_enum(src);
-                    if (reg != -1 && regs[reg].reg_value.type == WPOINTER) {
+            } else if (instr->argc >= 1) {
+                if (args[0].kind == OPERAND_REGISTER) {
+                    XRegisters reg = args[0].as_register;
+                    if (regs[reg].reg_value.type == WPOINTER) {
                         src_addr = regs[reg].reg_value.as_pointer;
                     } else {
-                        OERROR(stderr, "ERROR: Register %s must contain a pointer for READMEM\n", src);
+                        OERROR(stderr, "ERROR: Register %s must contain a pointer for READMEM\n", operand_text(instr, 0));
                         vm->xpu.ip = vm->program.instructions_count;
                         vm->program.exit_code = 1;
                         return;
@@ -2102,7 +3312,7 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                 }
             }
 
-            if (instr->operands.size <= 1) {
+            if (instr->argc <= 1) {
                 Word off_word = xstack_pop(&xpu->stack);
                 if (off_word.type == WINT) {
                     offset = off_word.as_int;
@@ -2112,16 +3322,15 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                     vm->program.exit_code = 1;
                     return;
                 }
-            } else if (instr->operands.size >= 2) {
-                char *off = vector_get_str(&instr->operands, 1);
-                if (is_number(off)) {
-                    offset = atoi(off);
-                } else if (is_register(off)) {
-                    XRegisters reg = register_name_to_enum(off);
-                    if (reg != -1 && regs[reg].reg_value.type == WINT) {
+            } else if (instr->argc >= 2) {
+                if (args[1].kind == OPERAND_INT) {
+                    offset = args[1].as_int;
+                } else if (args[1].kind == OPERAND_REGISTER) {
+                    XRegisters reg = args[1].as_register;
+                    if (regs[reg].reg_value.type == WINT) {
                         offset = regs[reg].reg_value.as_int;
                     } else {
-                        OERROR(stderr, "ERROR: Register %s must contain an integer for offset\n", off);
+                        OERROR(stderr, "ERROR: Register %s must contain an integer for offset\n", operand_text(instr, 1));
                         vm->xpu.ip = vm->program.instructions_count;
                         vm->program.exit_code = 1;
                         return;
@@ -2129,7 +3338,7 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                 }
             }
 
-            if (instr->operands.size <= 2) {
+            if (instr->argc <= 2) {
                 Word type_word = xstack_pop(&xpu->stack);
                 if (type_word.type == WINT) {
                     read_type = (WordType) type_word.as_int;
@@ -2145,9 +3354,8 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                     vm->program.exit_code = 1;
                     return;
                 }
-            } else if (instr->operands.size >= 3) {
-                char *type_str = vector_get_str(&instr->operands, 2);
-                read_type = get_type(type_str);
+            } else if (instr->argc >= 3) {
+                read_type = args[2].as_type;
             }
 
             if (src_addr) {
@@ -2170,7 +3378,7 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                     case WCHARP:
                         result.type = WCHARP;
                         if (*(char **) read_addr != NULL) {
-                            result.as_string = strdup(*(char **) read_addr);
+                            result.as_string = xstring_from(*(char **) read_addr);
                             if (!result.as_string) {
                                 OERROR(stderr, "ERROR: Failed to allocate memory for string\n");
                                 vm->xpu.ip = vm->program.instructions_count;
@@ -2192,27 +3400,16 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                         return;
                 }
 
-                if (instr->operands.size >= 4) {
-                    char *dest = vector_get_str(&instr->operands, 3);
-                    if (is_register(dest)) {
-                        XRegisters reg = register_name_to_enum(dest);
-                        if (reg != -1) {
-                            if (regs[reg].reg_value.type == WCHARP && regs[reg].reg_value.as_string != NULL) {
-                                free(regs[reg].reg_value.as_string);
-                            }
-                            regs[reg].reg_value = result;
-                        } else {
-                            if (result.type == WCHARP && result.as_string != NULL) {
-                                free(result.as_string);
-                            }
-                            OERROR(stderr, "ERROR: Invalid register %s\n", dest);
-                            vm->xpu.ip = vm->program.instructions_count;
-                            vm->program.exit_code = 1;
-                            return;
+                if (instr->argc >= 4) {
+                    if (args[3].kind == OPERAND_REGISTER) {
+                        XRegisters reg = args[3].as_register;
+                        if (regs[reg].reg_value.type == WCHARP && regs[reg].reg_value.as_string != NULL) {
+                            xstring_release(regs[reg].reg_value.as_string);
                         }
+                        regs[reg].reg_value = result;
                     } else {
                         if (result.type == WCHARP && result.as_string != NULL) {
-                            free(result.as_string);
+                            xstring_release(result.as_string);
                         }
                         OERROR(stderr, "ERROR: Destination must be a register\n");
                         vm->xpu.ip = vm->program.instructions_count;
@@ -2228,53 +3425,43 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                 vm->program.exit_code = 1;
                 return;
             }
-            break;
+            DISPATCH();
         }
 
-        case ICPYMEM: {
+        TARGET(ICPYMEM) {
             w1 = xstack_pop(&xpu->stack);
             w2 = xstack_pop(&xpu->stack);
             Word n = xstack_pop(&xpu->stack);
             if (w1.type == WPOINTER && w2.type == WPOINTER && n.type == WINT)
                 memcpy(w1.as_pointer, w2.as_pointer, n.as_int);
         }
-        break;
+        DISPATCH();
 
         // TODO: Implment ISYSCALL
 
-        case IMEMCMP: {
+        TARGET(IMEMCMP) {
             void *addr1 = NULL;
             void *addr2 = NULL;
             size_t size = 0;
 
-            if (instr->operands.size >= 1) {
-                char *ptr1 = vector_get_str(&instr->operands, 0);
-                if (is_register(ptr1)) {
-                    XRegisters reg = register_name_to_enum(ptr1);
-                    if (reg != -1 && regs[reg].reg_value.type == WPOINTER) {
-                        addr1 = regs[reg].reg_value.as_pointer;
-                    }
+            if (instr->argc >= 1 && args[0].kind == OPERAND_REGISTER) {
+                if (regs[args[0].as_register].reg_value.type == WPOINTER) {
+                    addr1 = regs[args[0].as_register].reg_value.as_pointer;
                 }
             }
 
-            if (instr->operands.size >= 2) {
-                char *ptr2 = vector_get_str(&instr->operands, 1);
-                if (is_register(ptr2)) {
-                    XRegisters reg = register_name_to_enum(ptr2);
-                    if (reg != -1 && regs[reg].reg_value.type == WPOINTER) {
-                        addr2 = regs[reg].reg_value.as_pointer;
-                    }
+            if (instr->argc >= 2 && args[1].kind == OPERAND_REGISTER) {
+                if (regs[args[1].as_register].reg_value.type == WPOINTER) {
+                    addr2 = regs[args[1].as_register].reg_value.as_pointer;
                 }
             }
 
-            if (instr->operands.size >= 3) {
-                char *sz = vector_get_str(&instr->operands, 2);
-                if (is_number(sz)) {
-                    size = atoi(sz);
-                } else if (is_register(sz)) {
-                    XRegisters reg = register_name_to_enum(sz);
-                    if (reg != -1 && regs[reg].reg_value.type == WINT) {
-                        size = regs[reg].reg_value.as_int;
+            if (instr->argc >= 3) {
+                if (args[2].kind == OPERAND_INT) {
+                    size = args[2].as_int;
+                } else if (args[2].kind == OPERAND_REGISTER) {
+                    if (regs[args[2].as_register].reg_value.type == WINT) {
+                        size = regs[args[2].as_register].reg_value.as_int;
                     }
                 }
             }
@@ -2282,127 +3469,108 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
             if (addr1 && addr2 && size > 0) {
                 int result = memcmp(addr1, addr2, size);
 
-                if (instr->operands.size >= 4) {
-                    char *dest = vector_get_str(&instr->operands, 3);
-                    if (is_register(dest)) {
-                        XRegisters reg = register_name_to_enum(dest);
-                        if (reg != -1) {
-                            if (regs[reg].reg_value.type == WCHARP)
-                                free(regs[reg].reg_value.as_string);
-                            regs[reg].reg_value.type = WINT;
-                            regs[reg].reg_value.as_int = result;
-                        }
+                if (instr->argc >= 4) {
+                    if (args[3].kind == OPERAND_REGISTER) {
+                        XRegisters reg = args[3].as_register;
+                        if (regs[reg].reg_value.type == WCHARP)
+                            xstring_release(regs[reg].reg_value.as_string);
+                        regs[reg].reg_value.type = WINT;
+                        regs[reg].reg_value.as_int = result;
                     }
                 } else {
                     xstack_push(&xpu->stack, (Word){.type = WINT, .as_int = result});
                 }
             }
         }
-        break;
+        DISPATCH();
 
-        case IVAR: {
-            if (instr->operands.size < 1) {
+        TARGET(IVAR) {
+            if (instr->argc < 1) {
                 OERROR(stderr, "ERROR: 'IVAR' requires a variable name\n");
                 break;
             }
-            char *name = vector_get_str(&instr->operands, 0);
-            Variable var;
-            var.name = strdup(name);
-            var.value.type = WPOINTER;
-            var.value.as_pointer = NULL;
-            vector_push(current_scope, &var);
+            bind_variable(vm, &args[0]);
         }
-        break;
+        DISPATCH();
 
-        case ISETVAR: {
-            if (instr->operands.size < 1) {
+        TARGET(ISETVAR) {
+            if (instr->argc < 1) {
                 OERROR(stderr, "ERROR: 'ISETVAR' requires a variable name\n");
                 break;
             }
-            char *var_name = vector_get_str(&instr->operands, 0);
             if (vm->xpu.stack.count == 0) {
                 OERROR(stderr, "ERROR: ISETVAR: Stack underflow\n");
                 break;
             }
             Word new_value = xstack_pop(&vm->xpu.stack);
-            setvar(vm, var_name, current_scope, new_value);
+            assign_variable(bind_variable(vm, &args[0]), new_value);
+            word_release(new_value);
         }
-        break;
+        DISPATCH();
 
-        case IGETVAR: {
-            if (instr->operands.size < 1) {
+        TARGET(IGETVAR) {
+            if (instr->argc < 1) {
                 OERROR(stderr, "ERROR: 'IGETVAR' requires a variable name\n");
                 break;
             }
-            char *var_name = vector_get_str(&instr->operands, 0);
-            Word found_var = getvar(vm, var_name, current_scope);
+            Variable *var = resolve_variable(vm, &args[0]);
+            Word found_var = var ? variable_value(var) : (Word){.type = WPOINTER, .as_pointer = NULL};
             if (found_var.type == WPOINTER && found_var.as_pointer == NULL) {
-                OERROR(stderr, "ERROR: IGETVAR: variable '%s' not found\n", var_name);
+                OERROR(stderr, "ERROR: IGETVAR: variable '%s' not found\n", operand_text(instr, 0));
             } else {
                 xstack_push(&vm->xpu.stack, found_var);
             }
         }
-        break;
+        DISPATCH();
 
-        case ITOGGLELOCALSCOPE: {
-            static int status = 1;
-            if (status) {
-                Vector *local_scope = malloc(sizeof(Vector));
-                vector_init(local_scope, 5, sizeof(Variable));
-                current_scope = local_scope;
-            } else {
-                vector_free(current_scope);
-                current_scope = &vm->program.variables;
-            }
+        TARGET(ITOGGLELOCALSCOPE) {
+            frame_toggle(xpu);
         }
-        break;
+        DISPATCH();
 
-        case ISETGLOBALVAR: {
-            if (instr->operands.size < 1) {
+        TARGET(ISETGLOBALVAR) {
+            if (instr->argc < 1) {
                 OERROR(stderr, "ERROR: 'ISETGLOBALVAR' requires a variable name\n");
                 break;
             }
-            char *var_name = vector_get_str(&instr->operands, 0);
             if (vm->xpu.stack.count == 0) {
                 OERROR(stderr, "ERROR: ISETGLOBALVAR: Stack underflow\n");
                 break;
             }
             Word new_value = xstack_pop(&vm->xpu.stack);
-            setvar(vm, var_name, &vm->program.variables, new_value);
+            setvar_slot(vm, args[0].as_index, &vm->program.variables, new_value);
+            word_release(new_value);
         }
-        break;
+        DISPATCH();
 
-        case IGETGLOBALVAR: {
-            if (instr->operands.size < 1) {
+        TARGET(IGETGLOBALVAR) {
+            if (instr->argc < 1) {
                 OERROR(stderr, "ERROR: 'IGETGLOBALVAR' requires a variable name\n");
                 break;
             }
-            char *var_name = vector_get_str(&instr->operands, 0);
-            Word found_var = getvar(vm, var_name, &vm->program.variables);
+            Word found_var = getvar_slot(vm, args[0].as_index, &vm->program.variables);
             if (found_var.type == WPOINTER && found_var.as_pointer == NULL) {
-                OERROR(stderr, "ERROR: IGETGLOBALVAR: variable '%s' not found\n", var_name);
+                OERROR(stderr, "ERROR: IGETGLOBALVAR: variable '%s' not found\n", operand_text(instr, 0));
             } else {
                 xstack_push(&vm->xpu.stack, found_var);
             }
         }
-        break;
+        DISPATCH();
 
 
-        case IFREE: {
+        TARGET(IFREE) {
             void *ptr_to_free = NULL;
-            if (instr->operands.size >= 1) {
-                char *operand = vector_get_str(&instr->operands, 0);
-
-                if (is_register(operand)) {
-                    XRegisters reg = register_name_to_enum(operand);
-                    if (reg != -1 && regs[reg].reg_value.type == WPOINTER) {
+            if (instr->argc >= 1) {
+                if (args[0].kind == OPERAND_REGISTER) {
+                    XRegisters reg = args[0].as_register;
+                    if (regs[reg].reg_value.type == WPOINTER) {
                         ptr_to_free = regs[reg].reg_value.as_pointer;
 
                         free(ptr_to_free);
                         regs[reg].reg_value.as_pointer = NULL;
                     }
-                } else if (is_pointer(operand)) {
-                    ptr_to_free = get_pointer(operand);
+                } else if (args[0].kind == OPERAND_POINTER) {
+                    ptr_to_free = args[0].as_pointer;
 
                     free(ptr_to_free);
                 }
@@ -2413,10 +3581,10 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                     free(ptr_to_free);
                 }
             }
-            break;
+            DISPATCH();
         }
 
-        case IOVM: {
+        TARGET(IOVM) {
             char *arg = vector_get_str(&instr->operands, 0);
             if (strcmp(arg, "stack") == 0) {
                 arg = xstack_pop_and_expect(vm, WCHARP).as_string;
@@ -2426,25 +3594,25 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
             } else if (strcmp(arg, "stack_ptr") == 0) {
                 xstack_push(&vm->xpu.stack, (Word){.type = WPOINTER, .as_pointer = (void *) vm->xpu.stack.stack});
             } else if (strcmp(arg, "platform") == 0) {
-                xstack_push(&vm->xpu.stack, (Word){.type = WCHARP, .as_string = strdup(PLATFORM)});
+                xstack_push(&vm->xpu.stack, (Word){.type = WCHARP, .as_string = xstring_from(PLATFORM)});
             }
         }
-        break;
+        DISPATCH();
 
-        case ICAST: {
+        TARGET(ICAST) {
             Word w = xstack_pop(&xpu->stack);
-            w.type = get_type(vector_get_str(&instr->operands, 0));
+            w.type = args[0].as_type;
             xstack_push(&xpu->stack, w);
         }
-        break;
-        case IHERE: {
+        DISPATCH();
+        TARGET(IHERE) {
             xstack_push(&vm->xpu.stack, (Word){
-                            .type = WCHARP, .as_string = format("%s:%zu", vm->program.filename, instr->line)
+                            .type = WCHARP, .as_string = xstring_adopt(format("%s:%zu", vm->program.filename, instr->line))
                         });
         }
-        break;
+        DISPATCH();
 
-        case ISPRINTF: {
+        TARGET(ISPRINTF) {
             Word format_word = xstack_pop(&xpu->stack);
             if (format_word.type != WCHARP || format_word.as_string == NULL) {
                 EERROR(vm, ERROR_BASE"Expected format string for sprintf, got %s\n",
@@ -2465,26 +3633,26 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
             if (!xstack_check(&xpu->stack, arg_count)) {
                 EERROR(vm, ERROR_BASE"Stack underflow: sprintf requires %d arguments\n",
                        vm->program.filename, instr->line, arg_count);
-                free(format_word.as_string);
+                xstring_release(format_word.as_string);
                 break;
             }
 
-            Word *args = malloc(arg_count * sizeof(Word));
-            if (!args) {
+            Word *fmt_args = malloc(arg_count * sizeof(Word));
+            if (!fmt_args) {
                 EERROR(vm, ERROR_BASE"Failed to allocate memory for sprintf arguments\n",
                        vm->program.filename, instr->line);
-                free(format_word.as_string);
+                xstring_release(format_word.as_string);
                 break;
             }
 
             for (int i = arg_count - 1; i >= 0; i--) {
-                args[i] = xstack_pop(&xpu->stack);
+                fmt_args[i] = xstack_pop(&xpu->stack);
             }
 
             int size = 0;
             char *tmp_buf = NULL;
             for (int i = 0; i < arg_count; i++) {
-                Word arg = args[i];
+                Word arg = fmt_args[i];
                 switch (arg.type) {
                     case WINT: size += snprintf(NULL, 0, "%d", arg.as_int);
                         break;
@@ -2501,20 +3669,20 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                     default:
                         EERROR(vm, ERROR_BASE"Unsupported argument type %s for sprintf\n",
                                vm->program.filename, instr->line, word_type_to_string(arg.type));
-                        free(args);
-                        free(format_word.as_string);
+                        free(fmt_args);
+                        xstring_release(format_word.as_string);
                         return;
                 }
             }
 
             size += strlen(fmt) + 1;
 
-            char *result = malloc(size);
+            char *result = xstring_alloc(size);
             if (!result) {
                 EERROR(vm, ERROR_BASE"Failed to allocate memory for sprintf result\n",
                        vm->program.filename, instr->line);
-                free(args);
-                free(format_word.as_string);
+                free(fmt_args);
+                xstring_release(format_word.as_string);
                 break;
             }
 
@@ -2532,7 +3700,7 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
                     specifier[spec_len++] = *p;
                     specifier[spec_len] = '\0';
 
-                    Word arg = args[arg_index++];
+                    Word arg = fmt_args[arg_index++];
                     switch (arg.type) {
                         case WINT:
                             offset += snprintf(result + offset, size - offset, specifier, arg.as_int);
@@ -2567,55 +3735,430 @@ void execute_instruction(OrtaVM *vm, InstructionData *instr) {
             Word result_word = {.type = WCHARP, .as_string = result};
             xstack_push(&xpu->stack, result_word);
 
-            for (int i = 0; i < arg_count; i++) {
-                if (args[i].type == WCHARP && args[i].as_string != NULL) {
-                    free(args[i].as_string);
-                }
-            }
-            free(args);
-            free(format_word.as_string);
-            break;
+            for (int i = 0; i < arg_count; i++) {
+                if (fmt_args[i].type == WCHARP && fmt_args[i].as_string != NULL) {
+                    xstring_release(fmt_args[i].as_string);
+                }
+            }
+            free(fmt_args);
+            xstring_release(format_word.as_string);
+            DISPATCH();
+        }
+
+        TARGET(ICMPJMPIF) {
+            // cmpjmpif <cmp> <label> [a] [b]: push a, push b, compare, jmpif label
+            size_t pushed = instr->argc - 2;
+            w1 = pushed >= 1 ? operand_to_word(vm, instr, instr->argc - 1) : xstack_pop(&xpu->stack);
+            w2 = pushed >= 2 ? operand_to_word(vm, instr, 2) : xstack_pop(&xpu->stack);
+            binary_words(vm, instr, (Instruction) args[0].as_int, w2, w1, &result);
+            quicken(instr, w2, w1);
+            word_release(w1);
+            word_release(w2);
+            if (result.as_int == 1) {
+                size_t target = args[1].kind == OPERAND_LABEL ? args[1].as_index : 0;
+                if (target < vm->program.instructions_count) xpu->ip = target - 1;
+                else {
+                    EERROR(vm, ERROR_BASE"Invalid target: %s %d\n",
+                           vm->program.filename, instr->line, operand_text(instr, 1), target);
+                }
+            }
+            DISPATCH();
+        }
+
+        TARGET(IADDVAR) {
+            // addvar <var> <n>: getvar var, push n, add, setvar var
+            Variable *var = resolve_variable(vm, &args[0]);
+            if (var == NULL) {
+                EERROR(vm, ERROR_BASE"Variable not found: %s\n",
+                       vm->program.filename, instr->line, operand_text(instr, 0));
+            }
+            Word value = WORD_LOAD(var->value);
+            if (value.type != WINT) {
+                EERROR(vm, ERROR_BASE"Invalid types on stack expected two values of same type got %s and %s\n",
+                       vm->program.filename, instr->line, word_type_to_string(WINT),
+                       word_type_to_string(value.type));
+            }
+            value.as_int += args[1].as_int;
+            WORD_STORE(var->value, value);
+            DISPATCH();
+        }
+
+        TARGET(IPUSHOP) {
+            // pushop <op> <a> <b>: push a, push b, op
+            Instruction op = (Instruction) args[0].as_int;
+            w2 = operand_to_word(vm, instr, 1);
+            w1 = operand_to_word(vm, instr, 2);
+            if (binary_words(vm, instr, op, w2, w1, &result)) xstack_push(&xpu->stack, result);
+            word_release(w1);
+            word_release(w2);
+            DISPATCH();
+        }
+
+        QUICKENED_HANDLERS(QUICKENED)
+
+        TARGET(ICMPJMPIF_INT) {
+            // quickened cmpjmpif, every compared value has been an int so far
+            size_t pushed = instr->argc - 2;
+            WordCell *top = xpu->stack.stack + xpu->stack.count;
+            int a = 0, b = 0;
+            bool ints = xpu->stack.count >= 2 - pushed;
+            if (ints && pushed == 2) {
+                ints = operand_int(vm, &args[2], &a) && operand_int(vm, &args[3], &b);
+            } else if (ints && pushed == 1) {
+                ints = WORD_TYPE(top[-1]) == WINT && operand_int(vm, &args[2], &b);
+                if (ints) a = WORD_LOAD(top[-1]).as_int;
+            } else if (ints) {
+                ints = WORD_TYPE(top[-1]) == WINT && WORD_TYPE(top[-2]) == WINT;
+                if (ints) a = WORD_LOAD(top[-2]).as_int, b = WORD_LOAD(top[-1]).as_int;
+            }
+            if (!ints) {
+                deoptimize(instr);
+                goto dispatch;
+            }
+            xpu->stack.count -= 2 - pushed;
+
+            if (compare_ints((Instruction) args[0].as_int, a, b)) {
+                size_t target = args[1].kind == OPERAND_LABEL ? args[1].as_index : 0;
+                if (target < vm->program.instructions_count) xpu->ip = target - 1;
+                else {
+                    EERROR(vm, ERROR_BASE"Invalid target: %s %d\n",
+                           vm->program.filename, instr->line, operand_text(instr, 1), target);
+                }
+            }
+            DISPATCH();
+        }
+
+        TARGET(IHALT)
+            if (instr->argc == 1) {
+                vm->program.exit_code = args[0].as_int;
+            }
+            vm->program.halted = true;
+            return;
+            break;
+
+        default:
+            break;
+    }
+    // handlers that leave the switch early continue here
+    xpu->ip++;
+    if (single_step || xpu->ip >= vm->program.instructions_count) return;
+    instr = &vm->program.instructions[xpu->ip];
+    args = instr->args;
+    goto dispatch;
+
+#ifdef ORTA_COMPUTED_GOTO
+step_done:
+    return;
+#endif
+}
+
+void execute_instruction(OrtaVM *vm, InstructionData *instr) {
+    execute_from(vm, instr, true);
+}
+
+// ----------------- Verified run loop -------------------------
+// Runs programs verify_program accepted. Pushes and pops skip the bounds checks,
+// quickened handlers skip the type guards the verifier proved, and a call checks
+// once that the callee's whole stack fits. Other opcodes are single stepped through
+// execute_from. A step that leaves another depth than verified (a missing variable,
+// a division by zero) hands the rest of the run to the checked loop.
+
+#define VERIFIED_QUICKENED(op, a_type, b_type, result_type, result_field, expr) \
+    TARGET(op) { \
+        WordCell *top = stack->stack + stack->count; \
+        if (!instr->proven && (WORD_TYPE(top[-2]) != a_type || WORD_TYPE(top[-1]) != b_type)) goto slow; \
+        Word a = WORD_LOAD(top[-2]), b = WORD_LOAD(top[-1]); \
+        Word r = {.type = result_type, .result_field = (expr)}; \
+        word_release(a); \
+        word_release(b); \
+        WORD_STORE(top[-2], r); \
+        stack->count--; \
+        DISPATCH(); \
+    }
+
+#define VERIFIED_ENTRY(op, ...) dispatch_table[op] = &&TARGET_##op;
+
+static void execute_verified(OrtaVM *vm, InstructionData *instr) {
+    XPU *xpu = &vm->xpu;
+    XStack *stack = &xpu->stack;
+    Operand *args = instr->args;
+
+#ifdef ORTA_COMPUTED_GOTO
+    static const void *dispatch_table[OPCODE_COUNT];
+    if (dispatch_table[INOP] == NULL) {
+        for (size_t i = 0; i < OPCODE_COUNT; i++) dispatch_table[i] = &&slow;
+        dispatch_table[INOP] = &&TARGET_INOP;
+        dispatch_table[IPUSH] = &&TARGET_IPUSH;
+        dispatch_table[IDROP] = &&TARGET_IDROP;
+        dispatch_table[IDUP] = &&TARGET_IDUP;
+        dispatch_table[ISWAP] = &&TARGET_ISWAP;
+        dispatch_table[IJMP] = &&TARGET_IJMP;
+        dispatch_table[IJMPIF] = &&TARGET_IJMPIF;
+        dispatch_table[IJMPTABLE] = &&TARGET_IJMPTABLE;
+        dispatch_table[ICALL] = &&TARGET_ICALL;
+        dispatch_table[IRET] = &&TARGET_IRET;
+        dispatch_table[IINC] = &&TARGET_IINC;
+        dispatch_table[IDEC] = &&TARGET_IDEC;
+        dispatch_table[IGETVAR] = &&TARGET_IGETVAR;
+        dispatch_table[ISETVAR] = &&TARGET_ISETVAR;
+        dispatch_table[IGETGLOBALVAR] = &&TARGET_IGETGLOBALVAR;
+        dispatch_table[ISETGLOBALVAR] = &&TARGET_ISETGLOBALVAR;
+        dispatch_table[IADDVAR] = &&TARGET_IADDVAR;
+        dispatch_table[IDIV] = &&TARGET_IDIV;
+        dispatch_table[IMOD] = &&TARGET_IMOD;
+        dispatch_table[IPUSHOP] = &&TARGET_IPUSHOP;
+        dispatch_table[IPRINT] = &&TARGET_IPRINT;
+        dispatch_table[IMERGE] = &&TARGET_IMERGE;
+        dispatch_table[IEVAL] = &&TARGET_IEVAL;
+        dispatch_table[ICMPJMPIF_INT] = &&TARGET_ICMPJMPIF_INT;
+        QUICKENED_HANDLERS(VERIFIED_ENTRY)
+    }
+#endif
+
+dispatch:
+    switch (instr->opcode) {
+        TARGET(INOP)
+            DISPATCH();
+
+        TARGET(IPUSH) {
+            // one push per operand kind, a shared push would spill the word
+            Operand *op = &args[0];
+            switch (op->kind) {
+                case OPERAND_INT: xstack_push_unchecked(stack, (Word){.type = WINT, .as_int = op->as_int});
+                    break;
+                case OPERAND_FLOAT: xstack_push_unchecked(stack, (Word){.type = WFLOAT, .as_float = op->as_float});
+                    break;
+                case OPERAND_STRING: {
+                    char *s = xstring_retain(program_string(&vm->program, op->as_index));
+                    xstack_push_unchecked(stack, (Word){.type = WCHARP, .as_string = s});
+                    break;
+                }
+                default: xstack_push_unchecked(stack, word_retain(xpu->registers[op->as_register].reg_value));
+                    break;
+            }
+            DISPATCH();
+        }
+
+        TARGET(IPRINT) {
+            // folded at load time, printing the stack top is left to the checked handler
+            if (instr->argc == 0) goto slow;
+            puts(program_string(&vm->program, args[0].as_index));
+            DISPATCH();
+        }
+
+        TARGET(IMERGE) {
+            if (instr->argc == 0) goto slow;
+            char *s = xstring_retain(program_string(&vm->program, args[0].as_index));
+            xstack_push_unchecked(stack, (Word){.type = WCHARP, .as_string = s});
+            DISPATCH();
+        }
+
+        TARGET(IEVAL) {
+            xstack_push_unchecked(stack, (Word){.type = WINT, .as_int = instr->argc ? args[0].as_int : 0});
+            DISPATCH();
+        }
+
+        TARGET(IDROP) {
+            word_release(xstack_pop_unchecked(stack));
+            DISPATCH();
+        }
+
+        TARGET(IDUP) {
+            Word w = WORD_LOAD(stack->stack[stack->count - 1]);
+            // the checked handler pushes nothing for chars and bools
+            if (w.type != WINT && w.type != WFLOAT && w.type != WCHARP && w.type != WPOINTER) goto slow;
+            xstack_push_unchecked(stack, word_retain(w));
+            DISPATCH();
+        }
+
+        TARGET(ISWAP) {
+            WordCell top = stack->stack[stack->count - 1];
+            stack->stack[stack->count - 1] = stack->stack[stack->count - 2];
+            stack->stack[stack->count - 2] = top;
+            DISPATCH();
+        }
+
+        TARGET(IJMP) {
+            xpu->ip = args[0].as_index - 1;
+            DISPATCH();
+        }
+
+        TARGET(IJMPIF) {
+            Word w = xstack_pop_unchecked(stack);
+            if (w.type == WINT && w.as_int == 1) xpu->ip = args[0].as_index - 1;
+            DISPATCH();
+        }
+
+        TARGET(IJMPTABLE) {
+            Word w = xstack_pop_unchecked(stack);
+            xpu->ip = jmptable_target(instr, w) - 1;
+            word_release(w);
+            DISPATCH();
+        }
+
+        TARGET(ICALL) {
+            size_t target = args[0].as_index;
+            size_t room = stack->count + (instr->argc - 1) + vm->program.instructions[target].max_stack;
+            if (room > stack->capacity || !call_push(xpu, xpu->ip)) {
+                execute_from(vm, instr, false);
+                return;
+            }
+            xpu->ip = target - 1;
+            for (size_t i = instr->argc; i > 1; i--) {
+                xstack_push_unchecked(stack, operand_to_word(vm, instr, i - 1));
+            }
+            DISPATCH();
+        }
+
+        TARGET(IRET) {
+            // a ret without a call jumps somewhere the verifier never looked at
+            if (xpu->calls_count == 0) {
+                execute_from(vm, instr, false);
+                return;
+            }
+            xpu->ip = xpu->calls[--xpu->calls_count].ret;
+            DISPATCH();
+        }
+
+        TARGET(IINC) {
+            if (args[0].kind != OPERAND_REGISTER) goto slow;
+            Word *value = &xpu->registers[args[0].as_register].reg_value;
+            if (value->type == WINT) value->as_int++;
+            DISPATCH();
+        }
+
+        TARGET(IDEC) {
+            if (args[0].kind != OPERAND_REGISTER) goto slow;
+            Word *value = &xpu->registers[args[0].as_register].reg_value;
+            if (value->type == WINT) value->as_int--;
+            DISPATCH();
+        }
+
+        TARGET(IGETVAR) {
+            Variable *var = resolve_variable(vm, &args[0]);
+            if (var == NULL) goto slow;
+            Word w = variable_value(var);
+            if (w.type == WPOINTER && w.as_pointer == NULL) goto slow;
+            xstack_push_unchecked(stack, w);
+            DISPATCH();
+        }
+
+        TARGET(ISETVAR) {
+            Word w = xstack_pop_unchecked(stack);
+            assign_variable(bind_variable(vm, &args[0]), w);
+            word_release(w);
+            DISPATCH();
+        }
+
+        TARGET(IGETGLOBALVAR) {
+            Variable *var = find_variable(&vm->program.variables, args[0].as_index);
+            if (var == NULL) goto slow;
+            Word w = variable_value(var);
+            if (w.type == WPOINTER && w.as_pointer == NULL) goto slow;
+            xstack_push_unchecked(stack, w);
+            DISPATCH();
+        }
+
+        TARGET(ISETGLOBALVAR) {
+            Word w = xstack_pop_unchecked(stack);
+            setvar_slot(vm, args[0].as_index, &vm->program.variables, w);
+            word_release(w);
+            DISPATCH();
+        }
+
+        TARGET(IADDVAR) {
+            Variable *var = resolve_variable(vm, &args[0]);
+            if (var == NULL || WORD_TYPE(var->value) != WINT) goto slow;
+            Word value = WORD_LOAD(var->value);
+            value.as_int += args[1].as_int;
+            WORD_STORE(var->value, value);
+            DISPATCH();
+        }
+
+        TARGET(IDIV) {
+            // div and mod are never quickened, the common cases are done in place
+            WordCell *top = stack->stack + stack->count;
+            Word a = WORD_LOAD(top[-2]), b = WORD_LOAD(top[-1]);
+            if (a.type == WINT && b.type == WINT && b.as_int != 0) a.as_int /= b.as_int;
+            else if (a.type == WFLOAT && b.type == WFLOAT && b.as_float != 0.0f) a.as_float /= b.as_float;
+            else goto slow;
+            WORD_STORE(top[-2], a);
+            stack->count--;
+            DISPATCH();
+        }
+
+        TARGET(IMOD) {
+            WordCell *top = stack->stack + stack->count;
+            Word a = WORD_LOAD(top[-2]), b = WORD_LOAD(top[-1]);
+            if (a.type != WINT || b.type != WINT || b.as_int == 0) goto slow;
+            a.as_int %= b.as_int;
+            WORD_STORE(top[-2], a);
+            stack->count--;
+            DISPATCH();
         }
 
+        TARGET(IPUSHOP) {
+            Word result;
+            Word w2 = operand_to_word(vm, instr, 1);
+            Word w1 = operand_to_word(vm, instr, 2);
+            bool pushed = binary_words(vm, instr, (Instruction) args[0].as_int, w2, w1, &result);
+            word_release(w1);
+            word_release(w2);
+            if (!pushed) goto bail;
+            xstack_push_unchecked(stack, result);
+            DISPATCH();
+        }
 
-        case IHALT:
-            if (instr->operands.size == 1) {
-                vm->program.exit_code = atoi(vector_get_str(&instr->operands, 0));
+        TARGET(ICMPJMPIF_INT) {
+            size_t pushed = instr->argc - 2;
+            WordCell *top = stack->stack + stack->count;
+            int a, b;
+            if (pushed == 2) {
+                if (!operand_int(vm, &args[2], &a) || !operand_int(vm, &args[3], &b)) goto slow;
+            } else if (pushed == 1) {
+                if ((!instr->proven && WORD_TYPE(top[-1]) != WINT) || !operand_int(vm, &args[2], &b)) goto slow;
+                a = WORD_LOAD(top[-1]).as_int;
+            } else {
+                if (!instr->proven && (WORD_TYPE(top[-2]) != WINT || WORD_TYPE(top[-1]) != WINT)) goto slow;
+                a = WORD_LOAD(top[-2]).as_int;
+                b = WORD_LOAD(top[-1]).as_int;
             }
-            vm->program.halted = true;
-            return;
-            break;
+            stack->count -= 2 - pushed;
+            if (compare_ints((Instruction) args[0].as_int, a, b)) xpu->ip = args[1].as_index - 1;
+            DISPATCH();
+        }
+
+        QUICKENED_HANDLERS(VERIFIED_QUICKENED)
 
         default:
-            break;
+            goto slow;
     }
+    // handlers that leave the switch early continue here
     xpu->ip++;
-}
-
-unsigned char optimal_size(int64_t x) {
-    if (x < 0) {
-        if (x >= SCHAR_MIN && x <= SCHAR_MAX) {
-            return (unsigned char) sizeof(signed char);
-        } else if (x >= SHRT_MIN && x <= SHRT_MAX) {
-            return (unsigned char) sizeof(short);
-        } else if (x >= INT_MIN && x <= INT_MAX) {
-            return (unsigned char) sizeof(int);
-        } else {
-            return (unsigned char) sizeof(int64_t);
-        }
-    } else {
-        if (x <= UCHAR_MAX) {
-            return (unsigned char) sizeof(unsigned char);
-        } else if (x <= USHRT_MAX) {
-            return (unsigned char) sizeof(unsigned short);
-        } else if (x <= UINT_MAX) {
-            return (unsigned char) sizeof(unsigned int);
-        } else {
-            return (unsigned char) sizeof(uint64_t);
+    if (xpu->ip >= vm->program.instructions_count) return;
+    instr = &vm->program.instructions[xpu->ip];
+    args = instr->args;
+    goto dispatch;
+
+slow: {
+        int effect = instr->stack_effect;
+        size_t depth = stack->count;
+        execute_from(vm, instr, true);
+        if (vm->program.halted || xpu->ip >= vm->program.instructions_count) return;
+        instr = &vm->program.instructions[xpu->ip];
+        args = instr->args;
+        if ((ptrdiff_t) (stack->count - depth) != effect) {
+            execute_from(vm, instr, false);
+            return;
         }
+        goto dispatch;
     }
-}
 
+bail:
+    // instr did not push what the verifier assumed, the checked loop runs the rest
+    if (vm->program.halted || ++xpu->ip >= vm->program.instructions_count) return;
+    execute_from(vm, &vm->program.instructions[xpu->ip], false);
+}
 
 void set_flags(OrtaVM *vm) {
     for (size_t i = 0; i < vm->program.instructions_count; i++) {
@@ -2637,140 +4180,763 @@ void set_flags(OrtaVM *vm) {
     }
 }
 
-int create_xbin(OrtaVM *vm, const char *output_filename) {
-    Program *program = &vm->program;
-    FILE *fp = fopen(output_filename, "wb");
-    if (!fp) {
-        OERROR(stderr, "ERROR: Could not create bytecode file '%s'\n", output_filename);
-        return 0;
+// ----------------- Bytecode image -------------------------
+// An xbin v2 file holds the linked, decoded program as fixed width records, so a
+// loader maps the file and points the instructions at it instead of reading and
+// parsing every operand. A header with a section table is followed by the
+// sections, each 8 byte aligned:
+//
+//   instructions  XbinInstruction: opcode, argc and the index of the first operand
+//   operands      XbinOperand per operand, laid out like Operand
+//   texts         pool offset of every operand's source text
+//   lines         source line of every instruction
+//   labels        XbinLabel: pool offset of the name and the address
+//   variables     pool offset of every variable name, by slot
+//   constants     XbinString per string constant, by index into Program.strings
+//   pool          the NUL terminated texts
+//
+// The header's encoding can shrink a file for shipping, at the cost of one pass
+// that expands it back into the fixed records on load:
+//
+//   XBIN_COMPACT     every section but the pool as LEB128 varints behind a record
+//                    count, lines and text offsets as deltas, registers as a byte
+//   XBIN_COMPRESSED  every section as its expanded size and an xlz stream
+//
+// Files that start with "XBIN" predate v2, load_xbin_legacy reads them.
+
+#define XBIN_MAGIC "OXBC"
+#define XBIN_LEGACY_MAGIC "XBIN"
+#define XBIN_VERSION 2
+#define XBIN_ALIGN 8
+
+typedef enum {
+    XBIN_FIXED = 0,
+    XBIN_COMPACT = 1,
+    XBIN_COMPRESSED = 2,
+} XbinEncoding;
+
+typedef enum {
+    XBIN_INSTRUCTIONS,
+    XBIN_OPERANDS,
+    XBIN_TEXTS,
+    XBIN_LINES,
+    XBIN_LABELS,
+    XBIN_VARIABLES,
+    XBIN_CONSTANTS,
+    XBIN_POOL,
+    XBIN_SECTION_COUNT,
+} XbinSectionId;
+
+typedef struct {
+    uint32_t offset; // from the start of the file
+    uint32_t size;   // in bytes
+} XbinSection;
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t header_size;
+    uint32_t filename; // pool offset
+    uint32_t encoding; // XbinEncoding flags
+    XbinSection sections[XBIN_SECTION_COUNT];
+    OrtaMeta meta;
+} XbinHeader;
+
+typedef struct {
+    uint8_t opcode;
+    uint8_t reserved;
+    uint16_t argc;
+    uint32_t first;
+} XbinInstruction;
+
+typedef struct {
+    uint32_t kind;  // OperandKind
+    uint32_t local;
+    uint64_t value; // ints, floats, registers and types in the low 32 bits
+} XbinOperand;
+
+typedef struct {
+    uint32_t name;
+    uint32_t address;
+} XbinLabel;
+
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+} XbinString;
+
+typedef struct {
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+} XbinBuffer;
+
+static size_t xbin_append(XbinBuffer *buffer, const void *data, size_t size) {
+    if (buffer->size + size > buffer->capacity) {
+        while (buffer->size + size > buffer->capacity) buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 256;
+        buffer->data = realloc(buffer->data, buffer->capacity);
     }
-    set_flags(vm);
-    if (fwrite(&vm->meta, sizeof(OrtaMeta), 1, fp) != 1)
-        goto error;
+    size_t at = buffer->size;
+    if (size) memcpy(buffer->data + at, data, size);
+    buffer->size += size;
+    return at;
+}
+
+static uint32_t xbin_text(XbinBuffer *pool, const char *text, size_t length) {
+    uint32_t at = (uint32_t) xbin_append(pool, text, length);
+    xbin_append(pool, "", 1);
+    return at;
+}
+
+static XbinOperand xbin_operand(const Operand *op) {
+    XbinOperand out = {.kind = op->kind, .local = op->local, .value = 0};
+    switch (op->kind) {
+        case OPERAND_INT: out.value = (uint32_t) op->as_int;
+            break;
+        case OPERAND_FLOAT: {
+            uint32_t bits;
+            memcpy(&bits, &op->as_float, sizeof(bits));
+            out.value = bits;
+            break;
+        }
+        case OPERAND_REGISTER: out.value = (uint32_t) op->as_register;
+            break;
+        case OPERAND_TYPE: out.value = (uint32_t) op->as_type;
+            break;
+        case OPERAND_POINTER: out.value = (uint64_t) (uintptr_t) op->as_pointer;
+            break;
+        case OPERAND_STRING:
+        case OPERAND_LABEL:
+        case OPERAND_VARIABLE: out.value = op->as_index;
+            break;
+        default: break;
+    }
+    return out;
+}
+
+static Operand xbin_decode_operand(const XbinOperand *in) {
+    Operand op = {.kind = (OperandKind) in->kind, .local = in->local, .as_index = 0};
+    switch (op.kind) {
+        case OPERAND_INT: op.as_int = (int) (uint32_t) in->value;
+            break;
+        case OPERAND_FLOAT: {
+            uint32_t bits = (uint32_t) in->value;
+            memcpy(&op.as_float, &bits, sizeof(bits));
+            break;
+        }
+        case OPERAND_REGISTER: op.as_register = (XRegisters) (int32_t) (uint32_t) in->value;
+            break;
+        case OPERAND_TYPE: op.as_type = (WordType) (int32_t) (uint32_t) in->value;
+            break;
+        case OPERAND_POINTER: op.as_pointer = (void *) (uintptr_t) in->value;
+            break;
+        default: op.as_index = (size_t) in->value;
+            break;
+    }
+    return op;
+}
 
-    size_t filename_len = strlen(program->filename);
-    if (fwrite(&filename_len, sizeof(size_t), 1, fp) != 1)
-        goto error;
+// an XbinOperand already is an Operand on little endian 64 bit targets
+static bool xbin_operands_in_place(void) {
+    const uint16_t probe = 1;
+    return sizeof(Operand) == sizeof(XbinOperand) && offsetof(Operand, local) == offsetof(XbinOperand, local) &&
+           offsetof(Operand, as_index) == offsetof(XbinOperand, value) && sizeof(size_t) == sizeof(uint64_t) &&
+           *(const uint8_t *) &probe == 1;
+}
 
-    if (fwrite(program->filename, 1, filename_len, fp) != filename_len)
-        goto error;
+// fills the header and the fixed sections of the program, false when it does not fit the 32 bit fields
+static bool xbin_sections(OrtaVM *vm, XbinHeader *header, XbinBuffer sections[XBIN_SECTION_COUNT]) {
+    Program *program = &vm->program;
+    XbinBuffer *pool = &sections[XBIN_POOL];
+    bool ok = true;
 
-    size_t instructions_count = program->instructions_count;
-    if (fwrite(&instructions_count, sizeof(size_t), 1, fp) != 1)
-        goto error;
+    *header = (XbinHeader){0};
+    memcpy(header->magic, XBIN_MAGIC, sizeof(header->magic));
+    header->version = XBIN_VERSION;
+    header->header_size = sizeof(XbinHeader);
+    header->meta = vm->meta;
+    header->filename = xbin_text(pool, program->filename, strlen(program->filename));
 
-    for (size_t i = 0; i < instructions_count; i++) {
+    uint32_t first = 0;
+    for (size_t i = 0; i < program->instructions_count; i++) {
         InstructionData *instr = &program->instructions[i];
+        if (instr->operands.size > UINT16_MAX) ok = false;
+        XbinInstruction record = {
+            .opcode = (uint8_t) generic_opcode(instr->opcode),
+            .argc = (uint16_t) instr->operands.size,
+            .first = first,
+        };
+        uint32_t line = (uint32_t) instr->line;
+        xbin_append(&sections[XBIN_INSTRUCTIONS], &record, sizeof(record));
+        xbin_append(&sections[XBIN_LINES], &line, sizeof(line));
+        for (size_t j = 0; j < instr->operands.size; j++) {
+            const char *text = vector_get_str(&instr->operands, j);
+            uint32_t at = xbin_text(pool, text, strlen(text));
+            // an instruction that was never decoded keeps its text only
+            XbinOperand op = j < instr->argc ? xbin_operand(&instr->args[j]) : (XbinOperand){.kind = OPERAND_SYMBOL};
+            xbin_append(&sections[XBIN_TEXTS], &at, sizeof(at));
+            xbin_append(&sections[XBIN_OPERANDS], &op, sizeof(op));
+            first++;
+        }
+    }
 
-        if (fwrite(&instr->opcode, sizeof(unsigned char), 1, fp) != 1)
-            goto error;
-        if (fwrite(&instr->line, sizeof(unsigned int), 1, fp) != 1)
-            goto error;
-
-        size_t operands_count = instr->operands.size;
-        if (fwrite(&operands_count, sizeof(size_t), 1, fp) != 1)
-            goto error;
+    for (size_t i = 0; i < program->labels_count; i++) {
+        Label *label = &program->labels[i];
+        XbinLabel record = {xbin_text(pool, label->name, strlen(label->name)), (uint32_t) label->address};
+        xbin_append(&sections[XBIN_LABELS], &record, sizeof(record));
+    }
+    for (size_t i = 0; i < program->variable_names.size; i++) {
+        const char *name = vector_get_str(&program->variable_names, i);
+        uint32_t at = xbin_text(pool, name, strlen(name));
+        xbin_append(&sections[XBIN_VARIABLES], &at, sizeof(at));
+    }
+    for (size_t i = 0; i < program->strings.size; i++) {
+        const char *constant = program_string(program, i);
+        size_t length = strlen(constant);
+        XbinString record = {xbin_text(pool, constant, length), (uint32_t) length};
+        xbin_append(&sections[XBIN_CONSTANTS], &record, sizeof(record));
+    }
+    return ok && program->instructions_count <= UINT32_MAX;
+}
 
-        for (size_t j = 0; j < operands_count; j++) {
-            char *operand = *(char **) vector_get(&instr->operands, j);
+// writes the header and the 8 byte aligned sections to out and frees the sections
+static bool xbin_layout(XbinHeader *header, XbinBuffer sections[XBIN_SECTION_COUNT], XbinBuffer *out) {
+    xbin_append(out, header, sizeof(*header));
+    for (size_t i = 0; i < XBIN_SECTION_COUNT; i++) {
+        static const unsigned char padding[XBIN_ALIGN] = {0};
+        xbin_append(out, padding, (XBIN_ALIGN - out->size % XBIN_ALIGN) % XBIN_ALIGN);
+        header->sections[i].offset = (uint32_t) out->size;
+        header->sections[i].size = (uint32_t) sections[i].size;
+        xbin_append(out, sections[i].data, sections[i].size);
+        free(sections[i].data);
+        sections[i] = (XbinBuffer){0};
+    }
+    memcpy(out->data, header, sizeof(*header));
+    return out->size <= UINT32_MAX;
+}
 
-            if (is_register(operand)) {
-                char type = 'R';
-                if (fwrite(&type, sizeof(char), 1, fp) != 1)
-                    goto error;
+static void xbin_varint(XbinBuffer *buffer, uint64_t value) {
+    unsigned char bytes[10];
+    xbin_append(buffer, bytes, xlz_put_varint(bytes, value));
+}
 
-                XRegisters reg_id = register_name_to_enum(operand);
-                if (fwrite(&reg_id, sizeof(XRegisters), 1, fp) != 1)
-                    goto error;
-            } else if (is_number(operand)) {
-                char type = 'N';
-                if (fwrite(&type, sizeof(char), 1, fp) != 1)
-                    goto error;
+static inline uint64_t xbin_zigzag(int64_t value) {
+    return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
 
-                int64_t value = atoll(operand);
+static inline int64_t xbin_unzigzag(uint64_t value) {
+    return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
 
-                unsigned char size = optimal_size(value);
-                if (fwrite(&size, sizeof(unsigned char), 1, fp) != 1)
-                    goto error;
+// the 32 bit fields of a section, as deltas to the previous field when they mostly grow
+static void xbin_compact_words(const XbinBuffer *in, XbinBuffer *out, bool delta) {
+    size_t count = in->size / sizeof(uint32_t);
+    uint32_t previous = 0;
+    xbin_varint(out, count);
+    for (size_t i = 0; i < count; i++) {
+        uint32_t word;
+        memcpy(&word, in->data + i * sizeof(word), sizeof(word));
+        xbin_varint(out, delta ? xbin_zigzag((int64_t) word - previous) : word);
+        previous = word;
+    }
+}
 
-                switch (size) {
-                    case sizeof(signed char):
-                        if (value < 0) {
-                            signed char sval = (signed char) value;
-                            if (fwrite(&sval, size, 1, fp) != 1) goto error;
-                        } else {
-                            unsigned char uval = (unsigned char) value;
-                            if (fwrite(&uval, size, 1, fp) != 1) goto error;
-                        }
+// rewrites a fixed section with varints, false when a register does not fit its byte
+static bool xbin_compact(XbinSectionId id, const XbinBuffer *in, XbinBuffer *out) {
+    switch (id) {
+        case XBIN_INSTRUCTIONS: {
+            // first is the running sum of argc, the loader counts it again
+            size_t count = in->size / sizeof(XbinInstruction);
+            xbin_varint(out, count);
+            for (size_t i = 0; i < count; i++) {
+                XbinInstruction record;
+                memcpy(&record, in->data + i * sizeof(record), sizeof(record));
+                xbin_append(out, &record.opcode, 1);
+                xbin_varint(out, record.argc);
+            }
+            return true;
+        }
+        case XBIN_OPERANDS: {
+            size_t count = in->size / sizeof(XbinOperand);
+            xbin_varint(out, count);
+            for (size_t i = 0; i < count; i++) {
+                XbinOperand op;
+                memcpy(&op, in->data + i * sizeof(op), sizeof(op));
+                xbin_varint(out, op.kind);
+                xbin_varint(out, op.local);
+                switch (op.kind) {
+                    case OPERAND_INT:
+                    case OPERAND_TYPE: xbin_varint(out, xbin_zigzag((int32_t) (uint32_t) op.value));
                         break;
-                    case sizeof(short):
-                        if (value < 0) {
-                            short sval = (short) value;
-                            if (fwrite(&sval, size, 1, fp) != 1) goto error;
-                        } else {
-                            unsigned short uval = (unsigned short) value;
-                            if (fwrite(&uval, size, 1, fp) != 1) goto error;
-                        }
+                    case OPERAND_FLOAT: {
+                        uint32_t bits = (uint32_t) op.value;
+                        unsigned char bytes[4] = {bits, bits >> 8, bits >> 16, bits >> 24};
+                        xbin_append(out, bytes, sizeof(bytes));
                         break;
-                    case sizeof(int):
-                        if (value < 0) {
-                            int sval = (int) value;
-                            if (fwrite(&sval, size, 1, fp) != 1) goto error;
-                        } else {
-                            unsigned int uval = (unsigned int) value;
-                            if (fwrite(&uval, size, 1, fp) != 1) goto error;
-                        }
+                    }
+                    case OPERAND_REGISTER: {
+                        if (op.value > UINT8_MAX) return false;
+                        uint8_t reg = (uint8_t) op.value;
+                        xbin_append(out, &reg, 1);
                         break;
-                    case sizeof(int64_t):
-                        if (value < 0) {
-                            if (fwrite(&value, size, 1, fp) != 1) goto error;
-                        } else {
-                            uint64_t uval = (uint64_t) value;
-                            if (fwrite(&uval, size, 1, fp) != 1) goto error;
-                        }
+                    }
+                    default: xbin_varint(out, op.value);
                         break;
                 }
-            } else {
-                char type = 'S';
-                if (fwrite(&type, sizeof(char), 1, fp) != 1)
-                    goto error;
+            }
+            return true;
+        }
+        case XBIN_TEXTS:
+        case XBIN_LINES: xbin_compact_words(in, out, true);
+            return true;
+        case XBIN_LABELS:
+        case XBIN_VARIABLES:
+        case XBIN_CONSTANTS: xbin_compact_words(in, out, false);
+            return true;
+        default: xbin_append(out, in->data, in->size);
+            return true;
+    }
+}
+
+// every record takes at least a byte, a count beyond that is malformed
+static bool xbin_read_count(const unsigned char *in, size_t size, size_t *at, size_t *count) {
+    uint64_t value;
+    if (!xlz_get_varint(in, size, at, &value) || value > size - *at) return false;
+    *count = (size_t) value;
+    return true;
+}
+
+static bool xbin_expand_words(const unsigned char *in, size_t size, XbinBuffer *out, bool delta) {
+    size_t at = 0, count;
+    uint32_t previous = 0;
+    if (!xbin_read_count(in, size, &at, &count)) return false;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t value;
+        if (!xlz_get_varint(in, size, &at, &value)) return false;
+        if (delta) value = (uint64_t) ((int64_t) previous + xbin_unzigzag(value));
+        if (value > UINT32_MAX) return false;
+        uint32_t word = (uint32_t) value;
+        xbin_append(out, &word, sizeof(word));
+        previous = word;
+    }
+    return at == size;
+}
 
-                size_t operand_len = strlen(operand);
-                if (fwrite(&operand_len, sizeof(size_t), 1, fp) != 1)
-                    goto error;
+// the fixed records of a section xbin_compact wrote
+static bool xbin_expand_section(XbinSectionId id, const unsigned char *in, size_t size, XbinBuffer *out) {
+    size_t at = 0, count;
+    switch (id) {
+        case XBIN_INSTRUCTIONS: {
+            uint32_t first = 0;
+            if (!xbin_read_count(in, size, &at, &count)) return false;
+            for (size_t i = 0; i < count; i++) {
+                uint64_t argc;
+                if (at >= size) return false;
+                XbinInstruction record = {.opcode = in[at++], .first = first};
+                if (!xlz_get_varint(in, size, &at, &argc) || argc > UINT16_MAX || argc > UINT32_MAX - first) return false;
+                record.argc = (uint16_t) argc;
+                first += record.argc;
+                xbin_append(out, &record, sizeof(record));
+            }
+            return at == size;
+        }
+        case XBIN_OPERANDS: {
+            if (!xbin_read_count(in, size, &at, &count)) return false;
+            for (size_t i = 0; i < count; i++) {
+                uint64_t kind, local, value;
+                if (!xlz_get_varint(in, size, &at, &kind) || !xlz_get_varint(in, size, &at, &local) ||
+                    kind > UINT32_MAX || local > UINT32_MAX) return false;
+                switch (kind) {
+                    case OPERAND_INT:
+                    case OPERAND_TYPE:
+                        if (!xlz_get_varint(in, size, &at, &value)) return false;
+                        value = (uint32_t) (int32_t) xbin_unzigzag(value);
+                        break;
+                    case OPERAND_FLOAT:
+                        if (size - at < 4) return false;
+                        value = in[at] | (uint32_t) in[at + 1] << 8 | (uint32_t) in[at + 2] << 16 | (uint32_t) in[at + 3] << 24;
+                        at += 4;
+                        break;
+                    case OPERAND_REGISTER:
+                        if (at >= size) return false;
+                        value = in[at++];
+                        break;
+                    default:
+                        if (!xlz_get_varint(in, size, &at, &value)) return false;
+                        break;
+                }
+                XbinOperand op = {.kind = (uint32_t) kind, .local = (uint32_t) local, .value = value};
+                xbin_append(out, &op, sizeof(op));
+            }
+            return at == size;
+        }
+        case XBIN_TEXTS:
+        case XBIN_LINES: return xbin_expand_words(in, size, out, true);
+        case XBIN_LABELS:
+        case XBIN_VARIABLES:
+        case XBIN_CONSTANTS: return xbin_expand_words(in, size, out, false);
+        default: xbin_append(out, in, size);
+            return true;
+    }
+}
 
-                if (fwrite(operand, 1, operand_len, fp) != operand_len)
-                    goto error;
+// Turns an encoded image back into the fixed one xbin_load_image points into
+static bool xbin_expand(const XbinHeader *header, const ProgramImage *image, ProgramImage *expanded) {
+    if (header->encoding & ~(uint32_t) (XBIN_COMPACT | XBIN_COMPRESSED)) return false;
+    XbinBuffer sections[XBIN_SECTION_COUNT] = {0};
+    bool ok = true;
+    for (size_t i = 0; i < XBIN_SECTION_COUNT && ok; i++) {
+        const XbinSection *section = &header->sections[i];
+        if (section->offset > image->size || section->size > image->size - section->offset) {
+            ok = false;
+            break;
+        }
+        const unsigned char *data = image->data + section->offset;
+        size_t size = section->size;
+        unsigned char *raw = NULL;
+        if (header->encoding & XBIN_COMPRESSED) {
+            size_t at = 0;
+            uint64_t raw_size;
+            if (!xlz_get_varint(data, size, &at, &raw_size) || raw_size > UINT32_MAX) {
+                ok = false;
+                break;
             }
+            raw = malloc(raw_size ? (size_t) raw_size : 1);
+            ok = raw && xlz_decompress(data + at, size - at, raw, (size_t) raw_size);
+            data = raw;
+            size = (size_t) raw_size;
         }
+        if (ok && (header->encoding & XBIN_COMPACT)) ok = xbin_expand_section((XbinSectionId) i, data, size, &sections[i]);
+        else if (ok) xbin_append(&sections[i], data, size);
+        free(raw);
     }
 
-    size_t labels_count = program->labels_count;
-    if (fwrite(&labels_count, sizeof(size_t), 1, fp) != 1)
-        goto error;
+    XbinHeader fixed = *header;
+    fixed.encoding = XBIN_FIXED;
+    fixed.header_size = sizeof(XbinHeader);
+    XbinBuffer out = {0};
+    if (ok) ok = xbin_layout(&fixed, sections, &out);
+    for (size_t i = 0; i < XBIN_SECTION_COUNT; i++) free(sections[i].data);
+    if (!ok) {
+        free(out.data);
+        return false;
+    }
+    *expanded = (ProgramImage){.data = out.data, .size = out.size, .allocated = true};
+    return true;
+}
 
-    for (size_t i = 0; i < labels_count; i++) {
-        Label *label = &program->labels[i];
+// lays the program out as an xbin v2 image, false when it does not fit the 32 bit fields
+static bool xbin_build(OrtaVM *vm, XbinBuffer *out, XbinEncoding encoding) {
+    XbinHeader header;
+    XbinBuffer sections[XBIN_SECTION_COUNT] = {0};
+    bool ok = xbin_sections(vm, &header, sections);
+    header.encoding = encoding;
+    for (size_t i = 0; i < XBIN_SECTION_COUNT; i++) {
+        if (encoding & XBIN_COMPACT) {
+            XbinBuffer compact = {0};
+            if (!xbin_compact((XbinSectionId) i, &sections[i], &compact)) ok = false;
+            free(sections[i].data);
+            sections[i] = compact;
+        }
+        if (encoding & XBIN_COMPRESSED) {
+            XbinBuffer compressed = {0};
+            unsigned char *packed = malloc(xlz_bound(sections[i].size));
+            const unsigned char *raw = sections[i].data ? sections[i].data : (const unsigned char *) "";
+            xbin_varint(&compressed, sections[i].size);
+            xbin_append(&compressed, packed, xlz_compress(raw, sections[i].size, packed));
+            free(packed);
+            free(sections[i].data);
+            sections[i] = compressed;
+        }
+    }
+    return xbin_layout(&header, sections, out) && ok;
+}
 
-        size_t name_len = strlen(label->name);
-        if (fwrite(&name_len, sizeof(size_t), 1, fp) != 1)
-            goto error;
+int create_xbin_encoded(OrtaVM *vm, const char *output_filename, XbinEncoding encoding) {
+    FILE *fp = fopen(output_filename, "wb");
+    if (!fp) {
+        OERROR(stderr, "ERROR: Could not create bytecode file '%s'\n", output_filename);
+        return 0;
+    }
+    bool ok = program_decode_all(&vm->program);
+    set_flags(vm);
+    XbinBuffer image = {0};
+    ok = ok && xbin_build(vm, &image, encoding) && fwrite(image.data, 1, image.size, fp) == image.size;
+    free(image.data);
+    fclose(fp);
+    return ok;
+}
 
-        if (fwrite(label->name, 1, name_len, fp) != name_len)
-            goto error;
+int create_xbin(OrtaVM *vm, const char *output_filename) {
+    return create_xbin_encoded(vm, output_filename, XBIN_FIXED);
+}
 
-        if (fwrite(&label->address, sizeof(size_t), 1, fp) != 1)
-            goto error;
+// Gives every instruction of a program loaded in place its own operands again,
+// for anything that rewrites instructions.
+void program_detach(Program *program) {
+    if (!program->image.data) return;
+    program_decode_all(program);
+    for (size_t i = 0; i < program->instructions_count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        Vector operands;
+        vector_init(&operands, instr->operands.size, sizeof(char *));
+        VECTOR_FOR_EACH(char *, elem, &instr->operands) {
+            char *copy = strdup(*elem);
+            vector_push(&operands, &copy);
+        }
+        instr->operands = operands;
+        Operand *args = instr->argc ? malloc(sizeof(Operand) * instr->argc) : NULL;
+        if (args) memcpy(args, instr->args, sizeof(Operand) * instr->argc);
+        instr->args = args;
     }
+    // literals decoded from here on share the constants the image brought
+    for (size_t i = 0; i < program->strings.size; i++) {
+        Symbol *symbol = symtab_intern(&program->symbols, program_string(program, i));
+        if (symbol->constant == SYMBOL_NONE) symbol->constant = i;
+    }
+    image_release(&program->image);
+}
 
-    fclose(fp);
-    return 1;
+// the records of section id, NULL and a count of 0 when it does not fit the image
+static const void *xbin_section(const XbinHeader *header, const ProgramImage *image, XbinSectionId id,
+                                size_t record, size_t *count) {
+    const XbinSection *section = &header->sections[id];
+    *count = 0;
+    if (section->offset % XBIN_ALIGN != 0 || section->offset > image->size ||
+        section->size > image->size - section->offset || section->size % record != 0) return NULL;
+    *count = section->size / record;
+    return image->data + section->offset;
+}
 
-error:
-    fclose(fp);
-    return 0;
+static bool xbin_operand_valid(Program *program, const Operand *op) {
+    switch (op->kind) {
+        case OPERAND_NONE:
+        case OPERAND_INT:
+        case OPERAND_FLOAT:
+        case OPERAND_LABEL: // jump targets are checked by verify_program
+        case OPERAND_POINTER:
+        case OPERAND_SYMBOL: return true;
+        case OPERAND_REGISTER: return (unsigned) op->as_register < REG_COUNT;
+        case OPERAND_STRING: return op->as_index < program->strings.size;
+        case OPERAND_VARIABLE: return op->as_index < program->variable_names.size &&
+                                      op->local < program->variable_names.size;
+        case OPERAND_TYPE: return (int) op->as_type >= -1 && (int) op->as_type <= WBOOL; // -1 for no type
+        default: return false;
+    }
+}
+
+// the code sections of an image
+typedef struct {
+    const XbinInstruction *records;
+    size_t count;
+    const XbinOperand *operands;
+    size_t operands_count;
+    const uint32_t *texts;
+    const uint32_t *lines;
+    const char *pool;
+    size_t pool_size;
+} XbinCode;
+
+static bool xbin_code(const XbinHeader *header, const ProgramImage *image, XbinCode *code) {
+    size_t texts_count = 0, lines_count = 0;
+    code->records = xbin_section(header, image, XBIN_INSTRUCTIONS, sizeof(XbinInstruction), &code->count);
+    code->operands = xbin_section(header, image, XBIN_OPERANDS, sizeof(XbinOperand), &code->operands_count);
+    code->texts = xbin_section(header, image, XBIN_TEXTS, sizeof(uint32_t), &texts_count);
+    code->lines = xbin_section(header, image, XBIN_LINES, sizeof(uint32_t), &lines_count);
+    code->pool = xbin_section(header, image, XBIN_POOL, 1, &code->pool_size);
+    return code->records && code->operands && code->texts && code->lines && code->pool &&
+           texts_count == code->operands_count && lines_count == code->count && code->pool_size > 0 &&
+           code->pool[code->pool_size - 1] == '\0';
+}
+
+// Points instructions [from, to) at the image, false when one of them is malformed.
+// lazy checks what verify_program would have checked for them.
+static bool xbin_decode_range(Program *program, const XbinCode *code, size_t from, size_t to, bool lazy) {
+    const ArgRequirement *arg_counts = arg_requirements();
+    Operand *args = program->image.args ? program->image.args : (Operand *) code->operands;
+    char **text = program->image.texts;
+    for (size_t i = from; i < to; i++) {
+        const XbinInstruction *record = &code->records[i];
+        // directives never survive linking, the handlers rely on the operand counts the assembler checks.
+        // Passes that drop an instruction leave its operands on the INOP
+        if (record->opcode >= INSTRUCTION_COUNT || record->opcode == IARITY || record->opcode == IINVOKE ||
+            record->first > code->operands_count || record->argc > code->operands_count - record->first ||
+            (record->opcode != INOP && !validateArgCount(arg_counts[record->opcode], record->argc))) return false;
+        for (size_t j = record->first; j < (size_t) record->first + record->argc; j++) {
+            if (program->image.args) args[j] = xbin_decode_operand(&code->operands[j]);
+            if (code->texts[j] >= code->pool_size || !xbin_operand_valid(program, &args[j])) return false;
+            text[j] = (char *) code->pool + code->texts[j];
+        }
+        InstructionData *instr = &program->instructions[i];
+        *instr = (InstructionData){0};
+        instr->opcode = (Instruction) record->opcode;
+        instr->line = code->lines[i];
+        instr->argc = record->argc;
+        instr->args = record->argc ? &args[record->first] : NULL;
+        instr->operands = (Vector){text + record->first, record->argc, record->argc, sizeof(char *)};
+        if (lazy && !verify_structure(program, instr)) return false;
+    }
+    return true;
+}
+
+static int segment_order(const void *a, const void *b) {
+    size_t x = *(const size_t *) a, y = *(const size_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+// Leaves every label address with an ILAZY, the code up to the next one is decoded
+// the first time execution gets there. Nothing reaches an instruction of a segment
+// but through its start: jumps and calls target labels, and returns go back into
+// code that ran already.
+static void xbin_lazy_segments(Program *program) {
+    ProgramImage *image = &program->image;
+    image->segments = malloc(sizeof(size_t) * (program->labels_count + 1));
+    image->segments[image->segments_count++] = 0;
+    for (size_t i = 0; i < program->labels_count; i++) {
+        if (program->labels[i].address < program->instructions_count) {
+            image->segments[image->segments_count++] = program->labels[i].address;
+        }
+    }
+    qsort(image->segments, image->segments_count, sizeof(size_t), segment_order);
+    size_t unique = 0;
+    for (size_t i = 0; i < image->segments_count; i++) {
+        if (unique == 0 || image->segments[unique - 1] != image->segments[i]) image->segments[unique++] = image->segments[i];
+    }
+    image->segments_count = unique;
+    for (size_t i = 0; i < unique; i++) {
+        program->instructions[image->segments[i]] = (InstructionData){.opcode = ILAZY};
+    }
+}
+
+// Decodes the segment starting at at, see xbin_lazy_segments
+bool program_decode_segment(Program *program, size_t at) {
+    ProgramImage *image = &program->image;
+    XbinCode code;
+    if (!image->segments_count || !xbin_code((const XbinHeader *) image->data, image, &code)) return false;
+    size_t lo = 0, hi = image->segments_count;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (image->segments[mid] <= at) lo = mid;
+        else hi = mid;
+    }
+    size_t end = lo + 1 < image->segments_count ? image->segments[lo + 1] : program->instructions_count;
+    return image->segments[lo] == at && xbin_decode_range(program, &code, at, end, true);
+}
+
+// Decodes what a lazily loaded program has not run yet, for anything that walks all of it
+bool program_decode_all(Program *program) {
+    ProgramImage *image = &program->image;
+    bool ok = true;
+    for (size_t i = 0; i < image->segments_count && ok; i++) {
+        size_t at = image->segments[i];
+        if (program->instructions[at].opcode == ILAZY) ok = program_decode_segment(program, at);
+    }
+    if (!ok) return false;
+    free(image->segments);
+    image->segments = NULL;
+    image->segments_count = 0;
+    return true;
+}
+
+// Loads an xbin v2 without copying it, the program owns image from here on.
+// lazy decodes only the labels and leaves the code to program_decode_segment.
+static int xbin_load_image(OrtaVM *vm, ProgramImage image, bool lazy) {
+    Program *program = &vm->program;
+    program_free(program);
+    vector_init(&program->variables, 5, sizeof(Variable));
+    vector_init(&program->strings, 8, sizeof(char *));
+    vector_init(&program->variable_names, 8, sizeof(char *));
+    program->image = image;
+
+    const XbinHeader *header = (const XbinHeader *) image.data;
+    if (image.size < sizeof(XbinHeader) || memcmp(header->magic, XBIN_MAGIC, sizeof(header->magic)) != 0) return 0;
+    if (header->version != XBIN_VERSION) {
+        OERROR(stderr, "ERROR: xbin version %d is not supported, expected %d\n", header->version, XBIN_VERSION);
+        return 0;
+    }
+    if (header->header_size < sizeof(XbinHeader)) return 0;
+    if (header->encoding != XBIN_FIXED) {
+        ProgramImage expanded;
+        if (!xbin_expand(header, &image, &expanded)) return 0;
+        image_release(&program->image);
+        program->image = image = expanded;
+        header = (const XbinHeader *) image.data;
+    }
+
+    XbinCode code;
+    size_t labels_count = 0, variables_count = 0, constants_count = 0;
+    const XbinLabel *labels = xbin_section(header, &image, XBIN_LABELS, sizeof(XbinLabel), &labels_count);
+    const uint32_t *variables = xbin_section(header, &image, XBIN_VARIABLES, sizeof(uint32_t), &variables_count);
+    const XbinString *constants = xbin_section(header, &image, XBIN_CONSTANTS, sizeof(XbinString), &constants_count);
+    if (!xbin_code(header, &image, &code) || !labels || !variables || !constants ||
+        header->filename >= code.pool_size) return 0;
+    const char *pool = code.pool;
+    size_t pool_size = code.pool_size;
+
+    vm->meta = header->meta;
+    program->filename = strdup(pool + header->filename);
+
+    for (size_t i = 0; i < constants_count; i++) {
+        if (constants[i].offset >= pool_size || constants[i].length > pool_size - constants[i].offset - 1) return 0;
+        char *constant = xstring_new(pool + constants[i].offset, constants[i].length);
+        vector_push(&program->strings, &constant);
+    }
+    for (size_t i = 0; i < variables_count; i++) {
+        if (variables[i] >= pool_size || intern_variable(program, pool + variables[i]) != i) return 0;
+    }
+
+    program->labels = malloc(sizeof(Label) * (labels_count ? labels_count : 1));
+    program->labels_capacity = labels_count;
+    for (size_t i = 0; i < labels_count; i++) {
+        if (labels[i].name >= pool_size) return 0;
+        program->labels[i].name = strdup(pool + labels[i].name);
+        program->labels[i].address = labels[i].address;
+        program->labels_count = i + 1;
+        register_label(program, i);
+    }
+
+    size_t operands = code.operands_count ? code.operands_count : 1;
+    if (!xbin_operands_in_place()) program->image.args = malloc(sizeof(Operand) * operands);
+    program->image.texts = malloc(sizeof(char *) * operands);
+    program->instructions = malloc(sizeof(InstructionData) * (code.count ? code.count : 1));
+    program->instructions_capacity = code.count;
+    program->instructions_count = code.count;
+    if (lazy) {
+        program->verified = false;
+        xbin_lazy_segments(program);
+        return 1;
+    }
+    if (!xbin_decode_range(program, &code, 0, code.count, false)) {
+        program->instructions_count = 0;
+        return 0;
+    }
+    return verify_program(program);
 }
 
+#ifndef _WIN32
+static bool xbin_map(FILE *fp, ProgramImage *image) {
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0 || st.st_size <= 0) return false;
+    void *data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    if (data == MAP_FAILED) return false;
+    *image = (ProgramImage){.data = data, .size = (size_t) st.st_size, .mapped = true};
+    return true;
+}
+#else
+static bool xbin_map(FILE *fp, ProgramImage *image) {
+    if (fseek(fp, 0, SEEK_END) != 0) return false;
+    long size = ftell(fp);
+    unsigned char *data = size > 0 ? malloc((size_t) size) : NULL;
+    rewind(fp);
+    if (!data || fread(data, 1, (size_t) size, fp) != (size_t) size) {
+        free(data);
+        return false;
+    }
+    *image = (ProgramImage){.data = data, .size = (size_t) size, .allocated = true};
+    return true;
+}
+#endif
+
 void free_program_instructions(Program *program, size_t count) {
     for (size_t i = 0; i < count; i++) {
         for (size_t j = 0; j < program->instructions[i].operands.size; j++) {
@@ -2789,16 +4955,13 @@ void free_program_labels(Program *program, size_t count) {
     free(program->labels);
 }
 
-int load_xbin(OrtaVM *vm, const char *input_filename) {
+// the format before v2: every field written one at a time, operands as text
+static int load_xbin_legacy(OrtaVM *vm, FILE *fp) {
     Program *program = &vm->program;
-    FILE *fp = fopen(input_filename, "rb");
-    if (!fp) {
-        OERROR(stderr, "ERROR: Could not open bytecode file '%s'\n", input_filename);
-        return 0;
-    }
-
     program_free(program);
     vector_init(&program->variables, 5, sizeof(Variable));
+    vector_init(&program->strings, 8, sizeof(char *));
+    vector_init(&program->variable_names, 8, sizeof(char *));
 
     if (fread(&vm->meta, sizeof(OrtaMeta), 1, fp) != 1)
         goto error_close;
@@ -2957,6 +5120,9 @@ int load_xbin(OrtaVM *vm, const char *input_filename) {
         program->instructions[i].opcode = opcode;
         program->instructions[i].operands = operands;
         program->instructions[i].line = line;
+        program->instructions[i].args = NULL;
+        program->instructions[i].argc = 0;
+        program->instructions[i].deopt = false;
     }
 
     size_t labels_count;
@@ -2993,11 +5159,16 @@ int load_xbin(OrtaVM *vm, const char *input_filename) {
 
         program->labels[i].name = strdup(name);
         program->labels[i].address = address;
+        register_label(program, i);
         free(name);
     }
 
     fclose(fp);
-    return 1;
+    decode_program(program);
+    if (!link_calls(program)) return false;
+    link_program(program);
+    fuse_program(program);
+    return verify_program(program);
 
 error_labels:
     free_program_labels(program, i);
@@ -3010,12 +5181,14 @@ error_close:
     return 0;
 }
 
-int load_bytecode_from_memory(OrtaVM *vm, const unsigned char *data, size_t data_size) {
+static int load_bytecode_legacy(OrtaVM *vm, const unsigned char *data, size_t data_size) {
     Program *program = &vm->program;
     size_t offset = 0;
 
     program_free(program);
     vector_init(&program->variables, 5, sizeof(Variable));
+    vector_init(&program->strings, 8, sizeof(char *));
+    vector_init(&program->variable_names, 8, sizeof(char *));
 
     if (offset + sizeof(OrtaMeta) > data_size)
         return 0;
@@ -3211,6 +5384,9 @@ int load_bytecode_from_memory(OrtaVM *vm, const unsigned char *data, size_t data
         program->instructions[i].opcode = opcode;
         program->instructions[i].operands = operands;
         program->instructions[i].line = line;
+        program->instructions[i].args = NULL;
+        program->instructions[i].argc = 0;
+        program->instructions[i].deopt = false;
     }
 
     size_t labels_count;
@@ -3253,10 +5429,15 @@ int load_bytecode_from_memory(OrtaVM *vm, const unsigned char *data, size_t data
 
         program->labels[i].name = strdup(name);
         program->labels[i].address = address;
+        register_label(program, i);
         free(name);
     }
 
-    return 1;
+    decode_program(program);
+    if (!link_calls(program)) return false;
+    link_program(program);
+    fuse_program(program);
+    return verify_program(program);
 
 error_labels:
     free_program_labels(program, i);
@@ -3267,20 +5448,83 @@ error_instructions:
     return 0;
 }
 
-void execute_program(OrtaVM *vm) {
+static int xbin_open(OrtaVM *vm, const char *input_filename, bool lazy) {
+    FILE *fp = fopen(input_filename, "rb");
+    if (!fp) {
+        OERROR(stderr, "ERROR: Could not open bytecode file '%s'\n", input_filename);
+        return 0;
+    }
+    char magic[4];
+    if (fread(magic, 1, sizeof(magic), fp) == sizeof(magic) && memcmp(magic, XBIN_LEGACY_MAGIC, sizeof(magic)) == 0) {
+        rewind(fp);
+        return load_xbin_legacy(vm, fp);
+    }
+    ProgramImage image;
+    bool mapped = xbin_map(fp, &image);
+    fclose(fp);
+    if (!mapped) {
+        OERROR(stderr, "ERROR: Could not map bytecode file '%s'\n", input_filename);
+        return 0;
+    }
+    return xbin_load_image(vm, image, lazy);
+}
+
+int load_xbin(OrtaVM *vm, const char *input_filename) {
+    return xbin_open(vm, input_filename, false);
+}
+
+// the XbinEncoding of a v2 file, -1 when it cannot be read or is no v2 xbin
+int xbin_file_encoding(const char *filename) {
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) return -1;
+    XbinHeader header;
+    bool read = fread(&header, sizeof(header), 1, fp) == 1;
+    fclose(fp);
+    if (!read || memcmp(header.magic, XBIN_MAGIC, sizeof(header.magic)) != 0 || header.version != XBIN_VERSION) return -1;
+    return (int) header.encoding;
+}
+
+// Like load_xbin, but decodes every routine on its first entry instead of up front,
+// so a short run of a big program only pays for the code it reaches. The program is
+// not verified and runs in the checked loop.
+int load_xbin_lazy(OrtaVM *vm, const char *input_filename) {
+    return xbin_open(vm, input_filename, true);
+}
+
+// A v2 image runs from data in place, which has to outlive the program, like the
+// bytecode[] array xtoa emits
+int load_bytecode_from_memory(OrtaVM *vm, const unsigned char *data, size_t data_size) {
+    if (data_size >= 4 && memcmp(data, XBIN_LEGACY_MAGIC, 4) == 0) return load_bytecode_legacy(vm, data, data_size);
+    ProgramImage image = {.data = data, .size = data_size};
+    if ((uintptr_t) data % XBIN_ALIGN != 0) {
+        unsigned char *copy = malloc(data_size ? data_size : 1);
+        if (!copy) return 0;
+        memcpy(copy, data, data_size);
+        image.data = copy;
+        image.allocated = true;
+    }
+    return xbin_load_image(vm, image, false);
+}
+
+// Points ip at the entry label, false when there is nothing to run.
+bool enter_program(OrtaVM *vm) {
     XPU *xpu = &vm->xpu;
     size_t entry = 0;
     if (!find_label(&vm->program, OENTRY, &entry)) {
         xpu->ip = 0;
         OERROR(stderr, "Could not find label '%s' starting at 0\n", OENTRY);
     } else xpu->ip = entry;
-    int running = 1;
-    while (running && !vm->program.halted) {
-        if (vm->xpu.ip >= vm->program.instructions_count) {
-            running = 0;
-            break;
-        }
-        execute_instruction(vm, &vm->program.instructions[xpu->ip]);
+    return !vm->program.halted && xpu->ip < vm->program.instructions_count;
+}
+
+void execute_program(OrtaVM *vm) {
+    XPU *xpu = &vm->xpu;
+    if (!enter_program(vm)) return;
+    InstructionData *start = &vm->program.instructions[xpu->ip];
+    if (vm->program.verified && xpu->stack.count + start->max_stack <= xpu->stack.capacity) {
+        execute_verified(vm, start);
+    } else {
+        execute_from(vm, start, false);
     }
 }
 
@@ -3311,7 +5555,7 @@ void print_stack(XPU *xpu) {
     printf(BOLD CYAN "Stack (%zu items):\n" RESET, xpu->stack.count);
     for (size_t i = 0; i < xpu->stack.count; i++) {
         printf("[%zu] ", i);
-        print_word(xpu->stack.stack[i]);
+        print_word(WORD_LOAD(xpu->stack.stack[i]));
     }
 }
 
@@ -0,0 +1,217 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+#include "orta.h"
+
+// ----------------- Profiles -------------------------
+// orta --profile-out runs a program one instruction at a time and counts how
+// often every instruction ran and how often every jmpif and cmpjmpif jumped.
+// The profile is written when the run ends, also when a runtime error ends it.
+// The sidecar file is text:
+//
+//   orta-profile 1 <instructions> <program hash>
+//   <index> <count>                          for every instruction that ran
+//   <index> <count> <taken> <not taken>      for branches
+//   # pair <op> <op> <count>                 hottest opcode pairs, for picking superinstructions
+//
+// A profile belongs to the instructions it was recorded on. profile_read
+// rejects one whose hash differs, like one recorded with other flags.
+
+#define PROFILE_VERSION 1
+#define PROFILE_PAIRS 10 // opcode pairs listed in a written profile
+#define PROFILE_HOT 100  // an instruction is hot when it ran at least 1/PROFILE_HOT as often as the hottest
+
+typedef struct {
+    size_t count;      // instructions the profile covers
+    uint64_t *counts;  // runs per instruction
+    uint64_t *taken;   // jumps per branch
+    uint64_t max;      // runs of the hottest instruction
+    uint64_t hash;     // profile_hash of the program
+} Profile;
+
+static bool profile_branch(Instruction op) {
+    return op == IJMPIF || op == ICMPJMPIF;
+}
+
+// FNV-1a over the opcodes and decoded operands, which a parsed program and its
+// xbin share even where the operand texts differ
+uint64_t profile_hash(Program *program) {
+    uint64_t hash = 14695981039346656037u;
+    for (size_t i = 0; i < program->instructions_count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        hash = (hash ^ (uint64_t) generic_opcode(instr->opcode)) * 1099511628211u;
+        for (size_t j = 0; j < instr->argc; j++) {
+            Operand *op = &instr->args[j];
+            uint64_t value = 0;
+            switch (op->kind) {
+                case OPERAND_INT: value = (uint64_t) (uint32_t) op->as_int; break;
+                case OPERAND_REGISTER: value = op->as_register; break;
+                case OPERAND_LABEL: value = op->as_index; break;
+                default: break;
+            }
+            hash = (hash ^ (uint64_t) op->kind) * 1099511628211u;
+            hash = (hash ^ value) * 1099511628211u;
+        }
+    }
+    return hash;
+}
+
+Profile profile_create(Program *program) {
+    Profile profile = {0};
+    profile.count = program->instructions_count;
+    profile.counts = calloc(profile.count + 1, sizeof(uint64_t));
+    profile.taken = calloc(profile.count + 1, sizeof(uint64_t));
+    profile.hash = profile_hash(program);
+    return profile;
+}
+
+void profile_free(Profile *profile) {
+    free(profile->counts);
+    free(profile->taken);
+    *profile = (Profile){0};
+}
+
+static inline bool profile_hot(const Profile *profile, size_t at) {
+    return profile->counts[at] > 0 && profile->counts[at] * PROFILE_HOT >= profile->max;
+}
+
+bool profile_write(Profile *profile, Program *program, const char *path);
+
+typedef struct {
+    Profile *profile;
+    Program *program;
+    const char *path;
+} ProfileRun;
+
+static void profile_finish(void *data) {
+    ProfileRun *run = data;
+    for (size_t i = 0; i < run->profile->count; i++) {
+        if (run->profile->counts[i] > run->profile->max) run->profile->max = run->profile->counts[i];
+    }
+    profile_write(run->profile, run->program, run->path);
+}
+
+// Runs the program like execute_program, counting every step, and writes the profile to path
+void profile_program(OrtaVM *vm, Profile *profile, const char *path) {
+    XPU *xpu = &vm->xpu;
+    ProfileRun run = {.profile = profile, .program = &vm->program, .path = path};
+    // EERROR exits from inside execute_instruction, the counts so far still get written
+    vm->on_error = profile_finish;
+    vm->on_error_data = &run;
+    if (enter_program(vm)) {
+        while (!vm->program.halted && xpu->ip < vm->program.instructions_count) {
+            size_t at = xpu->ip;
+            InstructionData *instr = &vm->program.instructions[at];
+            bool branch = profile_branch(generic_opcode(instr->opcode));
+            profile->counts[at]++;
+            execute_instruction(vm, instr);
+            if (branch && xpu->ip != at + 1) profile->taken[at]++;
+        }
+    }
+    vm->on_error = NULL;
+    vm->on_error_data = NULL;
+    profile_finish(&run);
+}
+
+typedef struct {
+    Instruction first;
+    Instruction second;
+    uint64_t count;
+} ProfilePair;
+
+static int profile_pair_order(const void *a, const void *b) {
+    uint64_t x = ((const ProfilePair *) a)->count, y = ((const ProfilePair *) b)->count;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+// Adjacent opcodes inside a block: the second one only runs after the first
+static void profile_write_pairs(FILE *fp, Profile *profile, Program *program) {
+    bool *targets = jump_targets(program);
+    ProfilePair *pairs = calloc(INSTRUCTION_COUNT * INSTRUCTION_COUNT, sizeof(ProfilePair));
+    for (size_t i = 0; i + 1 < program->instructions_count; i++) {
+        Instruction first = generic_opcode(program->instructions[i].opcode);
+        Instruction second = generic_opcode(program->instructions[i + 1].opcode);
+        if (targets[i + 1] || first >= INSTRUCTION_COUNT || second >= INSTRUCTION_COUNT) continue;
+        switch (first) {
+            case IJMP: case IJMPIF: case ICMPJMPIF: case IJMPTABLE: case ICALL: case IRET: case IHALT: continue;
+            default: break;
+        }
+        ProfilePair *pair = &pairs[first * INSTRUCTION_COUNT + second];
+        pair->first = first;
+        pair->second = second;
+        pair->count += profile->counts[i + 1];
+    }
+    qsort(pairs, INSTRUCTION_COUNT * INSTRUCTION_COUNT, sizeof(ProfilePair), profile_pair_order);
+    for (size_t i = 0; i < PROFILE_PAIRS && pairs[i].count > 0; i++) {
+        fprintf(fp, "# pair %s %s %llu\n", instruction_to_string(pairs[i].first),
+                instruction_to_string(pairs[i].second), (unsigned long long) pairs[i].count);
+    }
+    free(pairs);
+    free(targets);
+}
+
+bool profile_write(Profile *profile, Program *program, const char *path) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        OERROR(stderr, "ERROR: Could not create profile '%s'\n", path);
+        return false;
+    }
+    fprintf(fp, "orta-profile %d %zu %016llx\n", PROFILE_VERSION, profile->count, (unsigned long long) profile->hash);
+    for (size_t i = 0; i < profile->count; i++) {
+        if (profile->counts[i] == 0) continue;
+        if (profile_branch(generic_opcode(program->instructions[i].opcode))) {
+            fprintf(fp, "%zu %llu %llu %llu\n", i, (unsigned long long) profile->counts[i],
+                    (unsigned long long) profile->taken[i],
+                    (unsigned long long) (profile->counts[i] - profile->taken[i]));
+        } else {
+            fprintf(fp, "%zu %llu\n", i, (unsigned long long) profile->counts[i]);
+        }
+    }
+    profile_write_pairs(fp, profile, program);
+    fclose(fp);
+    return true;
+}
+
+// Reads a profile of program, false when it is missing, malformed or recorded on other code
+bool profile_read(Profile *profile, Program *program, const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        OERROR(stderr, "ERROR: Could not open profile '%s'\n", path);
+        return false;
+    }
+    int version;
+    size_t count;
+    unsigned long long hash;
+    *profile = profile_create(program);
+    if (fscanf(fp, "orta-profile %d %zu %llx", &version, &count, &hash) != 3 || version != PROFILE_VERSION) {
+        OERROR(stderr, "ERROR: '%s' is not a profile\n", path);
+        goto error;
+    }
+    if (count != profile->count || hash != profile->hash) {
+        OERROR(stderr, "ERROR: profile '%s' was recorded on other code\n", path);
+        goto error;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        size_t at;
+        unsigned long long runs, taken = 0, not_taken = 0;
+        if (line[0] == '#' || line[0] == '\n') continue;
+        int fields = sscanf(line, "%zu %llu %llu %llu", &at, &runs, &taken, &not_taken);
+        if (fields < 2 || at >= profile->count || taken > runs) {
+            OERROR(stderr, "ERROR: malformed profile line in '%s': %s", path, line);
+            goto error;
+        }
+        profile->counts[at] = runs;
+        profile->taken[at] = taken;
+        if (runs > profile->max) profile->max = runs;
+    }
+    fclose(fp);
+    return true;
+
+error:
+    fclose(fp);
+    profile_free(profile);
+    return false;
+}
+
+#endif // PROFILE_H
@@ -121,7 +121,7 @@ bool parse_line(OrtaVM *vm, const char *line) {
         vector_free(&tokens);
         return false;
     }
-    InstructionData instr;
+    InstructionData instr = {0};
     instr.opcode = parsed_instruction;
     instr.operands = tokens;
     add_instruction(&vm->program, instr);
@@ -177,6 +177,7 @@ int main(int argc, char **argv) {
             } else {
                 size_t current_ip = vm.program.instructions_count - 1;
                 vm.xpu.ip = current_ip;
+                decode_instruction(&vm.program, &vm.program.instructions[current_ip]);
                 execute_instruction(&vm, &vm.program.instructions[current_ip]);
             }
             add_to_history(line);
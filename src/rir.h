@@ -0,0 +1,776 @@
+#ifndef RIR_H
+#define RIR_H
+#include "orta.h"
+
+// ----------------- Register IR -------------------------
+// orta --regvm translates verified stack code into a three-address register IR
+// and interprets that instead. The xbin stays stack code, the IR only lives in
+// memory while the program runs.
+//
+// Virtual registers are slots of a frame array laid over the data stack: slot k
+// of a block is stack[count + k], count being the depth the block was entered
+// with, so negative slots are words an earlier block left behind. Translation
+// runs a block's stack effects symbolically. A push of an immediate or register
+// only records the operand and whatever consumes it reads it in place, so
+// push r8; push 1; add; pop r8 becomes the single r8 = r8 + 1.
+//
+// Operands still pending are written to their slots ("flushed") before anything
+// that looks at the real stack: jumps, guarded instructions and opcodes without
+// an IR form. Those step the original instruction with execute_instruction, and a
+// step that ends at another depth than verified, or that jumps, leaves the block
+// with the real stack exact. Blocks start at labels, jump targets and return
+// addresses; a conditional branch does not end one.
+
+#define RIR_NONE ((size_t) -1)
+
+typedef enum {
+    RIR_SLOT, // slot of the block
+    RIR_REG,  // XPU register
+    RIR_IMM,  // int, float or string literal, strings point into the program's table
+    RIR_VAR,  // variable operand of a fused instruction, or the variable a result is stored to
+} RirKind;
+
+typedef struct {
+    RirKind kind;
+    int index; // slot, register or the operand's index in its instruction
+    Word imm;
+    const Operand *var;
+} RirOperand;
+
+typedef enum {
+    RIR_ENTER,   // block entry, a.index is the lowest slot read and b.index one past the highest written
+    RIR_MOVE,    // dst = a
+    RIR_ADD,     // dst = a + b, ints inline and anything else through binary_words
+    RIR_SUB,     // dst = b - a, the stack form subtracts the deeper word
+    RIR_MUL,
+    RIR_COMPARE, // dst = a cmp b
+    RIR_DIVIDE,  // dst = a cmp b for div and mod, other types and zero divisors step
+    RIR_INC,     // dst register
+    RIR_DEC,
+    RIR_DROP,    // releases slot a
+    RIR_DUP,     // slot depth = slot depth - 1
+    RIR_SWAP,    // exchanges slots depth - 2 and depth - 1
+    RIR_GETVAR,  // slot depth = the variable of instruction ip
+    RIR_SETVAR,  // the variable of instruction ip = a
+    RIR_ADDVAR,
+    RIR_JMP,
+    RIR_JMPIF,   // jumps when a is 1
+    RIR_CMPJMP,  // jumps when a cmp b
+    RIR_STEP,    // runs instruction ip on the real stack
+} RirOp;
+
+typedef struct {
+    RirOp op;
+    Instruction cmp;  // operator of the arithmetic, compare and divide forms
+    int depth;        // slots in use before the instruction
+    size_t ip;        // stack instruction it came from
+    size_t target;    // jumps: the stack instruction they go to
+    size_t jump;      // jumps: IR index of the target block, RIR_NONE when there is none
+    bool fits;        // jumps: the target block fits the stack whenever this one did
+    RirOperand dst, a, b;
+} RirInstr;
+
+typedef struct {
+    RirInstr *code;
+    size_t count;
+    size_t capacity;
+    size_t *blocks; // per stack instruction, IR index of the block it starts or RIR_NONE
+} RirProgram;
+
+// ----------------- Translation -------------------------
+
+typedef struct {
+    Program *program;
+    RirProgram *rir;
+    RirOperand *stack; // operands of slots 0 .. depth - 1, slots below the entry are never pending
+    size_t capacity;
+    int depth;
+    int low;
+    int high;
+    size_t ip;
+} RirBuilder;
+
+static inline RirOperand rir_slot(int index) {
+    return (RirOperand){.kind = RIR_SLOT, .index = index};
+}
+
+static RirInstr *rir_emit(RirBuilder *b, RirOp op) {
+    RirProgram *rir = b->rir;
+    if (rir->count >= rir->capacity) {
+        rir->capacity = rir->capacity ? rir->capacity * 2 : 64;
+        rir->code = realloc(rir->code, rir->capacity * sizeof(RirInstr));
+    }
+    RirInstr *ins = &rir->code[rir->count++];
+    *ins = (RirInstr){.op = op, .depth = b->depth, .ip = b->ip, .jump = RIR_NONE};
+    return ins;
+}
+
+static void rir_wrote(RirBuilder *b, int slot) {
+    if (slot + 1 > b->high) b->high = slot + 1;
+}
+
+static void rir_flush_slot(RirBuilder *b, int at) {
+    if (b->stack[at].kind == RIR_SLOT) return;
+    RirInstr *ins = rir_emit(b, RIR_MOVE);
+    ins->dst = rir_slot(at);
+    ins->a = b->stack[at];
+    b->stack[at] = ins->dst;
+    rir_wrote(b, at);
+}
+
+static void rir_flush(RirBuilder *b) {
+    for (int i = 0; i < b->depth; i++) rir_flush_slot(b, i);
+}
+
+// a pending read of reg must happen before reg changes
+static void rir_flush_register(RirBuilder *b, XRegisters reg) {
+    for (int i = 0; i < b->depth; i++) {
+        if (b->stack[i].kind == RIR_REG && b->stack[i].index == (int) reg) rir_flush_slot(b, i);
+    }
+}
+
+static void rir_push(RirBuilder *b, RirOperand op) {
+    if (b->depth < 0) {
+        // below the entry there is nothing to keep an operand pending in
+        if (op.kind != RIR_SLOT) {
+            RirInstr *ins = rir_emit(b, RIR_MOVE);
+            ins->dst = rir_slot(b->depth);
+            ins->a = op;
+        }
+        b->depth++;
+        return;
+    }
+    if ((size_t) b->depth >= b->capacity) {
+        b->capacity = b->capacity ? b->capacity * 2 : 16;
+        b->stack = realloc(b->stack, b->capacity * sizeof(RirOperand));
+    }
+    b->stack[b->depth++] = op;
+}
+
+static RirOperand rir_pop(RirBuilder *b) {
+    b->depth--;
+    if (b->depth >= 0) return b->stack[b->depth];
+    if (b->depth < b->low) b->low = b->depth;
+    return rir_slot(b->depth);
+}
+
+static RirOperand rir_peek(RirBuilder *b) {
+    RirOperand top = rir_pop(b);
+    rir_push(b, top);
+    return top;
+}
+
+static bool rir_operand(Program *program, const Operand *op, RirOperand *out) {
+    switch (op->kind) {
+        case OPERAND_INT:
+            *out = (RirOperand){.kind = RIR_IMM, .imm = {.type = WINT, .as_int = op->as_int}};
+            return true;
+        case OPERAND_FLOAT:
+            *out = (RirOperand){.kind = RIR_IMM, .imm = {.type = WFLOAT, .as_float = op->as_float}};
+            return true;
+        case OPERAND_STRING:
+            *out = (RirOperand){.kind = RIR_IMM, .imm = {.type = WCHARP, .as_string = program_string(program, op->as_index)}};
+            return true;
+        case OPERAND_REGISTER:
+            *out = (RirOperand){.kind = RIR_REG, .index = op->as_register};
+            return true;
+        default:
+            return false;
+    }
+}
+
+// operands of pushop and cmpjmpif may also name variables, they are read in place
+static bool rir_argument(Program *program, InstructionData *instr, size_t index, RirOperand *out) {
+    if (instr->args[index].kind != OPERAND_VARIABLE) return rir_operand(program, &instr->args[index], out);
+    *out = (RirOperand){.kind = RIR_VAR, .index = (int) index, .var = &instr->args[index]};
+    return true;
+}
+
+static bool rir_jumps_to(Program *program, const Operand *op) {
+    return op->kind == OPERAND_LABEL && op->as_index < program->instructions_count;
+}
+
+// a and b are on the symbolic stack, the result takes a's slot
+static void rir_arithmetic(RirBuilder *b, Instruction cmp) {
+    RirOperand rhs = rir_pop(b), lhs = rir_pop(b);
+    RirOp op = cmp == IADD ? RIR_ADD : cmp == ISUB ? RIR_SUB : cmp == IMUL ? RIR_MUL : RIR_COMPARE;
+    RirInstr *ins = rir_emit(b, op);
+    ins->cmp = cmp;
+    ins->a = lhs;
+    ins->b = rhs;
+    ins->dst = rir_slot(b->depth);
+    rir_wrote(b, b->depth);
+    rir_push(b, ins->dst);
+}
+
+// div and mod may push nothing, a step has to find everything below them on the real stack
+static void rir_divide(RirBuilder *b, Instruction cmp, RirOperand lhs, RirOperand rhs, int depth) {
+    RirInstr *ins = rir_emit(b, RIR_DIVIDE);
+    ins->cmp = cmp;
+    ins->depth = depth;
+    ins->a = lhs;
+    ins->b = rhs;
+    ins->dst = rir_slot(b->depth);
+    rir_wrote(b, b->depth);
+    rir_push(b, ins->dst);
+}
+
+// the arithmetic emitted last when it produced src, nothing read its slot since
+static RirInstr *rir_producer(RirBuilder *b, size_t before, RirOperand src) {
+    RirProgram *rir = b->rir;
+    if (src.kind != RIR_SLOT || rir->count != before || before == 0) return NULL;
+    RirInstr *last = &rir->code[before - 1];
+    if (last->op < RIR_ADD || last->op > RIR_COMPARE) return NULL;
+    if (last->dst.kind != RIR_SLOT || last->dst.index != src.index) return NULL;
+    return last;
+}
+
+// Translates one stack instruction, false when control never falls through it
+static bool rir_instruction(RirBuilder *b, InstructionData *instr) {
+    Program *program = b->program;
+    Operand *args = instr->args;
+    Instruction opcode = generic_opcode(instr->opcode);
+    RirOperand op, lhs, rhs;
+    switch (opcode) {
+        case INOP:
+            return true;
+
+        case IPUSH:
+            if (instr->argc != 1 || !rir_operand(program, &args[0], &op)) break;
+            rir_push(b, op);
+            return true;
+
+        case IPOP: {
+            if (instr->argc < 1 || args[0].kind != OPERAND_REGISTER) break;
+            XRegisters reg = args[0].as_register;
+            RirOperand src = rir_pop(b);
+            size_t before = b->rir->count;
+            rir_flush_register(b, reg);
+            // pop right after arithmetic writes the register instead of the slot
+            RirInstr *ins = rir_producer(b, before, src);
+            if (ins) {
+                ins->dst = (RirOperand){.kind = RIR_REG, .index = reg};
+                return true;
+            }
+            ins = rir_emit(b, RIR_MOVE);
+            ins->dst = (RirOperand){.kind = RIR_REG, .index = reg};
+            ins->a = src;
+            return true;
+        }
+
+        case IDROP:
+            op = rir_pop(b);
+            if (op.kind == RIR_SLOT) rir_emit(b, RIR_DROP)->a = op;
+            return true;
+
+        case IDUP:
+            op = rir_peek(b);
+            if (op.kind == RIR_IMM) {
+                rir_push(b, op);
+                return true;
+            }
+            // a register may hold a type dup does not copy
+            rir_flush(b);
+            rir_emit(b, RIR_DUP);
+            rir_wrote(b, b->depth);
+            rir_push(b, rir_slot(b->depth));
+            return true;
+
+        case ISWAP:
+            rhs = rir_pop(b);
+            lhs = rir_pop(b);
+            if (lhs.kind != RIR_SLOT && rhs.kind != RIR_SLOT) {
+                rir_push(b, rhs);
+                rir_push(b, lhs);
+                return true;
+            }
+            rir_push(b, lhs);
+            rir_push(b, rhs);
+            rir_flush(b);
+            rir_emit(b, RIR_SWAP);
+            rir_wrote(b, b->depth - 1);
+            return true;
+
+        case IMOV: {
+            if (instr->argc != 2 || args[1].kind != OPERAND_REGISTER || !rir_operand(program, &args[0], &op)) break;
+            rir_flush_register(b, args[1].as_register);
+            RirInstr *ins = rir_emit(b, RIR_MOVE);
+            ins->dst = (RirOperand){.kind = RIR_REG, .index = args[1].as_register};
+            ins->a = op;
+            return true;
+        }
+
+        case IINC:
+        case IDEC:
+            if (instr->argc < 1 || args[0].kind != OPERAND_REGISTER) break;
+            rir_flush_register(b, args[0].as_register);
+            rir_emit(b, opcode == IINC ? RIR_INC : RIR_DEC)->dst =
+                    (RirOperand){.kind = RIR_REG, .index = args[0].as_register};
+            return true;
+
+        case IADD:
+        case ISUB:
+        case IMUL:
+        case IEQ:
+        case INE:
+        case ILT:
+        case IGT:
+        case ILE:
+        case IGE:
+            // add and sub with operands work on a register in place
+            if (instr->argc != 0) break;
+            rir_arithmetic(b, opcode);
+            return true;
+
+        case IDIV:
+        case IMOD: {
+            if (instr->argc != 0) break;
+            int depth = b->depth;
+            rhs = rir_pop(b);
+            lhs = rir_pop(b);
+            // a step puts pending operands into their slots itself
+            rir_flush(b);
+            rir_wrote(b, depth - 1);
+            rir_divide(b, opcode, lhs, rhs, depth);
+            return true;
+        }
+
+        case IPUSHOP: {
+            Instruction cmp = (Instruction) args[0].as_int;
+            if (!rir_argument(program, instr, 1, &lhs) || !rir_argument(program, instr, 2, &rhs)) break;
+            if (cmp == IDIV || cmp == IMOD) {
+                rir_flush(b);
+                rir_divide(b, cmp, lhs, rhs, b->depth);
+                return true;
+            }
+            rir_push(b, lhs);
+            rir_push(b, rhs);
+            rir_arithmetic(b, cmp);
+            return true;
+        }
+
+        case IGETVAR:
+            if (instr->argc < 1) break;
+            rir_flush(b);
+            rir_emit(b, RIR_GETVAR);
+            rir_wrote(b, b->depth);
+            rir_push(b, rir_slot(b->depth));
+            return true;
+
+        case ISETVAR: {
+            if (instr->argc < 1) break;
+            op = rir_pop(b);
+            RirInstr *ins = rir_producer(b, b->rir->count, op);
+            if (ins) {
+                ins->dst = (RirOperand){.kind = RIR_VAR, .var = &args[0]};
+                return true;
+            }
+            rir_emit(b, RIR_SETVAR)->a = op;
+            return true;
+        }
+
+        case IADDVAR:
+            // touches neither the stack nor registers, pending operands stay
+            rir_emit(b, RIR_ADDVAR);
+            return true;
+
+        case IJMP:
+            if (instr->argc < 1 || !rir_jumps_to(program, &args[0])) break;
+            rir_flush(b);
+            rir_emit(b, RIR_JMP)->target = args[0].as_index;
+            return false;
+
+        case IJMPIF: {
+            if (instr->argc < 1 || !rir_jumps_to(program, &args[0])) break;
+            op = rir_pop(b);
+            // a compare right before becomes a cmpjmpif, the flush does not touch its operands
+            RirInstr *compare = rir_producer(b, b->rir->count, op);
+            RirInstr *ins;
+            if (compare && compare->op == RIR_COMPARE) {
+                RirInstr fused = *compare;
+                b->rir->count--;
+                rir_flush(b);
+                ins = rir_emit(b, RIR_CMPJMP);
+                ins->ip = fused.ip;
+                ins->cmp = fused.cmp;
+                ins->a = fused.a;
+                ins->b = fused.b;
+            } else {
+                rir_flush(b);
+                ins = rir_emit(b, RIR_JMPIF);
+                ins->a = op;
+            }
+            ins->target = args[0].as_index;
+            return true;
+        }
+
+        case ICMPJMPIF: {
+            if (instr->argc < 2 || instr->argc > 4 || !rir_jumps_to(program, &args[1])) break;
+            size_t pushed = instr->argc - 2;
+            if (pushed >= 1 && !rir_argument(program, instr, instr->argc - 1, &rhs)) break;
+            if (pushed == 2 && !rir_argument(program, instr, 2, &lhs)) break;
+            if (pushed < 1) rhs = rir_pop(b);
+            if (pushed < 2) lhs = rir_pop(b);
+            rir_flush(b);
+            RirInstr *ins = rir_emit(b, RIR_CMPJMP);
+            ins->cmp = (Instruction) args[0].as_int;
+            ins->a = lhs;
+            ins->b = rhs;
+            ins->target = args[1].as_index;
+            return true;
+        }
+
+        default:
+            break;
+    }
+
+    // no IR form, the instruction runs on the real stack
+    rir_flush(b);
+    rir_emit(b, RIR_STEP);
+    if (instr->stack_effect < 0) b->depth += instr->stack_effect;
+    for (int i = 0; i < instr->stack_effect; i++) rir_push(b, rir_slot(b->depth));
+    switch (opcode) {
+        case IJMP: case IJMPTABLE: case ICALL: case IRET: case IHALT: return false;
+        default: return true;
+    }
+}
+
+void rir_free(RirProgram *rir) {
+    free(rir->code);
+    free(rir->blocks);
+    *rir = (RirProgram){0};
+}
+
+// Translates a verified program, every instruction that starts a block gets an entry
+RirProgram rir_translate(Program *program) {
+    size_t count = program->instructions_count;
+    RirProgram rir = {0};
+    rir.blocks = malloc(count * sizeof(size_t));
+    bool *leaders = jump_targets(program);
+    for (size_t i = 0; i < count; i++) {
+        rir.blocks[i] = RIR_NONE;
+        // where ret comes back to
+        if (generic_opcode(program->instructions[i].opcode) == ICALL) leaders[i + 1] = true;
+    }
+    leaders[0] = true;
+
+    RirBuilder b = {.program = program, .rir = &rir};
+    size_t i = 0;
+    while (i < count) {
+        if (!leaders[i]) {
+            i++;
+            continue;
+        }
+        size_t enter = rir.count;
+        rir.blocks[i] = enter;
+        b.depth = b.low = b.high = 0;
+        b.ip = i;
+        rir_emit(&b, RIR_ENTER);
+        bool falls = true;
+        for (; i < count && falls; i++) {
+            if (leaders[i] && rir.blocks[i] != enter) break;
+            b.ip = i;
+            falls = rir_instruction(&b, &program->instructions[i]);
+        }
+        if (falls) {
+            rir_flush(&b);
+            rir_emit(&b, RIR_JMP)->target = i;
+        }
+        rir.code[enter].a.index = b.low;
+        rir.code[enter].b.index = b.high;
+    }
+
+    RirInstr *block = NULL;
+    for (size_t j = 0; j < rir.count; j++) {
+        RirInstr *ins = &rir.code[j];
+        if (ins->op == RIR_ENTER) block = ins;
+        if ((ins->op == RIR_JMP || ins->op == RIR_JMPIF || ins->op == RIR_CMPJMP) && ins->target < count) {
+            ins->jump = rir.blocks[ins->target];
+            RirInstr *target = &rir.code[ins->jump];
+            ins->fits = ins->depth + target->a.index >= block->a.index &&
+                        ins->depth + target->b.index <= block->b.index;
+        }
+    }
+    free(b.stack);
+    free(leaders);
+    return rir;
+}
+
+// ----------------- Interpreter -------------------------
+
+static Word rir_variable(OrtaVM *vm, const RirInstr *ins, const RirOperand *op) {
+    Variable *var = resolve_variable(vm, op->var);
+    if (var && (WORD_TYPE(var->value) != WPOINTER || WORD_LOAD(var->value).as_pointer != NULL)) {
+        return WORD_LOAD(var->value);
+    }
+    // reports the missing variable like the stack form does
+    return operand_to_word(vm, &vm->program.instructions[ins->ip], op->index);
+}
+
+static inline Word rir_read(OrtaVM *vm, const RirInstr *ins, const RirOperand *op, WordCell *base) {
+    if (op->kind == RIR_SLOT) return WORD_LOAD(base[op->index]);
+    if (op->kind == RIR_REG) return vm->xpu.registers[op->index].reg_value;
+    if (op->kind == RIR_IMM) return op->imm;
+    return rir_variable(vm, ins, op);
+}
+
+// slots own their words, registers and immediates are only borrowed
+static inline void rir_consume(const RirOperand *op, Word w) {
+    if (op->kind == RIR_SLOT) word_release(w);
+}
+
+static inline void rir_write(OrtaVM *vm, const RirOperand *op, WordCell *base, Word w) {
+    if (op->kind == RIR_SLOT) {
+        WORD_STORE(base[op->index], w);
+    } else if (op->kind == RIR_REG) {
+        XRegister *reg = &vm->xpu.registers[op->index];
+        Word old_value = reg->reg_value;
+        reg->reg_value = w;
+        word_release(old_value);
+    } else {
+        assign_variable(bind_variable(vm, op->var), w);
+    }
+}
+
+// Runs the stack instruction of ins on the real stack, true when the block goes on after it
+static bool rir_step(OrtaVM *vm, const RirInstr *ins, WordCell *base) {
+    XStack *stack = &vm->xpu.stack;
+    InstructionData *instr = &vm->program.instructions[ins->ip];
+    size_t depth = (size_t) (base - stack->stack) + ins->depth;
+    stack->count = depth;
+    vm->xpu.ip = ins->ip;
+    execute_instruction(vm, instr);
+    return !vm->program.halted && vm->xpu.ip == ins->ip + 1 &&
+           (ptrdiff_t) (stack->count - depth) == instr->stack_effect;
+}
+
+// Stack form of div and mod stepped on the real stack, operands not yet in their slots go there first
+static bool rir_step_divide(OrtaVM *vm, const RirInstr *ins, WordCell *base, Word a, Word b) {
+    if (generic_opcode(vm->program.instructions[ins->ip].opcode) != IPUSHOP) {
+        if (ins->a.kind != RIR_SLOT) WORD_STORE(base[ins->depth - 2], word_retain(a));
+        if (ins->b.kind != RIR_SLOT) WORD_STORE(base[ins->depth - 1], word_retain(b));
+    }
+    return rir_step(vm, ins, base);
+}
+
+#ifdef ORTA_COMPUTED_GOTO
+#define RIR_TARGET(op) case op: L_##op:
+#define RIR_NEXT() do { ins++; goto *dispatch_table[ins->op]; } while (0)
+#else
+#define RIR_TARGET(op) case op:
+#define RIR_NEXT() do { ins++; goto dispatch; } while (0)
+#endif
+
+// a and b are read, ints are done inline and anything else goes through binary_words
+#define RIR_ARITHMETIC(op, expr) \
+    RIR_TARGET(op) { \
+        Word a = rir_read(vm, ins, &ins->a, base), b = rir_read(vm, ins, &ins->b, base), result; \
+        if (a.type == WINT && b.type == WINT) { \
+            result.type = WINT; \
+            result.as_int = (expr); \
+        } else { \
+            binary_words(vm, &program->instructions[ins->ip], ins->cmp, a, b, &result); \
+            rir_consume(&ins->a, a); \
+            rir_consume(&ins->b, b); \
+        } \
+        rir_write(vm, &ins->dst, base, result); \
+        RIR_NEXT(); \
+    }
+
+// Runs blocks from the one at IR index at, false when a block did not fit the
+// stack and the instruction at ip has to run in the interpreter
+static bool rir_run(OrtaVM *vm, RirProgram *rir, size_t at) {
+    XPU *xpu = &vm->xpu;
+    XStack *stack = &xpu->stack;
+    Program *program = &vm->program;
+    RirInstr *ins = &rir->code[at];
+    WordCell *base;
+
+#ifdef ORTA_COMPUTED_GOTO
+    static const void *dispatch_table[] = {
+        [RIR_ENTER] = &&L_RIR_ENTER, [RIR_MOVE] = &&L_RIR_MOVE, [RIR_ADD] = &&L_RIR_ADD,
+        [RIR_SUB] = &&L_RIR_SUB, [RIR_MUL] = &&L_RIR_MUL, [RIR_COMPARE] = &&L_RIR_COMPARE,
+        [RIR_DIVIDE] = &&L_RIR_DIVIDE, [RIR_INC] = &&L_RIR_INC, [RIR_DEC] = &&L_RIR_DEC,
+        [RIR_DROP] = &&L_RIR_DROP, [RIR_DUP] = &&L_RIR_DUP, [RIR_SWAP] = &&L_RIR_SWAP,
+        [RIR_GETVAR] = &&L_RIR_GETVAR, [RIR_SETVAR] = &&L_RIR_SETVAR, [RIR_ADDVAR] = &&L_RIR_ADDVAR,
+        [RIR_JMP] = &&L_RIR_JMP, [RIR_JMPIF] = &&L_RIR_JMPIF, [RIR_CMPJMP] = &&L_RIR_CMPJMP,
+        [RIR_STEP] = &&L_RIR_STEP,
+    };
+#endif
+
+enter:
+    if ((ptrdiff_t) stack->count + ins->a.index < 0 || stack->count + ins->b.index > stack->capacity) return false;
+    base = stack->stack + stack->count;
+    RIR_NEXT();
+
+#ifndef ORTA_COMPUTED_GOTO
+dispatch:
+#endif
+    switch (ins->op) {
+        RIR_TARGET(RIR_ENTER)
+            // a step fell through into the next block, the real stack is exact
+            goto enter;
+
+        RIR_TARGET(RIR_MOVE) {
+            Word w = rir_read(vm, ins, &ins->a, base);
+            rir_write(vm, &ins->dst, base, ins->a.kind == RIR_SLOT ? w : word_retain(w));
+            RIR_NEXT();
+        }
+
+        RIR_ARITHMETIC(RIR_ADD, a.as_int + b.as_int)
+        RIR_ARITHMETIC(RIR_SUB, b.as_int - a.as_int)
+        RIR_ARITHMETIC(RIR_MUL, a.as_int * b.as_int)
+        RIR_ARITHMETIC(RIR_COMPARE, compare_ints(ins->cmp, a.as_int, b.as_int))
+
+        RIR_TARGET(RIR_DIVIDE) {
+            Word a = rir_read(vm, ins, &ins->a, base), b = rir_read(vm, ins, &ins->b, base), result = a;
+            if (a.type == WINT && b.type == WINT && b.as_int != 0) {
+                result.as_int = ins->cmp == IDIV ? a.as_int / b.as_int : a.as_int % b.as_int;
+            } else if (ins->cmp == IDIV && a.type == WFLOAT && b.type == WFLOAT && b.as_float != 0.0f) {
+                result.as_float = a.as_float / b.as_float;
+            } else {
+                if (!rir_step_divide(vm, ins, base, a, b)) goto leave;
+                RIR_NEXT();
+            }
+            WORD_STORE(base[ins->dst.index], result);
+            RIR_NEXT();
+        }
+
+        RIR_TARGET(RIR_INC) {
+            Word *value = &xpu->registers[ins->dst.index].reg_value;
+            if (value->type == WINT) value->as_int++;
+            RIR_NEXT();
+        }
+
+        RIR_TARGET(RIR_DEC) {
+            Word *value = &xpu->registers[ins->dst.index].reg_value;
+            if (value->type == WINT) value->as_int--;
+            RIR_NEXT();
+        }
+
+        RIR_TARGET(RIR_DROP)
+            word_release(WORD_LOAD(base[ins->a.index]));
+            RIR_NEXT();
+
+        RIR_TARGET(RIR_DUP) {
+            Word w = WORD_LOAD(base[ins->depth - 1]);
+            // the checked handler pushes nothing for chars and bools
+            if (w.type != WINT && w.type != WFLOAT && w.type != WCHARP && w.type != WPOINTER) {
+                if (!rir_step(vm, ins, base)) goto leave;
+                RIR_NEXT();
+            }
+            WORD_STORE(base[ins->depth], word_retain(w));
+            RIR_NEXT();
+        }
+
+        RIR_TARGET(RIR_SWAP) {
+            WordCell top = base[ins->depth - 1];
+            base[ins->depth - 1] = base[ins->depth - 2];
+            base[ins->depth - 2] = top;
+            RIR_NEXT();
+        }
+
+        RIR_TARGET(RIR_GETVAR) {
+            Variable *var = resolve_variable(vm, &program->instructions[ins->ip].args[0]);
+            Word w = var ? variable_value(var) : (Word){.type = WPOINTER, .as_pointer = NULL};
+            if (w.type == WPOINTER && w.as_pointer == NULL) {
+                if (!rir_step(vm, ins, base)) goto leave;
+                RIR_NEXT();
+            }
+            WORD_STORE(base[ins->depth], w);
+            RIR_NEXT();
+        }
+
+        RIR_TARGET(RIR_SETVAR) {
+            Word w = rir_read(vm, ins, &ins->a, base);
+            assign_variable(bind_variable(vm, &program->instructions[ins->ip].args[0]), w);
+            rir_consume(&ins->a, w);
+            RIR_NEXT();
+        }
+
+        RIR_TARGET(RIR_ADDVAR) {
+            Operand *args = program->instructions[ins->ip].args;
+            Variable *var = resolve_variable(vm, &args[0]);
+            if (var == NULL || WORD_TYPE(var->value) != WINT) {
+                if (!rir_step(vm, ins, base)) goto leave;
+                RIR_NEXT();
+            }
+            Word value = WORD_LOAD(var->value);
+            value.as_int += args[1].as_int;
+            WORD_STORE(var->value, value);
+            RIR_NEXT();
+        }
+
+        RIR_TARGET(RIR_JMP)
+            goto jump;
+
+        RIR_TARGET(RIR_JMPIF) {
+            Word w = rir_read(vm, ins, &ins->a, base);
+            rir_consume(&ins->a, w);
+            if (w.type == WINT && w.as_int == 1) goto jump;
+            RIR_NEXT();
+        }
+
+        RIR_TARGET(RIR_CMPJMP) {
+            Word a = rir_read(vm, ins, &ins->a, base), b = rir_read(vm, ins, &ins->b, base), result;
+            if (a.type == WINT && b.type == WINT) {
+                if (compare_ints(ins->cmp, a.as_int, b.as_int)) goto jump;
+                RIR_NEXT();
+            }
+            binary_words(vm, &program->instructions[ins->ip], ins->cmp, a, b, &result);
+            rir_consume(&ins->a, a);
+            rir_consume(&ins->b, b);
+            if (result.as_int == 1) goto jump;
+            RIR_NEXT();
+        }
+
+        RIR_TARGET(RIR_STEP)
+            if (!rir_step(vm, ins, base)) goto leave;
+            RIR_NEXT();
+    }
+
+jump:
+    if (ins->fits) {
+        // the entry check of the target could not fail, ip and the stack count wait for leaving
+        base += ins->depth;
+        ins = &rir->code[ins->jump];
+        RIR_NEXT();
+    }
+    stack->count = (size_t) (base - stack->stack) + ins->depth;
+    xpu->ip = ins->target;
+    if (ins->jump == RIR_NONE) return true;
+    ins = &rir->code[ins->jump];
+    goto enter;
+
+leave:
+    // the real stack is exact, go on at whatever block the step left ip at
+    if (program->halted || xpu->ip >= program->instructions_count) return true;
+    at = rir->blocks[xpu->ip];
+    if (at == RIR_NONE) return true;
+    ins = &rir->code[at];
+    goto enter;
+}
+
+#undef RIR_ARITHMETIC
+#undef RIR_NEXT
+#undef RIR_TARGET
+
+// Runs the program like execute_program through the register IR of its verified code
+void rir_execute_program(OrtaVM *vm) {
+    Program *program = &vm->program;
+    if (!program->verified) {
+        execute_program(vm);
+        return;
+    }
+    if (!enter_program(vm)) return;
+    XPU *xpu = &vm->xpu;
+    RirProgram rir = rir_translate(program);
+    while (!program->halted && xpu->ip < program->instructions_count) {
+        size_t at = rir.blocks[xpu->ip];
+        if (at != RIR_NONE && rir_run(vm, &rir, at)) continue;
+        execute_instruction(vm, &program->instructions[xpu->ip]);
+    }
+    rir_free(&rir);
+}
+
+#endif // RIR_H
@@ -90,10 +90,16 @@ void delete_breakpoint(int index) {
 
 void cmd_break(int argc, char **argv) {
     if (argc < 2) {
-        printf("Usage: %sbreak <address>%s\n", COLOR_YELLOW, COLOR_RESET);
+        printf("Usage: %sbreak <address|label>%s\n", COLOR_YELLOW, COLOR_RESET);
+        return;
+    }
+    size_t addr;
+    if (isdigit((unsigned char) argv[1][0])) {
+        addr = strtoul(argv[1], NULL, 0);
+    } else if (!find_label(&vm.program, argv[1], &addr)) {
+        printf("%sError:%s Unknown label '%s'\n", COLOR_RED, COLOR_RESET, argv[1]);
         return;
     }
-    size_t addr = strtoul(argv[1], NULL, 0);
     add_breakpoint(addr);
 }
 
@@ -197,7 +203,7 @@ void cmd_stack(int argc, char **argv) {
                vm.xpu.stack.count - 1 - i,
                COLOR_RESET);
         printf("[%d] ", i);
-        print_word(vm.xpu.stack.stack[vm.xpu.stack.count - 1 - i]);
+        print_word(xstack_peek(&vm.xpu.stack, i));
         printf("\n");
     }
     printf("\n");
@@ -265,7 +271,7 @@ void cmd_help() {
     printf("%sAvailable commands:%s\n", COLOR_BOLD, COLOR_RESET);
     printf("Command        | Description\n");
     printf("----------------------------------------------------\n");
-    printf("%sbreak <addr>%s   | Set breakpoint at specified address\n", COLOR_YELLOW, COLOR_RESET);
+    printf("%sbreak <addr>%s   | Set breakpoint at specified address or label\n", COLOR_YELLOW, COLOR_RESET);
     printf("%slist%s           | List all breakpoints\n", COLOR_YELLOW, COLOR_RESET);
     printf("%sdelete <idx>%s   | Delete breakpoint by index\n", COLOR_YELLOW, COLOR_RESET);
     printf("%sstep%s           | Execute next instruction\n", COLOR_YELLOW, COLOR_RESET);
@@ -0,0 +1,131 @@
+#include "orta.h"
+#include "opt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <stdbool.h>
+
+#define VERSION "1.0.0"
+#define PROGRAM_NAME "xopt"
+
+typedef struct {
+    bool verbose;
+    XbinEncoding encoding;
+    char *profile_file;
+    char *input_file;
+    char *output_file;
+} ProgramOptions;
+
+void print_usage(FILE *stream) {
+    fprintf(stream, "Usage: %s [OPTIONS] <input.xbin> <output.xbin>\n\n", PROGRAM_NAME);
+    fprintf(stream, "Options:\n");
+    fprintf(stream, "  -v, --verbose      Print pass statistics\n");
+    fprintf(stream, "  -p, --profile FILE Lay out and inline by a profile from orta --profile-out\n");
+    fprintf(stream, "  -c, --compact      Write varints instead of fixed records\n");
+    fprintf(stream, "  -z, --compress     Compress the sections of the output\n");
+    fprintf(stream, "  -h, --help         Display this help message\n");
+    fprintf(stream, "  -V, --version      Display version information\n");
+}
+
+ProgramOptions parse_args(int argc, char *argv[]) {
+    ProgramOptions options = {false, XBIN_FIXED, NULL, NULL, NULL};
+    int opt;
+
+    static struct option long_options[] = {
+        {"verbose", no_argument, 0, 'v'},
+        {"profile", required_argument, 0, 'p'},
+        {"compact", no_argument, 0, 'c'},
+        {"compress", no_argument, 0, 'z'},
+        {"help", no_argument, 0, 'h'},
+        {"version", no_argument, 0, 'V'},
+        {0, 0, 0, 0}
+    };
+
+    while ((opt = getopt_long(argc, argv, "vp:czhV", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'v':
+                options.verbose = true;
+                break;
+            case 'p':
+                options.profile_file = optarg;
+                break;
+            case 'c':
+                options.encoding |= XBIN_COMPACT;
+                break;
+            case 'z':
+                options.encoding |= XBIN_COMPRESSED;
+                break;
+            case 'h':
+                print_usage(stdout);
+                exit(EXIT_SUCCESS);
+            case 'V':
+                printf("%s version %s\n", PROGRAM_NAME, VERSION);
+                exit(EXIT_SUCCESS);
+            default:
+                print_usage(stderr);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (optind + 2 > argc) {
+        fprintf(stderr, "Error: Input and output files are required\n");
+        print_usage(stderr);
+        exit(EXIT_FAILURE);
+    }
+
+    options.input_file = argv[optind];
+    options.output_file = argv[optind + 1];
+    return options;
+}
+
+int main(int argc, char *argv[]) {
+    ProgramOptions options = parse_args(argc, argv);
+
+    OrtaVM vm = ortavm_create(options.input_file);
+    if (!load_xbin(&vm, options.input_file)) {
+        fprintf(stderr, "Error: Failed to load xbin file '%s'\n", options.input_file);
+        exit(EXIT_FAILURE);
+    }
+
+    Profile profile = {0};
+    if (options.profile_file && !profile_read(&profile, &vm.program, options.profile_file)) {
+        ortavm_free(&vm);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t before = vm.program.instructions_count;
+    OptStats stats = {0};
+    bool ok = optimize_program(&vm.program, options.profile_file ? &profile : NULL, &stats);
+    profile_free(&profile);
+    if (!ok) {
+        fprintf(stderr, "Error: Optimizing '%s' produced malformed bytecode, nothing written\n", options.input_file);
+        ortavm_free(&vm);
+        exit(EXIT_FAILURE);
+    }
+
+    if (!create_xbin_encoded(&vm, options.output_file, options.encoding)) {
+        fprintf(stderr, "Error: Failed to write xbin file '%s'\n", options.output_file);
+        ortavm_free(&vm);
+        exit(EXIT_FAILURE);
+    }
+
+    if (options.verbose) {
+        printf("%s: %zu rounds\n", options.input_file, stats.rounds);
+        if (options.profile_file) printf("  profile layout       %zu\n", stats.laid_out);
+        printf("  inlined calls        %zu\n", stats.inlined);
+        printf("  constant folding     %zu\n", stats.folded);
+        printf("  copy propagation     %zu\n", stats.propagated);
+        printf("  dead stores          %zu\n", stats.dead_stores);
+        printf("  dead code            %zu\n", stats.dead_code);
+        printf("  jump threading       %zu\n", stats.threaded);
+        printf("  unreachable labels   %zu\n", stats.labels);
+        printf("  loop invariants      %zu\n", stats.hoisted);
+        printf("  strength reduction   %zu\n", stats.reduced);
+        printf("  unrolled loops       %zu\n", stats.unrolled);
+        printf("  instructions         %zu -> %zu\n", before, vm.program.instructions_count);
+    }
+
+    ortavm_free(&vm);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,469 @@
+#ifndef XPU_H
+#define XPU_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// ----------------- XPU -------------------------
+// Words, strings, registers, the data stack, local frames and the call stack: the
+// state a program runs on, without the loader or the interpreter. orta.h builds on
+// it, and the C that xtoa --aot generates links against it through aot.h alone.
+
+#define ODEFAULT_STACK_SIZE 16384
+#define OLOG_PREFIX "[OVM] "
+
+#define OERROR(stream, fmt, ...) fprintf(stream, OLOG_PREFIX fmt, ##__VA_ARGS__)
+
+#define SYMBOL_NONE ((size_t) -1)
+
+static size_t OSTACK_SIZE = ODEFAULT_STACK_SIZE;
+
+typedef enum {
+    WINT,
+    WFLOAT,
+    WCHARP,
+    W_CHAR,
+    WPOINTER,
+    WBOOL,
+} WordType;
+
+typedef struct {
+    WordType type;
+    union {
+        int as_int;
+        float as_float;
+        char as_char;
+        char *as_string;
+        void *as_pointer;
+        int as_bool;
+    };
+} Word;
+
+// ----------------- Word Storage -------------------------
+// Word is the unpacked value every handler works on. Storage that holds many
+// words (the data stack and variables) uses WordCell and goes through
+// WORD_LOAD/WORD_STORE/WORD_TYPE, so the cell layout is chosen at build time.
+//
+// With ORTA_COMPACT_WORD a cell is a single uint64_t: the type tag lives in
+// the high 16 bits and the payload in the low 48. Ints, bools and floats keep
+// their 32 bit pattern, chars their 8 bits and pointers their low 48 bits,
+// sign-extended on load like x86-64/AArch64 canonical addresses.
+#ifdef ORTA_COMPACT_WORD
+typedef uint64_t WordCell;
+
+#define WORD_TAG_SHIFT 48
+#define WORD_PAYLOAD_MASK ((UINT64_C(1) << WORD_TAG_SHIFT) - 1)
+
+static inline WordCell word_pack(Word w) {
+    uint64_t payload;
+    switch (w.type) {
+        case WINT:
+        case WBOOL: payload = (uint32_t) w.as_int; break;
+        case WFLOAT: {
+            uint32_t bits;
+            memcpy(&bits, &w.as_float, sizeof(bits));
+            payload = bits;
+            break;
+        }
+        case W_CHAR: payload = (unsigned char) w.as_char; break;
+        default: payload = (uint64_t) (uintptr_t) w.as_pointer & WORD_PAYLOAD_MASK; break;
+    }
+    return ((uint64_t) (uint16_t) w.type << WORD_TAG_SHIFT) | payload;
+}
+
+static inline Word word_unpack(WordCell cell) {
+    Word w = {.type = (WordType) (int16_t) (cell >> WORD_TAG_SHIFT), .as_pointer = NULL};
+    uint64_t payload = cell & WORD_PAYLOAD_MASK;
+    switch (w.type) {
+        case WINT:
+        case WBOOL: w.as_int = (int) (uint32_t) payload; break;
+        case WFLOAT: {
+            uint32_t bits = (uint32_t) payload;
+            memcpy(&w.as_float, &bits, sizeof(bits));
+            break;
+        }
+        case W_CHAR: w.as_char = (char) payload; break;
+        default: w.as_pointer = (void *) (uintptr_t) ((int64_t) (payload << 16) >> 16); break;
+    }
+    return w;
+}
+
+#define WORD_LOAD(cell) word_unpack(cell)
+#define WORD_STORE(cell, w) ((cell) = word_pack(w))
+#define WORD_TYPE(cell) ((WordType) (int16_t) ((cell) >> WORD_TAG_SHIFT))
+#else
+typedef Word WordCell;
+
+#define WORD_LOAD(cell) (cell)
+#define WORD_STORE(cell, w) ((cell) = (w))
+#define WORD_TYPE(cell) ((cell).type)
+#endif
+
+// ----------------- Strings -------------------------
+// A WCHARP word points at the data of an immutable, reference counted XString,
+// so it can still be handed to anything that expects a char *. Every stack cell,
+// register, variable and constant pool entry holding a string owns one reference.
+// Strings that were not made by xstring_* (raw memory, native libraries) carry no
+// header: retaining one copies it into an XString, releasing one does nothing.
+#define XSTRING_MAGIC 0x4f535452u
+
+typedef struct {
+    uint32_t magic;
+    uint32_t refcount;
+    char data[];
+} XString;
+
+static inline XString *xstring_header(const char *s) {
+    if (s == NULL) return NULL;
+    XString *str = (XString *) (s - offsetof(XString, data));
+    return str->magic == XSTRING_MAGIC ? str : NULL;
+}
+
+// a string of length bytes with one reference, the caller fills in the data
+char *xstring_alloc(size_t length) {
+    XString *str = malloc(sizeof(XString) + length + 1);
+    if (str == NULL) return NULL;
+    str->magic = XSTRING_MAGIC;
+    str->refcount = 1;
+    str->data[length] = '\0';
+    return str->data;
+}
+
+char *xstring_new(const char *s, size_t length) {
+    char *data = xstring_alloc(length);
+    if (data != NULL) memcpy(data, s, length);
+    return data;
+}
+
+char *xstring_from(const char *s) {
+    return xstring_new(s, strlen(s));
+}
+
+// takes over a malloc'd C string
+char *xstring_adopt(char *s) {
+    char *data = xstring_from(s);
+    free(s);
+    return data;
+}
+
+char *xstring_retain(char *s) {
+    if (s == NULL) return NULL;
+    XString *str = xstring_header(s);
+    if (str == NULL) return xstring_from(s);
+    str->refcount++;
+    return s;
+}
+
+void xstring_release(char *s) {
+    XString *str = xstring_header(s);
+    if (str == NULL || --str->refcount > 0) return;
+    str->magic = 0;
+    free(str);
+}
+
+static inline Word word_retain(Word w) {
+    if (w.type == WCHARP) w.as_string = xstring_retain(w.as_string);
+    return w;
+}
+
+static inline void word_release(Word w) {
+    if (w.type == WCHARP) xstring_release(w.as_string);
+}
+
+typedef struct {
+    Word reg_value;
+    size_t reg_size;
+} XRegister;
+
+typedef enum {
+    REG_RAX,
+    REG_RBX,
+    REG_RCX,
+    REG_RDX,
+    REG_RSI,
+    REG_RDI,
+    REG_R8,
+    REG_R9,
+    REG_R10,
+    REG_R11,
+    REG_R12,
+    REG_R13,
+    REG_R14,
+    REG_R15,
+    REG_FR,
+    REG_COUNT,
+} XRegisters;
+
+typedef enum {
+    REGSIZE_8BIT = 1,
+    REGSIZE_16BIT,
+    REGSIZE_32BIT = 4,
+    REGSIZE_64BIT = 8,
+} XRegisterSize;
+
+typedef struct {
+    char *name;
+    XRegisters id;
+    XRegisterSize size;
+} XRegisterInfo;
+
+XRegisterInfo register_table[REG_COUNT] = {
+    {"RAX", REG_RAX, REGSIZE_64BIT}, {"RBX", REG_RBX, REGSIZE_64BIT},
+    {"RCX", REG_RCX, REGSIZE_64BIT}, {"RDX", REG_RDX, REGSIZE_64BIT},
+    {"RSI", REG_RSI, REGSIZE_64BIT}, {"RDI", REG_RDI, REGSIZE_64BIT},
+    {"R8", REG_R8, REGSIZE_64BIT}, {"R9", REG_R9, REGSIZE_64BIT},
+    {"R10", REG_R10, REGSIZE_64BIT}, {"R11", REG_R11, REGSIZE_64BIT},
+    {"R12", REG_R12, REGSIZE_64BIT}, {"R13", REG_R13, REGSIZE_64BIT},
+    {"R14", REG_R14, REGSIZE_64BIT}, {"R15", REG_R15, REGSIZE_64BIT},
+    {"FR", REG_FR, REGSIZE_64BIT},
+};
+
+int is_register(const char *str) {
+    for (int i = 0; i < REG_COUNT; i++) {
+        if (strcasecmp(str, register_table[i].name) == 0) return 1;
+    }
+    return 0;
+}
+
+XRegisters register_name_to_enum(const char *reg_name) {
+    for (int i = 0; i < REG_COUNT; i++) {
+        if (strcasecmp(reg_name, register_table[i].name) == 0)
+            return register_table[i].id;
+    }
+    return (XRegisters) -1;
+}
+
+typedef struct {
+    WordCell *stack;
+    size_t count;
+    size_t capacity;
+} XStack;
+
+XStack xstack_create(size_t capacity) {
+    XStack x = {0};
+    x.stack = malloc(sizeof(WordCell) * capacity);
+    x.capacity = capacity;
+    x.count = 0;
+    return x;
+}
+
+int xstack_push(XStack *stack, Word w) {
+    if (stack->count >= stack->capacity) return 0;
+    WORD_STORE(stack->stack[stack->count++], w);
+    return 1;
+}
+
+Word xstack_pop(XStack *stack) {
+    if (stack->count == 0) {
+        Word w = {.type = WPOINTER, .as_pointer = NULL};
+        return w;
+    }
+    return WORD_LOAD(stack->stack[--stack->count]);
+}
+
+// only for code verify_program accepted, the verifier proved the stack has room
+static inline void xstack_push_unchecked(XStack *stack, Word w) {
+    WORD_STORE(stack->stack[stack->count++], w);
+}
+
+static inline Word xstack_pop_unchecked(XStack *stack) {
+    return WORD_LOAD(stack->stack[--stack->count]);
+}
+
+Word xstack_peek(XStack *stack, size_t offset) {
+    if (offset >= stack->count) {
+        Word w = {.type = WPOINTER, .as_pointer = NULL};
+        return w;
+    }
+    return WORD_LOAD(stack->stack[stack->count - 1 - offset]);
+}
+
+int xstack_check(XStack *stack, size_t expected) {
+    if (stack->count >= expected) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+void xstack_free(XStack *stack) {
+    for (size_t i = 0; i < stack->count; i++) {
+        Word w = WORD_LOAD(stack->stack[i]);
+        if (w.type == WCHARP) xstring_release(w.as_string);
+        else if (w.type == WPOINTER) free(w.as_pointer);
+    }
+    free(stack->stack);
+}
+
+typedef struct {
+    size_t slot; // index into Program.variable_names, SYMBOL_NONE for an unused entry
+    WordCell value;
+} Variable;
+
+typedef struct {
+    size_t base;  // first cell of the frame in XPU.locals
+    size_t depth; // calls_count when togglelocalscope opened it
+} Frame;
+
+// one per active call, the call frames of a run are contiguous and grow on demand.
+// Locals are not part of it, they stay in the Frame stack togglelocalscope manages.
+typedef struct {
+    size_t ret; // index of the call instruction
+} CallFrame;
+
+#define OCALL_DEPTH_INITIAL 256
+#define OCALL_DEPTH_MAX ((size_t) 1 << 22)
+
+typedef struct {
+    XRegister *registers;
+    XStack stack;
+    size_t ip;
+    CallFrame *calls;
+    size_t calls_count;
+    size_t calls_capacity;
+    // local scopes opened by togglelocalscope, the cells of all frames share one array
+    Frame *frames;
+    size_t frames_count;
+    size_t frames_capacity;
+    Variable *locals;
+    size_t locals_count;
+    size_t locals_capacity;
+} XPU;
+
+XPU xpu_init() {
+    XPU xpu = {0};
+    xpu.stack = xstack_create(OSTACK_SIZE);
+    xpu.registers = malloc(sizeof(XRegister) * REG_COUNT);
+    xpu.ip = 0;
+
+    for (int i = 0; i < REG_COUNT; i++) {
+        xpu.registers[i].reg_size = register_table[i].size;
+        xpu.registers[i].reg_value.type = WPOINTER;
+        xpu.registers[i].reg_value.as_pointer = NULL;
+    }
+    return xpu;
+}
+
+void xpu_free(XPU *xpu) {
+    for (int i = 0; i < REG_COUNT; i++) {
+        if (xpu->registers[i].reg_value.type == WCHARP)
+            xstring_release(xpu->registers[i].reg_value.as_string);
+        else if (xpu->registers[i].reg_value.type == WPOINTER)
+            free(xpu->registers[i].reg_value.as_pointer);
+    }
+    xstack_free(&xpu->stack);
+    free(xpu->calls);
+    for (size_t i = 0; i < xpu->locals_count; i++) {
+        word_release(WORD_LOAD(xpu->locals[i].value));
+    }
+    free(xpu->locals);
+    free(xpu->frames);
+    free(xpu->registers);
+}
+
+const char *word_type_to_string(WordType wt) {
+    switch (wt) {
+        case WINT: return "INT";
+        case W_CHAR: return "CHAR";
+        case WPOINTER: return "POINTER";
+        case WCHARP: return "CHARP";
+        case WFLOAT: return "FLOAT";
+        case WBOOL: return "BOOL";
+    }
+    return "ERROR";
+}
+
+// ----------------- Frames -------------------------
+// togglelocalscope opens a frame on function entry and closes it again when it runs
+// at the same call depth, so nested and recursive calls each get their own locals.
+
+void frame_push(XPU *xpu) {
+    if (xpu->frames_count >= xpu->frames_capacity) {
+        xpu->frames_capacity = xpu->frames_capacity ? xpu->frames_capacity * 2 : 16;
+        xpu->frames = realloc(xpu->frames, sizeof(Frame) * xpu->frames_capacity);
+    }
+    xpu->frames[xpu->frames_count].base = xpu->locals_count;
+    xpu->frames[xpu->frames_count].depth = xpu->calls_count;
+    xpu->frames_count++;
+}
+
+void frame_pop(XPU *xpu) {
+    size_t base = xpu->frames[--xpu->frames_count].base;
+    for (size_t i = base; i < xpu->locals_count; i++) {
+        word_release(WORD_LOAD(xpu->locals[i].value));
+    }
+    xpu->locals_count = base;
+}
+
+void frame_toggle(XPU *xpu) {
+    if (xpu->frames_count > 0 && xpu->frames[xpu->frames_count - 1].depth == xpu->calls_count) {
+        frame_pop(xpu);
+    } else {
+        frame_push(xpu);
+    }
+}
+
+// ----------------- Calls -------------------------
+// call records the call instruction in a CallFrame and ret resumes after it. The
+// array doubles as it fills, so recursion is only bounded by OCALL_DEPTH_MAX.
+
+static inline bool call_push(XPU *xpu, size_t ret) {
+    if (xpu->calls_count >= xpu->calls_capacity) {
+        size_t capacity = xpu->calls_capacity ? xpu->calls_capacity * 2 : OCALL_DEPTH_INITIAL;
+        if (capacity > OCALL_DEPTH_MAX) return false;
+        CallFrame *calls = realloc(xpu->calls, sizeof(CallFrame) * capacity);
+        if (!calls) return false;
+        xpu->calls = calls;
+        xpu->calls_capacity = capacity;
+    }
+    xpu->calls[xpu->calls_count++] = (CallFrame){ret};
+    return true;
+}
+
+// a ret without a call goes back to the start, like a pop of an empty stack always did
+static inline size_t call_pop(XPU *xpu) {
+    return xpu->calls_count ? xpu->calls[--xpu->calls_count].ret : 0;
+}
+
+// variable slot in the innermost frame, local is the cell the function's layout gave it
+static Variable *frame_lookup(XPU *xpu, size_t slot, size_t local) {
+    Variable *cells = xpu->locals + xpu->frames[xpu->frames_count - 1].base;
+    size_t size = xpu->locals + xpu->locals_count - cells;
+    if (local < size && cells[local].slot == slot) return &cells[local];
+    // the frame was opened by code with a different layout, fall back to a scan
+    for (size_t i = 0; i < size; i++) {
+        if (cells[i].slot == slot) return &cells[i];
+    }
+    return NULL;
+}
+
+static Variable *frame_cell(XPU *xpu, size_t index) {
+    if (index >= xpu->locals_capacity) {
+        while (index >= xpu->locals_capacity) {
+            xpu->locals_capacity = xpu->locals_capacity ? xpu->locals_capacity * 2 : 64;
+        }
+        xpu->locals = realloc(xpu->locals, sizeof(Variable) * xpu->locals_capacity);
+    }
+    while (xpu->locals_count <= index) {
+        xpu->locals[xpu->locals_count].slot = SYMBOL_NONE;
+        WORD_STORE(xpu->locals[xpu->locals_count].value, ((Word){.type = WPOINTER, .as_pointer = NULL}));
+        xpu->locals_count++;
+    }
+    return &xpu->locals[index];
+}
+
+static Variable *frame_bind(XPU *xpu, size_t slot, size_t local) {
+    Variable *var = frame_lookup(xpu, slot, local);
+    if (var) return var;
+    size_t base = xpu->frames[xpu->frames_count - 1].base;
+    var = frame_cell(xpu, base + local);
+    if (var->slot != SYMBOL_NONE) var = frame_cell(xpu, xpu->locals_count);
+    var->slot = slot;
+    return var;
+}
+
+#endif // XPU_H
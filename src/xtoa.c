@@ -2,45 +2,759 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <math.h>
+#include "orta.h"
 #include "libs/xhex.h"
 
+// ----------------- AOT -------------------------
+// xtoa --aot translates every instruction into straight-line C that links against
+// aot.h, a runtime of its own on top of xpu.h. Nothing is loaded at startup: the
+// string pool becomes C literals, labels C labels and operands immediates. A
+// program with an instruction that has no C form is embedded like without --aot.
+
+static void emit_c_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fprintf(out, "\\%c", *s);
+        else if (isprint((unsigned char) *s)) fputc(*s, out);
+        else fprintf(out, "\\%03o", (unsigned char) *s);
+    }
+    fputc('"', out);
+}
+
+static void emit_comment(FILE *out, InstructionData *instr, size_t ip) {
+    fprintf(out, "    // %zu: %s", ip, instruction_to_string(instr->opcode));
+    for (size_t i = 0; i < instr->operands.size; i++) {
+        fputc(' ', out);
+        // a trailing backslash would continue the comment onto the next line
+        for (const char *c = operand_text(instr, i); *c; c++) {
+            fputc(isprint((unsigned char) *c) && *c != '\\' ? *c : '?', out);
+        }
+    }
+    fputc('\n', out);
+}
+
+// instructions control can arrive at other than from the one before
+static bool *aot_targets(Program *program, size_t entry) {
+    size_t count = program->instructions_count;
+    bool *targets = calloc(count + 1, sizeof(bool));
+    targets[entry] = true;
+    for (size_t i = 0; i < program->labels_count; i++) {
+        if (program->labels[i].address < count) targets[program->labels[i].address] = true;
+    }
+    for (size_t i = 0; i < count; i++) {
+        InstructionData *instr = &program->instructions[i];
+        for (size_t j = 0; j < instr->argc; j++) {
+            if (instr->args[j].kind == OPERAND_LABEL && instr->args[j].as_index < count)
+                targets[instr->args[j].as_index] = true;
+        }
+        // ret comes back after the call, a ret without one goes to 1
+        if (generic_opcode(instr->opcode) == ICALL) targets[i + 1] = true;
+        if (generic_opcode(instr->opcode) == IRET && count > 1) targets[1] = true;
+    }
+    return targets;
+}
+
+static bool aot_label(Program *program, const Operand *op, size_t *target) {
+    if (op->kind != OPERAND_LABEL || op->as_index >= program->instructions_count) return false;
+    *target = op->as_index;
+    return true;
+}
+
+static const char *aot_op(Instruction op) {
+    switch (op) {
+        case IADD: return "AOT_ADD";
+        case ISUB: return "AOT_SUB";
+        case IMUL: return "AOT_MUL";
+        case IDIV: return "AOT_DIV";
+        case IMOD: return "AOT_MOD";
+        case IEQ: return "AOT_EQ";
+        case INE: return "AOT_NE";
+        case ILT: return "AOT_LT";
+        case IGT: return "AOT_GT";
+        case ILE: return "AOT_LE";
+        case IGE: return "AOT_GE";
+        default: return NULL;
+    }
+}
+
+// C for the int stack form of op, a is the deeper and b the topmost operand
+static bool aot_binary(Instruction op, const char **expr, const char **guard) {
+    *guard = "1";
+    switch (op) {
+        case IADD: *expr = "a + b"; return true;
+        case ISUB: *expr = "b - a"; return true;
+        case IMUL: *expr = "a * b"; return true;
+        // a zero divisor, and INT_MIN which binary_words also takes for float zero, go generic
+        case IDIV: *expr = "a / b"; *guard = "b != 0 && b != -1 && b != INT_MIN"; return true;
+        case IMOD: *expr = "a % b"; *guard = "b != 0 && b != -1"; return true;
+        case IEQ: *expr = "a == b"; return true;
+        case INE: *expr = "a != b"; return true;
+        case ILT: *expr = "a < b"; return true;
+        case IGT: *expr = "a > b"; return true;
+        case ILE: *expr = "a <= b"; return true;
+        case IGE: *expr = "a >= b"; return true;
+        default: return false;
+    }
+}
+
+typedef struct {
+    char expr[64];
+    char guard[256];
+} AotInts;
+
+static void aot_guard(AotInts *ints, const char *fmt, ...) {
+    size_t used = strlen(ints->guard);
+    if (used) used += snprintf(ints->guard + used, sizeof(ints->guard) - used, " && ");
+    va_list vl;
+    va_start(vl, fmt);
+    vsnprintf(ints->guard + used, sizeof(ints->guard) - used, fmt, vl);
+    va_end(vl);
+}
+
+// the int behind an operand, false for an operand the fast path can not read
+static bool aot_int_operand(AotInts *ints, const Operand *op, char *expr, size_t expr_size) {
+    switch (op->kind) {
+        case OPERAND_INT:
+            snprintf(expr, expr_size, "%d", op->as_int);
+            return true;
+        case OPERAND_REGISTER:
+            aot_guard(ints, "regs[%d].reg_value.type == WINT", op->as_register);
+            snprintf(expr, expr_size, "regs[%d].reg_value.as_int", op->as_register);
+            return true;
+        default:
+            return false;
+    }
+}
+
+// the int in the cell depth below the top of the stack
+static void aot_int_cell(AotInts *ints, size_t depth, char *expr, size_t expr_size) {
+    aot_guard(ints, "WORD_TYPE(stack->stack[stack->count - %zu]) == WINT", depth);
+    snprintf(expr, expr_size, "WORD_LOAD(stack->stack[stack->count - %zu]).as_int", depth);
+}
+
+static void emit_float(FILE *out, float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    fprintf(out, "aot_float(0x%08" PRIx32 "u)", bits);
+}
+
+// the word operand_to_word makes of operand index, false for one that has no C form
+static bool emit_word(FILE *out, InstructionData *instr, size_t index) {
+    Operand *op = &instr->args[index];
+    switch (op->kind) {
+        case OPERAND_INT:
+            fprintf(out, "(Word){.type = WINT, .as_int = %d}", op->as_int);
+            return true;
+        case OPERAND_FLOAT:
+            emit_float(out, op->as_float);
+            return true;
+        case OPERAND_REGISTER:
+            fprintf(out, "word_retain(regs[%d].reg_value)", op->as_register);
+            return true;
+        case OPERAND_STRING:
+            fprintf(out, "aot_string(%zu)", op->as_index);
+            return true;
+        case OPERAND_LABEL:
+            fprintf(out, "(Word){.type = WINT, .as_int = %d}", (int) op->as_index);
+            return true;
+        case OPERAND_VARIABLE:
+            fprintf(out, "aot_variable(%zu, %zu, %u, ", instr->line, op->as_index, op->local);
+            emit_c_string(out, operand_text(instr, index));
+            fputc(')', out);
+            return true;
+        case OPERAND_POINTER:
+            return false;
+        default:
+            fprintf(out, "aot_invalid_operand(%zu, ", instr->line);
+            emit_c_string(out, operand_text(instr, index));
+            fputc(')', out);
+            return true;
+    }
+}
+
+static bool emit_pushed_word(FILE *out, InstructionData *instr, size_t index) {
+    fprintf(out, "    xstack_push(stack, ");
+    if (!emit_word(out, instr, index)) return false;
+    fprintf(out, ");\n");
+    return true;
+}
+
+static void emit_error(FILE *out, InstructionData *instr, const char *msg) {
+    fprintf(out, "    aot_error(%zu, ", instr->line);
+    emit_c_string(out, msg);
+    fprintf(out, ");\n");
+}
+
+static size_t aot_type_size(WordType type) {
+    switch (type) {
+        case WINT: return sizeof(int);
+        case WFLOAT: return sizeof(float);
+        case WCHARP: return sizeof(char *);
+        case W_CHAR: return sizeof(char);
+        case WPOINTER: return sizeof(void *);
+        default: return 0;
+    }
+}
+
+// alloc with operands: the size expression and the register the memory goes to
+static bool emit_alloc(FILE *out, InstructionData *instr) {
+    Operand *args = instr->args;
+    if (instr->argc == 0) return false;
+    if (instr->argc >= 3 && args[2].kind != OPERAND_REGISTER) return true;
+    fprintf(out, "    aot_alloc(");
+    if (args[0].kind == OPERAND_TYPE) {
+        size_t size = aot_type_size(args[0].as_type);
+        if (size == 0) size = 1;
+        Operand *count = instr->argc >= 2 ? &args[1] : NULL;
+        if (count && count->kind == OPERAND_INT) {
+            fprintf(out, "(size_t) %zu * (size_t) %d", size, count->as_int);
+        } else if (count && count->kind == OPERAND_REGISTER) {
+            fprintf(out, "(size_t) %zu * (regs[%d].reg_value.type == WINT ? (size_t) regs[%d].reg_value.as_int : 1)",
+                    size, count->as_register, count->as_register);
+        } else if (count && count->kind == OPERAND_VARIABLE) {
+            fprintf(out, "(size_t) %zu * aot_variable_count(%zu, %u)", size, count->as_index, count->local);
+        } else {
+            fprintf(out, "%zu", size);
+        }
+    } else if (args[0].kind == OPERAND_INT) {
+        fprintf(out, "(size_t) %d", args[0].as_int);
+    } else if (args[0].kind == OPERAND_REGISTER) {
+        fprintf(out, "regs[%d].reg_value.type == WINT ? (size_t) regs[%d].reg_value.as_int : 0",
+                args[0].as_register, args[0].as_register);
+    } else {
+        fprintf(out, "0");
+    }
+    if (instr->argc >= 3) fprintf(out, ", &regs[%d]);\n", args[2].as_register);
+    else fprintf(out, ", NULL);\n");
+    return true;
+}
+
+// emits the C for one instruction, false when it has none
+static bool emit_instruction(FILE *out, Program *program, size_t ip) {
+    InstructionData *instr = &program->instructions[ip];
+    Operand *args = instr->args;
+    Instruction op = generic_opcode(instr->opcode);
+    size_t line = instr->line;
+    const char *expr, *guard;
+    size_t target;
+
+    switch (op) {
+        case INOP:
+            return true;
+
+        case IPUSH:
+            switch (args[0].kind) {
+                case OPERAND_INT:
+                case OPERAND_FLOAT:
+                case OPERAND_STRING:
+                case OPERAND_REGISTER:
+                    return emit_pushed_word(out, instr, 0);
+                default:
+                    emit_error(out, instr, "Invalid operand type expected number, string, float or register\n");
+                    return true;
+            }
+
+        case IEVAL: // print, merge and eval operands are folded at load time
+            fprintf(out, "    xstack_push(stack, (Word){.type = WINT, .as_int = %d});\n",
+                    instr->argc ? args[0].as_int : 0);
+            return true;
+
+        case IMERGE:
+            if (instr->argc == 0) fprintf(out, "    aot_merge();\n");
+            else fprintf(out, "    xstack_push(stack, aot_string(%zu));\n", args[0].as_index);
+            return true;
+
+        case IPRINT:
+            if (instr->argc == 0) {
+                fprintf(out, "    aot_print();\n");
+            } else {
+                fprintf(out, "    puts(");
+                emit_c_string(out, program_string(program, args[0].as_index));
+                fprintf(out, ");\n");
+            }
+            return true;
+
+        case IHERE: {
+            char *here = format("%s:%zu", program->filename, line);
+            fprintf(out, "    xstack_push(stack, (Word){.type = WCHARP, .as_string = xstring_from(");
+            emit_c_string(out, here);
+            fprintf(out, ")});\n");
+            free(here);
+            return true;
+        }
+
+        case ISIZEOF:
+            fprintf(out, "    xstack_push(stack, (Word){.type = WINT, .as_int = %zu});\n",
+                    aot_type_size(args[0].as_type));
+            return true;
+
+        case ICAST:
+            fprintf(out, "    { Word w = xstack_pop(stack); w.type = %d; xstack_push(stack, w); }\n", args[0].as_type);
+            return true;
+
+        case IMOV:
+            if (args[1].kind != OPERAND_REGISTER) return true;
+            switch (args[0].kind) {
+                case OPERAND_INT:
+                case OPERAND_FLOAT:
+                case OPERAND_STRING:
+                case OPERAND_REGISTER:
+                    fprintf(out, "    aot_set_register(&regs[%d], ", args[1].as_register);
+                    emit_word(out, instr, 0);
+                    fprintf(out, ");\n");
+                    return true;
+                default:
+                    emit_error(out, instr, "Invalid operand type expected number, string, float or register\n");
+                    return true;
+            }
+
+        case IPOP:
+            if (args[0].kind != OPERAND_REGISTER) {
+                fprintf(out, "    aot_error(%zu, \"Invalid register: %%s\\n\", ", line);
+                emit_c_string(out, operand_text(instr, 0));
+                fprintf(out, ");\n");
+                return true;
+            }
+            fprintf(out, "    aot_set_register(&regs[%d], xstack_pop(stack));\n", args[0].as_register);
+            return true;
+
+        case ILOAD:
+            if (args[0].kind == OPERAND_REGISTER)
+                fprintf(out, "    xstack_push(stack, word_retain(regs[%d].reg_value));\n", args[0].as_register);
+            return true;
+
+        case ISTORE:
+            if (args[0].kind == OPERAND_REGISTER)
+                fprintf(out, "    aot_set_register(&regs[%d], xstack_pop(stack));\n", args[0].as_register);
+            else fprintf(out, "    (void) xstack_pop(stack);\n");
+            return true;
+
+        case IINC:
+        case IDEC:
+            if (args[0].kind == OPERAND_REGISTER) {
+                fprintf(out, "    if (regs[%d].reg_value.type == WINT) regs[%d].reg_value.as_int%s;\n",
+                        args[0].as_register, args[0].as_register, op == IINC ? "++" : "--");
+            } else if (args[0].kind == OPERAND_VARIABLE) {
+                fprintf(out, "    aot_step_variable(%zu, %u, %d, ", args[0].as_index, args[0].local, op == IINC ? 1 : -1);
+                emit_c_string(out, operand_text(instr, 0));
+                fprintf(out, ");\n");
+            }
+            return true;
+
+        case IADD:
+        case ISUB:
+            if (instr->argc >= 2) {
+                Operand *src = &args[1];
+                if (src->kind != OPERAND_REGISTER && src->kind != OPERAND_INT && src->kind != OPERAND_FLOAT) {
+                    if (op == IADD) emit_error(out, instr, "Invalid operand type expected number, float or register\n");
+                    return true;
+                }
+                if (args[0].kind != OPERAND_REGISTER) return true;
+                fprintf(out, "    aot_register_add(%zu, &regs[%d], ", line, args[0].as_register);
+                if (src->kind == OPERAND_REGISTER) fprintf(out, "regs[%d].reg_value", src->as_register);
+                else emit_word(out, instr, 1);
+                fprintf(out, ", %s);\n", op == ISUB ? "true" : "false");
+                return true;
+            }
+            if (instr->argc == 1) {
+                fprintf(out, "    aot_offset_top(%d, %s);\n", args[0].kind == OPERAND_INT ? args[0].as_int : 0,
+                        op == ISUB ? "true" : "false");
+                return true;
+            }
+        // fallthrough
+        case IMUL:
+        case IDIV:
+        case IMOD:
+        case IEQ:
+        case INE:
+        case ILT:
+        case IGT:
+        case ILE:
+        case IGE:
+            aot_binary(op, &expr, &guard);
+            fprintf(out, "    AOT_BINARY_INT(%zu, %s, %s, %s);\n", line, aot_op(op), expr, guard);
+            return true;
+
+        case IAND:
+        case IOR:
+            fprintf(out, "    aot_bitwise(%zu, %s);\n", line, op == IOR ? "true" : "false");
+            return true;
+
+        case INOT:
+            fprintf(out, "    aot_not(%zu);\n", line);
+            return true;
+
+        case IXOR:
+            if (instr->argc >= 2 && args[0].kind == OPERAND_REGISTER && args[1].kind == OPERAND_REGISTER) {
+                int a = args[0].as_register, b = args[1].as_register;
+                fprintf(out, "    if (regs[%d].reg_value.type == WINT && regs[%d].reg_value.type == WINT) "
+                             "regs[%d].reg_value.as_int ^= regs[%d].reg_value.as_int;\n", a, b, a, b);
+            }
+            return true;
+
+        case ICMP:
+            if (instr->argc < 2) return true;
+            fprintf(out, "    aot_cmp(");
+            for (size_t j = 0; j < 2; j++) {
+                if (args[j].kind == OPERAND_REGISTER) fprintf(out, "regs[%d].reg_value", args[j].as_register);
+                else fprintf(out, "(Word){.type = WINT, .as_int = %d}", args[j].kind == OPERAND_INT ? args[j].as_int : 0);
+                fprintf(out, j == 0 ? ", " : ");\n");
+            }
+            return true;
+
+        case IPUSHOP: {
+            // pushop <op> <a> <b>: push a, push b, op
+            AotInts ints = {0};
+            char a[64], b[64];
+            Instruction binary = (Instruction) args[0].as_int;
+            if (!aot_binary(binary, &expr, &guard)) return false;
+            bool fast = aot_int_operand(&ints, &args[1], a, sizeof(a)) && aot_int_operand(&ints, &args[2], b, sizeof(b));
+            if (fast) {
+                fprintf(out, "    if (%s) {\n", ints.guard[0] ? ints.guard : "1");
+                fprintf(out, "        int a = %s, b = %s;\n", a, b);
+                fprintf(out, "        if (%s) xstack_push(stack, (Word){.type = WINT, .as_int = %s});\n", guard, expr);
+                fprintf(out, "        else aot_pushop(%zu, %s, (Word){.type = WINT, .as_int = a}, "
+                             "(Word){.type = WINT, .as_int = b});\n", line, aot_op(binary));
+                fprintf(out, "    } else ");
+            } else {
+                fprintf(out, "    ");
+            }
+            fprintf(out, "{\n        Word w2 = ");
+            if (!emit_word(out, instr, 1)) return false;
+            fprintf(out, ";\n        Word w1 = ");
+            if (!emit_word(out, instr, 2)) return false;
+            fprintf(out, ";\n        aot_pushop(%zu, %s, w2, w1);\n    }\n", line, aot_op(binary));
+            return true;
+        }
+
+        case ICMPJMPIF: {
+            // cmpjmpif <cmp> <label> [a] [b], the compared values are pushed operands or popped
+            AotInts ints = {0};
+            char a[64], b[64];
+            size_t pushed = instr->argc - 2;
+            size_t popped = 2 - pushed;
+            Instruction cmp = (Instruction) args[0].as_int;
+            if (cmp < IEQ || cmp > IGE || !aot_binary(cmp, &expr, &guard) || !aot_label(program, &args[1], &target))
+                return false;
+            bool fast = true;
+            if (popped) aot_guard(&ints, "stack->count >= %zu", popped);
+            if (pushed >= 1) fast = aot_int_operand(&ints, &args[instr->argc - 1], b, sizeof(b));
+            else aot_int_cell(&ints, 1, b, sizeof(b));
+            if (pushed >= 2) fast = fast && aot_int_operand(&ints, &args[2], a, sizeof(a));
+            else aot_int_cell(&ints, pushed == 1 ? 1 : 2, a, sizeof(a));
+            if (fast) {
+                fprintf(out, "    if (%s) {\n", ints.guard[0] ? ints.guard : "1");
+                fprintf(out, "        int a = %s, b = %s;\n", a, b);
+                if (popped) fprintf(out, "        stack->count -= %zu;\n", popped);
+                fprintf(out, "        if (%s) goto L_%zu;\n", expr, target);
+                fprintf(out, "    } else ");
+            } else {
+                fprintf(out, "    ");
+            }
+            fprintf(out, "{\n        Word w1 = ");
+            if (pushed >= 1) {
+                if (!emit_word(out, instr, instr->argc - 1)) return false;
+            } else {
+                fprintf(out, "xstack_pop(stack)");
+            }
+            fprintf(out, ";\n        Word w2 = ");
+            if (pushed >= 2) {
+                if (!emit_word(out, instr, 2)) return false;
+            } else {
+                fprintf(out, "xstack_pop(stack)");
+            }
+            fprintf(out, ";\n        if (aot_compare(%zu, %s, w2, w1)) goto L_%zu;\n    }\n", line, aot_op(cmp), target);
+            return true;
+        }
+
+        case IJMP:
+            if (!aot_label(program, &args[0], &target)) return false;
+            fprintf(out, "    goto L_%zu;\n", target);
+            return true;
+
+        case IJMPIF:
+            if (!aot_label(program, &args[0], &target)) return false;
+            fprintf(out, "    { Word w = xstack_pop(stack); if (w.type == WINT && w.as_int == 1) goto L_%zu; }\n", target);
+            return true;
+
+        case IJMPTABLE:
+            for (size_t j = 0; j < instr->argc; j++) {
+                if (!aot_label(program, &args[j], &target)) return false;
+            }
+            fprintf(out, "    { Word w = xstack_pop(stack); int index = w.type == WINT ? w.as_int : -1; word_release(w);\n");
+            fprintf(out, "      switch (index) {\n");
+            for (size_t j = 1; j < instr->argc; j++) {
+                fprintf(out, "        case %zu: goto L_%zu;\n", j - 1, args[j].as_index);
+            }
+            fprintf(out, "        default: goto L_%zu;\n      } }\n", args[0].as_index);
+            return true;
+
+        case ICALL:
+            if (args[0].kind != OPERAND_LABEL) {
+                fprintf(out, "    aot_error(%zu, \"Label not found: %%s\\n\", ", line);
+                emit_c_string(out, operand_text(instr, 0));
+                fprintf(out, ");\n");
+                return true;
+            }
+            if (!aot_label(program, &args[0], &target)) return false;
+            fprintf(out, "    if (!call_push(&aot_xpu, %zu)) aot_error(%zu, "
+                         "\"Call stack overflow: more than %%zu nested calls\\n\", aot_xpu.calls_count);\n", ip, line);
+            for (size_t j = instr->argc; j > 1; j--) {
+                if (!emit_pushed_word(out, instr, j - 1)) return false;
+            }
+            fprintf(out, "    goto L_%zu;\n", target);
+            return true;
+
+        case IRET:
+            fprintf(out, "    goto aot_return;\n");
+            return true;
+
+        case IDROP:
+            fprintf(out, "    word_release(xstack_pop(stack));\n");
+            return true;
+
+        case IDUP:
+            fprintf(out, "    aot_dup();\n");
+            return true;
+
+        case ISWAP:
+            fprintf(out, "    { Word w1 = xstack_pop(stack), w2 = xstack_pop(stack); "
+                         "xstack_push(stack, w1); xstack_push(stack, w2); }\n");
+            return true;
+
+        case ISPRINTF:
+            fprintf(out, "    aot_sprintf(%zu);\n", line);
+            return true;
+
+        case IROTL:
+        case IROTR:
+            fprintf(out, "    aot_rotate(%d, %s);\n", args[0].as_int, op == IROTL ? "true" : "false");
+            return true;
+
+        case IALLOC:
+            return emit_alloc(out, instr);
+
+        case IFREE:
+            if (instr->argc == 0) fprintf(out, "    aot_free_top();\n");
+            else if (args[0].kind == OPERAND_REGISTER) fprintf(out, "    aot_free_register(&regs[%d]);\n", args[0].as_register);
+            else if (args[0].kind == OPERAND_POINTER) return false;
+            return true;
+
+        case IOVM: {
+            const char *what = operand_text(instr, 0);
+            if (strcmp(what, "stack") == 0) return false;
+            if (strcmp(what, "stack_size") == 0)
+                fprintf(out, "    xstack_push(stack, (Word){.type = WINT, .as_int = (int) stack->count});\n");
+            else if (strcmp(what, "stack_ptr") == 0)
+                fprintf(out, "    xstack_push(stack, (Word){.type = WPOINTER, .as_pointer = (void *) stack->stack});\n");
+            else if (strcmp(what, "platform") == 0)
+                fprintf(out, "    xstack_push(stack, (Word){.type = WCHARP, .as_string = xstring_from(AOT_PLATFORM)});\n");
+            return true;
+        }
+
+        case IVAR:
+        case ISETVAR:
+        case IGETVAR:
+        case ISETGLOBALVAR:
+        case IGETGLOBALVAR: {
+            if (instr->argc < 1) {
+                char name[32];
+                snprintf(name, sizeof(name), "I%s", instruction_to_string(op));
+                for (char *c = name; *c; c++) *c = toupper((unsigned char) *c);
+                fprintf(out, "    OERROR(stderr, \"ERROR: '%s' requires a variable name\\n\");\n", name);
+                return true;
+            }
+            if (args[0].kind != OPERAND_VARIABLE) return false;
+            size_t slot = args[0].as_index;
+            switch (op) {
+                case IVAR:
+                    fprintf(out, "    (void) aot_bind(%zu, %u);\n", slot, args[0].local);
+                    return true;
+                case ISETVAR:
+                    fprintf(out, "    aot_setvar(false, %zu, %u, \"ISETVAR\");\n", slot, args[0].local);
+                    return true;
+                case ISETGLOBALVAR:
+                    fprintf(out, "    aot_setvar(true, %zu, 0, \"ISETGLOBALVAR\");\n", slot);
+                    return true;
+                case IGETVAR:
+                    fprintf(out, "    aot_getvar(aot_resolve(%zu, %u), \"IGETVAR\", ", slot, args[0].local);
+                    break;
+                default:
+                    fprintf(out, "    aot_getvar(aot_global(%zu), \"IGETGLOBALVAR\", ", slot);
+                    break;
+            }
+            emit_c_string(out, operand_text(instr, 0));
+            fprintf(out, ");\n");
+            return true;
+        }
+
+        case ITOGGLELOCALSCOPE:
+            fprintf(out, "    frame_toggle(&aot_xpu);\n");
+            return true;
+
+        case IADDVAR:
+            if (args[0].kind != OPERAND_VARIABLE) return false;
+            fprintf(out, "    aot_addvar(%zu, %zu, %u, %d, ", line, args[0].as_index, args[0].local, args[1].as_int);
+            emit_c_string(out, operand_text(instr, 0));
+            fprintf(out, ");\n");
+            return true;
+
+        case IHALT:
+            if (instr->argc == 1) fprintf(out, "    aot_exit_code = %d;\n", args[0].as_int);
+            fprintf(out, "    return;\n");
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+// Prints the instructions that have no C form, true when there are none.
+static bool aot_check(Program *program, FILE *scratch) {
+    size_t missing[OPCODE_COUNT] = {0};
+    bool ok = true;
+    for (size_t ip = 0; ip < program->instructions_count; ip++) {
+        if (emit_instruction(scratch, program, ip)) continue;
+        missing[generic_opcode(program->instructions[ip].opcode)]++;
+        ok = false;
+    }
+    for (size_t op = 0; op < OPCODE_COUNT; op++) {
+        if (missing[op]) fprintf(stderr, "No C form for %zu %s instruction(s)\n", missing[op], instruction_to_string(op));
+    }
+    return ok;
+}
+
+static void emit_embedded(FILE *out, xhex_options_t *hex, const char *input) {
+    fprintf(out, "#include <orta.h>\n");
+
+    xhex_print_hex_dump(hex);
+
+    fprintf(out, "\n\nint main() {\n");
+    fprintf(out, "    OrtaVM vm = ortavm_create(\"%s\");\n", input);
+    fprintf(out, "    load_bytecode_from_memory(&vm, bytecode, bytecode_size);\n");
+    fprintf(out, "    execute_program(&vm);\n");
+    fprintf(out, "    ortavm_free(&vm);\n");
+    fprintf(out, "    return 0;\n");
+    fprintf(out, "}\n");
+}
+
+static int emit_aot(FILE *out, xhex_options_t *hex, const char *input) {
+    OrtaVM vm = ortavm_create(input);
+    if (!load_xbin(&vm, input)) {
+        fprintf(stderr, "Error loading bytecode\n");
+        ortavm_free(&vm);
+        return 1;
+    }
+    Program *program = &vm.program;
+
+    FILE *scratch = tmpfile();
+    bool ok = scratch != NULL && aot_check(program, scratch);
+    if (scratch) fclose(scratch);
+    if (!ok) {
+        fprintf(stderr, "Embedding the bytecode instead\n");
+        emit_embedded(out, hex, input);
+        ortavm_free(&vm);
+        return 0;
+    }
+
+    size_t entry = 0;
+    bool has_entry = find_label(program, OENTRY, &entry);
+    bool *targets = aot_targets(program, entry);
+
+    fprintf(out, "// generated by xtoa --aot from %s\n", input);
+    fprintf(out, "#include <aot.h>\n\n");
+
+    fprintf(out, "static const char *const aot_strings[] = {\n");
+    for (size_t i = 0; i < program->strings.size; i++) {
+        fprintf(out, "    ");
+        emit_c_string(out, program_string(program, i));
+        fprintf(out, ",\n");
+    }
+    fprintf(out, "    NULL,\n};\n\n");
+
+    fprintf(out, "static void aot_program() {\n");
+    fprintf(out, "    XStack *stack = &aot_xpu.stack;\n");
+    fprintf(out, "    XRegister *regs = aot_xpu.registers;\n");
+    fprintf(out, "    (void) stack;\n");
+    fprintf(out, "    (void) regs;\n");
+    if (!has_entry) fprintf(out, "    OERROR(stderr, \"Could not find label '%%s' starting at 0\\n\", \"%s\");\n", OENTRY);
+    if (program->instructions_count == 0) {
+        fprintf(out, "}\n\n");
+    } else {
+        fprintf(out, "    goto L_%zu;\n", entry);
+
+        bool returns = false;
+        for (size_t ip = 0; ip < program->instructions_count; ip++) {
+            if (targets[ip]) fprintf(out, "L_%zu:\n", ip);
+            emit_comment(out, &program->instructions[ip], ip);
+            emit_instruction(out, program, ip);
+            if (generic_opcode(program->instructions[ip].opcode) == IRET) returns = true;
+        }
+        fprintf(out, "    return;\n");
+
+        if (returns) {
+            // ret resumes after the call it pops, without one at instruction 1
+            fprintf(out, "\naot_return:\n");
+            fprintf(out, "    switch (call_pop(&aot_xpu)) {\n");
+            for (size_t ip = 0; ip < program->instructions_count; ip++) {
+                if (generic_opcode(program->instructions[ip].opcode) != ICALL) continue;
+                if (ip + 1 < program->instructions_count) fprintf(out, "        case %zu: goto L_%zu;\n", ip, ip + 1);
+                else fprintf(out, "        case %zu: return;\n", ip);
+            }
+            if (program->instructions_count > 1) fprintf(out, "        default: goto L_1;\n");
+            else fprintf(out, "        default: return;\n");
+            fprintf(out, "    }\n");
+        }
+        fprintf(out, "}\n\n");
+    }
+
+    fprintf(out, "int main() {\n");
+    fprintf(out, "    aot_init(");
+    emit_c_string(out, program->filename);
+    fprintf(out, ", aot_strings, %zu, %zu);\n", program->strings.size, program->variable_names.size);
+    fprintf(out, "    aot_program();\n");
+    fprintf(out, "    int exit_code = aot_exit_code;\n");
+    fprintf(out, "    aot_free();\n");
+    fprintf(out, "    return exit_code;\n");
+    fprintf(out, "}\n");
+
+    free(targets);
+    ortavm_free(&vm);
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
-    if (argc < 3) {
-        printf("Usage: %s <input.xbin> <output>\n", argv[0]);
+    bool aot = argc > 1 && strcmp(argv[1], "--aot") == 0;
+    if (argc < 3 + aot) {
+        printf("Usage: %s [--aot] <input.xbin> <output>\n", argv[0]);
         return 1;
     }
-    
+    const char *input = argv[1 + aot];
+    const char *output = argv[2 + aot];
+
     xhex_options_t options;
     xhex_init_options(&options);
     options.c_style_output = true;
     options.var_name = "bytecode";
-    options.input = fopen(argv[1], "rb");
+    options.input = fopen(input, "rb");
     if (!options.input) {
         fprintf(stderr, "Error opening input file\n");
         return 1;
     }
-    
-    options.output = fopen(argv[2], "w");
+
+    options.output = fopen(output, "w");
     if (!options.output) {
         fprintf(stderr, "Error opening output file\n");
         fclose(options.input);
         return 1;
     }
-    
-     
-    fprintf(options.output, "#include <orta.h>\n");
-    
-    xhex_print_hex_dump(&options);
-    
-    fprintf(options.output, "\n\nint main() {\n");
-    fprintf(options.output, "    OrtaVM vm = ortavm_create(\"%s\");\n", argv[1]);
-    fprintf(options.output, "    load_bytecode_from_memory(&vm, bytecode, bytecode_size);\n");
-    fprintf(options.output, "    execute_program(&vm);\n");
-    fprintf(options.output, "    ortavm_free(&vm);\n");
-    fprintf(options.output, "    return 0;\n");
-    fprintf(options.output, "}\n");
-    
+
+    int status = 0;
+    if (aot) status = emit_aot(options.output, &options, input);
+    else emit_embedded(options.output, &options, input);
+
     if (options.input != stdin) fclose(options.input);
     if (options.output != stdout) fclose(options.output);
-    return 0;
+    return status;
 }